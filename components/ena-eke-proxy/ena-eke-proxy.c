@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 #include <string.h>
+#include <stdlib.h>
 #include "time.h"
 #include "esp_log.h"
 #include "esp_event.h"
@@ -19,6 +20,7 @@
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
 
 #include "ena-crypto.h"
 #include "ena-storage.h"
@@ -30,6 +32,17 @@
 #define HOUR_IN_SECONDS (60 * 60)
 #define DAY_IN_SECONDS (HOUR_IN_SECONDS * 24)
 
+/**
+ * @brief received key data passed from download to matching
+ */
+typedef struct
+{
+    size_t length;                          // bytes of key data
+    bool last;                              // last part of a response
+    size_t resume_page;                     // page to resume with once matched, 0 for an aborted response
+    uint8_t data[ENA_EKE_PROXY_PAGE_SIZE]; // key data
+} ena_eke_proxy_page_t;
+
 extern const uint8_t cert_pem_start[] asm("_binary_cert_pem_start");
 extern const uint8_t cert_pem_end[] asm("_binary_cert_pem_end");
 
@@ -37,18 +50,50 @@ static size_t current_page = 0;
 static time_t request_sleep = 0;
 static uint32_t request_sleep_waiting = 30;
 static time_t last_check = 0;
-static bool wait_for_request = false;
+static uint32_t last_exposure_date = 0; // stored date of last check, read on start of a sync
+static ena_eke_proxy_checkpoint_t checkpoint = {0}; // progress of the hour or day synced, read on start of a sync
 static bool request_pause = false;
+static ena_eke_proxy_state_t state = ENA_EKE_PROXY_STATE_IDLE;
+static bool cancel_requested = false;
+static esp_http_client_handle_t client = NULL; // client kept open over all requests of a sync
+static char *request_url = NULL;               // url of the running request
+static int request_retries = 0;
+static uint8_t read_buffer[ENA_EKE_PROXY_KEY_SIZE * ENA_EKE_PROXY_READ_KEYS];
+static TaskHandle_t eke_proxy_task_handle = NULL;
+static ena_eke_proxy_stats_t sync_stats = {0};
+static bool pipeline = false;                      // pages are matched by the match task, both pages allocated
+static QueueHandle_t free_pages = NULL;            // pages to download to
+static QueueHandle_t received_pages = NULL;        // downloaded pages to match
+static ena_eke_proxy_page_t *fetch_page = NULL;    // page currently downloaded to
+static bool fetch_page_open = false;               // parts of current response passed without last part
+static uint32_t pages_in_flight = 0;               // downloaded pages not matched yet, at most ENA_EKE_PROXY_PIPELINE_PAGES
+static TaskHandle_t eke_proxy_match_task_handle = NULL;
+static uint8_t key_buffer[ENA_EKE_PROXY_KEY_SIZE]; // key split over received data
+static size_t key_buffer_length = 0;
+static size_t received_keys = 0;
+static bool check_started = false;
+static bool check_received = false; // response of the check received, its collected keys are matched in steps
+static uint32_t check_start_time = 0;
+static uint64_t *key_digests = NULL;   // sorted digests of keys checked in hourly requests of the synced day
+static uint32_t key_digests_count = 0;
+static uint64_t *page_digests = NULL;  // digests of keys checked in current page of an hourly request
+static size_t page_digests_count = 0;
+static size_t page_digests_dropped = 0; // digests of current page not fitting into page_digests
 
 void ena_eke_proxy_pause(void)
 {
-    while (wait_for_request || request_pause)
+    while (request_pause)
     {
         ESP_LOGD(ENA_EKE_PROXY_LOG, "waiting for other requests to finish...");
         vTaskDelay(1000 / portTICK_PERIOD_MS);
     }
 
     request_pause = true;
+    ena_eke_proxy_cancel();
+    while (ena_eke_proxy_get_state() != ENA_EKE_PROXY_STATE_IDLE || __atomic_load_n(&pages_in_flight, __ATOMIC_ACQUIRE) > 0)
+    {
+        vTaskDelay(100 / portTICK_PERIOD_MS);
+    }
 }
 
 void ena_eke_proxy_resume(void)
@@ -56,212 +101,351 @@ void ena_eke_proxy_resume(void)
     request_pause = false;
 }
 
-esp_err_t ena_eke_proxy_fetch_event_handler(esp_http_client_event_t *evt)
+uint64_t ena_eke_proxy_key_digest(ena_temporary_exposure_key_t *temporary_exposure_key)
 {
-    static uint8_t *output_buffer;
-    static int output_len;
-    switch (evt->event_id)
+    // FNV-1a of key data and rolling start interval number
+    uint64_t digest = 0xcbf29ce484222325;
+    uint8_t *data = (uint8_t *)&(temporary_exposure_key->rolling_start_interval_number);
+    for (int i = 0; i < ENA_KEY_LENGTH + 4; i++)
     {
-    case HTTP_EVENT_ON_DATA:
-        if (!esp_http_client_is_chunked_response(evt->client))
+        digest ^= i < ENA_KEY_LENGTH ? temporary_exposure_key->key_data[i] : data[i - ENA_KEY_LENGTH];
+        digest *= 0x100000001b3;
+    }
+    return digest == ENA_STORAGE_KEY_DIGEST_EMPTY ? digest - 1 : digest;
+}
+
+int ena_eke_proxy_key_digest_compare(const void *a, const void *b)
+{
+    uint64_t digest_a = *(const uint64_t *)a;
+    uint64_t digest_b = *(const uint64_t *)b;
+    return (digest_a > digest_b) - (digest_a < digest_b);
+}
+
+void ena_eke_proxy_key_digests_load(uint32_t day)
+{
+    if (!ENA_STORAGE_KEY_DIGESTS)
+    {
+        return;
+    }
+
+    uint32_t today = (uint32_t)time(NULL) / DAY_IN_SECONDS * DAY_IN_SECONDS;
+    ena_storage_expire_key_digests(today - ENA_EKE_PROXY_MAX_PAST_DAYS * DAY_IN_SECONDS);
+
+    free(key_digests);
+    key_digests = NULL;
+    key_digests_count = ena_storage_key_digests_count(day);
+    if (key_digests_count > 0)
+    {
+        key_digests = malloc(key_digests_count * sizeof(uint64_t));
+        if (key_digests == NULL)
         {
-            if (output_buffer == NULL)
-            {
-                output_buffer = malloc(esp_http_client_get_content_length(evt->client));
-                output_len = 0;
-                if (output_buffer == NULL)
-                {
-                    ESP_LOGE(ENA_EKE_PROXY_LOG, "Failed to allocate memory for output buffer, memory: %d kB", (xPortGetFreeHeapSize() / 1024));
-                    return ESP_FAIL;
-                }
-            }
-            memcpy(output_buffer + output_len, evt->data, evt->data_len);
-            output_len += evt->data_len;
+            ESP_LOGW(ENA_EKE_PROXY_LOG, "failed to allocate memory for %u key digests, memory: %d kB", key_digests_count, (xPortGetFreeHeapSize() / 1024));
+            key_digests_count = 0;
         }
-
-        break;
-    case HTTP_EVENT_ON_FINISH:
-        if (output_buffer != NULL && esp_http_client_get_status_code(evt->client) == 200)
+        else
         {
+            key_digests_count = ena_storage_read_key_digests(day, key_digests, key_digests_count);
+            qsort(key_digests, key_digests_count, sizeof(uint64_t), ena_eke_proxy_key_digest_compare);
+        }
+    }
 
-            if (output_len % 28 != 0)
-            {
-                ESP_LOGW(ENA_EKE_PROXY_LOG, "Response length does not match key size! %d", output_len);
-            }
+    if (page_digests == NULL)
+    {
+        page_digests = malloc(ENA_EKE_PROXY_DEFAULT_LIMIT * sizeof(uint64_t));
+    }
+    page_digests_count = 0;
+    ESP_LOGD(ENA_EKE_PROXY_LOG, "loaded %u key digests of day %u", key_digests_count, day);
+}
 
-            size_t temporary_exposure_keys = (output_len / 28);
+bool ena_eke_proxy_key_checked(ena_temporary_exposure_key_t *temporary_exposure_key)
+{
+    if (!ENA_STORAGE_KEY_DIGESTS)
+    {
+        return false;
+    }
 
-            if (temporary_exposure_keys > 0)
-            {
-                uint32_t start_time = (uint32_t)time(NULL);
-                ena_temporary_exposure_key_t temporary_exposure_key;
-                int tek_index = 0;
-
-                memcpy(&(temporary_exposure_key.key_data), &output_buffer[tek_index * 28], ENA_KEY_LENGTH);
-                memcpy(&(temporary_exposure_key.rolling_start_interval_number), &output_buffer[tek_index * 28 + ENA_KEY_LENGTH], 4);
-                memcpy(&(temporary_exposure_key.rolling_period), &output_buffer[tek_index * 28 + ENA_KEY_LENGTH + 4], 4);
-                memcpy(&(temporary_exposure_key.days_since_onset_of_symptoms), &output_buffer[tek_index * 28 + ENA_KEY_LENGTH + 8], 4);
-
-                uint32_t timestamp_start = temporary_exposure_key.rolling_start_interval_number * ENA_TIME_WINDOW;
-                int min = ena_expore_check_find_min(timestamp_start);
-
-                tek_index = temporary_exposure_keys - 1;
-                memcpy(&(temporary_exposure_key.key_data), &output_buffer[tek_index * 28], ENA_KEY_LENGTH);
-                memcpy(&(temporary_exposure_key.rolling_start_interval_number), &output_buffer[tek_index * 28 + ENA_KEY_LENGTH], 4);
-                memcpy(&(temporary_exposure_key.rolling_period), &output_buffer[tek_index * 28 + ENA_KEY_LENGTH + 4], 4);
-                memcpy(&(temporary_exposure_key.days_since_onset_of_symptoms), &output_buffer[tek_index * 28 + ENA_KEY_LENGTH + 8], 4);
-
-                uint32_t timestamp_end = (temporary_exposure_key.rolling_start_interval_number + temporary_exposure_key.rolling_period) * ENA_TIME_WINDOW;
-                int max = ena_expore_check_find_max(timestamp_end);
-
-                if (min >= 0 && max >= 0 && min <= max)
-                {
-                    ESP_LOGI(ENA_EKE_PROXY_LOG, "start check with beacons [%d,%d] for [%u,%u]", min, max, timestamp_start, timestamp_end);
-                    ena_beacon_t beacon;
-                    for (int y = min; y <= max; y++)
-                    {
-                        ena_storage_get_beacon(y, &beacon);
-                        for (int i = 0; i < temporary_exposure_keys; i++)
-                        {
-                            memcpy(&(temporary_exposure_key.key_data), &output_buffer[i * 28], ENA_KEY_LENGTH);
-                            memcpy(&(temporary_exposure_key.rolling_start_interval_number), &output_buffer[i * 28 + ENA_KEY_LENGTH], 4);
-                            memcpy(&(temporary_exposure_key.rolling_period), &output_buffer[i * 28 + ENA_KEY_LENGTH + 4], 4);
-                            memcpy(&(temporary_exposure_key.days_since_onset_of_symptoms), &output_buffer[i * 28 + ENA_KEY_LENGTH + 8], 4);
+    uint64_t digest = ena_eke_proxy_key_digest(temporary_exposure_key);
+    if (key_digests_count > 0 && bsearch(&digest, key_digests, key_digests_count, sizeof(uint64_t), ena_eke_proxy_key_digest_compare) != NULL)
+    {
+        return true;
+    }
+
+    // only keys of hourly requests are received again with the daily request
+    if (checkpoint.hour != ENA_EKE_PROXY_CHECKPOINT_DAILY)
+    {
+        if (page_digests != NULL && page_digests_count < ENA_EKE_PROXY_DEFAULT_LIMIT)
+        {
+            page_digests[page_digests_count++] = digest;
+        }
+        else
+        {
+            page_digests_dropped++;
+            sync_stats.dropped++;
+        }
+    }
+    return false;
+}
+
+void ena_eke_proxy_check_key(uint8_t *key)
+{
+    ena_temporary_exposure_key_t temporary_exposure_key;
+    memset(&temporary_exposure_key, 0, sizeof(ena_temporary_exposure_key_t));
+    memcpy(&(temporary_exposure_key.key_data), &key[0], ENA_KEY_LENGTH);
+    memcpy(&(temporary_exposure_key.rolling_start_interval_number), &key[ENA_KEY_LENGTH], 4);
+    memcpy(&(temporary_exposure_key.rolling_period), &key[ENA_KEY_LENGTH + 4], 4);
+    memcpy(&(temporary_exposure_key.days_since_onset_of_symptoms), &key[ENA_KEY_LENGTH + 8], 4);
 #ifdef DEBUG_ENA_EKE_PROXY
-                            ESP_LOGD(ENA_EKE_PROXY_LOG, "key payload: ");
-                            ESP_LOG_BUFFER_HEXDUMP(ENA_EKE_PROXY_LOG, &output_buffer[i * 28], 28, ESP_LOG_DEBUG);
-                            ESP_LOGD(ENA_EKE_PROXY_LOG, "received key: ");
-                            ESP_LOG_BUFFER_HEXDUMP(ENA_EKE_PROXY_LOG, &(temporary_exposure_key.key_data), ENA_KEY_LENGTH, ESP_LOG_DEBUG);
-                            ESP_LOG_BUFFER_HEXDUMP(ENA_EKE_PROXY_LOG, &output_buffer[i * 28], ENA_KEY_LENGTH, ESP_LOG_DEBUG);
-                            ESP_LOGD(ENA_EKE_PROXY_LOG, "rolling_start_interval_number %u", temporary_exposure_key.rolling_start_interval_number);
-                            ESP_LOG_BUFFER_HEXDUMP(ENA_EKE_PROXY_LOG, &output_buffer[i * 28 + ENA_KEY_LENGTH], 4, ESP_LOG_DEBUG);
-                            ESP_LOGD(ENA_EKE_PROXY_LOG, "rolling_period %u", temporary_exposure_key.rolling_period);
-                            ESP_LOG_BUFFER_HEXDUMP(ENA_EKE_PROXY_LOG, &output_buffer[i * 28 + ENA_KEY_LENGTH + 4], 4, ESP_LOG_DEBUG);
-                            ESP_LOGD(ENA_EKE_PROXY_LOG, "days_since_onset_of_symptoms %u", temporary_exposure_key.days_since_onset_of_symptoms);
-                            ESP_LOG_BUFFER_HEXDUMP(ENA_EKE_PROXY_LOG, &output_buffer[i * 28 + ENA_KEY_LENGTH + 8], 4, ESP_LOG_DEBUG);
+    ESP_LOGD(ENA_EKE_PROXY_LOG, "key payload: ");
+    ESP_LOG_BUFFER_HEXDUMP(ENA_EKE_PROXY_LOG, key, ENA_EKE_PROXY_KEY_SIZE, ESP_LOG_DEBUG);
+    ESP_LOGD(ENA_EKE_PROXY_LOG, "received key: ");
+    ESP_LOG_BUFFER_HEXDUMP(ENA_EKE_PROXY_LOG, &(temporary_exposure_key.key_data), ENA_KEY_LENGTH, ESP_LOG_DEBUG);
+    ESP_LOGD(ENA_EKE_PROXY_LOG, "rolling_start_interval_number %u", temporary_exposure_key.rolling_start_interval_number);
+    ESP_LOGD(ENA_EKE_PROXY_LOG, "rolling_period %u", temporary_exposure_key.rolling_period);
+    ESP_LOGD(ENA_EKE_PROXY_LOG, "days_since_onset_of_symptoms %u", temporary_exposure_key.days_since_onset_of_symptoms);
 #endif
-                            ena_exposure_check(beacon, temporary_exposure_key);
-                        }
-                    }
-                    uint32_t end_time = (uint32_t)time(NULL);
-                    ESP_LOGI(ENA_EKE_PROXY_LOG, "check took %u seconds", (end_time - start_time));
-                }
-                else
-                {
-                    ESP_LOGD(ENA_EKE_PROXY_LOG, "no matching beacons for [%u,%u]", timestamp_start, timestamp_end);
-                }
-            }
-            else
-            {
-                ESP_LOGW(ENA_EKE_PROXY_LOG, "no keys in request, should not happen on 200 status!");
-            }
+    received_keys++;
+    sync_stats.keys++;
+    if (ena_eke_proxy_key_checked(&temporary_exposure_key))
+    {
+        sync_stats.duplicates++;
+        return;
+    }
+    ena_exposure_check_key(&temporary_exposure_key);
+}
 
-            current_page = current_page + 1;
-            free(output_buffer);
-        }
-        else if (esp_http_client_get_status_code(evt->client) == 204)
+void ena_eke_proxy_check_data(uint8_t *data, size_t length)
+{
+    if (!check_started)
+    {
+        // digests of an aborted page are dropped, it is checked again
+        page_digests_count = 0;
+        page_digests_dropped = 0;
+        check_start_time = (uint32_t)time(NULL);
+        ena_exposure_check_start(ENA_EKE_PROXY_DEFAULT_LIMIT);
+        check_started = true;
+    }
+
+    // complete key split over previous data
+    if (key_buffer_length > 0)
+    {
+        size_t missing = ENA_EKE_PROXY_KEY_SIZE - key_buffer_length;
+        if (missing > length)
         {
-            // finished!
-            if (difftime(time(NULL), last_check) >= DAY_IN_SECONDS)
-            {
-                last_check = last_check + DAY_IN_SECONDS;
-            }
-            else
-            {
-                last_check = last_check + HOUR_IN_SECONDS;
-            }
-            ena_storage_write_last_exposure_date(last_check);
-            current_page = 0;
-            request_sleep = 0;
-            request_sleep_waiting = 30;
-            ena_exposure_summary(ena_exposure_default_config());
-
-            ena_exposure_summary_t *current_summary = ena_exposure_current_summary();
-            ESP_LOGD(ENA_EKE_PROXY_LOG, "current summary\nlast update: %u\ndays_since_last_exposure: %d\nnum_exposures: %d\nmax_risk_score: %d\nrisk_score_sum: %d",
-                     current_summary->last_update,
-                     current_summary->days_since_last_exposure,
-                     current_summary->num_exposures,
-                     current_summary->max_risk_score,
-                     current_summary->risk_score_sum);
+            missing = length;
         }
-        else
+        memcpy(&key_buffer[key_buffer_length], data, missing);
+        key_buffer_length += missing;
+        data += missing;
+        length -= missing;
+        if (key_buffer_length < ENA_EKE_PROXY_KEY_SIZE)
         {
-            current_page = 0;
-            request_sleep = time(NULL) + request_sleep_waiting;
-            if (request_sleep_waiting < HOUR_IN_SECONDS)
-            {
-                request_sleep_waiting = request_sleep_waiting * 3;
-            }
+            return;
         }
+        ena_eke_proxy_check_key(key_buffer);
+        key_buffer_length = 0;
+    }
 
-        output_buffer = NULL;
-        output_len = 0;
-        wait_for_request = false;
+    while (length >= ENA_EKE_PROXY_KEY_SIZE)
+    {
+        ena_eke_proxy_check_key(data);
+        data += ENA_EKE_PROXY_KEY_SIZE;
+        length -= ENA_EKE_PROXY_KEY_SIZE;
+    }
 
-        break;
-    default:
-        break;
+    // keep incomplete key for next data
+    memcpy(key_buffer, data, length);
+    key_buffer_length = length;
+}
+
+void ena_eke_proxy_check_end(void)
+{
+    if (check_started)
+    {
+        ena_exposure_check_finish();
+        ESP_LOGI(ENA_EKE_PROXY_LOG, "check of %u keys took %u seconds", received_keys, ((uint32_t)time(NULL) - check_start_time));
     }
-    return ESP_OK;
+    check_started = false;
+    check_received = false;
+    key_buffer_length = 0;
+    received_keys = 0;
 }
 
-esp_err_t ena_eke_proxy_receive_keys(char *url)
+void ena_eke_proxy_check_page_end(void)
 {
-    static int retries = 0;
-    wait_for_request = true;
-    esp_http_client_config_t config = {
-        .url = url,
-        .timeout_ms = 30000,
-        .event_handler = ena_eke_proxy_fetch_event_handler,
-    };
+    if (key_buffer_length > 0)
+    {
+        ESP_LOGW(ENA_EKE_PROXY_LOG, "Response length does not match key size! %d bytes left", key_buffer_length);
+    }
 
-    if (memcmp(url, "https", 5) == 0)
+    if (received_keys == 0)
     {
-        config.cert_pem = (char *)cert_pem_start;
+        ESP_LOGW(ENA_EKE_PROXY_LOG, "no keys in request, should not happen on 200 status!");
     }
 
-    ESP_LOGD(ENA_EKE_PROXY_LOG, "start request: url = %s | memory: %d kB", url, (xPortGetFreeHeapSize() / 1024));
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    esp_err_t err = esp_http_client_perform(client);
+    ena_eke_proxy_check_end();
+}
 
-    if (err == ESP_OK)
+void ena_eke_proxy_checkpoint_start(uint32_t date, uint8_t hour)
+{
+    memset(&checkpoint, 0, sizeof(ena_eke_proxy_checkpoint_t));
+    checkpoint.magic = ENA_EKE_PROXY_CHECKPOINT_MAGIC;
+    checkpoint.date = date;
+    checkpoint.hour = hour;
+    checkpoint.exposure_information = ena_storage_exposure_information_count();
+    checkpoint.key_digests = ena_storage_key_digests_count(date);
+    ena_storage_write_sync_checkpoint(&checkpoint, sizeof(ena_eke_proxy_checkpoint_t));
+}
+
+void ena_eke_proxy_checkpoint_save(size_t page, size_t keys)
+{
+    // digests are written before the checkpoint, so a page with stored digests is finished on resume
+    if (page_digests_count > 0)
     {
-        int content_length = esp_http_client_get_content_length(client);
-        ESP_LOGD(ENA_EKE_PROXY_LOG, "finished request: url = %s, status = %d, content_length = %d | memory: %d kB", url,
-                 esp_http_client_get_status_code(client),
-                 content_length, (xPortGetFreeHeapSize() / 1024));
-        retries = 0;
+        checkpoint.page_keys = keys;
+        ena_storage_write_sync_checkpoint(&checkpoint, sizeof(ena_eke_proxy_checkpoint_t));
+        ena_storage_add_key_digests(checkpoint.date, page_digests, page_digests_count);
+        page_digests_count = 0;
+    }
+    if (page_digests_dropped > 0)
+    {
+        ESP_LOGW(ENA_EKE_PROXY_LOG, "%u keys of page %u exceed the limit of %u digests, checked again with the daily request", page_digests_dropped, page - 1, ENA_EKE_PROXY_DEFAULT_LIMIT);
+        page_digests_dropped = 0;
     }
 
-    free(url);
-    esp_http_client_close(client);
-    esp_http_client_cleanup(client);
+    checkpoint.page = page;
+    checkpoint.keys += keys;
+    checkpoint.page_keys = 0;
+    checkpoint.exposure_information = ena_storage_exposure_information_count();
+    checkpoint.key_digests = ena_storage_key_digests_count(checkpoint.date);
+    ena_storage_write_sync_checkpoint(&checkpoint, sizeof(ena_eke_proxy_checkpoint_t));
+}
 
-    if (err != ESP_OK && retries < 6)
+void ena_eke_proxy_checkpoint_resume(void)
+{
+    // digests of an aborted page are not stored
+    page_digests_count = 0;
+    page_digests_dropped = 0;
+    uint32_t digests = ena_storage_key_digests_count(checkpoint.date);
+    if (digests > checkpoint.key_digests)
     {
-        retries = retries + 1;
-        ESP_LOGD(ENA_EKE_PROXY_LOG, "retry %d for url = %s", retries, url);
-        return ena_eke_proxy_receive_keys(url);
+        // interrupted after the digests of the page, its exposure information was written before them
+        ESP_LOGI(ENA_EKE_PROXY_LOG, "page %u was matched before interruption", checkpoint.page);
+        ena_eke_proxy_checkpoint_save(checkpoint.page + 1, checkpoint.page_keys);
+        return;
     }
 
-    return err;
+    // exposure information of a partially matched page is written again with the page
+    ena_storage_truncate_exposure_information(checkpoint.exposure_information);
 }
 
-esp_err_t ena_eke_proxy_receive_daily_keys(char *date_string, size_t page, size_t size)
+void ena_eke_proxy_send_page(bool last)
 {
-    char *url = malloc(strlen(ENA_EKE_PROXY_KEYFILES_DAILY_URL) + strlen(date_string) + 16);
-    sprintf(url, ENA_EKE_PROXY_KEYFILES_DAILY_URL, date_string, page, size);
-    return ena_eke_proxy_receive_keys(url);
+    fetch_page->last = last;
+    fetch_page_open = !last;
+    __atomic_add_fetch(&pages_in_flight, 1, __ATOMIC_ACQ_REL);
+    xQueueSend(received_pages, &fetch_page, portMAX_DELAY);
+    fetch_page = NULL;
 }
 
-esp_err_t ena_eke_proxy_receive_hourly_keys(char *date_string, uint8_t hour, size_t page, size_t size)
+void ena_eke_proxy_abort_page(void)
 {
-    char *url = malloc(strlen(ENA_EKE_PROXY_KEYFILES_HOURLY_URL) + strlen(date_string) + 24);
-    sprintf(url, ENA_EKE_PROXY_KEYFILES_HOURLY_URL, date_string, hour, page, size);
-    return ena_eke_proxy_receive_keys(url);
+    if (!pipeline)
+    {
+        ena_eke_proxy_check_end();
+        return;
+    }
+
+    // received keys are still checked, the check of the response is finished with them
+    if (fetch_page == NULL && fetch_page_open)
+    {
+        xQueueReceive(free_pages, &fetch_page, portMAX_DELAY);
+    }
+    if (fetch_page != NULL && fetch_page->length == 0 && !fetch_page_open)
+    {
+        // nothing of the response received, no check to finish
+        xQueueSend(free_pages, &fetch_page, portMAX_DELAY);
+        fetch_page = NULL;
+    }
+    if (fetch_page != NULL)
+    {
+        fetch_page->resume_page = 0;
+        ena_eke_proxy_send_page(true);
+    }
 }
 
-void ena_eke_proxy_run(void)
+bool ena_eke_proxy_matching(void)
+{
+    return __atomic_load_n(&pages_in_flight, __ATOMIC_ACQUIRE) > 0;
+}
+
+void ena_eke_proxy_match_task(void *pvParameter)
+{
+    ena_eke_proxy_page_t *page = NULL;
+    while (1)
+    {
+        xQueueReceive(received_pages, &page, portMAX_DELAY);
+        for (size_t offset = 0; offset < page->length; offset += sizeof(read_buffer))
+        {
+            size_t length = page->length - offset;
+            if (length > sizeof(read_buffer))
+            {
+                length = sizeof(read_buffer);
+            }
+            ena_eke_proxy_check_data(&page->data[offset], length);
+            // same steps as without pipeline, so other tasks of same priority keep their timing
+            taskYIELD();
+        }
+        if (page->last)
+        {
+            while (ena_exposure_check_match(ENA_EKE_PROXY_READ_KEYS) > 0)
+            {
+                taskYIELD();
+            }
+            size_t keys = received_keys;
+            ena_eke_proxy_check_page_end();
+            if (page->resume_page > 0)
+            {
+                ena_eke_proxy_checkpoint_save(page->resume_page, keys);
+            }
+        }
+        page->length = 0;
+        xQueueSend(free_pages, &page, portMAX_DELAY);
+        __atomic_sub_fetch(&pages_in_flight, 1, __ATOMIC_ACQ_REL);
+    }
+}
+
+void ena_eke_proxy_request_close(void)
+{
+    free(request_url);
+    request_url = NULL;
+}
+
+void ena_eke_proxy_client_close(void)
+{
+    if (client != NULL)
+    {
+        esp_http_client_close(client);
+        esp_http_client_cleanup(client);
+        client = NULL;
+    }
+}
+
+ena_eke_proxy_state_t ena_eke_proxy_request_failed(void)
+{
+    ena_eke_proxy_abort_page();
+    ena_eke_proxy_request_close();
+    // client and its session ticket are kept for the retry after the sleep
+    esp_http_client_close(client);
+    current_page = 0;
+    request_sleep = time(NULL) + request_sleep_waiting;
+    if (request_sleep_waiting < HOUR_IN_SECONDS)
+    {
+        request_sleep_waiting = request_sleep_waiting * 3;
+    }
+    return ENA_EKE_PROXY_STATE_IDLE;
+}
+
+ena_eke_proxy_state_t ena_eke_proxy_next(void)
 {
     static time_t current_time = 0;
     static struct tm current_tm;
@@ -269,68 +453,398 @@ void ena_eke_proxy_run(void)
     static double check_diff = 0;
     static time_t wifi_reconnect = 0;
     static uint32_t wifi_reconnect_waiting = 15;
+    // nothing to cancel before a request is started
+    __atomic_store_n(&cancel_requested, false, __ATOMIC_RELEASE);
     current_time = time(NULL);
-    last_check = (time_t)ena_storage_read_last_exposure_date();
+    bool resume = state == ENA_EKE_PROXY_STATE_IDLE;
+    if (resume)
+    {
+        if (ena_eke_proxy_matching())
+        {
+            // keys of a canceled request are still checked
+            return ENA_EKE_PROXY_STATE_IDLE;
+        }
+        // storage is not read while a sync is running, pages may be matched meanwhile
+        last_exposure_date = ena_storage_read_last_exposure_date();
+        ena_storage_read_sync_checkpoint(&checkpoint, sizeof(ena_eke_proxy_checkpoint_t));
+    }
+    last_check = (time_t)last_exposure_date;
     check_diff = difftime(current_time, last_check);
 
-    if (check_diff > HOUR_IN_SECONDS && !wait_for_request && !request_pause && current_time > request_sleep)
+    if (check_diff <= HOUR_IN_SECONDS || request_pause || current_time <= request_sleep)
+    {
+        return ENA_EKE_PROXY_STATE_IDLE;
+    }
+
+    if (wifi_controller_connection() == NULL)
     {
-        if (wifi_controller_connection() == NULL && current_time > wifi_reconnect && wifi_reconnect_waiting < 86400)
+        if (current_time > wifi_reconnect && wifi_reconnect_waiting < 86400)
         {
             wifi_controller_reconnect(NULL);
             wifi_reconnect = current_time + wifi_reconnect_waiting;
             wifi_reconnect_waiting = wifi_reconnect_waiting * 4;
         }
-        else if (wifi_controller_connection() != NULL)
+        return ENA_EKE_PROXY_STATE_IDLE;
+    }
+
+    wifi_reconnect = 0;
+    wifi_reconnect_waiting = 15;
+    int current_day_offset = check_diff / DAY_IN_SECONDS;
+
+    if (current_day_offset > ENA_EKE_PROXY_MAX_PAST_DAYS)
+    {
+        current_day_offset = ENA_EKE_PROXY_MAX_PAST_DAYS;
+        last_check = (current_time - (DAY_IN_SECONDS * current_day_offset));
+    }
+
+    memcpy(&current_tm, gmtime(&current_time), sizeof current_tm);
+    memcpy(&last_check_tm, gmtime(&last_check), sizeof last_check_tm);
+
+    if (current_day_offset > 0 || current_tm.tm_mday > last_check_tm.tm_mday || current_tm.tm_mon > last_check_tm.tm_mon)
+    {
+        last_check_tm.tm_hour = 0;
+        if (current_day_offset <= 0)
         {
-            wifi_reconnect = 0;
-            wifi_reconnect_waiting = 15;
-            int current_day_offset = check_diff / DAY_IN_SECONDS;
+            current_day_offset = 1;
+        }
+    }
 
-            if (current_day_offset > ENA_EKE_PROXY_MAX_PAST_DAYS)
-            {
-                current_day_offset = ENA_EKE_PROXY_MAX_PAST_DAYS;
-                last_check = (current_time - (DAY_IN_SECONDS * current_day_offset));
-            }
+    last_check_tm.tm_min = 0;
+    last_check_tm.tm_sec = 0;
+    last_check = mktime(&last_check_tm);
 
-            memcpy(&current_tm, gmtime(&current_time), sizeof current_tm);
-            memcpy(&last_check_tm, gmtime(&last_check), sizeof last_check_tm);
+    bool hourly = current_day_offset == 0 && ENA_EKE_PROXY_KEYFILES_HOURLY;
+    uint8_t checkpoint_hour = hourly ? last_check_tm.tm_hour : ENA_EKE_PROXY_CHECKPOINT_DAILY;
+    uint32_t checkpoint_date = (uint32_t)last_check - last_check_tm.tm_hour * HOUR_IN_SECONDS;
+    if (checkpoint.magic != ENA_EKE_PROXY_CHECKPOINT_MAGIC || checkpoint.date != checkpoint_date || checkpoint.hour != checkpoint_hour)
+    {
+        if (ena_eke_proxy_matching())
+        {
+            // pages of the previous hour or day still use its digests and save its checkpoint
+            return ENA_EKE_PROXY_STATE_NEXT;
+        }
+        // hour or day not started before
+        ena_eke_proxy_checkpoint_start(checkpoint_date, checkpoint_hour);
+        ena_eke_proxy_key_digests_load(checkpoint_date);
+        current_page = 0;
+    }
+    else if (resume)
+    {
+        ena_eke_proxy_checkpoint_resume();
+        ena_eke_proxy_key_digests_load(checkpoint_date);
+        current_page = checkpoint.page;
+        ESP_LOGI(ENA_EKE_PROXY_LOG, "resume sync at page %u, %u keys matched before", checkpoint.page, checkpoint.keys);
+    }
 
-            if (current_day_offset > 0 || current_tm.tm_mday > last_check_tm.tm_mday || current_tm.tm_mon > last_check_tm.tm_mon)
-            {
-                last_check_tm.tm_hour = 0;
-                if (current_day_offset <= 0)
-                {
-                    current_day_offset = 1;
-                }
-            }
+    char date_string[11];
+    strftime(date_string, 11, ENA_EKE_PROXY_KEYFILES_DAILY_FORMAT, &last_check_tm);
 
-            last_check_tm.tm_min = 0;
-            last_check_tm.tm_sec = 0;
-            last_check = mktime(&last_check_tm);
+    if (hourly)
+    {
+        ESP_LOGD(ENA_EKE_PROXY_LOG, "eke-proxy request for /%s/hour/%d?page=%d&size=%d : %d kB, ", date_string, last_check_tm.tm_hour, current_page, ENA_EKE_PROXY_DEFAULT_LIMIT, (xPortGetFreeHeapSize() / 1024));
+        request_url = malloc(strlen(ENA_EKE_PROXY_KEYFILES_HOURLY_URL) + strlen(date_string) + 24);
+        sprintf(request_url, ENA_EKE_PROXY_KEYFILES_HOURLY_URL, date_string, last_check_tm.tm_hour, current_page, ENA_EKE_PROXY_DEFAULT_LIMIT);
+    }
+    else
+    {
+        ESP_LOGD(ENA_EKE_PROXY_LOG, "eke-proxy request for /%s?page=%d&size=%d : %d kB, ", date_string, current_page, ENA_EKE_PROXY_DEFAULT_LIMIT, (xPortGetFreeHeapSize() / 1024));
+        request_url = malloc(strlen(ENA_EKE_PROXY_KEYFILES_DAILY_URL) + strlen(date_string) + 16);
+        sprintf(request_url, ENA_EKE_PROXY_KEYFILES_DAILY_URL, date_string, current_page, ENA_EKE_PROXY_DEFAULT_LIMIT);
+    }
 
-            esp_err_t err;
+    request_retries = 0;
+    return ENA_EKE_PROXY_STATE_CONNECT;
+}
 
-            char date_string[11];
-            strftime(date_string, 11, ENA_EKE_PROXY_KEYFILES_DAILY_FORMAT, &last_check_tm);
+esp_err_t ena_eke_proxy_fetch_event_handler(esp_http_client_event_t *evt)
+{
+    if (evt->event_id == HTTP_EVENT_ON_CONNECTED)
+    {
+        // requests on a kept connection do not connect (and handshake) again
+        sync_stats.connections++;
+    }
+    return ESP_OK;
+}
 
-            if (current_day_offset == 0 && ENA_EKE_PROXY_KEYFILES_HOURLY)
-            {
-                ESP_LOGD(ENA_EKE_PROXY_LOG, "eke-proxy request for /%s/hour/%d?page=%d&size=%d : %d kB, ", date_string, last_check_tm.tm_hour, current_page, ENA_EKE_PROXY_DEFAULT_LIMIT, (xPortGetFreeHeapSize() / 1024));
-                err = ena_eke_proxy_receive_hourly_keys(date_string, last_check_tm.tm_hour, current_page, ENA_EKE_PROXY_DEFAULT_LIMIT);
-            }
-            else
-            {
-                ESP_LOGD(ENA_EKE_PROXY_LOG, "eke-proxy request for /%s?page=%d&size=%d : %d kB, ", date_string, current_page, ENA_EKE_PROXY_DEFAULT_LIMIT, (xPortGetFreeHeapSize() / 1024));
-                err = ena_eke_proxy_receive_daily_keys(date_string, current_page, ENA_EKE_PROXY_DEFAULT_LIMIT);
-            }
+ena_eke_proxy_state_t ena_eke_proxy_connect(void)
+{
+    if (pipeline && __atomic_load_n(&pages_in_flight, __ATOMIC_ACQUIRE) >= ENA_EKE_PROXY_PIPELINE_PAGES)
+    {
+        // receiving runs ahead of the checkpoint by at most the pipeline pages, request once the oldest is matched
+        return ENA_EKE_PROXY_STATE_CONNECT;
+    }
+
+    ESP_LOGD(ENA_EKE_PROXY_LOG, "start request: url = %s | memory: %d kB", request_url, (xPortGetFreeHeapSize() / 1024));
+    if (client == NULL)
+    {
+        esp_http_client_config_t config = {
+            .url = request_url,
+            .timeout_ms = 30000,
+            .event_handler = ena_eke_proxy_fetch_event_handler,
+        };
+
+        if (memcmp(request_url, "https", 5) == 0)
+        {
+            config.cert_pem = (char *)cert_pem_start;
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+            // reconnects of this client resume the TLS session with its ticket instead of a full handshake
+            config.save_client_session = true;
+#endif
+        }
+        client = esp_http_client_init(&config);
+    }
+    else
+    {
+        // same host keeps the connection open (HTTP/1.1 persistent connection)
+        esp_http_client_set_url(client, request_url);
+    }
+
+    sync_stats.requests++;
+    esp_err_t err = esp_http_client_open(client, 0);
+    int content_length = -1;
+    if (err == ESP_OK)
+    {
+        content_length = esp_http_client_fetch_headers(client);
+    }
+
+    if (err != ESP_OK || (content_length < 0 && !esp_http_client_is_chunked_response(client)))
+    {
+        // reconnect on retry, e.g. after the connection was dropped
+        esp_http_client_close(client);
+        if (request_retries < 6)
+        {
+            request_retries = request_retries + 1;
+            ESP_LOGD(ENA_EKE_PROXY_LOG, "retry %d for url = %s", request_retries, request_url);
+            return ENA_EKE_PROXY_STATE_CONNECT;
+        }
+        ESP_LOGD(ENA_EKE_PROXY_LOG, "error eke-proxy url = %s | memory: %d kB", request_url, (xPortGetFreeHeapSize() / 1024));
+        return ena_eke_proxy_request_failed();
+    }
+
+    int status = esp_http_client_get_status_code(client);
+    ESP_LOGD(ENA_EKE_PROXY_LOG, "response: url = %s, status = %d, content_length = %d | memory: %d kB", request_url, status, content_length, (xPortGetFreeHeapSize() / 1024));
+
+    if (status == 200)
+    {
+        return ENA_EKE_PROXY_STATE_FETCH;
+    }
+    else if (status == 204)
+    {
+        ena_eke_proxy_request_close();
+        return ENA_EKE_PROXY_STATE_SUMMARIZE;
+    }
+
+    return ena_eke_proxy_request_failed();
+}
+
+ena_eke_proxy_state_t ena_eke_proxy_fetch_page(void)
+{
+    if (fetch_page == NULL && xQueueReceive(free_pages, &fetch_page, 0) != pdTRUE)
+    {
+        // both pages are matched right now
+        return ENA_EKE_PROXY_STATE_FETCH;
+    }
+
+    int length = esp_http_client_read(client, (char *)&fetch_page->data[fetch_page->length], ENA_EKE_PROXY_PAGE_SIZE - fetch_page->length);
+    if (length < 0)
+    {
+        ESP_LOGW(ENA_EKE_PROXY_LOG, "failed to read response: url = %s", request_url);
+        return ena_eke_proxy_request_failed();
+    }
+
+    fetch_page->length += length;
+    sync_stats.bytes += length;
+    if (length > 0 && !esp_http_client_is_complete_data_received(client))
+    {
+        if (fetch_page->length == ENA_EKE_PROXY_PAGE_SIZE)
+        {
+            // response longer than a page, continue in next page
+            ena_eke_proxy_send_page(false);
+        }
+        return ENA_EKE_PROXY_STATE_FETCH;
+    }
+
+    // download next page while this one is matched
+    fetch_page->resume_page = current_page + 1;
+    ena_eke_proxy_send_page(true);
+    ena_eke_proxy_request_close();
+    current_page = current_page + 1;
+    return ENA_EKE_PROXY_STATE_NEXT;
+}
+
+ena_eke_proxy_state_t ena_eke_proxy_fetch(void)
+{
+    if (pipeline)
+    {
+        return ena_eke_proxy_fetch_page();
+    }
+
+    if (!check_received)
+    {
+        // keys are collected while receiving, chunked or not
+        int length = esp_http_client_read(client, (char *)read_buffer, sizeof(read_buffer));
+        if (length > 0)
+        {
+            ena_eke_proxy_check_data(read_buffer, length);
+            sync_stats.bytes += length;
+            return ENA_EKE_PROXY_STATE_FETCH;
+        }
+        else if (length < 0)
+        {
+            ESP_LOGW(ENA_EKE_PROXY_LOG, "failed to read response: url = %s", request_url);
+            return ena_eke_proxy_request_failed();
+        }
+        check_received = true;
+    }
+
+    // collected keys are matched in steps of as many keys as are read in one
+    if (ena_exposure_check_match(ENA_EKE_PROXY_READ_KEYS) > 0)
+    {
+        return ENA_EKE_PROXY_STATE_FETCH;
+    }
+
+    size_t keys = received_keys;
+    ena_eke_proxy_check_page_end();
+    ena_eke_proxy_checkpoint_save(current_page + 1, keys);
+    ena_eke_proxy_request_close();
+    current_page = current_page + 1;
+    return ENA_EKE_PROXY_STATE_NEXT;
+}
+
+ena_eke_proxy_state_t ena_eke_proxy_summarize(void)
+{
+    if (ena_eke_proxy_matching())
+    {
+        // day or hour is finished after all its pages are matched
+        return ENA_EKE_PROXY_STATE_SUMMARIZE;
+    }
+
+    // finished!
+    if (difftime(time(NULL), last_check) >= DAY_IN_SECONDS)
+    {
+        last_check = last_check + DAY_IN_SECONDS;
+    }
+    else
+    {
+        last_check = last_check + HOUR_IN_SECONDS;
+    }
+    last_exposure_date = (uint32_t)last_check;
+    ena_storage_write_last_exposure_date(last_exposure_date);
+    current_page = 0;
+    request_sleep = 0;
+    request_sleep_waiting = 30;
+
+    ena_exposure_summary(ena_exposure_default_config());
+
+    ena_exposure_summary_t *current_summary = ena_exposure_current_summary();
+    ESP_LOGD(ENA_EKE_PROXY_LOG, "current summary\nlast update: %u\ndays_since_last_exposure: %d\nnum_exposures: %d\nmax_risk_score: %d\nrisk_score_sum: %d",
+             current_summary->last_update,
+             current_summary->days_since_last_exposure,
+             current_summary->num_exposures,
+             current_summary->max_risk_score,
+             current_summary->risk_score_sum);
+    return ENA_EKE_PROXY_STATE_NEXT;
+}
+
+void ena_eke_proxy_run(void)
+{
+    if (state != ENA_EKE_PROXY_STATE_IDLE && __atomic_exchange_n(&cancel_requested, false, __ATOMIC_ACQ_REL))
+    {
+        // an incomplete page is checked again when resuming from the checkpoint
+        ESP_LOGI(ENA_EKE_PROXY_LOG, "cancel request of page %u", current_page);
+        ena_eke_proxy_abort_page();
+        ena_eke_proxy_request_close();
+        ena_eke_proxy_client_close();
+        __atomic_store_n(&state, ENA_EKE_PROXY_STATE_IDLE, __ATOMIC_RELEASE);
+        return;
+    }
+
+    ena_eke_proxy_state_t next_state = state;
+    switch (state)
+    {
+    case ENA_EKE_PROXY_STATE_IDLE:
+    case ENA_EKE_PROXY_STATE_NEXT:
+        next_state = ena_eke_proxy_next();
+        break;
+    case ENA_EKE_PROXY_STATE_CONNECT:
+        next_state = ena_eke_proxy_connect();
+        break;
+    case ENA_EKE_PROXY_STATE_FETCH:
+        next_state = ena_eke_proxy_fetch();
+        break;
+    case ENA_EKE_PROXY_STATE_SUMMARIZE:
+        next_state = ena_eke_proxy_summarize();
+        break;
+    }
+
+    if (next_state == ENA_EKE_PROXY_STATE_IDLE && client != NULL && request_sleep == 0)
+    {
+        // sync finished, release connection and TLS buffers, a failed one keeps the client to resume its session
+        ena_eke_proxy_client_close();
+        ESP_LOGI(ENA_EKE_PROXY_LOG, "sync stats: %u requests, %u connections, %u keys (%u checked before, %u digests dropped), %u bytes", sync_stats.requests, sync_stats.connections, sync_stats.keys, sync_stats.duplicates, sync_stats.dropped, sync_stats.bytes);
+    }
+    __atomic_store_n(&state, next_state, __ATOMIC_RELEASE);
+}
+
+void ena_eke_proxy_task(void *pvParameter)
+{
+    while (1)
+    {
+        ena_eke_proxy_run();
+        // a running sync only yields between steps, so other tasks of same priority keep their timing
+        vTaskDelay(ena_eke_proxy_get_state() == ENA_EKE_PROXY_STATE_IDLE ? (1000 / portTICK_PERIOD_MS) : 1);
+    }
+}
 
-            if (err != ESP_OK)
+void ena_eke_proxy_start(void)
+{
+    ena_eke_proxy_page_t *pages[ENA_EKE_PROXY_PIPELINE_PAGES] = {NULL};
+    if (ENA_EKE_PROXY_PIPELINE)
+    {
+        pipeline = true;
+        for (int i = 0; i < ENA_EKE_PROXY_PIPELINE_PAGES; i++)
+        {
+            pages[i] = malloc(sizeof(ena_eke_proxy_page_t));
+            pipeline = pipeline && pages[i] != NULL;
+        }
+        if (!pipeline)
+        {
+            // keys are checked while receiving instead
+            ESP_LOGW(ENA_EKE_PROXY_LOG, "failed to allocate memory for pipeline pages, memory: %d kB", (xPortGetFreeHeapSize() / 1024));
+            for (int i = 0; i < ENA_EKE_PROXY_PIPELINE_PAGES; i++)
             {
-                ESP_LOGD(ENA_EKE_PROXY_LOG, "error eke-proxy /%s/%u %d, ", date_string, last_check_tm.tm_hour, (xPortGetFreeHeapSize() / 1024));
+                free(pages[i]);
             }
         }
     }
+    if (pipeline)
+    {
+        free_pages = xQueueCreate(ENA_EKE_PROXY_PIPELINE_PAGES, sizeof(ena_eke_proxy_page_t *));
+        received_pages = xQueueCreate(ENA_EKE_PROXY_PIPELINE_PAGES, sizeof(ena_eke_proxy_page_t *));
+        for (int i = 0; i < ENA_EKE_PROXY_PIPELINE_PAGES; i++)
+        {
+            pages[i]->length = 0;
+            xQueueSend(free_pages, &pages[i], portMAX_DELAY);
+        }
+        xTaskCreatePinnedToCore(&ena_eke_proxy_match_task, "ena_eke_proxy_match_task", 4096, NULL, ENA_EKE_PROXY_TASK_PRIORITY, &eke_proxy_match_task_handle,
+                                ENA_EKE_PROXY_PIPELINE_CORE < 0 ? tskNO_AFFINITY : ENA_EKE_PROXY_PIPELINE_CORE);
+    }
+    xTaskCreate(&ena_eke_proxy_task, "ena_eke_proxy_task", ENA_EKE_PROXY_TASK_STACK_SIZE, NULL, ENA_EKE_PROXY_TASK_PRIORITY, &eke_proxy_task_handle);
+}
+
+void ena_eke_proxy_cancel(void)
+{
+    __atomic_store_n(&cancel_requested, true, __ATOMIC_RELEASE);
+}
+
+ena_eke_proxy_state_t ena_eke_proxy_get_state(void)
+{
+    return __atomic_load_n(&state, __ATOMIC_ACQUIRE);
+}
+
+void ena_eke_proxy_get_stats(ena_eke_proxy_stats_t *stats)
+{
+    memcpy(stats, &sync_stats, sizeof(ena_eke_proxy_stats_t));
 }
 
 esp_err_t ena_eke_proxy_fetch_upload_handler(esp_http_client_event_t *evt)
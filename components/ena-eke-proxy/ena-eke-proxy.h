@@ -45,37 +45,107 @@
 #define ENA_EKE_PROXY_KEYFILES_UPLOAD_URL CONFIG_ENA_EKE_PROXY_KEYFILES_UPLOAD_URL
 #define ENA_EKE_PROXY_DEFAULT_LIMIT CONFIG_ENA_EKE_PROXY_KEY_LIMIT
 #define ENA_EKE_PROXY_MAX_PAST_DAYS CONFIG_ENA_EKE_PROXY_MAX_PAST_DAYS // ENA_STORAGE_TEK_MAX
+#define ENA_EKE_PROXY_KEY_SIZE (28)                                   // size of a key in response: key data, rolling start interval number, rolling period, days since onset of symptoms
+#define ENA_EKE_PROXY_READ_KEYS (16)                                  // keys read or matched in one step of the sync
+#define ENA_EKE_PROXY_TASK_STACK_SIZE (4096 * 2)                      // stack of the sync task, TLS handshake needs most of it
+#define ENA_EKE_PROXY_TASK_PRIORITY (1)                               // priority of the sync task, same as main loop calling ena_run
+#define ENA_EKE_PROXY_PAGE_SIZE (ENA_EKE_PROXY_DEFAULT_LIMIT * ENA_EKE_PROXY_KEY_SIZE) // bytes of a full page of keys
+#define ENA_EKE_PROXY_CHECKPOINT_MAGIC (0x31435345)                                     // "ESC1", marks a valid sync checkpoint
+#define ENA_EKE_PROXY_CHECKPOINT_DAILY (0xFF)                                           // hour of the checkpoint of a daily request
+
+#ifdef CONFIG_ENA_EKE_PROXY_PIPELINE
+#define ENA_EKE_PROXY_PIPELINE true
+#define ENA_EKE_PROXY_PIPELINE_CORE (CONFIG_ENA_EKE_PROXY_PIPELINE_CORE) // core of the matching task, -1 for any
+#else
+#define ENA_EKE_PROXY_PIPELINE false
+#define ENA_EKE_PROXY_PIPELINE_CORE (-1)
+#endif
+#define ENA_EKE_PROXY_PIPELINE_PAGES (2) // page buffers of the pipeline, also the most pages requested before their checkpoint
+
+/**
+ * @brief states of the key sync
+ */
+typedef enum
+{
+    ENA_EKE_PROXY_STATE_IDLE = 0,  // no sync running, check for next request every second
+    ENA_EKE_PROXY_STATE_NEXT,      // check for next request (page, hour or day) right away
+    ENA_EKE_PROXY_STATE_CONNECT,   // open request and read status
+    ENA_EKE_PROXY_STATE_FETCH,     // read next keys of response, then match the collected ones
+    ENA_EKE_PROXY_STATE_SUMMARIZE, // update exposure summary after a day or hour is finished
+} ena_eke_proxy_state_t;
 
 /**
- * @brief fetch key export from given url
+ * @brief statistics of the key sync since boot
+ */
+typedef struct
+{
+    uint32_t requests;    // requests sent
+    uint32_t connections; // connections opened, each with a TLS handshake for https
+    uint32_t keys;        // keys received
+    uint32_t duplicates;  // keys not checked, because they were checked in an hourly request before
+    uint32_t bytes;       // bytes of received key data
+    uint32_t dropped;     // digests of checked keys not stored, their keys are checked again with the daily request
+} ena_eke_proxy_stats_t;
+
+/**
+ * @brief structure for the persisted progress of the hour or day synced
  * 
- * @param[in] url       the url to fetch the data from
+ * Written after every matched page, so an interrupted sync resumes with the next page. Before the key digests of
+ * a page are stored it is written once more with the keys of the page, so a resume after the digests counts them.
  */
-esp_err_t ena_eke_proxy_receive_keys(char *url);
+typedef struct __attribute__((__packed__))
+{
+    uint32_t magic;                // marks a valid checkpoint
+    uint32_t date;                 // start of the day synced
+    uint8_t hour;                  // hour synced, ENA_EKE_PROXY_CHECKPOINT_DAILY for the whole day
+    uint8_t reserved[3];           // reserved
+    uint32_t page;                 // next page to request
+    uint32_t keys;                 // keys matched in previous pages
+    uint32_t exposure_information; // stored exposure information after previous pages
+    uint32_t key_digests;          // stored key digests of the day after previous pages
+    uint32_t page_keys;            // keys of the page whose digests are stored after this checkpoint, 0 for none
+} ena_eke_proxy_checkpoint_t;
 
 /**
- * @brief fetch key export for given date with limit and offset
+ * @brief run one step of the key sync
  * 
- * @param[in] date_string   the date to fetch the data for
- * @param[in] page          the page to request
- * @param[in] size          the size of a page
+ * Every step is short (at most ENA_EKE_PROXY_READ_KEYS keys are checked), so the caller can yield in between.
  */
-esp_err_t ena_eke_proxy_receive_daily_keys(char *date_string, size_t page, size_t size);
+void ena_eke_proxy_run(void);
 
 /**
- * @brief fetch key export for given date with limit and offset
+ * @brief start task running the key sync
  * 
- * @param[in] date_string   the date to fetch the data for
- * @param[in] hour          the hour to fetch the data for
- * @param[in] page          the page to request
- * @param[in] size          the size of a page
+ * With ENA_EKE_PROXY_PIPELINE a second task checks the keys of a downloaded page while the next page is
+ * downloaded. Both pages are allocated once, without memory for them keys are checked while receiving. A request
+ * only starts with less than ENA_EKE_PROXY_PIPELINE_PAGES pages waiting for their checkpoint, so an interrupted
+ * sync fetches at most ENA_EKE_PROXY_PIPELINE_PAGES pages again.
  */
-esp_err_t ena_eke_proxy_receive_hourly_keys(char *date_string, uint8_t hour, size_t page, size_t size);
+void ena_eke_proxy_start(void);
 
 /**
- * @brief run ena eke proxy
+ * @brief cancel a running request
+ * 
+ * The sync stops after the current step, the incomplete page is requested again later.
  */
-void ena_eke_proxy_run(void);
+void ena_eke_proxy_cancel(void);
+
+/**
+ * @brief return current state of the key sync
+ * 
+ * @return
+ *          ena_eke_proxy_state_t   current state
+ */
+ena_eke_proxy_state_t ena_eke_proxy_get_state(void);
+
+/**
+ * @brief get statistics of the key sync
+ * 
+ * Requests of a sync share one connection, so connections stay far below requests unless the connection drops.
+ * 
+ * @param[out] stats    pointer to write the statistics to
+ */
+void ena_eke_proxy_get_stats(ena_eke_proxy_stats_t *stats);
 
 /**
  * @brief Upload own keys to server
@@ -88,6 +158,7 @@ esp_err_t ena_eke_proxy_upload(char *token, uint32_t days_since_onset_of_symptom
 /**
  * @brief pause requests
  * 
+ * Cancels a running request and waits until the sync is idle.
  */
 void ena_eke_proxy_pause(void);
 
@@ -18,51 +18,166 @@
 
 #include "ena-crypto.h"
 #include "ena-storage.h"
+#include "ena-bluetooth-scan.h"
 
 #include "ena-beacons.h"
 
 static uint32_t temp_beacons_count = 0;
 static ena_beacon_t temp_beacons[ENA_STORAGE_TEMP_BEACONS_MAX];
+static uint16_t temp_beacons_table[ENA_BEACON_TEMP_TABLE_SIZE]; // hash table, index of temporary beacon + 1 or 0 for empty
+static bool temp_beacons_changed = false;                       // temporary beacons changed since last snapshot
+static uint32_t temp_beacons_snapshot_timestamp = 0;            // time of last snapshot
 
-int ena_get_temp_beacon_index(uint8_t *rpi, uint8_t *aem)
+uint32_t ena_beacons_temp_table_slot(uint8_t *rpi)
+{
+    // RPIs are AES output, so plain bytes are uniformly distributed
+    uint32_t hash;
+    memcpy(&hash, rpi, sizeof(uint32_t));
+    return hash % ENA_BEACON_TEMP_TABLE_SIZE;
+}
+
+int ena_beacons_temp_table_find(uint8_t *rpi, uint8_t *aem)
 {
-    for (int i = 0; i < temp_beacons_count; i++)
+    uint32_t slot = ena_beacons_temp_table_slot(rpi);
+    while (temp_beacons_table[slot] != 0)
     {
-        if (memcmp(temp_beacons[i].rpi, rpi, sizeof(ENA_KEY_LENGTH)) == 0 &&
-            memcmp(temp_beacons[i].aem, aem, sizeof(ENA_AEM_METADATA_LENGTH)) == 0)
+        ena_beacon_t *beacon = &temp_beacons[temp_beacons_table[slot] - 1];
+        if (memcmp(beacon->rpi, rpi, ENA_KEY_LENGTH) == 0 &&
+            memcmp(beacon->aem, aem, ENA_AEM_METADATA_LENGTH) == 0)
         {
-            return i;
+            return slot;
         }
+        slot = (slot + 1) % ENA_BEACON_TEMP_TABLE_SIZE;
     }
     return -1;
 }
 
+void ena_beacons_temp_table_insert(uint32_t index)
+{
+    uint32_t slot = ena_beacons_temp_table_slot(temp_beacons[index].rpi);
+    while (temp_beacons_table[slot] != 0)
+    {
+        slot = (slot + 1) % ENA_BEACON_TEMP_TABLE_SIZE;
+    }
+    temp_beacons_table[slot] = index + 1;
+}
+
+void ena_beacons_temp_table_remove(uint32_t slot)
+{
+    // backward shift deletion, following entries are moved up instead of leaving a tombstone
+    uint32_t next = slot;
+    while (true)
+    {
+        temp_beacons_table[slot] = 0;
+        while (true)
+        {
+            next = (next + 1) % ENA_BEACON_TEMP_TABLE_SIZE;
+            if (temp_beacons_table[next] == 0)
+            {
+                return;
+            }
+            uint32_t home = ena_beacons_temp_table_slot(temp_beacons[temp_beacons_table[next] - 1].rpi);
+            // entry can move to the free slot if its home is not cyclically in (slot, next]
+            if ((slot <= next) ? (home <= slot || home > next) : (home <= slot && home > next))
+            {
+                break;
+            }
+        }
+        temp_beacons_table[slot] = temp_beacons_table[next];
+        slot = next;
+    }
+}
+
+int ena_get_temp_beacon_index(uint8_t *rpi, uint8_t *aem)
+{
+    int slot = ena_beacons_temp_table_find(rpi, aem);
+    if (slot < 0)
+    {
+        return -1;
+    }
+    return temp_beacons_table[slot] - 1;
+}
+
+void ena_beacons_temp_remove(uint32_t index)
+{
+    ena_beacons_temp_table_remove(ena_beacons_temp_table_find(temp_beacons[index].rpi, temp_beacons[index].aem));
+    temp_beacons_count--;
+    if (index != temp_beacons_count)
+    {
+        // move last temporary beacon into the gap
+        int slot = ena_beacons_temp_table_find(temp_beacons[temp_beacons_count].rpi, temp_beacons[temp_beacons_count].aem);
+        temp_beacons[index] = temp_beacons[temp_beacons_count];
+        temp_beacons_table[slot] = index + 1;
+    }
+}
+
+void ena_beacons_temp_snapshot(void)
+{
+    ena_storage_write_temp_beacons(temp_beacons, temp_beacons_count);
+    temp_beacons_changed = false;
+    ESP_LOGD(ENA_BEACON_LOG, "snapshot of %u temporary beacons", temp_beacons_count);
+}
+
+void ena_beacons_temp_restore(void)
+{
+    uint32_t count = ena_storage_read_temp_beacons(temp_beacons, ENA_STORAGE_TEMP_BEACONS_MAX);
+    // an interrupted snapshot leaves records of the previous one next to the new ones, keep each beacon once
+    memset(temp_beacons_table, 0, sizeof(temp_beacons_table));
+    temp_beacons_count = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        int slot = ena_beacons_temp_table_find(temp_beacons[i].rpi, temp_beacons[i].aem);
+        if (slot >= 0)
+        {
+            ena_beacon_t *kept = &temp_beacons[temp_beacons_table[slot] - 1];
+            if (temp_beacons[i].timestamp_last > kept->timestamp_last)
+            {
+                *kept = temp_beacons[i];
+            }
+            continue;
+        }
+        temp_beacons[temp_beacons_count] = temp_beacons[i];
+        ena_beacons_temp_table_insert(temp_beacons_count++);
+    }
+    temp_beacons_changed = temp_beacons_count != count;
+    ESP_LOGD(ENA_BEACON_LOG, "restored %u temporary beacons", temp_beacons_count);
+}
+
 void ena_beacons_temp_refresh(uint32_t unix_timestamp)
 {
     for (int i = temp_beacons_count - 1; i >= 0; i--)
     {
+        bool remove = false;
         // check for treshold and add permanent beacon
         if (temp_beacons[i].timestamp_last - temp_beacons[i].timestamp_first >= ENA_BEACON_TRESHOLD)
         {
             ESP_LOGD(ENA_BEACON_LOG, "create beacon after treshold");
             ESP_LOG_BUFFER_HEXDUMP(ENA_BEACON_LOG, temp_beacons[i].rpi, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
             ena_storage_add_beacon(&temp_beacons[i]);
-            ena_storage_remove_temp_beacon(i);
+            remove = true;
         }
         else
             // delete temp beacons older than two times time window (two times to be safe, one times time window enough?!)
             if (unix_timestamp - temp_beacons[i].timestamp_last > (ENA_TIME_WINDOW * 2))
         {
             ESP_LOGD(ENA_BEACON_LOG, "remove old temporary beacon %u", i);
-            ena_storage_remove_temp_beacon(i);
+            remove = true;
+        }
+
+        if (remove)
+        {
+            // order does not matter, last one was already checked
+            ena_beacons_temp_remove(i);
+            temp_beacons_changed = true;
         }
     }
 
-    // update beacons
-    temp_beacons_count = ena_storage_temp_beacons_count();
-    for (int i = 0; i < temp_beacons_count; i++)
+    // write temporary beacons once per scan interval, half an interval since the last snapshot keeps a scan ending a
+    // little early from skipping its snapshot
+    if (temp_beacons_changed && unix_timestamp - temp_beacons_snapshot_timestamp >= ENA_SCANNING_INTERVAL / 2)
     {
-        ena_storage_get_temp_beacon(i, &temp_beacons[i]);
+        ena_beacons_temp_snapshot();
+        temp_beacons_snapshot_timestamp = unix_timestamp;
     }
 
 #if (CONFIG_ENA_STORAGE_DUMP)
@@ -76,16 +191,8 @@ void ena_beacons_temp_refresh(uint32_t unix_timestamp)
 
 void ena_beacons_cleanup(uint32_t unix_timestamp)
 {
-    uint32_t count = ena_storage_beacons_count();
-    ena_beacon_t beacon;
-    for (int i = count - 1; i >= 0; i--)
-    {
-        ena_storage_get_beacon(i, &beacon);
-        if (((unix_timestamp - beacon.timestamp_last) / (60 * 60 * 24)) > ENA_BEACON_CLEANUP_TRESHOLD)
-        {
-            ena_storage_remove_beacon(i);
-        }
-    }
+    // remove beacons older than ENA_BEACON_CLEANUP_TRESHOLD full days
+    ena_storage_expire_beacons(unix_timestamp - (ENA_BEACON_CLEANUP_TRESHOLD + 1) * (60 * 60 * 24));
 }
 
 void ena_beacon(uint32_t unix_timestamp, uint8_t *rpi, uint8_t *aem, int rssi)
@@ -93,21 +200,21 @@ void ena_beacon(uint32_t unix_timestamp, uint8_t *rpi, uint8_t *aem, int rssi)
     uint32_t beacon_index = ena_get_temp_beacon_index(rpi, aem);
     if (beacon_index == -1)
     {
+        if (temp_beacons_count >= ENA_STORAGE_TEMP_BEACONS_MAX)
+        {
+            ESP_LOGW(ENA_BEACON_LOG, "no space left for temporary beacon");
+            return;
+        }
         temp_beacons[temp_beacons_count].timestamp_first = unix_timestamp;
         memcpy(temp_beacons[temp_beacons_count].rpi, rpi, ENA_KEY_LENGTH);
         memcpy(temp_beacons[temp_beacons_count].aem, aem, ENA_AEM_METADATA_LENGTH);
         temp_beacons[temp_beacons_count].rssi = rssi;
         temp_beacons[temp_beacons_count].timestamp_last = unix_timestamp;
-        beacon_index = ena_storage_add_temp_beacon(&temp_beacons[temp_beacons_count]);
         ESP_LOGD(ENA_BEACON_LOG, "new temporary beacon %d at %u", temp_beacons_count, unix_timestamp);
         ESP_LOG_BUFFER_HEX_LEVEL(ENA_BEACON_LOG, rpi, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
         ESP_LOG_BUFFER_HEX_LEVEL(ENA_BEACON_LOG, aem, ENA_AEM_METADATA_LENGTH, ESP_LOG_DEBUG);
         ESP_LOGD(ENA_BEACON_LOG, "RSSI %d", rssi);
-
-        if (beacon_index != temp_beacons_count)
-        {
-            ESP_LOGW(ENA_BEACON_LOG, "last temporary beacon index does not match array index!");
-        }
+        ena_beacons_temp_table_insert(temp_beacons_count);
         temp_beacons_count++;
     }
     else
@@ -118,6 +225,6 @@ void ena_beacon(uint32_t unix_timestamp, uint8_t *rpi, uint8_t *aem, int rssi)
         ESP_LOG_BUFFER_HEX_LEVEL(ENA_BEACON_LOG, temp_beacons[beacon_index].rpi, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
         ESP_LOG_BUFFER_HEX_LEVEL(ENA_BEACON_LOG, temp_beacons[beacon_index].aem, ENA_AEM_METADATA_LENGTH, ESP_LOG_DEBUG);
         ESP_LOGD(ENA_BEACON_LOG, "RSSI %d", temp_beacons[beacon_index].rssi);
-        ena_storage_set_temp_beacon(beacon_index, &temp_beacons[beacon_index]);
     }
+    temp_beacons_changed = true;
 }
\ No newline at end of file
@@ -40,13 +40,11 @@ void ena_bluetooth_advertise_set_payload(uint32_t enin, uint8_t *tek)
     uint8_t aemk[ENA_KEY_LENGTH] = {0};
     uint8_t aem[ENA_AEM_METADATA_LENGTH] = {0};
 
-    ena_crypto_rpik(rpik, tek);
+    ena_crypto_derive_keys(tek, rpik, aemk);
 
-    ena_crypto_rpi(rpi, rpik, enin);
+    ena_crypto_rpi_batch(rpik, enin, 1, rpi);
 
-    ena_crypto_aemk(aemk, tek);
-
-    ena_crypto_aem(aem, aemk, rpi, esp_ble_tx_power_get(ESP_BLE_PWR_TYPE_ADV));
+    ena_crypto_aem_batch(aemk, rpi, 1, esp_ble_tx_power_get(ESP_BLE_PWR_TYPE_ADV), aem);
 
     uint8_t adv_raw_data[31];
     // FLAG??? skipped on sniffed android packages!?
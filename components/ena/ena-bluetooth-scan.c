@@ -14,16 +14,30 @@
 #include <string.h>
 #include <time.h>
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
 #include "esp_gap_ble_api.h"
 
 #include "ena-crypto.h"
+#include "ena-storage.h"
 #include "ena-beacons.h"
 
 #include "ena-bluetooth-scan.h"
 
 static int scan_status = ENA_SCAN_STATUS_NOT_SCANNING;
 
+// single producer (Bluetooth task), single consumer (scan task) ring buffer
+static ena_bluetooth_scan_entry_t scan_queue[ENA_SCAN_QUEUE_SIZE];
+static uint32_t scan_queue_head = 0;        // next entry to write, only written by producer
+static uint32_t scan_queue_tail = 0;        // next entry to read, only written by consumer
+static uint32_t scan_refresh_timestamp = 0; // pending refresh of temporary beacons, 0 for none
+static bool scan_snapshot_requested = false; // pending snapshot of temporary beacons
+static SemaphoreHandle_t scan_snapshot_done = NULL;
+static ena_bluetooth_scan_stats_t scan_stats = {0};
+static TaskHandle_t scan_task_handle = NULL;
+
 static const uint16_t ENA_SERVICE_UUID = 0xFD6F;
 
 static esp_ble_scan_params_t ena_scan_params = {
@@ -35,6 +49,88 @@ static esp_ble_scan_params_t ena_scan_params = {
     .scan_duplicate = BLE_SCAN_DUPLICATE_ENABLE,
 };
 
+void ena_bluetooth_scan_enqueue(uint32_t unix_timestamp, uint8_t *rpi, uint8_t *aem, int rssi)
+{
+    uint32_t head = scan_queue_head;
+    uint32_t next = (head + 1) % ENA_SCAN_QUEUE_SIZE;
+    if (next == __atomic_load_n(&scan_queue_tail, __ATOMIC_ACQUIRE))
+    {
+        scan_stats.dropped++;
+        return;
+    }
+    scan_queue[head].timestamp = unix_timestamp;
+    memcpy(scan_queue[head].rpi, rpi, ENA_KEY_LENGTH);
+    memcpy(scan_queue[head].aem, aem, ENA_AEM_METADATA_LENGTH);
+    scan_queue[head].rssi = rssi;
+    // publish entry after it is complete
+    __atomic_store_n(&scan_queue_head, next, __ATOMIC_RELEASE);
+    scan_stats.enqueued++;
+    xTaskNotifyGive(scan_task_handle);
+}
+
+void ena_bluetooth_scan_request_refresh(uint32_t unix_timestamp)
+{
+    __atomic_store_n(&scan_refresh_timestamp, unix_timestamp, __ATOMIC_RELEASE);
+    xTaskNotifyGive(scan_task_handle);
+}
+
+void ena_bluetooth_scan_task(void *pvParameter)
+{
+    const TickType_t flush_interval = pdMS_TO_TICKS(ENA_STORAGE_WRITE_CACHE_FLUSH_INTERVAL * 1000);
+    TickType_t last_flush = xTaskGetTickCount();
+    while (1)
+    {
+        // with write cache, wake up at least once per flush interval
+        bool timeout = ulTaskNotifyTake(pdTRUE, ENA_STORAGE_WRITE_CACHE ? flush_interval : portMAX_DELAY) == 0;
+
+        // drain all entries published so far as one batch
+        uint32_t tail = scan_queue_tail;
+        uint32_t head = __atomic_load_n(&scan_queue_head, __ATOMIC_ACQUIRE);
+        while (tail != head)
+        {
+            ena_bluetooth_scan_entry_t *entry = &scan_queue[tail];
+            ena_beacon(entry->timestamp, entry->rpi, entry->aem, entry->rssi);
+            tail = (tail + 1) % ENA_SCAN_QUEUE_SIZE;
+            __atomic_store_n(&scan_queue_tail, tail, __ATOMIC_RELEASE);
+            scan_stats.processed++;
+        }
+
+        // refresh after all advertisements of the scan are handled
+        uint32_t refresh_timestamp = __atomic_exchange_n(&scan_refresh_timestamp, 0, __ATOMIC_ACQ_REL);
+        if (refresh_timestamp > 0)
+        {
+            ena_beacons_temp_refresh(refresh_timestamp);
+        }
+
+        // temporary beacons are only touched by this task, so the snapshot is written here
+        bool snapshot = __atomic_exchange_n(&scan_snapshot_requested, false, __ATOMIC_ACQ_REL);
+        if (snapshot)
+        {
+            ena_beacons_temp_snapshot();
+        }
+
+        // writes of the scan cost one erase per block, a plain drain of the queue only touches RAM and leaves blocks
+        // of other tasks to coalesce until the flush interval passes
+        if (refresh_timestamp > 0 || snapshot || timeout || (ENA_STORAGE_WRITE_CACHE && xTaskGetTickCount() - last_flush >= flush_interval))
+        {
+            ena_storage_flush();
+            last_flush = xTaskGetTickCount();
+        }
+
+        if (snapshot)
+        {
+            xSemaphoreGive(scan_snapshot_done);
+        }
+    }
+}
+
+void ena_bluetooth_scan_snapshot(void)
+{
+    __atomic_store_n(&scan_snapshot_requested, true, __ATOMIC_RELEASE);
+    xTaskNotifyGive(scan_task_handle);
+    xSemaphoreTake(scan_snapshot_done, portMAX_DELAY);
+}
+
 void ena_bluetooth_scan_event_callback(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param)
 {
 
@@ -47,7 +143,7 @@ void ena_bluetooth_scan_event_callback(esp_gap_ble_cb_event_t event, esp_ble_gap
         break;
     case ESP_GAP_BLE_SCAN_STOP_COMPLETE_EVT:
         ESP_LOGD(ENA_SCAN_LOG, "stopped scanning...");
-        ena_beacons_temp_refresh(unix_timestamp);
+        ena_bluetooth_scan_request_refresh(unix_timestamp);
         break;
     case ESP_GAP_BLE_SCAN_RESULT_EVT:
         if (p->scan_rst.search_evt == ESP_GAP_SEARCH_INQ_RES_EVT)
@@ -65,19 +161,13 @@ void ena_bluetooth_scan_event_callback(esp_gap_ble_cb_event_t event, esp_ble_gap
                     break;
                 }
 
-                uint8_t *rpi = malloc(ENA_KEY_LENGTH);
-                memcpy(rpi, &service_data[sizeof(ENA_SERVICE_UUID)], ENA_KEY_LENGTH);
-                uint8_t *aem = malloc(ENA_AEM_METADATA_LENGTH);
-                memcpy(aem, &service_data[sizeof(ENA_SERVICE_UUID) + ENA_KEY_LENGTH], ENA_AEM_METADATA_LENGTH);
-                ena_beacon(unix_timestamp, rpi, aem, p->scan_rst.rssi);
-                free(rpi);
-                free(aem);
+                ena_bluetooth_scan_enqueue(unix_timestamp, &service_data[sizeof(ENA_SERVICE_UUID)], &service_data[sizeof(ENA_SERVICE_UUID) + ENA_KEY_LENGTH], p->scan_rst.rssi);
             }
         }
         else if (p->scan_rst.search_evt == ESP_GAP_SEARCH_INQ_CMPL_EVT)
         {
             scan_status = ENA_SCAN_STATUS_NOT_SCANNING;
-            ena_beacons_temp_refresh(unix_timestamp);
+            ena_bluetooth_scan_request_refresh(unix_timestamp);
             ESP_LOGD(ENA_SCAN_LOG, "finished scanning...");
         }
         break;
@@ -89,10 +179,12 @@ void ena_bluetooth_scan_event_callback(esp_gap_ble_cb_event_t event, esp_ble_gap
 
 void ena_bluetooth_scan_init(void)
 {
+    // init temporary beacons
+    ena_beacons_temp_restore();
+    scan_snapshot_done = xSemaphoreCreateBinary();
+    xTaskCreate(&ena_bluetooth_scan_task, "ena_bluetooth_scan_task", 4096, NULL, 5, &scan_task_handle);
     ESP_ERROR_CHECK(esp_ble_gap_set_scan_params(&ena_scan_params));
     ESP_ERROR_CHECK(esp_ble_gap_register_callback(ena_bluetooth_scan_event_callback));
-    // init temporary beacons
-    ena_beacons_temp_refresh((uint32_t)time(NULL));
 }
 
 void ena_bluetooth_scan_start(uint32_t duration)
@@ -111,3 +203,10 @@ int ena_bluetooth_scan_get_status(void)
 {
     return scan_status;
 }
+
+void ena_bluetooth_scan_get_stats(ena_bluetooth_scan_stats_t *stats)
+{
+    stats->enqueued = scan_stats.enqueued;
+    stats->dropped = scan_stats.dropped;
+    stats->processed = scan_stats.processed;
+}
@@ -11,7 +11,11 @@
 // WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 // See the License for the specific language governing permissions and
 // limitations under the License.
+#include <string.h>
+#include <stdbool.h>
+
 #include "mbedtls/md.h"
+#include "mbedtls/sha256.h"
 #include "mbedtls/aes.h"
 #include "mbedtls/hkdf.h"
 #include "mbedtls/entropy.h"
@@ -22,9 +26,70 @@
 #include "ena-crypto.h"
 
 #define ESP_CRYPTO_LOG "ESP-CRYPTO"
+#define ENA_CRYPTO_SHA256_LENGTH (32)
+#define ENA_CRYPTO_SHA256_BLOCK_SIZE (64)
 
 static mbedtls_ctr_drbg_context ctr_drbg;
 
+static mbedtls_sha256_context hkdf_extract_inner; // HMAC inner state after ipad of the empty salt
+static mbedtls_sha256_context hkdf_extract_outer; // HMAC outer state after opad of the empty salt
+
+// HKDF-Expand info with appended counter byte for the first (and only) output block
+static const uint8_t rpik_info_block[] = {'E', 'N', '-', 'R', 'P', 'I', 'K', 0x01};
+static const uint8_t aemk_info_block[] = {'E', 'N', '-', 'A', 'E', 'M', 'K', 0x01};
+
+// test vectors from the Apple/Google cryptography specification
+static const uint8_t test_tek[ENA_KEY_LENGTH] = {0x75, 0xc7, 0x34, 0xc6, 0xdd, 0x1a, 0x78, 0x2d, 0xe7, 0xa9, 0x65, 0xda, 0x5e, 0xb9, 0x31, 0x25};
+static const uint8_t test_rpik[ENA_KEY_LENGTH] = {0x18, 0x5a, 0xd9, 0x1d, 0xb6, 0x9e, 0xc7, 0xdd, 0x04, 0x89, 0x60, 0xf1, 0xf3, 0xba, 0x61, 0x75};
+static const uint8_t test_aemk[ENA_KEY_LENGTH] = {0xd5, 0x7c, 0x46, 0xaf, 0x7a, 0x1d, 0x83, 0x96, 0x5b, 0x9b, 0xed, 0x8b, 0xd1, 0x52, 0x93, 0x6a};
+
+void ena_crypto_hmac_sha256_setup(const uint8_t *key, size_t key_length, mbedtls_sha256_context *inner, mbedtls_sha256_context *outer)
+{
+    uint8_t pad[ENA_CRYPTO_SHA256_BLOCK_SIZE];
+    mbedtls_sha256_context ctx;
+
+    memset(pad, 0x36, sizeof(pad));
+    for (int i = 0; i < key_length; i++)
+    {
+        pad[i] ^= key[i];
+    }
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts_ret(&ctx, 0);
+    mbedtls_sha256_update_ret(&ctx, pad, sizeof(pad));
+    // clone to keep the state in software, so no hardware SHA engine stays locked
+    mbedtls_sha256_clone(inner, &ctx);
+    mbedtls_sha256_free(&ctx);
+
+    memset(pad, 0x5c, sizeof(pad));
+    for (int i = 0; i < key_length; i++)
+    {
+        pad[i] ^= key[i];
+    }
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts_ret(&ctx, 0);
+    mbedtls_sha256_update_ret(&ctx, pad, sizeof(pad));
+    mbedtls_sha256_clone(outer, &ctx);
+    mbedtls_sha256_free(&ctx);
+}
+
+void ena_crypto_hmac_sha256_finish(const mbedtls_sha256_context *inner, const mbedtls_sha256_context *outer, const uint8_t *data, size_t data_length, uint8_t *mac)
+{
+    uint8_t inner_hash[ENA_CRYPTO_SHA256_LENGTH];
+    mbedtls_sha256_context ctx;
+
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_clone(&ctx, inner);
+    mbedtls_sha256_update_ret(&ctx, data, data_length);
+    mbedtls_sha256_finish_ret(&ctx, inner_hash);
+    mbedtls_sha256_free(&ctx);
+
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_clone(&ctx, outer);
+    mbedtls_sha256_update_ret(&ctx, inner_hash, sizeof(inner_hash));
+    mbedtls_sha256_finish_ret(&ctx, mac);
+    mbedtls_sha256_free(&ctx);
+}
+
 void ena_crypto_init(void)
 {
     mbedtls_entropy_context entropy;
@@ -38,6 +103,19 @@ void ena_crypto_init(void)
     {
         ESP_LOGE(ESP_CRYPTO_LOG, " failed\n ! mbedtls_ctr_drbg_init returned -0x%04x\n", -ret);
     }
+
+    // empty salt is HMAC key of zeros, so extract states never change; set up before any task derives keys
+    mbedtls_sha256_init(&hkdf_extract_inner);
+    mbedtls_sha256_init(&hkdf_extract_outer);
+    ena_crypto_hmac_sha256_setup(NULL, 0, &hkdf_extract_inner, &hkdf_extract_outer);
+
+    uint8_t rpik[ENA_KEY_LENGTH];
+    uint8_t aemk[ENA_KEY_LENGTH];
+    ena_crypto_derive_keys((uint8_t *)test_tek, rpik, aemk);
+    if (memcmp(rpik, test_rpik, ENA_KEY_LENGTH) != 0 || memcmp(aemk, test_aemk, ENA_KEY_LENGTH) != 0)
+    {
+        ESP_LOGE(ESP_CRYPTO_LOG, "key derivation does not match test vectors!");
+    }
 }
 
 uint32_t ena_crypto_enin(uint32_t unix_epoch_time)
@@ -57,40 +135,95 @@ void ena_crypto_tek(uint8_t *tek)
 void ena_crypto_rpik(uint8_t *rpik, uint8_t *tek)
 {
     const uint8_t rpik_info[] = "EN-RPIK";
-    mbedtls_hkdf(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), NULL, 0, tek, ENA_KEY_LENGTH, rpik_info, sizeof(rpik_info), rpik, ENA_KEY_LENGTH);
+    mbedtls_hkdf(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), NULL, 0, tek, ENA_KEY_LENGTH, rpik_info, sizeof(rpik_info) - 1, rpik, ENA_KEY_LENGTH);
+}
+
+void ena_crypto_derive_keys(uint8_t *tek, uint8_t *rpik, uint8_t *aemk)
+{
+    uint8_t prk[ENA_CRYPTO_SHA256_LENGTH];
+    uint8_t okm[ENA_CRYPTO_SHA256_LENGTH];
+    mbedtls_sha256_context expand_inner;
+    mbedtls_sha256_context expand_outer;
+
+    // HKDF-Extract, shared by RPIK and AEMK
+    ena_crypto_hmac_sha256_finish(&hkdf_extract_inner, &hkdf_extract_outer, tek, ENA_KEY_LENGTH, prk);
+
+    // HKDF-Expand, one output block is enough for 16 bytes
+    mbedtls_sha256_init(&expand_inner);
+    mbedtls_sha256_init(&expand_outer);
+    ena_crypto_hmac_sha256_setup(prk, sizeof(prk), &expand_inner, &expand_outer);
+
+    if (rpik != NULL)
+    {
+        ena_crypto_hmac_sha256_finish(&expand_inner, &expand_outer, rpik_info_block, sizeof(rpik_info_block), okm);
+        memcpy(rpik, okm, ENA_KEY_LENGTH);
+    }
+
+    if (aemk != NULL)
+    {
+        ena_crypto_hmac_sha256_finish(&expand_inner, &expand_outer, aemk_info_block, sizeof(aemk_info_block), okm);
+        memcpy(aemk, okm, ENA_KEY_LENGTH);
+    }
+
+    mbedtls_sha256_free(&expand_inner);
+    mbedtls_sha256_free(&expand_outer);
+    memset(prk, 0, sizeof(prk));
+    memset(okm, 0, sizeof(okm));
 }
 
 void ena_crypto_rpi(uint8_t *rpi, uint8_t *rpik, uint32_t enin)
 {
-    uint8_t padded_data[] = "EN-RPI";
-    padded_data[12] = (enin & 0x000000ff);
-    padded_data[13] = (enin & 0x0000ff00) >> 8;
-    padded_data[14] = (enin & 0x00ff0000) >> 16;
-    padded_data[15] = (enin & 0xff000000) >> 24;
+    ena_crypto_rpi_batch(rpik, enin, 1, rpi);
+}
+
+void ena_crypto_rpi_batch(uint8_t *rpik, uint32_t start_enin, size_t count, uint8_t *out)
+{
+    uint8_t padded_data[ENA_KEY_LENGTH] = "EN-RPI";
 
     mbedtls_aes_context aes;
     mbedtls_aes_init(&aes);
     mbedtls_aes_setkey_enc(&aes, rpik, ENA_KEY_LENGTH * 8);
-    mbedtls_aes_crypt_ecb(&aes, MBEDTLS_AES_ENCRYPT, padded_data, rpi);
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t enin = start_enin + i;
+        padded_data[12] = (enin & 0x000000ff);
+        padded_data[13] = (enin & 0x0000ff00) >> 8;
+        padded_data[14] = (enin & 0x00ff0000) >> 16;
+        padded_data[15] = (enin & 0xff000000) >> 24;
+        mbedtls_aes_crypt_ecb(&aes, MBEDTLS_AES_ENCRYPT, padded_data, &out[i * ENA_KEY_LENGTH]);
+    }
     mbedtls_aes_free(&aes);
 }
 
 void ena_crypto_aemk(uint8_t *aemk, uint8_t *tek)
 {
     uint8_t aemkInfo[] = "EN-AEMK";
-    mbedtls_hkdf(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), NULL, 0, tek, ENA_KEY_LENGTH, aemkInfo, sizeof(aemkInfo), aemk, ENA_KEY_LENGTH);
+    mbedtls_hkdf(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), NULL, 0, tek, ENA_KEY_LENGTH, aemkInfo, sizeof(aemkInfo) - 1, aemk, ENA_KEY_LENGTH);
 }
 
 void ena_crypto_aem(uint8_t *aem, uint8_t *aemk, uint8_t *rpi, uint8_t power_level)
 {
-    uint8_t metadata[ENA_AEM_METADATA_LENGTH];
+    ena_crypto_aem_batch(aemk, rpi, 1, power_level, aem);
+}
+
+void ena_crypto_aem_batch(uint8_t *aemk, uint8_t *rpis, size_t count, uint8_t power_level, uint8_t *out)
+{
+    uint8_t metadata[ENA_AEM_METADATA_LENGTH] = {0};
     metadata[0] = 0b01000000;
     metadata[1] = power_level;
-    size_t count = 0;
-    uint8_t sb[16] = {0};
+    uint8_t stream_block[ENA_KEY_LENGTH];
+
     mbedtls_aes_context aes;
     mbedtls_aes_init(&aes);
     mbedtls_aes_setkey_enc(&aes, aemk, ENA_KEY_LENGTH * 8);
-    mbedtls_aes_crypt_ctr(&aes, ENA_AEM_METADATA_LENGTH, &count, rpi, sb, metadata, aem);
+    for (size_t i = 0; i < count; i++)
+    {
+        // AES-CTR with RPI as counter block: the metadata fits into the first key stream block
+        mbedtls_aes_crypt_ecb(&aes, MBEDTLS_AES_ENCRYPT, &rpis[i * ENA_KEY_LENGTH], stream_block);
+        for (int j = 0; j < ENA_AEM_METADATA_LENGTH; j++)
+        {
+            out[i * ENA_AEM_METADATA_LENGTH + j] = metadata[j] ^ stream_block[j];
+        }
+    }
     mbedtls_aes_free(&aes);
 }
\ No newline at end of file
@@ -11,10 +11,13 @@
 // WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 // See the License for the specific language governing permissions and
 // limitations under the License.
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <limits.h>
+#include <stddef.h>
 
+#include "freertos/FreeRTOS.h"
 #include "esp_err.h"
 #include "esp_log.h"
 
@@ -24,8 +27,54 @@
 
 #include "ena-exposure.h"
 
+/**
+ * @brief beacon grouped by ENIN for a batch check
+ */
+typedef struct
+{
+    uint32_t rpi_prefix; // first bytes of the RPI for a fast compare
+    uint16_t offset;     // index of the beacon relative to the first beacon of the window
+    uint16_t bucket;     // ENIN of first recognition relative to the start of the window
+} ena_exposure_bucket_entry_t;
+
+/**
+ * @brief matches of a key and day merged during a batch check
+ */
+typedef struct
+{
+    uint8_t key_data[ENA_KEY_LENGTH];         // TEK of the matches
+    ena_exposure_information_t exposure_info; // merged exposure information
+    int attenuation_sum;                      // sum of the typical attenuations of all matches
+    uint32_t matches;                         // number of merged matches
+} ena_exposure_pending_t;
+
 static ena_exposure_summary_t *current_summary;
 
+static ena_exposure_day_summaries_t summary_days;  // aggregated exposure information, persisted in storage
+static bool summary_days_loaded = false;           // aggregates are read from storage
+static bool summary_days_dirty = false;            // aggregates changed since last persist
+
+static uint32_t check_enin_start = 0;                                // first ENIN of the grouped beacons
+static uint32_t check_enin_count = 0;                                // number of ENINs of the grouped beacons
+static uint32_t check_beacon_start = 0;                              // index of the first beacon of the window
+static uint16_t *check_slots = NULL;                                 // entry index + 1 per slot of the RPI prefix hash, 0 if free
+static uint32_t check_slots_mask = 0;                                // number of slots - 1, a power of two - 1
+static ena_exposure_bucket_entry_t *check_entries = NULL;            // grouped beacons
+static uint8_t check_rpis[ENA_TEK_ROLLING_PERIOD * ENA_KEY_LENGTH];  // RPIs of one rolling period
+static uint32_t check_found[8];                                      // beacon indices found for a RPI
+static ena_beacon_t check_beacons[ENA_STORAGE_CURSOR_BATCH];         // beacons read at once
+static ena_storage_beacons_view_t check_view;                        // mapped beacons of the window, if mapping is possible
+static ena_exposure_pending_t check_pending_fixed[ENA_EXPOSURE_CHECK_PENDING_MAX]; // pending key-days without heap
+static ena_exposure_pending_t *check_pending = check_pending_fixed;  // merged matches not yet stored, on the heap if more than fixed
+static uint32_t check_pending_count = 0;                             // number of used pending key-days
+static uint32_t check_pending_size = ENA_EXPOSURE_CHECK_PENDING_MAX; // number of pending key-days allocated
+static ena_temporary_exposure_key_t *check_keys = NULL;              // keys of a batch check not yet matched, sorted by interval before
+static uint32_t check_keys_size = 0;                                 // number of keys allocated, the keys of the batch
+static uint32_t check_keys_count = 0;                                // number of collected keys
+static uint32_t check_keys_matched = 0;                              // number of collected keys already matched
+static bool check_keys_sorted = true;                                // collected keys not matched yet are sorted
+static bool check_running = false;                                   // batch check started
+
 static ena_exposure_config_t DEFAULT_ENA_EXPOSURE_CONFIG = {
     // transmission_risk_values
     {
@@ -117,41 +166,45 @@ int ena_exposure_duration_risk_score(ena_exposure_config_t *config, ena_exposure
     return config->duration_risk_values[duration_level];
 }
 
-int ena_exposure_days_risk_score(ena_exposure_config_t *config, ena_exposure_parameter_t params)
+int ena_exposure_days_level(int days)
 {
-    // calc days level
     int days_level = DAYS_14;
 
-    if (params.days < 2)
+    if (days < 2)
     {
         days_level = DAYS_0;
     }
-    else if (params.days < 4)
+    else if (days < 4)
     {
         days_level = DAYS_3;
     }
-    else if (params.days < 6)
+    else if (days < 6)
     {
         days_level = DAYS_5;
     }
-    else if (params.days < 8)
+    else if (days < 8)
     {
         days_level = DAYS_7;
     }
-    else if (params.days < 10)
+    else if (days < 10)
     {
         days_level = DAYS_9;
     }
-    else if (params.days < 12)
+    else if (days < 12)
     {
         days_level = DAYS_11;
     }
-    else if (params.days < 14)
+    else if (days < 14)
     {
         days_level = DAYS_13;
     }
 
-    return config->days_risk_values[days_level];
+    return days_level;
+}
+
+int ena_exposure_days_risk_score(ena_exposure_config_t *config, ena_exposure_parameter_t params)
+{
+    return config->days_risk_values[ena_exposure_days_level(params.days)];
 }
 
 int ena_exposure_attenuation_risk_score(ena_exposure_config_t *config, ena_exposure_parameter_t params)
@@ -210,47 +263,246 @@ int ena_exposure_risk_score(ena_exposure_config_t *config, ena_exposure_paramete
     return score;
 }
 
-void ena_exposure_summary(ena_exposure_config_t *config)
+uint32_t ena_exposure_summary_checksum(ena_exposure_day_summaries_t *summaries)
 {
-    uint32_t count = ena_storage_exposure_information_count();
-    uint32_t current_time = (uint32_t)time(NULL);
+    // FNV-1a over all fields but the checksum
+    const uint8_t *data = (const uint8_t *)summaries;
+    uint32_t checksum = 2166136261;
+    for (int i = 0; i < offsetof(ena_exposure_day_summaries_t, checksum); i++)
+    {
+        checksum = (checksum ^ data[i]) * 16777619;
+    }
+    return checksum;
+}
 
-    if (current_summary == NULL)
+void ena_exposure_summary_merge(ena_exposure_day_summary_t *target, ena_exposure_day_summary_t *day_summary)
+{
+    if (day_summary->day > target->day)
     {
-        current_summary = malloc(sizeof(ena_exposure_summary_t));
+        target->day = day_summary->day;
     }
+    target->num_exposures += day_summary->num_exposures;
+    for (int i = 0; i < 8; i++)
+    {
+        if (day_summary->max_risk_score[i] > target->max_risk_score[i])
+        {
+            target->max_risk_score[i] = day_summary->max_risk_score[i];
+        }
+        target->risk_score_sum[i] += day_summary->risk_score_sum[i];
+    }
+    memset(day_summary, 0, sizeof(ena_exposure_day_summary_t));
+}
 
-    current_summary->last_update = ena_storage_read_last_exposure_date();
-    current_summary->days_since_last_exposure = INT_MAX;
-    current_summary->max_risk_score = 0;
-    current_summary->risk_score_sum = 0;
-    current_summary->num_exposures = count;
+ena_exposure_day_summary_t *ena_exposure_summary_day(uint32_t day, uint32_t current_time)
+{
+    // days older than 14 days always have the lowest days risk level
+    if (current_time > day && (current_time - day) / (60 * 60 * 24) >= 14)
+    {
+        return &summary_days.older;
+    }
 
-    if (count == 0)
+    ena_exposure_day_summary_t *free_day = NULL;
+    ena_exposure_day_summary_t *oldest_day = NULL;
+    for (int i = 0; i < ENA_EXPOSURE_SUMMARY_DAYS; i++)
     {
-        current_summary->days_since_last_exposure = -1;
+        ena_exposure_day_summary_t *day_summary = &summary_days.days[i];
+        if (day_summary->num_exposures == 0)
+        {
+            if (free_day == NULL)
+            {
+                free_day = day_summary;
+            }
+        }
+        else if (day_summary->day == day)
+        {
+            return day_summary;
+        }
+        else if (current_time > day_summary->day && (current_time - day_summary->day) / (60 * 60 * 24) >= 14)
+        {
+            // day got older than 14 days
+            ena_exposure_summary_merge(&summary_days.older, day_summary);
+            if (free_day == NULL)
+            {
+                free_day = day_summary;
+            }
+        }
+        else if (oldest_day == NULL || day_summary->day < oldest_day->day)
+        {
+            oldest_day = day_summary;
+        }
     }
 
-    ena_exposure_information_t exposure_info;
+    if (free_day == NULL)
+    {
+        ena_exposure_summary_merge(&summary_days.older, oldest_day);
+        free_day = oldest_day;
+    }
+
+    free_day->day = day;
+    return free_day;
+}
+
+void ena_exposure_summary_apply(ena_exposure_information_t *exposure_info, uint32_t current_time)
+{
+    ena_exposure_day_summary_t *day_summary = ena_exposure_summary_day(exposure_info->day, current_time);
+
     ena_exposure_parameter_t params;
-    for (int i = 0; i < count; i++)
+    params.duration = exposure_info->duration_minutes;
+    params.attenuation = exposure_info->typical_attenuation;
+    params.report_type = exposure_info->report_type;
+    int score = ena_exposure_transmission_risk_score(&summary_days.config, params);
+    score *= ena_exposure_duration_risk_score(&summary_days.config, params);
+    score *= ena_exposure_attenuation_risk_score(&summary_days.config, params);
+
+    // keep score for every days risk level, the level of the day changes over time
+    for (int i = 0; i < 8; i++)
     {
-        ena_storage_get_exposure_information(i, &exposure_info);
-        params.days = (current_time - exposure_info.day) / (60 * 60 * 24); // difference in days
-        if (params.days < current_summary->days_since_last_exposure)
+        int level_score = score * summary_days.config.days_risk_values[i];
+        if (level_score > 255)
+        {
+            level_score = 255;
+        }
+        if (level_score > day_summary->max_risk_score[i])
         {
-            current_summary->days_since_last_exposure = params.days;
+            day_summary->max_risk_score[i] = level_score;
         }
-        params.duration = exposure_info.duration_minutes;
-        params.attenuation = exposure_info.typical_attenuation;
-        params.report_type = exposure_info.report_type;
-        int score = ena_exposure_risk_score(config, params);
-        if (score > current_summary->max_risk_score)
+        day_summary->risk_score_sum[i] += level_score;
+    }
+    day_summary->num_exposures++;
+    summary_days.count++;
+    summary_days_dirty = true;
+}
+
+void ena_exposure_summary_load(ena_exposure_config_t *config)
+{
+    uint32_t count = ena_storage_exposure_information_count();
+    uint32_t current_time = (uint32_t)time(NULL);
+
+    bool valid = true;
+    if (!summary_days_loaded)
+    {
+        ena_storage_read_exposure_summary(&summary_days, sizeof(ena_exposure_day_summaries_t));
+        valid = summary_days.checksum == ena_exposure_summary_checksum(&summary_days);
+        summary_days_loaded = true;
+        summary_days_dirty = false;
+    }
+
+    if (!valid || summary_days.magic != ENA_EXPOSURE_SUMMARY_MAGIC ||
+        memcmp(&summary_days.config, config, sizeof(ena_exposure_config_t)) != 0 ||
+        summary_days.count > count)
+    {
+        ESP_LOGD(ENA_EXPOSURE_LOG, "rebuild exposure summary of %u exposure information", count);
+        memset(&summary_days, 0, sizeof(ena_exposure_day_summaries_t));
+        summary_days.magic = ENA_EXPOSURE_SUMMARY_MAGIC;
+        memcpy(&summary_days.config, config, sizeof(ena_exposure_config_t));
+        summary_days_dirty = true;
+    }
+
+    // exposure information overwritten in the ring before it was aggregated is lost
+    if (count > ENA_STORAGE_EXPOSURE_INFORMATION_SLOTS && summary_days.count < count - ENA_STORAGE_EXPOSURE_INFORMATION_SLOTS)
+    {
+        ESP_LOGW(ENA_EXPOSURE_LOG, "skip %u overwritten exposure information", count - ENA_STORAGE_EXPOSURE_INFORMATION_SLOTS - summary_days.count);
+        summary_days.count = count - ENA_STORAGE_EXPOSURE_INFORMATION_SLOTS;
+    }
+
+    // add exposure information stored since last update
+    ena_exposure_information_t exposure_info;
+    while (summary_days.count < count)
+    {
+        ena_storage_get_exposure_information(summary_days.count, &exposure_info);
+        ena_exposure_summary_apply(&exposure_info, current_time);
+    }
+}
+
+void ena_exposure_summary_persist(void)
+{
+    ena_storage_lock();
+    if (summary_days_loaded && summary_days_dirty)
+    {
+        summary_days.checksum = ena_exposure_summary_checksum(&summary_days);
+        ena_storage_write_exposure_summary(&summary_days, sizeof(ena_exposure_day_summaries_t));
+        summary_days_dirty = false;
+    }
+    ena_storage_unlock();
+}
+
+void ena_exposure_summary_add(ena_exposure_information_t *exposure_info)
+{
+    if (!summary_days_loaded)
+    {
+        // stored exposure information is added on next load
+        return;
+    }
+
+    if (summary_days.count + 1 == ena_storage_exposure_information_count())
+    {
+        ena_exposure_summary_apply(exposure_info, (uint32_t)time(NULL));
+    }
+    else
+    {
+        // aggregates are out of sync, read again on next load
+        summary_days_loaded = false;
+    }
+}
+
+void ena_exposure_summary_day_add(ena_exposure_summary_t *summary, ena_exposure_day_summary_t *day_summary, int level, uint32_t current_time)
+{
+    int days = (current_time - day_summary->day) / (60 * 60 * 24); // difference in days
+    if (days < summary->days_since_last_exposure)
+    {
+        summary->days_since_last_exposure = days;
+    }
+    if (day_summary->max_risk_score[level] > summary->max_risk_score)
+    {
+        summary->max_risk_score = day_summary->max_risk_score[level];
+    }
+    summary->risk_score_sum += day_summary->risk_score_sum[level];
+    summary->num_exposures += day_summary->num_exposures;
+}
+
+void ena_exposure_summary(ena_exposure_config_t *config)
+{
+    uint32_t current_time = (uint32_t)time(NULL);
+
+    // aggregates are updated by the sync task and read by the interface
+    ena_storage_lock();
+    if (current_summary == NULL)
+    {
+        current_summary = malloc(sizeof(ena_exposure_summary_t));
+    }
+
+    ena_exposure_summary_load(config);
+
+    ena_exposure_summary_t summary;
+    summary.last_update = ena_storage_read_last_exposure_date();
+    summary.days_since_last_exposure = INT_MAX;
+    summary.max_risk_score = 0;
+    summary.risk_score_sum = 0;
+    summary.num_exposures = 0;
+
+    for (int i = 0; i < ENA_EXPOSURE_SUMMARY_DAYS; i++)
+    {
+        ena_exposure_day_summary_t *day_summary = &summary_days.days[i];
+        if (day_summary->num_exposures > 0)
         {
-            current_summary->max_risk_score = score;
+            ena_exposure_summary_day_add(&summary, day_summary, ena_exposure_days_level((current_time - day_summary->day) / (60 * 60 * 24)), current_time);
         }
-        current_summary->risk_score_sum += score;
     }
+
+    if (summary_days.older.num_exposures > 0)
+    {
+        ena_exposure_summary_day_add(&summary, &summary_days.older, DAYS_14, current_time);
+    }
+
+    if (summary.num_exposures == 0)
+    {
+        summary.days_since_last_exposure = -1;
+    }
+
+    // readers of the current summary never see a partly computed one
+    memcpy(current_summary, &summary, sizeof(ena_exposure_summary_t));
+    ena_exposure_summary_persist();
+    ena_storage_unlock();
 }
 
 ena_exposure_summary_t *ena_exposure_current_summary(void)
@@ -268,6 +520,90 @@ ena_exposure_config_t *ena_exposure_default_config(void)
     return &DEFAULT_ENA_EXPOSURE_CONFIG;
 }
 
+void ena_exposure_check_store_pending(void)
+{
+    // record and aggregate together, the summary compares its count with the stored one
+    ena_storage_lock();
+    for (uint32_t i = 0; i < check_pending_count; i++)
+    {
+        ena_exposure_information_t *exposure_info = &check_pending[i].exposure_info;
+        exposure_info->typical_attenuation = check_pending[i].attenuation_sum / (int)check_pending[i].matches;
+        ESP_LOGD(ENA_EXPOSURE_LOG, "exposure on day %u of %u matches", exposure_info->day, check_pending[i].matches);
+        ena_storage_add_exposure_information(exposure_info);
+        ena_exposure_summary_add(exposure_info);
+    }
+    check_pending_count = 0;
+    ena_storage_unlock();
+
+    if (check_pending != check_pending_fixed)
+    {
+        free(check_pending);
+        check_pending = check_pending_fixed;
+        check_pending_size = ENA_EXPOSURE_CHECK_PENDING_MAX;
+    }
+}
+
+bool ena_exposure_check_grow_pending(void)
+{
+    uint32_t size = check_pending_size + ENA_EXPOSURE_CHECK_PENDING_MAX;
+    ena_exposure_pending_t *pending = malloc(size * sizeof(ena_exposure_pending_t));
+    if (pending == NULL)
+    {
+        ESP_LOGW(ENA_EXPOSURE_LOG, "failed to allocate memory for %u pending key-days, memory: %d kB", size, (xPortGetFreeHeapSize() / 1024));
+        return false;
+    }
+    memcpy(pending, check_pending, check_pending_count * sizeof(ena_exposure_pending_t));
+    if (check_pending != check_pending_fixed)
+    {
+        free(check_pending);
+    }
+    check_pending = pending;
+    check_pending_size = size;
+    return true;
+}
+
+void ena_exposure_check_collect(uint8_t *key_data, ena_exposure_information_t *exposure_info)
+{
+    ena_exposure_pending_t *pending = NULL;
+    for (uint32_t i = 0; i < check_pending_count; i++)
+    {
+        if (check_pending[i].exposure_info.day == exposure_info->day && memcmp(check_pending[i].key_data, key_data, ENA_KEY_LENGTH) == 0)
+        {
+            pending = &check_pending[i];
+            break;
+        }
+    }
+
+    if (pending == NULL)
+    {
+        // stored only at the end of the batch, a key-day matched again later in the batch has to find its pending one
+        if (check_pending_count == check_pending_size && !ena_exposure_check_grow_pending())
+        {
+            ena_exposure_check_store_pending();
+        }
+        pending = &check_pending[check_pending_count++];
+        memcpy(pending->key_data, key_data, ENA_KEY_LENGTH);
+        memcpy(&pending->exposure_info, exposure_info, sizeof(ena_exposure_information_t));
+        pending->attenuation_sum = exposure_info->typical_attenuation;
+        pending->matches = 1;
+    }
+    else
+    {
+        pending->exposure_info.duration_minutes += exposure_info->duration_minutes;
+        if (exposure_info->min_attenuation < pending->exposure_info.min_attenuation)
+        {
+            pending->exposure_info.min_attenuation = exposure_info->min_attenuation;
+        }
+        pending->attenuation_sum += exposure_info->typical_attenuation;
+        pending->matches++;
+    }
+
+    if (!check_running)
+    {
+        ena_exposure_check_store_pending();
+    }
+}
+
 void ena_exposure_check(ena_beacon_t beacon, ena_temporary_exposure_key_t temporary_exposure_key)
 {
     uint32_t timestamp_day_start = temporary_exposure_key.rolling_start_interval_number * ENA_TIME_WINDOW;
@@ -282,28 +618,35 @@ void ena_exposure_check(ena_beacon_t beacon, ena_temporary_exposure_key_t tempor
         exposure_info.min_attenuation = INT_MAX;
         exposure_info.typical_attenuation = 0;
         exposure_info.report_type = temporary_exposure_key.report_type;
-        uint8_t rpi[ENA_KEY_LENGTH];
         uint8_t rpik[ENA_KEY_LENGTH];
-        ena_crypto_rpik(rpik, temporary_exposure_key.key_data);
+        ena_crypto_derive_keys(temporary_exposure_key.key_data, rpik, NULL);
 
-        for (int i = 0; i < temporary_exposure_key.rolling_period; i++)
+        for (int i = 0; i < temporary_exposure_key.rolling_period; i += ENA_TEK_ROLLING_PERIOD)
         {
-            ena_crypto_rpi(rpi, rpik, temporary_exposure_key.rolling_start_interval_number + i);
-            if (memcmp(beacon.rpi, rpi, sizeof(ENA_KEY_LENGTH)) == 0)
+            int rpi_count = temporary_exposure_key.rolling_period - i;
+            if (rpi_count > ENA_TEK_ROLLING_PERIOD)
             {
-                match = true;
-                exposure_info.duration_minutes += ((beacon.timestamp_last - beacon.timestamp_first) / 60);
-                exposure_info.typical_attenuation = (exposure_info.typical_attenuation + beacon.rssi) / 2;
-                if (beacon.rssi < exposure_info.min_attenuation)
+                rpi_count = ENA_TEK_ROLLING_PERIOD;
+            }
+            ena_crypto_rpi_batch(rpik, temporary_exposure_key.rolling_start_interval_number + i, rpi_count, check_rpis);
+            for (int j = 0; j < rpi_count; j++)
+            {
+                if (memcmp(beacon.rpi, &check_rpis[j * ENA_KEY_LENGTH], ENA_KEY_LENGTH) == 0)
                 {
-                    exposure_info.min_attenuation = beacon.rssi;
+                    match = true;
+                    exposure_info.duration_minutes += ((beacon.timestamp_last - beacon.timestamp_first) / 60);
+                    exposure_info.typical_attenuation = (exposure_info.typical_attenuation + beacon.rssi) / 2;
+                    if (beacon.rssi < exposure_info.min_attenuation)
+                    {
+                        exposure_info.min_attenuation = beacon.rssi;
+                    }
                 }
             }
         }
 
         if (match)
         {
-            ena_storage_add_exposure_information(&exposure_info);
+            ena_exposure_check_collect(temporary_exposure_key.key_data, &exposure_info);
         }
     }
 }
@@ -380,20 +723,470 @@ int ena_expore_check_find_max(uint32_t timestamp)
 
 void ena_exposure_check_temporary_exposure_key(ena_temporary_exposure_key_t temporary_exposure_key)
 {
-    uint32_t timestamp_start = temporary_exposure_key.rolling_start_interval_number * ENA_TIME_WINDOW;
-    uint32_t timestamp_end = (temporary_exposure_key.rolling_start_interval_number + temporary_exposure_key.rolling_period) * ENA_TIME_WINDOW;
+    ena_exposure_check_start(1);
+    ena_exposure_check_key(&temporary_exposure_key);
+    ena_exposure_check_finish();
+}
 
-    int min = ena_expore_check_find_min(timestamp_start);
-    int max = ena_expore_check_find_max(timestamp_end);
-    if (min == -1 || max == -1)
+uint32_t ena_exposure_find_beacon_index(uint32_t timestamp, uint32_t count)
+{
+    uint32_t min = 0;
+    uint32_t max = count;
+    ena_beacon_t beacon;
+    // first beacon with timestamp_first not before timestamp
+    while (min < max)
     {
-        return;
+        uint32_t mid = min + (max - min) / 2;
+        ena_storage_get_beacon(mid, &beacon);
+        if (beacon.timestamp_first < timestamp)
+        {
+            min = mid + 1;
+        }
+        else
+        {
+            max = mid;
+        }
+    }
+    return min;
+}
+
+void ena_exposure_add_match(const ena_beacon_t *beacon, ena_temporary_exposure_key_t *temporary_exposure_key)
+{
+    ena_exposure_information_t exposure_info;
+    exposure_info.day = temporary_exposure_key->rolling_start_interval_number * ENA_TIME_WINDOW;
+    exposure_info.duration_minutes = ((beacon->timestamp_last - beacon->timestamp_first) / 60);
+    exposure_info.typical_attenuation = beacon->rssi;
+    exposure_info.min_attenuation = beacon->rssi;
+    exposure_info.report_type = temporary_exposure_key->report_type;
+    ESP_LOGD(ENA_EXPOSURE_LOG, "exposure with beacon at %u", beacon->timestamp_first);
+    ena_exposure_check_collect(temporary_exposure_key->key_data, &exposure_info);
+}
+
+void ena_exposure_check_free_window(void)
+{
+    ena_storage_beacons_view_close(&check_view);
+    free(check_slots);
+    free(check_entries);
+    check_slots = NULL;
+    check_slots_mask = 0;
+    check_entries = NULL;
+    check_enin_start = 0;
+    check_enin_count = 0;
+}
+
+uint32_t ena_exposure_check_slot(uint32_t rpi_prefix)
+{
+    // multiplicative hash, so equal low bits of crafted RPIs do not share slots
+    return (rpi_prefix * 2654435761u >> 16) & check_slots_mask;
+}
+
+const ena_beacon_t *ena_exposure_check_get_beacon(uint32_t index, ena_beacon_t *beacon)
+{
+    if (check_view.beacons != NULL && index >= check_view.start && index - check_view.start < check_view.count)
+    {
+        return &check_view.beacons[index - check_view.start];
+    }
+    ena_storage_get_beacon(index, beacon);
+    return beacon;
+}
+
+uint32_t ena_exposure_check_group(const ena_beacon_t *beacons, uint32_t count, uint32_t offset, uint32_t entries)
+{
+    for (uint32_t i = 0; i < count; i++, offset++)
+    {
+        uint32_t enin = ena_crypto_enin(beacons[i].timestamp_first);
+        if (enin >= check_enin_start && enin < check_enin_start + check_enin_count)
+        {
+            memcpy(&check_entries[entries].rpi_prefix, beacons[i].rpi, sizeof(uint32_t));
+            check_entries[entries].offset = offset;
+            check_entries[entries].bucket = enin - check_enin_start;
+            uint32_t slot = ena_exposure_check_slot(check_entries[entries].rpi_prefix);
+            while (check_slots[slot] != 0)
+            {
+                slot = (slot + 1) & check_slots_mask;
+            }
+            check_slots[slot] = ++entries;
+        }
+    }
+    return entries;
+}
+
+void ena_exposure_find_window(uint32_t enin_start, uint32_t enin_count, uint32_t *min, uint32_t *max)
+{
+    // beacons are stored in order of last recognition, so first recognitions are only sorted within the slack
+    uint32_t count = ena_storage_beacons_count();
+    uint32_t timestamp_start = enin_start * ENA_TIME_WINDOW;
+    uint32_t timestamp_end = (enin_start + enin_count) * ENA_TIME_WINDOW;
+    *min = ena_exposure_find_beacon_index(timestamp_start > ENA_EXPOSURE_CHECK_ORDER_SLACK ? timestamp_start - ENA_EXPOSURE_CHECK_ORDER_SLACK : 0, count);
+    *max = ena_exposure_find_beacon_index(timestamp_end + ENA_EXPOSURE_CHECK_ORDER_SLACK, count);
+}
+
+esp_err_t ena_exposure_check_load_window(uint32_t enin_start, uint32_t enin_count)
+{
+    ena_exposure_check_free_window();
+
+    uint32_t min, max;
+    ena_exposure_find_window(enin_start, enin_count, &min, &max);
+
+    if (max - min > UINT16_MAX)
+    {
+        ESP_LOGW(ENA_EXPOSURE_LOG, "too many beacons (%u) to group for [%u,%u]", (max - min), enin_start, enin_start + enin_count);
+        return ESP_ERR_NO_MEM;
+    }
+
+    // at most three quarters of the slots are used, so probe sequences stay short
+    uint32_t slots = 1;
+    while (slots < (max - min + 1) + (max - min + 1) / 3)
+    {
+        slots <<= 1;
+    }
+    check_slots = calloc(slots, sizeof(uint16_t));
+    check_slots_mask = slots - 1;
+    check_entries = malloc(sizeof(ena_exposure_bucket_entry_t) * (max - min + 1));
+    if (check_slots == NULL || check_entries == NULL)
+    {
+        ESP_LOGW(ENA_EXPOSURE_LOG, "failed to allocate memory for %u beacons, memory: %d kB", (max - min), (xPortGetFreeHeapSize() / 1024));
+        ena_exposure_check_free_window();
+        return ESP_ERR_NO_MEM;
+    }
+
+    check_enin_start = enin_start;
+    check_enin_count = enin_count;
+    check_beacon_start = min;
+
+    uint32_t entries = 0;
+    if (max > min && ena_storage_beacons_view_open(&check_view, min, max) == ESP_OK)
+    {
+        // zero-copy scan of mapped beacons
+        entries = ena_exposure_check_group(check_view.beacons, check_view.count, 0, entries);
+    }
+    else
+    {
+        uint32_t offset = 0;
+        uint32_t read = 0;
+        ena_storage_beacon_cursor_t cursor;
+        ena_storage_beacon_cursor_open(&cursor, min, max);
+        while ((read = ena_storage_beacon_cursor_next_batch(&cursor, check_beacons, ENA_STORAGE_CURSOR_BATCH)) > 0)
+        {
+            entries = ena_exposure_check_group(check_beacons, read, offset, entries);
+            offset += read;
+        }
+    }
+
+
+    ESP_LOGD(ENA_EXPOSURE_LOG, "grouped %u beacons [%u,%u] for ENIN [%u,%u]", entries, min, max, enin_start, enin_start + enin_count);
+    return ESP_OK;
+}
+
+void ena_exposure_check_key_indexed(ena_temporary_exposure_key_t *temporary_exposure_key)
+{
+    uint8_t rpik[ENA_KEY_LENGTH];
+    ena_beacon_t beacon;
+    ena_crypto_derive_keys(temporary_exposure_key->key_data, rpik, NULL);
+    ena_crypto_rpi_batch(rpik, temporary_exposure_key->rolling_start_interval_number, temporary_exposure_key->rolling_period, check_rpis);
+
+    for (uint32_t j = 0; j < temporary_exposure_key->rolling_period; j++)
+    {
+        uint32_t enin = temporary_exposure_key->rolling_start_interval_number + j;
+        uint32_t *found_indices = check_found;
+        uint32_t found = ena_storage_find_beacons(&check_rpis[j * ENA_KEY_LENGTH], check_found, sizeof(check_found) / sizeof(uint32_t));
+        if (found > sizeof(check_found) / sizeof(uint32_t))
+        {
+            // RPI seen more often than fit, find all of them again
+            found_indices = malloc(found * sizeof(uint32_t));
+            if (found_indices == NULL)
+            {
+                ESP_LOGW(ENA_EXPOSURE_LOG, "failed to allocate memory for %u beacons, memory: %d kB", found, (xPortGetFreeHeapSize() / 1024));
+                found_indices = check_found;
+                found = sizeof(check_found) / sizeof(uint32_t);
+            }
+            else
+            {
+                uint32_t size = found;
+                found = ena_storage_find_beacons(&check_rpis[j * ENA_KEY_LENGTH], found_indices, size);
+                found = found < size ? found : size;
+            }
+        }
+        for (uint32_t f = 0; f < found; f++)
+        {
+            ena_storage_get_beacon(found_indices[f], &beacon);
+            uint32_t beacon_enin = ena_crypto_enin(beacon.timestamp_first);
+            if (beacon_enin + ENA_EXPOSURE_CHECK_ENIN_SKEW >= enin && beacon_enin <= enin + ENA_EXPOSURE_CHECK_ENIN_SKEW)
+            {
+                ena_exposure_add_match(&beacon, temporary_exposure_key);
+            }
+        }
+        if (found_indices != check_found)
+        {
+            free(found_indices);
+        }
+    }
+}
+
+bool ena_exposure_check_fingerprint(const ena_beacon_t *beacon, uint8_t *aemk)
+{
+    // decrypted AEM version must be major version 1 without reserved bits, stored AEM is truncated
+    uint8_t aem[ENA_AEM_METADATA_LENGTH];
+    ena_crypto_aem(aem, aemk, (uint8_t *)beacon->rpi, 0);
+    return ((aem[0] ^ beacon->aem[0]) & ENA_EXPOSURE_CHECK_AEM_VERSION_MASK) == 0;
+}
+
+void ena_exposure_check_key_columns(ena_temporary_exposure_key_t *temporary_exposure_key)
+{
+    uint8_t rpik[ENA_KEY_LENGTH];
+    uint8_t aemk[ENA_KEY_LENGTH];
+    ena_crypto_derive_keys(temporary_exposure_key->key_data, rpik, ENA_STORAGE_BEACON_FINGERPRINT ? aemk : NULL);
+    ena_crypto_rpi_batch(rpik, temporary_exposure_key->rolling_start_interval_number, temporary_exposure_key->rolling_period, check_rpis);
+
+    ena_beacon_t *found_beacons = check_beacons;
+    uint32_t found = ena_storage_match_beacons(check_rpis, temporary_exposure_key->rolling_start_interval_number, temporary_exposure_key->rolling_period, ENA_EXPOSURE_CHECK_ENIN_SKEW, check_beacons, ENA_STORAGE_CURSOR_BATCH);
+    if (found > ENA_STORAGE_CURSOR_BATCH)
+    {
+        // more matches than fit (or fingerprint collisions), match all of them again
+        found_beacons = malloc(found * sizeof(ena_beacon_t));
+        if (found_beacons == NULL)
+        {
+            ESP_LOGW(ENA_EXPOSURE_LOG, "failed to allocate memory for %u beacons, memory: %d kB", found, (xPortGetFreeHeapSize() / 1024));
+            found_beacons = check_beacons;
+            found = ENA_STORAGE_CURSOR_BATCH;
+        }
+        else
+        {
+            uint32_t size = found;
+            found = ena_storage_match_beacons(check_rpis, temporary_exposure_key->rolling_start_interval_number, temporary_exposure_key->rolling_period, ENA_EXPOSURE_CHECK_ENIN_SKEW, found_beacons, size);
+            found = found < size ? found : size;
+        }
+    }
+    for (uint32_t f = 0; f < found; f++)
+    {
+        if (ENA_STORAGE_BEACON_FINGERPRINT && !ena_exposure_check_fingerprint(&found_beacons[f], aemk))
+        {
+            ESP_LOGD(ENA_EXPOSURE_LOG, "rejected fingerprint match at %u", found_beacons[f].timestamp_first);
+            continue;
+        }
+        ena_exposure_add_match(&found_beacons[f], temporary_exposure_key);
+    }
+    if (found_beacons != check_beacons)
+    {
+        free(found_beacons);
+    }
+}
+
+void ena_exposure_check_scan(const ena_beacon_t *beacons, uint32_t count, ena_temporary_exposure_key_t *key)
+{
+    // same window and skew as the grouped check, with the RPIs of the key derived before
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t beacon_enin = ena_crypto_enin(beacons[i].timestamp_first);
+        if (beacon_enin + ENA_EXPOSURE_CHECK_ENIN_SKEW < key->rolling_start_interval_number)
+        {
+            continue;
+        }
+        // only RPIs of intervals within the skew of the beacon
+        uint32_t j_min = beacon_enin > key->rolling_start_interval_number + ENA_EXPOSURE_CHECK_ENIN_SKEW ? beacon_enin - ENA_EXPOSURE_CHECK_ENIN_SKEW - key->rolling_start_interval_number : 0;
+        uint32_t j_end = beacon_enin + ENA_EXPOSURE_CHECK_ENIN_SKEW + 1 - key->rolling_start_interval_number;
+        if (j_end > key->rolling_period)
+        {
+            j_end = key->rolling_period;
+        }
+        for (uint32_t j = j_min; j < j_end; j++)
+        {
+            if (memcmp(beacons[i].rpi, &check_rpis[j * ENA_KEY_LENGTH], ENA_KEY_LENGTH) == 0)
+            {
+                ena_exposure_add_match(&beacons[i], key);
+                break;
+            }
+        }
     }
+}
+
+void ena_exposure_check_key_grouped(ena_temporary_exposure_key_t *temporary_exposure_key)
+{
+    ena_temporary_exposure_key_t key = *temporary_exposure_key;
+    uint32_t enin_start = key.rolling_start_interval_number - ENA_EXPOSURE_CHECK_ENIN_SKEW;
+    uint32_t enin_count = key.rolling_period + 2 * ENA_EXPOSURE_CHECK_ENIN_SKEW;
 
+    uint8_t rpik[ENA_KEY_LENGTH];
+    uint8_t *rpi;
+    uint32_t rpi_prefix;
     ena_beacon_t beacon;
-    for (int y = min; y <= max; y++)
+    ena_crypto_derive_keys(key.key_data, rpik, NULL);
+    ena_crypto_rpi_batch(rpik, key.rolling_start_interval_number, key.rolling_period, check_rpis);
+
+    if (check_slots == NULL || enin_start < check_enin_start || enin_start + enin_count > check_enin_start + check_enin_count)
+    {
+        // whole days, so following keys of the same day use the grouped beacons again
+        uint32_t day_start = key.rolling_start_interval_number - key.rolling_start_interval_number % ENA_TEK_ROLLING_PERIOD;
+        uint32_t day_end = key.rolling_start_interval_number + key.rolling_period;
+        day_end += (ENA_TEK_ROLLING_PERIOD - day_end % ENA_TEK_ROLLING_PERIOD) % ENA_TEK_ROLLING_PERIOD;
+        if (day_start < ENA_EXPOSURE_CHECK_ENIN_SKEW)
+        {
+            day_start = key.rolling_start_interval_number;
+        }
+        if (ena_exposure_check_load_window(day_start - ENA_EXPOSURE_CHECK_ENIN_SKEW, day_end - day_start + 2 * ENA_EXPOSURE_CHECK_ENIN_SKEW) != ESP_OK)
+        {
+            // fallback to stream the window of the key through its RPIs, same matches without grouping memory
+            uint32_t min, max;
+            ena_exposure_find_window(enin_start, enin_count, &min, &max);
+            if (max > min && ena_storage_beacons_view_open(&check_view, min, max) == ESP_OK)
+            {
+                ena_exposure_check_scan(check_view.beacons, check_view.count, &key);
+                ena_storage_beacons_view_close(&check_view);
+                return;
+            }
+            uint32_t read = 0;
+            ena_storage_beacon_cursor_t cursor;
+            ena_storage_beacon_cursor_open(&cursor, min, max);
+            while ((read = ena_storage_beacon_cursor_next_batch(&cursor, check_beacons, ENA_STORAGE_CURSOR_BATCH)) > 0)
+            {
+                ena_exposure_check_scan(check_beacons, read, &key);
+            }
+            return;
+        }
+    }
+
+    for (uint32_t j = 0; j < key.rolling_period; j++)
+    {
+        uint32_t enin = key.rolling_start_interval_number + j;
+        rpi = &check_rpis[j * ENA_KEY_LENGTH];
+        memcpy(&rpi_prefix, rpi, sizeof(uint32_t));
+
+        // only entries with the same prefix are probed, whatever the number of beacons per ENIN
+        uint32_t bucket_start = enin - ENA_EXPOSURE_CHECK_ENIN_SKEW - check_enin_start;
+        for (uint32_t slot = ena_exposure_check_slot(rpi_prefix); check_slots[slot] != 0; slot = (slot + 1) & check_slots_mask)
+        {
+            ena_exposure_bucket_entry_t *entry = &check_entries[check_slots[slot] - 1];
+            if (entry->rpi_prefix == rpi_prefix && entry->bucket >= bucket_start && entry->bucket <= bucket_start + 2 * ENA_EXPOSURE_CHECK_ENIN_SKEW)
+            {
+                const ena_beacon_t *candidate = ena_exposure_check_get_beacon(check_beacon_start + entry->offset, &beacon);
+                if (memcmp(candidate->rpi, rpi, ENA_KEY_LENGTH) == 0)
+                {
+                    ena_exposure_add_match(candidate, &key);
+                }
+            }
+        }
+    }
+}
+
+int ena_exposure_check_key_compare(const void *a, const void *b)
+{
+    uint32_t enin_a = ((const ena_temporary_exposure_key_t *)a)->rolling_start_interval_number;
+    uint32_t enin_b = ((const ena_temporary_exposure_key_t *)b)->rolling_start_interval_number;
+    return (enin_a > enin_b) - (enin_a < enin_b);
+}
+
+uint32_t ena_exposure_check_match(uint32_t keys)
+{
+    if (!check_keys_sorted)
+    {
+        // keys of a day one after another, its beacons are only grouped once
+        qsort(&check_keys[check_keys_matched], check_keys_count - check_keys_matched, sizeof(ena_temporary_exposure_key_t), ena_exposure_check_key_compare);
+        check_keys_sorted = true;
+    }
+    for (; keys > 0 && check_keys_matched < check_keys_count; keys--)
+    {
+        ena_exposure_check_key_grouped(&check_keys[check_keys_matched++]);
+    }
+    if (check_keys_matched == check_keys_count)
+    {
+        check_keys_count = 0;
+        check_keys_matched = 0;
+    }
+    return check_keys_count - check_keys_matched;
+}
+
+void ena_exposure_check_start(uint32_t keys)
+{
+    ena_exposure_check_match(UINT32_MAX);
+    ena_exposure_check_free_window();
+    ena_exposure_check_store_pending();
+    if (!check_running)
+    {
+        // window, cursors and views keep beacon indices until the batch finishes
+        ena_storage_beacons_hold();
+    }
+    if (check_keys != NULL && check_keys_size < keys)
+    {
+        free(check_keys);
+        check_keys = NULL;
+        check_keys_size = 0;
+    }
+    if (check_keys == NULL && keys > 0 && !ENA_STORAGE_BEACON_INDEX && !ENA_STORAGE_BEACON_COLUMNS)
+    {
+        check_keys = malloc(keys * sizeof(ena_temporary_exposure_key_t));
+        if (check_keys == NULL)
+        {
+            ESP_LOGW(ENA_EXPOSURE_LOG, "failed to allocate memory for %u keys, check unsorted, memory: %d kB", keys, (xPortGetFreeHeapSize() / 1024));
+        }
+        else
+        {
+            check_keys_size = keys;
+        }
+    }
+    check_running = true;
+}
+
+void ena_exposure_check_key(ena_temporary_exposure_key_t *temporary_exposure_key)
+{
+    // keys come from the key server, an invalid interval must not reach the window and bucket arithmetic
+    if (temporary_exposure_key->rolling_period == 0 ||
+        temporary_exposure_key->rolling_start_interval_number < ENA_EXPOSURE_CHECK_ENIN_SKEW ||
+        temporary_exposure_key->rolling_start_interval_number > UINT32_MAX / ENA_TIME_WINDOW - 2 * ENA_TEK_ROLLING_PERIOD - ENA_EXPOSURE_CHECK_ENIN_SKEW)
+    {
+        ESP_LOGW(ENA_EXPOSURE_LOG, "skip key with invalid interval %u, period %u", temporary_exposure_key->rolling_start_interval_number, temporary_exposure_key->rolling_period);
+        return;
+    }
+
+    ena_temporary_exposure_key_t key = *temporary_exposure_key;
+    if (key.rolling_period > ENA_TEK_ROLLING_PERIOD)
+    {
+        key.rolling_period = ENA_TEK_ROLLING_PERIOD;
+    }
+
+    if (ENA_STORAGE_BEACON_INDEX)
+    {
+        ena_exposure_check_key_indexed(&key);
+        return;
+    }
+
+    if (ENA_STORAGE_BEACON_COLUMNS)
+    {
+        ena_exposure_check_key_columns(&key);
+        return;
+    }
+
+    if (check_keys_count == check_keys_size)
+    {
+        // without memory or beyond the keys of the batch, matched right away so a call stays one key of work
+        ena_exposure_check_key_grouped(&key);
+        return;
+    }
+    check_keys[check_keys_count++] = key;
+    check_keys_sorted = false;
+}
+
+void ena_exposure_check_finish(void)
+{
+    ena_exposure_check_match(UINT32_MAX);
+    free(check_keys);
+    check_keys = NULL;
+    check_keys_size = 0;
+    ena_exposure_check_free_window();
+    ena_exposure_check_store_pending();
+    if (check_running)
+    {
+        ena_storage_beacons_release();
+    }
+    check_running = false;
+    ena_exposure_summary_persist();
+}
+
+void ena_exposure_check_temporary_exposure_keys(ena_temporary_exposure_key_t *temporary_exposure_keys, size_t count)
+{
+    ena_exposure_check_start(count);
+    for (int i = 0; i < count; i++)
     {
-        ena_storage_get_beacon(y, &beacon);
-        ena_exposure_check(beacon, temporary_exposure_key);
+        ena_exposure_check_key(&temporary_exposure_keys[i]);
     }
+    ena_exposure_check_finish();
 }
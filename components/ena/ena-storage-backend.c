@@ -0,0 +1,407 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "ena-storage.h"
+
+#include "ena-storage-backend.h"
+
+#ifdef ESP_PLATFORM
+#include "esp_partition.h"
+#include "esp_spi_flash.h"
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#define ENA_STORAGE_BACKEND_LOG "ESP-ENA-storage-backend" // TAG for Logging
+
+static const ena_storage_backend_t *storage_backend = NULL;
+static ena_storage_backend_t default_backend;
+static ena_storage_backend_stats_t backend_stats;
+
+typedef struct
+{
+    FILE *file;
+    uint8_t *map;
+    size_t size;
+} ena_storage_backend_file_t;
+
+void ena_storage_backend_set(const ena_storage_backend_t *backend)
+{
+    storage_backend = backend;
+    if (backend->block_size > ENA_STORAGE_BACKEND_BLOCK_SIZE || ENA_STORAGE_BACKEND_BLOCK_SIZE % backend->block_size != 0)
+    {
+        ESP_LOGW(ENA_STORAGE_BACKEND_LOG, "block size %u of %s does not fit storage block size %u", backend->block_size, backend->name, ENA_STORAGE_BACKEND_BLOCK_SIZE);
+    }
+    ESP_LOGI(ENA_STORAGE_BACKEND_LOG, "use backend %s (%u bytes, block size %u)", backend->name, backend->size, backend->block_size);
+}
+
+const ena_storage_backend_t *ena_storage_backend_get(void)
+{
+    if (storage_backend == NULL)
+    {
+        ESP_ERROR_CHECK(ena_storage_backend_partition_init(&default_backend, ENA_STORAGE_PARTITION_NAME));
+        ena_storage_backend_set(&default_backend);
+    }
+    return storage_backend;
+}
+
+esp_err_t ena_storage_backend_read(size_t address, void *data, size_t size)
+{
+    const ena_storage_backend_t *backend = ena_storage_backend_get();
+    backend_stats.reads++;
+    backend_stats.bytes_read += size;
+    return backend->read(backend->context, address, data, size);
+}
+
+esp_err_t ena_storage_backend_write(size_t address, const void *data, size_t size)
+{
+    const ena_storage_backend_t *backend = ena_storage_backend_get();
+    backend_stats.writes++;
+    backend_stats.bytes_written += size;
+    return backend->write(backend->context, address, data, size);
+}
+
+esp_err_t ena_storage_backend_erase(size_t address, size_t size)
+{
+    const ena_storage_backend_t *backend = ena_storage_backend_get();
+    if (address % backend->block_size != 0 || size % backend->block_size != 0)
+    {
+        ESP_LOGW(ENA_STORAGE_BACKEND_LOG, "unaligned erase of %u bytes at %u", size, address);
+        return ESP_ERR_INVALID_ARG;
+    }
+    backend_stats.erases += size / backend->block_size;
+    return backend->erase(backend->context, address, size);
+}
+
+esp_err_t ena_storage_backend_mmap(size_t address, size_t size, const void **data, uint32_t *handle)
+{
+    const ena_storage_backend_t *backend = ena_storage_backend_get();
+    if (backend->mmap == NULL)
+    {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    return backend->mmap(backend->context, address, size, data, handle);
+}
+
+void ena_storage_backend_munmap(uint32_t handle)
+{
+    const ena_storage_backend_t *backend = ena_storage_backend_get();
+    if (backend->munmap != NULL)
+    {
+        backend->munmap(backend->context, handle);
+    }
+}
+
+size_t ena_storage_backend_size(void)
+{
+    return ena_storage_backend_get()->size;
+}
+
+size_t ena_storage_backend_block_size(void)
+{
+    return ena_storage_backend_get()->block_size;
+}
+
+void ena_storage_backend_get_stats(ena_storage_backend_stats_t *stats)
+{
+    memcpy(stats, &backend_stats, sizeof(ena_storage_backend_stats_t));
+}
+
+void ena_storage_backend_reset_stats(void)
+{
+    memset(&backend_stats, 0, sizeof(ena_storage_backend_stats_t));
+}
+
+#ifdef ESP_PLATFORM
+esp_err_t ena_storage_backend_partition_read(void *context, size_t address, void *data, size_t size)
+{
+    return esp_partition_read(context, address, data, size);
+}
+
+esp_err_t ena_storage_backend_partition_write(void *context, size_t address, const void *data, size_t size)
+{
+    return esp_partition_write(context, address, data, size);
+}
+
+esp_err_t ena_storage_backend_partition_erase(void *context, size_t address, size_t size)
+{
+    return esp_partition_erase_range(context, address, size);
+}
+
+esp_err_t ena_storage_backend_partition_mmap(void *context, size_t address, size_t size, const void **data, uint32_t *handle)
+{
+    spi_flash_mmap_handle_t mmap_handle;
+    esp_err_t err = esp_partition_mmap(context, address, size, SPI_FLASH_MMAP_DATA, data, &mmap_handle);
+    *handle = mmap_handle;
+    return err;
+}
+
+void ena_storage_backend_partition_munmap(void *context, uint32_t handle)
+{
+    spi_flash_munmap(handle);
+}
+#endif
+
+esp_err_t ena_storage_backend_partition_init(ena_storage_backend_t *backend, const char *label)
+{
+#ifdef ESP_PLATFORM
+    const esp_partition_t *partition = esp_partition_find_first(
+        ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (partition == NULL)
+    {
+        ESP_LOGE(ENA_STORAGE_BACKEND_LOG, "partition %s not found", label);
+        return ESP_ERR_NOT_FOUND;
+    }
+    memset(backend, 0, sizeof(ena_storage_backend_t));
+    backend->name = partition->label;
+    backend->context = (void *)partition;
+    backend->size = partition->size;
+    backend->block_size = SPI_FLASH_SEC_SIZE;
+    backend->read = &ena_storage_backend_partition_read;
+    backend->write = &ena_storage_backend_partition_write;
+    backend->erase = &ena_storage_backend_partition_erase;
+    backend->mmap = &ena_storage_backend_partition_mmap;
+    backend->munmap = &ena_storage_backend_partition_munmap;
+    return ESP_OK;
+#else
+    ESP_LOGE(ENA_STORAGE_BACKEND_LOG, "no flash partitions on host");
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t ena_storage_backend_file_check(ena_storage_backend_file_t *file, size_t address, size_t size)
+{
+    if (address + size > file->size || address + size < address)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ESP_OK;
+}
+
+esp_err_t ena_storage_backend_file_read(void *context, size_t address, void *data, size_t size)
+{
+    ena_storage_backend_file_t *file = context;
+    if (ena_storage_backend_file_check(file, address, size) != ESP_OK)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (file->map != NULL)
+    {
+        memcpy(data, &file->map[address], size);
+        return ESP_OK;
+    }
+    if (fseek(file->file, address, SEEK_SET) != 0 || fread(data, 1, size, file->file) != size)
+    {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t ena_storage_backend_file_write(void *context, size_t address, const void *data, size_t size)
+{
+    ena_storage_backend_file_t *file = context;
+    if (ena_storage_backend_file_check(file, address, size) != ESP_OK)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    const uint8_t *bytes = data;
+    if (file->map != NULL)
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            file->map[address + i] &= bytes[i];
+        }
+        return ESP_OK;
+    }
+    // NOR flash can only clear bits, so combine with current content
+    uint8_t buffer[64];
+    while (size > 0)
+    {
+        size_t chunk = size < sizeof(buffer) ? size : sizeof(buffer);
+        if (fseek(file->file, address, SEEK_SET) != 0 || fread(buffer, 1, chunk, file->file) != chunk)
+        {
+            return ESP_FAIL;
+        }
+        for (size_t i = 0; i < chunk; i++)
+        {
+            buffer[i] &= bytes[i];
+        }
+        if (fseek(file->file, address, SEEK_SET) != 0 || fwrite(buffer, 1, chunk, file->file) != chunk)
+        {
+            return ESP_FAIL;
+        }
+        address += chunk;
+        bytes += chunk;
+        size -= chunk;
+    }
+    return ESP_OK;
+}
+
+esp_err_t ena_storage_backend_file_erase(void *context, size_t address, size_t size)
+{
+    ena_storage_backend_file_t *file = context;
+    if (ena_storage_backend_file_check(file, address, size) != ESP_OK)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (file->map != NULL)
+    {
+        memset(&file->map[address], 0xFF, size);
+        return ESP_OK;
+    }
+    uint8_t buffer[ENA_STORAGE_BACKEND_BLOCK_SIZE];
+    memset(buffer, 0xFF, sizeof(buffer));
+    if (fseek(file->file, address, SEEK_SET) != 0)
+    {
+        return ESP_FAIL;
+    }
+    for (size_t i = 0; i < size; i += sizeof(buffer))
+    {
+        if (fwrite(buffer, 1, sizeof(buffer), file->file) != sizeof(buffer))
+        {
+            return ESP_FAIL;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t ena_storage_backend_file_mmap(void *context, size_t address, size_t size, const void **data, uint32_t *handle)
+{
+    ena_storage_backend_file_t *file = context;
+    if (ena_storage_backend_file_check(file, address, size) != ESP_OK)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    *data = &file->map[address];
+    *handle = 0;
+    return ESP_OK;
+}
+
+void ena_storage_backend_file_munmap(void *context, uint32_t handle)
+{
+    // mapping lives as long as the backend
+}
+
+esp_err_t ena_storage_backend_file_open(ena_storage_backend_t *backend, const char *path, size_t size, ena_storage_backend_file_t **file)
+{
+    if (size == 0 || size % ENA_STORAGE_BACKEND_BLOCK_SIZE != 0)
+    {
+        ESP_LOGE(ENA_STORAGE_BACKEND_LOG, "invalid image size %u", size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    *file = calloc(1, sizeof(ena_storage_backend_file_t));
+    if (*file == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    (*file)->size = size;
+    (*file)->file = fopen(path, "r+b");
+    if ((*file)->file == NULL)
+    {
+        (*file)->file = fopen(path, "w+b");
+    }
+    if ((*file)->file == NULL)
+    {
+        ESP_LOGE(ENA_STORAGE_BACKEND_LOG, "cannot open %s", path);
+        free(*file);
+        return ESP_FAIL;
+    }
+    // extend image with erased blocks
+    fseek((*file)->file, 0, SEEK_END);
+    long current = ftell((*file)->file);
+    if (current < 0 || (size_t)current < size)
+    {
+        uint8_t buffer[ENA_STORAGE_BACKEND_BLOCK_SIZE];
+        memset(buffer, 0xFF, sizeof(buffer));
+        size_t position = current < 0 ? 0 : current;
+        while (position < size)
+        {
+            size_t chunk = size - position < sizeof(buffer) ? size - position : sizeof(buffer);
+            fwrite(buffer, 1, chunk, (*file)->file);
+            position += chunk;
+        }
+        fflush((*file)->file);
+    }
+
+    memset(backend, 0, sizeof(ena_storage_backend_t));
+    backend->name = path;
+    backend->context = *file;
+    backend->size = size;
+    backend->block_size = ENA_STORAGE_BACKEND_BLOCK_SIZE;
+    backend->read = &ena_storage_backend_file_read;
+    backend->write = &ena_storage_backend_file_write;
+    backend->erase = &ena_storage_backend_file_erase;
+    return ESP_OK;
+}
+
+esp_err_t ena_storage_backend_file_init(ena_storage_backend_t *backend, const char *path, size_t size)
+{
+    ena_storage_backend_file_t *file;
+    return ena_storage_backend_file_open(backend, path, size, &file);
+}
+
+esp_err_t ena_storage_backend_mmap_init(ena_storage_backend_t *backend, const char *path, size_t size)
+{
+#ifdef ESP_PLATFORM
+    ESP_LOGE(ENA_STORAGE_BACKEND_LOG, "mmap backend only available on host");
+    return ESP_ERR_NOT_SUPPORTED;
+#else
+    ena_storage_backend_file_t *file;
+    esp_err_t err = ena_storage_backend_file_open(backend, path, size, &file);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    file->map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fileno(file->file), 0);
+    if (file->map == MAP_FAILED)
+    {
+        ESP_LOGE(ENA_STORAGE_BACKEND_LOG, "cannot map %s", path);
+        file->map = NULL;
+        ena_storage_backend_deinit(backend);
+        return ESP_FAIL;
+    }
+    backend->mmap = &ena_storage_backend_file_mmap;
+    backend->munmap = &ena_storage_backend_file_munmap;
+    return ESP_OK;
+#endif
+}
+
+void ena_storage_backend_deinit(ena_storage_backend_t *backend)
+{
+    if (backend->read != &ena_storage_backend_file_read)
+    {
+        return;
+    }
+    ena_storage_backend_file_t *file = backend->context;
+#ifndef ESP_PLATFORM
+    if (file->map != NULL)
+    {
+        munmap(file->map, file->size);
+    }
+#endif
+    fclose(file->file);
+    free(file);
+    backend->context = NULL;
+    if (storage_backend == backend)
+    {
+        storage_backend = NULL;
+    }
+}
\ No newline at end of file
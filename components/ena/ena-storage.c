@@ -12,16 +12,66 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 #include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
-#include "esp_partition.h"
 
 #include "ena-storage.h"
 #include "ena-crypto.h"
+#include "ena-storage-backend.h"
 
 #define BLOCK_SIZE (4096)
 
+#define ENA_STORAGE_BEACON_INDEX_MAGIC (0x31494e45)  // "ENI1", marks a complete index
+#define ENA_STORAGE_BEACON_INDEX_EMPTY (0xFFFFFFFF)  // erased slot
+#define ENA_STORAGE_BEACON_INDEX_DELETED (0x00000000) // cleared slot, cannot be reused until erase
+#define ENA_STORAGE_BEACON_INDEX_POSITION_BITS (17)  // bits of a slot for the beacon index, remaining bits are RPI tag
+#define ENA_STORAGE_BEACON_INDEX_PROBE (8)           // slots read with one flash access
+#define ENA_STORAGE_BEACON_INDEX_SIZE (BLOCK_SIZE + ENA_STORAGE_BEACON_INDEX_SLOTS * sizeof(uint32_t))
+#define ENA_STORAGE_BEACON_INDEX_STATES ((BLOCK_SIZE - 2 * sizeof(uint32_t)) / (2 * sizeof(uint32_t))) // state entries (base, deleted) after the magic
+#define ENA_STORAGE_BEACON_INDEX_USED_MAX (ENA_STORAGE_BEACON_INDEX_SLOTS / 4 * 3)                      // live and deleted slots before the index is rebuilt
+
+#define ENA_STORAGE_BEACON_LOG_MAGIC (0x314c4e45) // "ENL1", marks an opened segment
+#define ENA_STORAGE_BEACON_LOG_FREE (0xFFFF)      // segment state: erased
+#define ENA_STORAGE_BEACON_LOG_DIRTY (0xFFFE)     // segment state: no valid segment, erase before use
+
+#define ENA_STORAGE_BEACON_COLUMNS_SLACK (3600) // first timestamps of a segment may be this much before its first record
+#define ENA_STORAGE_BEACON_COLUMNS_MAGIC (0x32434e45) // "ENC2", marks an opened columnar segment with a Bloom filter sized by its records
+#define ENA_STORAGE_BEACON_COLUMNS_FILTER_BITS (10)   // bits of the Bloom filter per record, about 1% false positives
+#define ENA_STORAGE_BEACON_COLUMNS_HASHES (7)         // bits set per RPI in the Bloom filter, optimal for 10 bits per record
+#define ENA_STORAGE_BEACON_COLUMNS_FILTER_SIZE ((ENA_STORAGE_BEACON_LOG_RECORDS * ENA_STORAGE_BEACON_COLUMNS_FILTER_BITS + 7) / 8)
+#define ENA_STORAGE_BEACON_COLUMNS_START (sizeof(ena_storage_segment_header_t) + sizeof(ena_storage_segment_columns_t) + ENA_STORAGE_BEACON_COLUMNS_FILTER_SIZE)
+#define ENA_STORAGE_BEACON_COLUMN_RPI_SIZE (ENA_STORAGE_BEACON_FINGERPRINT_SIZE)
+#define ENA_STORAGE_BEACON_COLUMN_AEM_SIZE (ENA_STORAGE_BEACON_FINGERPRINT_AEM_SIZE)
+// columns as offset per record: RPI, AEM, first timestamp offset, last timestamp offset, RSSI
+#define ENA_STORAGE_BEACON_COLUMN_RPI (0)
+#define ENA_STORAGE_BEACON_COLUMN_AEM (ENA_STORAGE_BEACON_COLUMN_RPI + ENA_STORAGE_BEACON_COLUMN_RPI_SIZE)
+#define ENA_STORAGE_BEACON_COLUMN_FIRST (ENA_STORAGE_BEACON_COLUMN_AEM + ENA_STORAGE_BEACON_COLUMN_AEM_SIZE)
+#define ENA_STORAGE_BEACON_COLUMN_LAST (ENA_STORAGE_BEACON_COLUMN_FIRST + sizeof(uint16_t))
+#define ENA_STORAGE_BEACON_COLUMN_RSSI (ENA_STORAGE_BEACON_COLUMN_LAST + sizeof(uint16_t))
+#define ENA_STORAGE_BEACON_COLUMNS_RECORD_SIZE (ENA_STORAGE_BEACON_COLUMN_RSSI + sizeof(int8_t))
+
+// columnar segments share the space after the headers between records and their filter bits
+#define ENA_STORAGE_BEACON_LOG_RECORDS (ENA_STORAGE_BEACON_COLUMNS                                                                                                  \
+                                            ? (BLOCK_SIZE - sizeof(ena_storage_segment_header_t) - sizeof(ena_storage_segment_columns_t)) * 8 /                   \
+                                                  (ENA_STORAGE_BEACON_COLUMNS_RECORD_SIZE * 8 + ENA_STORAGE_BEACON_COLUMNS_FILTER_BITS)                           \
+                                            : (BLOCK_SIZE - sizeof(ena_storage_segment_header_t)) / sizeof(ena_beacon_t))
+#define ENA_STORAGE_BEACON_LOG_SEGMENT_MAGIC (ENA_STORAGE_BEACON_COLUMNS ? ENA_STORAGE_BEACON_COLUMNS_MAGIC : ENA_STORAGE_BEACON_LOG_MAGIC)
+
+#define ENA_STORAGE_COUNTER_JOURNAL_MAGIC (0x314a4e45)                                        // "ENJ1", marks a complete journal block
+#define ENA_STORAGE_COUNTER_JOURNAL_SLOTS (BLOCK_SIZE / sizeof(ena_storage_counter_slot_t)) // slots per journal block, first holds the header
+#define ENA_STORAGE_COUNTER_SCRATCH_NONE (0xFFFFFFFF)                                         // scratch block holds no block
+#define ENA_STORAGE_COUNTER_SCRATCH_JOURNAL (0x00000001)                                      // flag of the held block address: copy is in the next journal block
+
+#define ENA_STORAGE_SYNC_CHECKPOINT_MAGIC (0x31534e45)                                                   // "ENS1", marks a complete checkpoint block
+#define ENA_STORAGE_SYNC_CHECKPOINT_SLOTS (BLOCK_SIZE / sizeof(ena_storage_sync_checkpoint_slot_t)) // slots per checkpoint block, first holds the header
+
+#define ENA_STORAGE_KEY_DIGEST_MAGIC (0x314b4e45)                                                                      // "ENK1", marks a used key digest block
+#define ENA_STORAGE_KEY_DIGEST_SLOTS ((BLOCK_SIZE - sizeof(ena_storage_key_digest_header_t)) / sizeof(uint64_t)) // digests per block
+
 const int ENA_STORAGE_LAST_EXPOSURE_DATE_ADDRESS = (ENA_STORAGE_START_ADDRESS);
 const int ENA_STORAGE_TEK_COUNT_ADDRESS = (ENA_STORAGE_LAST_EXPOSURE_DATE_ADDRESS + sizeof(uint32_t));
 const int ENA_STORAGE_TEK_START_ADDRESS = (ENA_STORAGE_TEK_COUNT_ADDRESS + sizeof(uint32_t));
@@ -32,42 +82,711 @@ const int ENA_STORAGE_TEMP_BEACONS_START_ADDRESS = (ENA_STORAGE_TEMP_BEACONS_COU
 const int ENA_STORAGE_BEACONS_COUNT_ADDRESS = (ENA_STORAGE_TEMP_BEACONS_START_ADDRESS + sizeof(ena_beacon_t) * ENA_STORAGE_TEMP_BEACONS_MAX);
 const int ENA_STORAGE_BEACONS_START_ADDRESS = (ENA_STORAGE_BEACONS_COUNT_ADDRESS + sizeof(uint32_t));
 
+static int beacon_index_state = -1;       // -1 not checked, 0 invalid, 1 valid
+static uint32_t beacon_index_base = 0;    // record number of the first beacon, slots hold record numbers
+static uint32_t beacon_index_deleted = 0; // deleted slots since last rebuild
+static uint32_t beacon_index_states = 0;  // written state entries in the index header
+
+static bool beacons_mounted = false; // flat beacons checked for the layout without exposure summary block
+
+static bool beacon_log_mounted = false;
+static uint32_t beacon_log_segments = 0;    // number of segments in beacon area
+static uint16_t *beacon_log_written = NULL; // written records per segment or segment state
+static uint16_t *beacon_log_live = NULL;    // not deleted records per segment
+static uint16_t *beacon_log_order = NULL;   // used segments from tail (oldest) to head (newest)
+static uint32_t beacon_log_used = 0;        // number of used segments
+static uint32_t beacon_log_sequence = 0;    // sequence number for next opened segment
+static uint32_t beacon_log_count = 0;       // number of stored beacons
+static uint32_t beacon_log_erases = 0;      // erased segments since boot
+static uint32_t *beacon_log_range = NULL;   // columnar storage: timestamp base and latest first timestamp per segment
+
+static bool counters_mounted = false;
+static uint32_t counters_value[ENA_STORAGE_COUNTERS];      // RAM mirror of journaled counters
+static uint32_t counters_slot[ENA_STORAGE_COUNTERS];       // latest slot of counter in current journal block, 0 for none
+static uint32_t counters_increments[ENA_STORAGE_COUNTERS]; // cleared increment bits in latest slot of counter
+static uint32_t counters_block = 0;                        // current journal block
+static uint32_t counters_sequence = 0;                     // sequence number of current journal block
+static uint32_t counters_next = 0;                         // next free slot in current journal block, 0 without valid block
+static uint32_t counters_erases = 0;                       // erased journal blocks since boot
+static bool counters_scratch_journal = false;              // next copy of a rewritten block goes to the next journal block
+static uint32_t counters_pending = 0;                      // bit mask of counters waiting for their cached records
+static uint32_t counters_update[ENA_STORAGE_COUNTERS];     // value of pending counter, journaled on next flush
+
+static bool checkpoint_mounted = false;
+static uint8_t checkpoint_data[ENA_STORAGE_SYNC_CHECKPOINT_SIZE]; // RAM mirror of the latest checkpoint
+static uint32_t checkpoint_block = 0;                             // current checkpoint block
+static uint32_t checkpoint_sequence = 0;                          // sequence number of current checkpoint block
+static uint32_t checkpoint_next = 0;                              // next free slot in current checkpoint block, 0 without valid block
+
+static bool key_digests_mounted = false;
+static uint32_t key_digests_day[ENA_STORAGE_KEY_DIGEST_BLOCKS];  // day of digests per block, 0 for an erased block
+static uint16_t key_digests_used[ENA_STORAGE_KEY_DIGEST_BLOCKS]; // used slots per block
+
+static size_t cache_address[ENA_STORAGE_WRITE_CACHE_BLOCKS]; // start address of cached block
+static uint8_t *cache_data[ENA_STORAGE_WRITE_CACHE_BLOCKS];  // data of cached block, NULL for unused entry
+static bool cache_dirty[ENA_STORAGE_WRITE_CACHE_BLOCKS];     // cached block differs from flash
+static uint32_t cache_used[ENA_STORAGE_WRITE_CACHE_BLOCKS];  // last use of entry for eviction
+static uint32_t cache_clock = 0;                             // counter for last use
+
+static SemaphoreHandle_t storage_lock = NULL; // recursive, taken by functions used from several tasks
+static uint32_t beacons_held = 0;             // holders of beacon indices, expiry waits for them
+static uint32_t beacons_expire_pending = 0;   // timestamp of an expiry requested while beacons were held
+
+void ena_storage_lock(void)
+{
+    // created on first access in ena_start, before any other task uses the storage
+    if (storage_lock == NULL)
+    {
+        storage_lock = xSemaphoreCreateRecursiveMutex();
+    }
+    xSemaphoreTakeRecursive(storage_lock, portMAX_DELAY);
+}
+
+void ena_storage_unlock(void)
+{
+    xSemaphoreGiveRecursive(storage_lock);
+}
+
+void ena_storage_yield(void)
+{
+    static TickType_t last_yield = 0;
+    if ((xTaskGetTickCount() - last_yield) >= pdMS_TO_TICKS(ENA_STORAGE_YIELD_BUDGET))
+    {
+        vTaskDelay(1);
+        last_yield = xTaskGetTickCount();
+    }
+}
+
+int ena_storage_cache_find(size_t block_start)
+{
+    for (int entry = 0; entry < ENA_STORAGE_WRITE_CACHE_BLOCKS; entry++)
+    {
+        if (cache_data[entry] != NULL && cache_address[entry] == block_start)
+        {
+            return entry;
+        }
+    }
+    return -1;
+}
+
+bool ena_storage_cache_dirty(size_t start, size_t end)
+{
+    for (int entry = 0; entry < ENA_STORAGE_WRITE_CACHE_BLOCKS; entry++)
+    {
+        if (cache_data[entry] != NULL && cache_dirty[entry] && cache_address[entry] < end && cache_address[entry] + BLOCK_SIZE > start)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ena_storage_cache_read(size_t address, void *data, size_t size)
+{
+    if (!ENA_STORAGE_WRITE_CACHE)
+    {
+        ESP_ERROR_CHECK(ena_storage_backend_read(address, data, size));
+        return;
+    }
+    // cached blocks may not be flushed yet
+    while (size > 0)
+    {
+        size_t block_start = (address / BLOCK_SIZE) * BLOCK_SIZE;
+        size_t part = block_start + BLOCK_SIZE - address;
+        if (part > size)
+        {
+            part = size;
+        }
+        int entry = ena_storage_cache_find(block_start);
+        if (entry >= 0)
+        {
+            memcpy(data, cache_data[entry] + (address - block_start), part);
+        }
+        else
+        {
+            ESP_ERROR_CHECK(ena_storage_backend_read(address, data, part));
+        }
+        address += part;
+        data += part;
+        size -= part;
+    }
+}
+
 void ena_storage_read(size_t address, void *data, size_t size)
 {
-    const esp_partition_t *partition = esp_partition_find_first(
-        ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, ENA_STORAGE_PARTITION_NAME);
-    assert(partition);
-    ESP_ERROR_CHECK(esp_partition_read(partition, address, data, size));
-    vTaskDelay(1);
+    ena_storage_lock();
+    ena_storage_cache_read(address, data, size);
+    ena_storage_yield();
     ESP_LOGD(ENA_STORAGE_LOG, "read data at %u", address);
     ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, data, size, ESP_LOG_DEBUG);
+    ena_storage_unlock();
+}
+
+size_t ena_storage_counters_address(void)
+{
+    size_t end = ena_storage_backend_size();
+    if (ENA_STORAGE_BEACON_INDEX)
+    {
+        end -= ENA_STORAGE_BEACON_INDEX_SIZE;
+    }
+    // journal blocks followed by scratch block
+    return (end / BLOCK_SIZE - ENA_STORAGE_COUNTER_JOURNAL_BLOCKS - 1) * BLOCK_SIZE;
+}
+
+size_t ena_storage_counters_scratch_address(void)
+{
+    return ena_storage_counters_address() + ENA_STORAGE_COUNTER_JOURNAL_BLOCKS * BLOCK_SIZE;
+}
+
+size_t ena_storage_counters_scratch_block(uint32_t scratch)
+{
+    if (scratch & ENA_STORAGE_COUNTER_SCRATCH_JOURNAL)
+    {
+        return ena_storage_counters_address() + ((counters_block + 1) % ENA_STORAGE_COUNTER_JOURNAL_BLOCKS) * BLOCK_SIZE;
+    }
+    return ena_storage_counters_scratch_address();
+}
+
+size_t ena_storage_beacon_index_address(void)
+{
+    return ((ena_storage_backend_size() - ENA_STORAGE_BEACON_INDEX_SIZE) / BLOCK_SIZE) * BLOCK_SIZE;
+}
+
+size_t ena_storage_exposure_summary_address(void)
+{
+    size_t end = ena_storage_backend_size();
+    if (ENA_STORAGE_COUNTER_JOURNAL)
+    {
+        end = ena_storage_counters_address();
+    }
+    else if (ENA_STORAGE_BEACON_INDEX)
+    {
+        end = ena_storage_beacon_index_address();
+    }
+    return (end / BLOCK_SIZE - 1) * BLOCK_SIZE;
+}
+
+size_t ena_storage_sync_checkpoint_address(void)
+{
+    return ena_storage_exposure_summary_address() - ENA_STORAGE_SYNC_CHECKPOINT_BLOCKS * BLOCK_SIZE;
+}
+
+size_t ena_storage_key_digests_address(void)
+{
+    if (!ENA_STORAGE_KEY_DIGESTS)
+    {
+        return ena_storage_sync_checkpoint_address();
+    }
+    return ena_storage_sync_checkpoint_address() - ENA_STORAGE_KEY_DIGEST_BLOCKS * BLOCK_SIZE;
+}
+
+size_t ena_storage_beacons_end_address(void)
+{
+    return ena_storage_key_digests_address();
+}
+
+size_t ena_storage_counter_address(ena_storage_counter_t counter)
+{
+    switch (counter)
+    {
+    case ENA_STORAGE_COUNTER_TEK:
+        return ENA_STORAGE_TEK_COUNT_ADDRESS;
+    case ENA_STORAGE_COUNTER_EXPOSURE_INFORMATION:
+        return ENA_STORAGE_EXPOSURE_INFORMATION_COUNT_ADDRESS;
+    case ENA_STORAGE_COUNTER_TEMP_BEACONS:
+        return ENA_STORAGE_TEMP_BEACONS_COUNT_ADDRESS;
+    case ENA_STORAGE_COUNTER_BEACONS_HEAD:
+        // last word of the beacon area
+        return ena_storage_beacons_end_address() - sizeof(uint32_t);
+    default:
+        return ENA_STORAGE_BEACONS_COUNT_ADDRESS;
+    }
+}
+
+bool ena_storage_counter_records_dirty(ena_storage_counter_t counter)
+{
+    switch (counter)
+    {
+    case ENA_STORAGE_COUNTER_TEK:
+        return ena_storage_cache_dirty(ENA_STORAGE_TEK_START_ADDRESS, ENA_STORAGE_EXPOSURE_INFORMATION_COUNT_ADDRESS);
+    case ENA_STORAGE_COUNTER_EXPOSURE_INFORMATION:
+        return ena_storage_cache_dirty(ENA_STORAGE_EXPOSURE_INFORMATION_START_ADDRESS, ENA_STORAGE_TEMP_BEACONS_COUNT_ADDRESS);
+    case ENA_STORAGE_COUNTER_TEMP_BEACONS:
+        return ena_storage_cache_dirty(ENA_STORAGE_TEMP_BEACONS_START_ADDRESS, ENA_STORAGE_BEACONS_COUNT_ADDRESS);
+    case ENA_STORAGE_COUNTER_SCRATCH:
+        return false;
+    default:
+        return ena_storage_cache_dirty(ENA_STORAGE_BEACONS_START_ADDRESS, ena_storage_beacons_end_address());
+    }
+}
+
+bool ena_storage_erased(const void *data, size_t size)
+{
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < size; i++)
+    {
+        if (bytes[i] != 0xFF)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t ena_storage_crc32(uint32_t crc, const void *data, size_t size)
+{
+    // bitwise CRC-32 (IEEE 802.3), slots are only checked on mount
+    const uint8_t *bytes = data;
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+    {
+        crc ^= bytes[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+uint32_t ena_storage_counter_check(const ena_storage_counter_slot_t *slot, uint32_t sequence, uint32_t index)
+{
+    // sequence and slot number bind the slot to its position, increments are written later
+    uint32_t crc = ena_storage_crc32(0, &slot->value, sizeof(uint32_t));
+    crc = ena_storage_crc32(crc, &slot->counter, sizeof(uint8_t));
+    crc = ena_storage_crc32(crc, &sequence, sizeof(uint32_t));
+    return ena_storage_crc32(crc, &index, sizeof(uint32_t));
+}
+
+void ena_storage_counters_replay(uint32_t block, ena_storage_counter_slot_t *slots)
+{
+    counters_block = block;
+    counters_sequence = ((ena_storage_counter_header_t *)slots)->sequence;
+    counters_next = 1;
+    memset(counters_slot, 0, sizeof(counters_slot));
+    for (uint32_t i = 1; i < ENA_STORAGE_COUNTER_JOURNAL_SLOTS; i++)
+    {
+        if (ena_storage_erased(&slots[i], sizeof(ena_storage_counter_slot_t)))
+        {
+            continue;
+        }
+        // slots after an interrupted write are still appended behind it
+        counters_next = i + 1;
+        if (slots[i].counter >= ENA_STORAGE_COUNTERS || slots[i].check != ena_storage_counter_check(&slots[i], counters_sequence, i))
+        {
+            ESP_LOGW(ENA_STORAGE_LOG, "skip invalid counter slot %u in journal block %u", i, block);
+            continue;
+        }
+        counters_slot[slots[i].counter] = i;
+        counters_increments[slots[i].counter] = 16 - __builtin_popcount(slots[i].increments);
+        counters_value[slots[i].counter] = slots[i].value + counters_increments[slots[i].counter];
+    }
+}
+
+void ena_storage_counters_rotate(void)
+{
+    uint32_t block = 0;
+    uint32_t sequence = 0;
+    if (counters_next > 0)
+    {
+        block = (counters_block + 1) % ENA_STORAGE_COUNTER_JOURNAL_BLOCKS;
+        sequence = counters_sequence + 1;
+    }
+    size_t address = ena_storage_counters_address() + block * BLOCK_SIZE;
+    ESP_ERROR_CHECK(ena_storage_backend_erase(address, BLOCK_SIZE));
+    counters_erases++;
+
+    // snapshot before header, so an interrupted rotation keeps the previous block
+    ena_storage_counter_slot_t slots[ENA_STORAGE_COUNTERS];
+    for (uint32_t counter = 0; counter < ENA_STORAGE_COUNTERS; counter++)
+    {
+        slots[counter].value = counters_value[counter];
+        slots[counter].counter = counter;
+        slots[counter].reserved = 0xFF;
+        slots[counter].increments = 0xFFFF;
+        slots[counter].check = ena_storage_counter_check(&slots[counter], sequence, 1 + counter);
+        counters_slot[counter] = 1 + counter;
+        counters_increments[counter] = 0;
+    }
+    ESP_ERROR_CHECK(ena_storage_backend_write(address + sizeof(ena_storage_counter_slot_t), slots, sizeof(slots)));
+    ena_storage_counter_header_t header = {
+        .magic = ENA_STORAGE_COUNTER_JOURNAL_MAGIC,
+        .sequence = sequence,
+    };
+    ESP_ERROR_CHECK(ena_storage_backend_write(address, &header, sizeof(ena_storage_counter_header_t)));
+
+    counters_block = block;
+    counters_sequence = sequence;
+    counters_next = 1 + ENA_STORAGE_COUNTERS;
+    ESP_LOGD(ENA_STORAGE_LOG, "rotated counter journal to block %u, sequence %u (%u erases)", block, sequence, counters_erases);
+}
+
+void ena_storage_counters_append(ena_storage_counter_t counter, uint32_t value)
+{
+    counters_value[counter] = value;
+    if (counters_next == 0 || counters_next >= ENA_STORAGE_COUNTER_JOURNAL_SLOTS)
+    {
+        // snapshot of new block contains value
+        ena_storage_counters_rotate();
+        return;
+    }
+    ena_storage_counter_slot_t slot = {
+        .value = value,
+        .counter = counter,
+        .reserved = 0xFF,
+        .increments = 0xFFFF,
+    };
+    slot.check = ena_storage_counter_check(&slot, counters_sequence, counters_next);
+    size_t address = ena_storage_counters_address() + counters_block * BLOCK_SIZE + counters_next * sizeof(ena_storage_counter_slot_t);
+    ESP_ERROR_CHECK(ena_storage_backend_write(address, &slot, sizeof(ena_storage_counter_slot_t)));
+    counters_slot[counter] = counters_next++;
+    counters_increments[counter] = 0;
+}
+
+void ena_storage_counters_mount(void)
+{
+    if (counters_mounted)
+    {
+        return;
+    }
+
+    ena_storage_counter_slot_t *slots = malloc(BLOCK_SIZE);
+    if (slots == NULL)
+    {
+        ESP_LOGE(ENA_STORAGE_LOG, "Warning %s malloc low memory", "counter journal");
+        return;
+    }
+
+    memset(counters_value, 0, sizeof(counters_value));
+    counters_value[ENA_STORAGE_COUNTER_SCRATCH] = ENA_STORAGE_COUNTER_SCRATCH_NONE;
+    counters_pending = 0;
+    counters_next = 0;
+
+    // replay valid blocks from oldest to newest, every block starts with a snapshot of all counters
+    uint32_t sequences[ENA_STORAGE_COUNTER_JOURNAL_BLOCKS];
+    bool valid[ENA_STORAGE_COUNTER_JOURNAL_BLOCKS];
+    for (uint32_t block = 0; block < ENA_STORAGE_COUNTER_JOURNAL_BLOCKS; block++)
+    {
+        ena_storage_counter_header_t header;
+        ESP_ERROR_CHECK(ena_storage_backend_read(ena_storage_counters_address() + block * BLOCK_SIZE, &header, sizeof(ena_storage_counter_header_t)));
+        valid[block] = header.magic == ENA_STORAGE_COUNTER_JOURNAL_MAGIC;
+        sequences[block] = header.sequence;
+    }
+    while (true)
+    {
+        int oldest = -1;
+        for (uint32_t block = 0; block < ENA_STORAGE_COUNTER_JOURNAL_BLOCKS; block++)
+        {
+            if (valid[block] && (oldest < 0 || sequences[block] < sequences[oldest]))
+            {
+                oldest = block;
+            }
+        }
+        if (oldest < 0)
+        {
+            break;
+        }
+        ESP_ERROR_CHECK(ena_storage_backend_read(ena_storage_counters_address() + oldest * BLOCK_SIZE, slots, BLOCK_SIZE));
+        ena_storage_counters_replay(oldest, slots);
+        valid[oldest] = false;
+    }
+    counters_mounted = true;
+
+    // finish an interrupted block rewrite
+    uint32_t scratch = counters_value[ENA_STORAGE_COUNTER_SCRATCH];
+    if (scratch != ENA_STORAGE_COUNTER_SCRATCH_NONE)
+    {
+        size_t address = scratch & ~ENA_STORAGE_COUNTER_SCRATCH_JOURNAL;
+        ESP_ERROR_CHECK(ena_storage_backend_read(ena_storage_counters_scratch_block(scratch), slots, BLOCK_SIZE));
+        ESP_ERROR_CHECK(ena_storage_backend_erase(address, BLOCK_SIZE));
+        ESP_ERROR_CHECK(ena_storage_backend_write(address, slots, BLOCK_SIZE));
+        ena_storage_counters_append(ENA_STORAGE_COUNTER_SCRATCH, ENA_STORAGE_COUNTER_SCRATCH_NONE);
+        ESP_LOGW(ENA_STORAGE_LOG, "restored interrupted rewrite of block at %u", address);
+    }
+    free(slots);
+
+    ESP_LOGI(ENA_STORAGE_LOG, "mounted counter journal: block %u, sequence %u, %u slots used", counters_block, counters_sequence, counters_next);
+}
+
+uint32_t ena_storage_counter_get(ena_storage_counter_t counter)
+{
+    ena_storage_lock();
+    uint32_t value = 0;
+    if (!ENA_STORAGE_COUNTER_JOURNAL)
+    {
+        ena_storage_read(ena_storage_counter_address(counter), &value, sizeof(uint32_t));
+        ena_storage_unlock();
+        return value;
+    }
+    ena_storage_counters_mount();
+    value = counters_pending & (1 << counter) ? counters_update[counter] : counters_value[counter];
+    ena_storage_unlock();
+    return value;
+}
+
+void ena_storage_counter_set(ena_storage_counter_t counter, uint32_t value)
+{
+    ena_storage_lock();
+    if (!ENA_STORAGE_COUNTER_JOURNAL)
+    {
+        ena_storage_write(ena_storage_counter_address(counter), &value, sizeof(uint32_t));
+        ena_storage_unlock();
+        return;
+    }
+    ena_storage_counters_mount();
+    if (value > 0 && ena_storage_counter_records_dirty(counter))
+    {
+        // counted records have to be in flash before the counter, journaled after the next flush wrote them
+        counters_update[counter] = value;
+        counters_pending |= 1 << counter;
+        ena_storage_unlock();
+        return;
+    }
+    counters_pending &= ~(1 << counter);
+    if (value == counters_value[counter])
+    {
+        ena_storage_unlock();
+        return;
+    }
+
+    size_t address = ena_storage_counters_address() + counters_block * BLOCK_SIZE;
+    if (value == counters_value[counter] + 1 && counters_next > 0 && counters_slot[counter] > 0 && counters_increments[counter] < 16)
+    {
+        // clear next increment bit of latest slot
+        uint16_t increments = 0xFFFF << (counters_increments[counter] + 1);
+        ESP_ERROR_CHECK(ena_storage_backend_write(address + counters_slot[counter] * sizeof(ena_storage_counter_slot_t) + offsetof(ena_storage_counter_slot_t, increments), &increments, sizeof(uint16_t)));
+        counters_increments[counter]++;
+        counters_value[counter] = value;
+        ena_storage_unlock();
+        return;
+    }
+
+    ena_storage_counters_append(counter, value);
+    ena_storage_unlock();
+}
+
+uint32_t ena_storage_beacons_capacity(void)
+{
+    return (ena_storage_beacons_end_address() - sizeof(uint32_t) - ENA_STORAGE_BEACONS_START_ADDRESS) / sizeof(ena_beacon_t);
+}
+
+void ena_storage_beacons_mount(void)
+{
+    if (beacons_mounted || ENA_STORAGE_BEACON_LOG)
+    {
+        return;
+    }
+    beacons_mounted = true;
+
+    // beacons of the layout without exposure summary block continue up to the end of the partition, the head
+    // word then holds a part of a beacon and cannot be a valid head
+    uint32_t count = ena_storage_counter_get(ENA_STORAGE_COUNTER_BEACONS);
+    uint32_t head = ena_storage_counter_get(ENA_STORAGE_COUNTER_BEACONS_HEAD);
+    uint32_t capacity = ena_storage_beacons_capacity();
+    if (count <= capacity || (head <= count && count - head <= capacity))
+    {
+        return;
+    }
+
+    // move beacons behind the beacon area over the oldest ones, then drop those with the head, so an
+    // interrupted migration is repeated from the unchanged beacons behind the area
+    uint32_t dropped = count - capacity;
+    ena_beacon_t *beacons = malloc(ENA_STORAGE_CURSOR_BATCH * sizeof(ena_beacon_t));
+    if (beacons == NULL)
+    {
+        ESP_LOGE(ENA_STORAGE_LOG, "Warning %s malloc low memory", "beacons");
+        beacons_mounted = false;
+        return;
+    }
+    for (uint32_t record = capacity; record < count; record += ENA_STORAGE_CURSOR_BATCH)
+    {
+        uint32_t batch = count - record < ENA_STORAGE_CURSOR_BATCH ? count - record : ENA_STORAGE_CURSOR_BATCH;
+        ena_storage_read(ENA_STORAGE_BEACONS_START_ADDRESS + record * sizeof(ena_beacon_t), beacons, batch * sizeof(ena_beacon_t));
+        ena_storage_write(ENA_STORAGE_BEACONS_START_ADDRESS + (record - capacity) * sizeof(ena_beacon_t), beacons, batch * sizeof(ena_beacon_t));
+    }
+    free(beacons);
+    ena_storage_counter_set(ENA_STORAGE_COUNTER_BEACONS_HEAD, dropped);
+    // beacon data is no valid summary or checkpoint of the former layout
+    ena_storage_erase(ena_storage_exposure_summary_address(), BLOCK_SIZE);
+    ena_storage_flush();
+    ESP_LOGW(ENA_STORAGE_LOG, "moved beacons out of the exposure summary block, dropped %u oldest beacons", dropped);
+}
+
+uint32_t ena_storage_beacons_head(void)
+{
+    ena_storage_beacons_mount();
+    uint32_t head = ena_storage_counter_get(ENA_STORAGE_COUNTER_BEACONS_HEAD);
+    if (head > ena_storage_counter_get(ENA_STORAGE_COUNTER_BEACONS))
+    {
+        // never written, beacons stored before the ring start at record 0
+        return 0;
+    }
+    return head;
+}
+
+size_t ena_storage_beacon_address(uint32_t index)
+{
+    return ENA_STORAGE_BEACONS_START_ADDRESS + ((ena_storage_beacons_head() + index) % ena_storage_beacons_capacity()) * sizeof(ena_beacon_t);
+}
+
+uint32_t ena_storage_counters_scratch_select(size_t address, void *buffer)
+{
+    ena_storage_counters_mount();
+    // the next journal block only holds counters repeated in the current one, but it must not be rotated to
+    // while it holds the copy, and the copy must not look like a journal block
+    uint32_t magic;
+    memcpy(&magic, buffer, sizeof(uint32_t));
+    counters_scratch_journal = !counters_scratch_journal;
+    if (counters_scratch_journal && counters_next > 0 && counters_next < ENA_STORAGE_COUNTER_JOURNAL_SLOTS && magic != ENA_STORAGE_COUNTER_JOURNAL_MAGIC)
+    {
+        return address | ENA_STORAGE_COUNTER_SCRATCH_JOURNAL;
+    }
+    return address;
+}
+
+bool ena_storage_block_needs_copy(size_t address)
+{
+    // a cut rewrite loses the block, so every block is copied before, except blocks wholly inside the temporary
+    // beacons while none are counted, there a cut rewrite only drops uncounted beacons
+    ena_storage_counters_mount();
+    size_t temp_end = ENA_STORAGE_TEMP_BEACONS_START_ADDRESS + ENA_STORAGE_TEMP_BEACONS_MAX * sizeof(ena_beacon_t);
+    return counters_value[ENA_STORAGE_COUNTER_TEMP_BEACONS] > 0 || address < ENA_STORAGE_TEMP_BEACONS_START_ADDRESS || address + BLOCK_SIZE > temp_end;
+}
+
+void ena_storage_write_block(size_t address, void *buffer)
+{
+    bool copy = ENA_STORAGE_COUNTER_JOURNAL && ena_storage_block_needs_copy(address);
+    if (copy)
+    {
+        // keep a copy until the block is rewritten, restored on mount if interrupted, alternating between the
+        // scratch block and the next journal block to spread their erases
+        uint32_t scratch = ena_storage_counters_scratch_select(address, buffer);
+        ESP_ERROR_CHECK(ena_storage_backend_erase(ena_storage_counters_scratch_block(scratch), BLOCK_SIZE));
+        ESP_ERROR_CHECK(ena_storage_backend_write(ena_storage_counters_scratch_block(scratch), buffer, BLOCK_SIZE));
+        ena_storage_counter_set(ENA_STORAGE_COUNTER_SCRATCH, scratch);
+    }
+    ESP_ERROR_CHECK(ena_storage_backend_erase(address, BLOCK_SIZE));
+    ESP_ERROR_CHECK(ena_storage_backend_write(address, buffer, BLOCK_SIZE));
+    if (copy)
+    {
+        ena_storage_counter_set(ENA_STORAGE_COUNTER_SCRATCH, ENA_STORAGE_COUNTER_SCRATCH_NONE);
+    }
+}
+
+int ena_storage_cache_entry(size_t block_start, bool load)
+{
+    int entry = ena_storage_cache_find(block_start);
+    if (entry < 0)
+    {
+        // unused or least recently used entry
+        entry = 0;
+        for (int i = 0; i < ENA_STORAGE_WRITE_CACHE_BLOCKS && cache_data[entry] != NULL; i++)
+        {
+            if (cache_data[i] == NULL || cache_used[i] < cache_used[entry])
+            {
+                entry = i;
+            }
+        }
+        if (cache_data[entry] == NULL)
+        {
+            cache_data[entry] = malloc(BLOCK_SIZE);
+            if (cache_data[entry] == NULL)
+            {
+                ESP_LOGE(ENA_STORAGE_LOG, "Warning %s malloc low memory", "cache");
+                return -1;
+            }
+        }
+        else if (cache_dirty[entry])
+        {
+            ESP_LOGD(ENA_STORAGE_LOG, "evict cached block at %u", cache_address[entry]);
+            cache_dirty[entry] = false;
+            ena_storage_write_block(cache_address[entry], cache_data[entry]);
+        }
+        if (load)
+        {
+            ESP_ERROR_CHECK(ena_storage_backend_read(block_start, cache_data[entry], BLOCK_SIZE));
+        }
+        cache_address[entry] = block_start;
+        cache_dirty[entry] = false;
+    }
+    cache_used[entry] = ++cache_clock;
+    return entry;
+}
+
+void ena_storage_put_block(size_t address, void *buffer)
+{
+    int entry = ENA_STORAGE_WRITE_CACHE ? ena_storage_cache_entry(address, false) : -1;
+    if (entry < 0)
+    {
+        ena_storage_write_block(address, buffer);
+        return;
+    }
+    memcpy(cache_data[entry], buffer, BLOCK_SIZE);
+    cache_dirty[entry] = true;
+}
+
+void ena_storage_flush(void)
+{
+    ena_storage_lock();
+    for (int entry = 0; entry < ENA_STORAGE_WRITE_CACHE_BLOCKS; entry++)
+    {
+        if (cache_dirty[entry])
+        {
+            cache_dirty[entry] = false;
+            ena_storage_write_block(cache_address[entry], cache_data[entry]);
+            ESP_LOGD(ENA_STORAGE_LOG, "flushed cached block at %u", cache_address[entry]);
+        }
+    }
+    // counters waiting for the flushed records
+    for (int counter = 0; counters_pending != 0 && counter < ENA_STORAGE_COUNTERS; counter++)
+    {
+        if (counters_pending & (1 << counter))
+        {
+            ena_storage_counter_set(counter, counters_update[counter]);
+        }
+    }
+    ena_storage_unlock();
 }
 
 void ena_storage_write(size_t address, void *data, size_t size)
 {
+    ena_storage_lock();
     const int block_num = address / BLOCK_SIZE;
     // check for overflow
     if (address + size <= (block_num + 1) * BLOCK_SIZE)
     {
-        const esp_partition_t *partition = esp_partition_find_first(
-            ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, ENA_STORAGE_PARTITION_NAME);
-        assert(partition);
         const int block_start = block_num * BLOCK_SIZE;
         const int block_address = address - block_start;
+        int entry = ena_storage_cache_find(block_start);
+        if (entry >= 0)
+        {
+            memcpy((cache_data[entry] + block_address), data, size);
+            cache_dirty[entry] = true;
+            cache_used[entry] = ++cache_clock;
+            ESP_LOGD(ENA_STORAGE_LOG, "write cached data at %u", address);
+            ena_storage_unlock();
+            return;
+        }
         void *buffer = malloc(BLOCK_SIZE);
         if (buffer == NULL)
         {
             ESP_LOGE(ENA_STORAGE_LOG, "Warning %s malloc low memory", "buffer");
+            ena_storage_unlock();
             return;
         }
         ESP_LOGD(ENA_STORAGE_LOG, "read block %d buffer: start %d size %u", block_num, block_start, BLOCK_SIZE);
-        ESP_ERROR_CHECK(esp_partition_read(partition, block_start, buffer, BLOCK_SIZE));
-        vTaskDelay(1);
-        ESP_ERROR_CHECK(esp_partition_erase_range(partition, block_start, BLOCK_SIZE));
-
-        memcpy((buffer + block_address), data, size);
-
-        ESP_ERROR_CHECK(esp_partition_write(partition, block_start, buffer, BLOCK_SIZE));
+        ESP_ERROR_CHECK(ena_storage_backend_read(block_start, buffer, BLOCK_SIZE));
+        ena_storage_yield();
+        if (ena_storage_erased(buffer + block_address, size))
+        {
+            // appended to erased flash, no need to erase the block
+            ESP_ERROR_CHECK(ena_storage_backend_write(address, data, size));
+        }
+        else
+        {
+            memcpy((buffer + block_address), data, size);
+            ena_storage_put_block(block_start, buffer);
+        }
         free(buffer);
         ESP_LOGD(ENA_STORAGE_LOG, "write data at %u", address);
         ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, data, size, ESP_LOG_DEBUG);
@@ -75,30 +794,38 @@ void ena_storage_write(size_t address, void *data, size_t size)
     else
     {
         ESP_LOGD(ENA_STORAGE_LOG, "overflow block at address %u with size %d (block %d)", address, size, block_num);
-        const size_t block2_address = (block_num + 1) * BLOCK_SIZE;
-        const size_t data2_size = address + size - block2_address;
-        const size_t data1_size = size - data2_size;
-        ESP_LOGD(ENA_STORAGE_LOG, "block1_address %d, block1_size %d (block %d)", address, data1_size, block_num);
-        ESP_LOGD(ENA_STORAGE_LOG, "block2_address %d, block2_size %d (block %d)", block2_address, data2_size, block_num + 1);
-        void *data1 = malloc(data1_size);
-        memcpy(data1, data, data1_size);
-        ena_storage_write(address, data1, data1_size);
-        free(data1);
-
-        void *data2 = malloc(data2_size);
-        memcpy(data2, (data + data1_size), data2_size);
-        ena_storage_write(block2_address, data2, data2_size);
-        free(data2);
-    }
+        // written block by block straight from the data, no copy of the remaining data is held
+        size_t written = 0;
+        while (written < size)
+        {
+            const size_t block_end = ((address + written) / BLOCK_SIZE + 1) * BLOCK_SIZE;
+            size_t part_size = size - written;
+            if (address + written + part_size > block_end)
+            {
+                part_size = block_end - (address + written);
+            }
+            ESP_LOGD(ENA_STORAGE_LOG, "block_address %d, block_size %d (block %d)", address + written, part_size, (address + written) / BLOCK_SIZE);
+            ena_storage_write(address + written, data + written, part_size);
+            written += part_size;
+        }
+    }
+    ena_storage_unlock();
 }
 
 void ena_storage_erase(size_t address, size_t size)
 {
+    ena_storage_lock();
     const int block_num = address / BLOCK_SIZE;
     // check for overflow
     if (address + size <= (block_num + 1) * BLOCK_SIZE)
     {
         uint8_t *zeros = calloc(size, sizeof(uint8_t));
+        if (zeros == NULL)
+        {
+            ESP_LOGE(ENA_STORAGE_LOG, "Warning %s malloc low memory", "zeros");
+            ena_storage_unlock();
+            return;
+        }
         ena_storage_write(address, zeros, size);
         free(zeros);
     }
@@ -108,256 +835,1975 @@ void ena_storage_erase(size_t address, size_t size)
         const size_t data2_size = address + size - block2_address;
         const size_t data1_size = size - data2_size;
         uint8_t *zeros = calloc(data1_size, sizeof(uint8_t));
+        if (zeros == NULL)
+        {
+            ESP_LOGE(ENA_STORAGE_LOG, "Warning %s malloc low memory", "zeros");
+            ena_storage_unlock();
+            return;
+        }
         ena_storage_write(address, zeros, data1_size);
         free(zeros);
         ena_storage_erase(block2_address, data2_size);
     }
+    ena_storage_unlock();
+}
+
+void ena_storage_shift_delete(size_t address, size_t end_address, size_t size)
+{
+    ena_storage_lock();
+    void *buffer = malloc(BLOCK_SIZE);
+    if (buffer == NULL)
+    {
+        ESP_LOGE(ENA_STORAGE_LOG, "Warning %s malloc low memory", "buffer");
+        ena_storage_unlock();
+        return;
+    }
+    // move following data in chunks up to the end of a target block, every block is rewritten only once
+    size_t remaining = end_address - address - size;
+    while (remaining > 0)
+    {
+        size_t chunk = BLOCK_SIZE - (address % BLOCK_SIZE);
+        if (chunk > remaining)
+        {
+            chunk = remaining;
+        }
+        ESP_LOGD(ENA_STORAGE_LOG, "shift %u bytes from %u to %u", chunk, (address + size), address);
+        ena_storage_cache_read(address + size, buffer, chunk);
+        ena_storage_yield();
+        ena_storage_write(address, buffer, chunk);
+        address += chunk;
+        remaining -= chunk;
+    }
+    free(buffer);
+    ena_storage_unlock();
+}
+
+uint32_t ena_storage_read_last_exposure_date(void)
+{
+    uint32_t timestamp = 0;
+    ena_storage_read(ENA_STORAGE_LAST_EXPOSURE_DATE_ADDRESS, &timestamp, sizeof(uint32_t));
+    return timestamp;
+}
+
+void ena_storage_write_last_exposure_date(uint32_t timestamp)
+{
+    ena_storage_write(ENA_STORAGE_LAST_EXPOSURE_DATE_ADDRESS, &timestamp, sizeof(uint32_t));
+}
+
+uint32_t ena_storage_tek_count(void)
+{
+    uint32_t count = ena_storage_counter_get(ENA_STORAGE_COUNTER_TEK);
+    ESP_LOGD(ENA_STORAGE_LOG, "read TEK count: %u", count);
+    return count;
+}
+
+uint32_t ena_storage_read_last_tek(ena_tek_t *tek)
+{
+    ena_storage_lock();
+    uint32_t tek_count = ena_storage_tek_count();
+    if (tek_count < 1)
+    {
+        ena_storage_unlock();
+        return 0;
+    }
+    uint8_t index = (tek_count % ENA_STORAGE_TEK_MAX) - 1;
+    ena_storage_read(ENA_STORAGE_TEK_START_ADDRESS + index * sizeof(ena_tek_t), tek, sizeof(ena_tek_t));
+
+    ESP_LOGD(ENA_STORAGE_LOG, "read last tek %u:", tek->enin);
+    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, tek->key_data, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
+    ena_storage_unlock();
+    return tek_count;
+}
+
+void ena_storage_get_tek(uint32_t index, ena_tek_t *tek)
+{
+    ena_storage_read(ENA_STORAGE_TEK_START_ADDRESS + index * sizeof(ena_tek_t), tek, sizeof(ena_tek_t));
+    ESP_LOGD(ENA_STORAGE_LOG, "read %d tek %u:", index, tek->enin);
+    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, tek->key_data, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
+}
+
+void ena_storage_write_tek(ena_tek_t *tek)
+{
+    ena_storage_lock();
+    uint32_t tek_count = ena_storage_counter_get(ENA_STORAGE_COUNTER_TEK);
+    uint8_t index = (tek_count % ENA_STORAGE_TEK_MAX);
+    ena_storage_write(ENA_STORAGE_TEK_START_ADDRESS + index * sizeof(ena_tek_t), tek, sizeof(ena_tek_t));
+
+    tek_count++;
+    ena_storage_counter_set(ENA_STORAGE_COUNTER_TEK, tek_count);
+
+    ESP_LOGD(ENA_STORAGE_LOG, "write tek: ENIN %u", tek->enin);
+    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, tek->key_data, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
+    ena_storage_unlock();
+}
+
+uint32_t ena_storage_exposure_information_count(void)
+{
+    uint32_t count = ena_storage_counter_get(ENA_STORAGE_COUNTER_EXPOSURE_INFORMATION);
+    ESP_LOGD(ENA_STORAGE_LOG, "read exposure information count: %u", count);
+    return count;
+}
+
+void ena_storage_get_exposure_information(uint32_t index, ena_exposure_information_t *exposure_info)
+{
+    index = index % ENA_STORAGE_EXPOSURE_INFORMATION_SLOTS;
+    ena_storage_read(ENA_STORAGE_EXPOSURE_INFORMATION_START_ADDRESS + index * sizeof(ena_exposure_information_t), exposure_info, sizeof(ena_exposure_information_t));
+    ESP_LOGD(ENA_STORAGE_LOG, "read exporuse information: day %u, duration %d", exposure_info->day, exposure_info->duration_minutes);
+}
+
+void ena_storage_add_exposure_information(ena_exposure_information_t *exposure_info)
+{
+    ena_storage_lock();
+    uint32_t count = ena_storage_exposure_information_count();
+    uint32_t index = count % ENA_STORAGE_EXPOSURE_INFORMATION_SLOTS;
+    ena_storage_write(ENA_STORAGE_EXPOSURE_INFORMATION_START_ADDRESS + index * sizeof(ena_exposure_information_t), exposure_info, sizeof(ena_exposure_information_t));
+    count++;
+    ena_storage_counter_set(ENA_STORAGE_COUNTER_EXPOSURE_INFORMATION, count);
+    ESP_LOGD(ENA_STORAGE_LOG, "write exposure info:  day %u, duration %d", exposure_info->day, exposure_info->duration_minutes);
+    ena_storage_unlock();
+}
+
+void ena_storage_truncate_exposure_information(uint32_t count)
+{
+    ena_storage_lock();
+    uint32_t stored = ena_storage_exposure_information_count();
+    if (count < stored)
+    {
+        // dropped records are overwritten by the next ones
+        ena_storage_counter_set(ENA_STORAGE_COUNTER_EXPOSURE_INFORMATION, count);
+        ESP_LOGD(ENA_STORAGE_LOG, "dropped %u exposure information", stored - count);
+    }
+    ena_storage_unlock();
+}
+
+uint32_t ena_storage_temp_beacons_count(void)
+{
+    uint32_t count = ena_storage_counter_get(ENA_STORAGE_COUNTER_TEMP_BEACONS);
+    ESP_LOGD(ENA_STORAGE_LOG, "read temp beacons count: %u", count);
+    return count;
+}
+
+void ena_storage_get_temp_beacon(uint32_t index, ena_beacon_t *beacon)
+{
+    ena_storage_read(ENA_STORAGE_TEMP_BEACONS_START_ADDRESS + index * sizeof(ena_beacon_t), beacon, sizeof(ena_beacon_t));
+    ESP_LOGD(ENA_STORAGE_LOG, "read temp beacon: first %u, last %u and rssi %d", beacon->timestamp_first, beacon->timestamp_last, beacon->rssi);
+    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->rpi, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
+    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->aem, ENA_AEM_METADATA_LENGTH, ESP_LOG_DEBUG);
+}
+
+uint32_t ena_storage_add_temp_beacon(ena_beacon_t *beacon)
+{
+    ena_storage_lock();
+    uint32_t count = ena_storage_temp_beacons_count();
+    // overwrite older temporary beacons?!
+    uint32_t index = count % ENA_STORAGE_TEMP_BEACONS_MAX;
+    ena_storage_set_temp_beacon(index, beacon);
+    ESP_LOGD(ENA_STORAGE_LOG, "add temp beacon at %u: first %u, last %u  and rssi %d", index, beacon->timestamp_first, beacon->timestamp_last, beacon->rssi);
+    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->rpi, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
+    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->aem, ENA_AEM_METADATA_LENGTH, ESP_LOG_DEBUG);
+    count++;
+    ena_storage_counter_set(ENA_STORAGE_COUNTER_TEMP_BEACONS, count);
+    ena_storage_unlock();
+    return count - 1;
+}
+
+void ena_storage_set_temp_beacon(uint32_t index, ena_beacon_t *beacon)
+{
+    ena_storage_write(ENA_STORAGE_TEMP_BEACONS_START_ADDRESS + index * sizeof(ena_beacon_t), beacon, sizeof(ena_beacon_t));
+    ESP_LOGD(ENA_STORAGE_LOG, "set temp beacon at %u: first %u, last %u  and rssi %d", index, beacon->timestamp_first, beacon->timestamp_last, beacon->rssi);
+    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->rpi, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
+    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->aem, ENA_AEM_METADATA_LENGTH, ESP_LOG_DEBUG);
+}
+
+void ena_storage_remove_temp_beacon(uint32_t index)
+{
+    ena_storage_lock();
+    uint32_t count = ena_storage_temp_beacons_count();
+    size_t address_from = ENA_STORAGE_TEMP_BEACONS_START_ADDRESS + index * sizeof(ena_beacon_t);
+    size_t address_to = ENA_STORAGE_TEMP_BEACONS_START_ADDRESS + count * sizeof(ena_beacon_t);
+
+    ena_storage_shift_delete(address_from, address_to, sizeof(ena_beacon_t));
+
+    count--;
+    ena_storage_counter_set(ENA_STORAGE_COUNTER_TEMP_BEACONS, count);
+    ESP_LOGD(ENA_STORAGE_LOG, "remove temp beacon: %u", index);
+    ena_storage_unlock();
+}
+
+void ena_storage_write_temp_beacons(ena_beacon_t *beacons, uint32_t count)
+{
+    ena_storage_lock();
+    if (count > ENA_STORAGE_TEMP_BEACONS_MAX)
+    {
+        count = ENA_STORAGE_TEMP_BEACONS_MAX;
+    }
+    // records are overwritten in place before the count, without the journal an interrupted snapshot keeps the
+    // previous count but some of its records are replaced by new ones, restoring drops the duplicates
+    if (ENA_STORAGE_COUNTER_JOURNAL)
+    {
+        // no records are counted while they are rewritten, a cut snapshot drops the temporary beacons, so their
+        // blocks are rewritten without a copy
+        ena_storage_counter_set(ENA_STORAGE_COUNTER_TEMP_BEACONS, 0);
+    }
+    if (count > 0)
+    {
+        ena_storage_write(ENA_STORAGE_TEMP_BEACONS_START_ADDRESS, beacons, count * sizeof(ena_beacon_t));
+    }
+    ena_storage_counter_set(ENA_STORAGE_COUNTER_TEMP_BEACONS, count);
+    ESP_LOGD(ENA_STORAGE_LOG, "write %u temp beacons", count);
+    ena_storage_unlock();
+}
+
+uint32_t ena_storage_read_temp_beacons(ena_beacon_t *beacons, uint32_t max)
+{
+    ena_storage_lock();
+    uint32_t count = ena_storage_temp_beacons_count();
+    if (count > max)
+    {
+        count = max;
+    }
+    if (count > 0)
+    {
+        ena_storage_read(ENA_STORAGE_TEMP_BEACONS_START_ADDRESS, beacons, count * sizeof(ena_beacon_t));
+    }
+    ena_storage_unlock();
+    return count;
+}
+
+void ena_storage_read_exposure_summary(void *summary, size_t size)
+{
+    ena_storage_read(ena_storage_exposure_summary_address(), summary, size);
+}
+
+void ena_storage_write_exposure_summary(void *summary, size_t size)
+{
+    ena_storage_write(ena_storage_exposure_summary_address(), summary, size);
+    ESP_LOGD(ENA_STORAGE_LOG, "write exposure summary (size %u)", size);
+}
+
+uint32_t ena_storage_sync_checkpoint_check(const ena_storage_sync_checkpoint_slot_t *slot, uint32_t sequence, uint32_t index)
+{
+    // sequence and slot number bind the slot to its position, like slots of the counter journal
+    uint32_t crc = ena_storage_crc32(0, slot->data, ENA_STORAGE_SYNC_CHECKPOINT_SIZE);
+    crc = ena_storage_crc32(crc, &sequence, sizeof(uint32_t));
+    return ena_storage_crc32(crc, &index, sizeof(uint32_t));
+}
+
+void ena_storage_sync_checkpoint_replay(uint32_t block, ena_storage_sync_checkpoint_slot_t *slots)
+{
+    checkpoint_block = block;
+    checkpoint_sequence = ((ena_storage_counter_header_t *)slots)->sequence;
+    checkpoint_next = 1;
+    for (uint32_t i = 1; i < ENA_STORAGE_SYNC_CHECKPOINT_SLOTS; i++)
+    {
+        if (ena_storage_erased(&slots[i], sizeof(ena_storage_sync_checkpoint_slot_t)))
+        {
+            continue;
+        }
+        // slots after an interrupted write are still appended behind it
+        checkpoint_next = i + 1;
+        if (slots[i].check != ena_storage_sync_checkpoint_check(&slots[i], checkpoint_sequence, i))
+        {
+            ESP_LOGW(ENA_STORAGE_LOG, "skip invalid checkpoint slot %u in block %u", i, block);
+            continue;
+        }
+        memcpy(checkpoint_data, slots[i].data, ENA_STORAGE_SYNC_CHECKPOINT_SIZE);
+    }
+}
+
+void ena_storage_sync_checkpoint_mount(void)
+{
+    if (checkpoint_mounted)
+    {
+        return;
+    }
+
+    ena_storage_sync_checkpoint_slot_t *slots = malloc(BLOCK_SIZE);
+    if (slots == NULL)
+    {
+        ESP_LOGE(ENA_STORAGE_LOG, "Warning %s malloc low memory", "sync checkpoint");
+        return;
+    }
+
+    memset(checkpoint_data, 0xFF, ENA_STORAGE_SYNC_CHECKPOINT_SIZE);
+    checkpoint_next = 0;
+
+    // replay valid blocks from oldest to newest, every block starts with the latest checkpoint before it
+    uint32_t sequences[ENA_STORAGE_SYNC_CHECKPOINT_BLOCKS];
+    bool valid[ENA_STORAGE_SYNC_CHECKPOINT_BLOCKS];
+    for (uint32_t block = 0; block < ENA_STORAGE_SYNC_CHECKPOINT_BLOCKS; block++)
+    {
+        ena_storage_counter_header_t header;
+        ESP_ERROR_CHECK(ena_storage_backend_read(ena_storage_sync_checkpoint_address() + block * BLOCK_SIZE, &header, sizeof(ena_storage_counter_header_t)));
+        valid[block] = header.magic == ENA_STORAGE_SYNC_CHECKPOINT_MAGIC;
+        sequences[block] = header.sequence;
+    }
+    while (true)
+    {
+        int oldest = -1;
+        for (uint32_t block = 0; block < ENA_STORAGE_SYNC_CHECKPOINT_BLOCKS; block++)
+        {
+            if (valid[block] && (oldest < 0 || sequences[block] < sequences[oldest]))
+            {
+                oldest = block;
+            }
+        }
+        if (oldest < 0)
+        {
+            break;
+        }
+        ESP_ERROR_CHECK(ena_storage_backend_read(ena_storage_sync_checkpoint_address() + oldest * BLOCK_SIZE, slots, BLOCK_SIZE));
+        ena_storage_sync_checkpoint_replay(oldest, slots);
+        valid[oldest] = false;
+    }
+    free(slots);
+
+    // without a valid slot the checkpoint stays erased
+    checkpoint_mounted = true;
+    ESP_LOGD(ENA_STORAGE_LOG, "mounted sync checkpoint: block %u, sequence %u, %u slots used", checkpoint_block, checkpoint_sequence, checkpoint_next);
+}
+
+void ena_storage_sync_checkpoint_rotate(ena_storage_sync_checkpoint_slot_t *slot)
+{
+    uint32_t block = 0;
+    uint32_t sequence = 0;
+    if (checkpoint_next > 0)
+    {
+        block = (checkpoint_block + 1) % ENA_STORAGE_SYNC_CHECKPOINT_BLOCKS;
+        sequence = checkpoint_sequence + 1;
+    }
+    size_t address = ena_storage_sync_checkpoint_address() + block * BLOCK_SIZE;
+    ESP_ERROR_CHECK(ena_storage_backend_erase(address, BLOCK_SIZE));
+
+    // checkpoint before header, so an interrupted rotation keeps the previous block
+    slot->check = ena_storage_sync_checkpoint_check(slot, sequence, 1);
+    ESP_ERROR_CHECK(ena_storage_backend_write(address + sizeof(ena_storage_sync_checkpoint_slot_t), slot, sizeof(ena_storage_sync_checkpoint_slot_t)));
+    ena_storage_counter_header_t header = {
+        .magic = ENA_STORAGE_SYNC_CHECKPOINT_MAGIC,
+        .sequence = sequence,
+    };
+    ESP_ERROR_CHECK(ena_storage_backend_write(address, &header, sizeof(ena_storage_counter_header_t)));
+
+    checkpoint_block = block;
+    checkpoint_sequence = sequence;
+    checkpoint_next = 2;
+    ESP_LOGD(ENA_STORAGE_LOG, "rotated sync checkpoint to block %u, sequence %u", block, sequence);
+}
+
+void ena_storage_read_sync_checkpoint(void *checkpoint, size_t size)
+{
+    ena_storage_lock();
+    ena_storage_sync_checkpoint_mount();
+    memset(checkpoint, 0xFF, size);
+    memcpy(checkpoint, checkpoint_data, size < ENA_STORAGE_SYNC_CHECKPOINT_SIZE ? size : ENA_STORAGE_SYNC_CHECKPOINT_SIZE);
+    ena_storage_unlock();
+}
+
+void ena_storage_write_sync_checkpoint(void *checkpoint, size_t size)
+{
+    if (size > ENA_STORAGE_SYNC_CHECKPOINT_SIZE)
+    {
+        ESP_LOGE(ENA_STORAGE_LOG, "sync checkpoint too large (size %u)", size);
+        return;
+    }
+
+    ena_storage_lock();
+    // exposure information covered by the checkpoint has to be in flash before it
+    ena_storage_flush();
+    ena_storage_sync_checkpoint_mount();
+    ena_storage_sync_checkpoint_slot_t slot;
+    memset(slot.data, 0xFF, ENA_STORAGE_SYNC_CHECKPOINT_SIZE);
+    memcpy(slot.data, checkpoint, size);
+    memcpy(checkpoint_data, slot.data, ENA_STORAGE_SYNC_CHECKPOINT_SIZE);
+    if (checkpoint_next == 0 || checkpoint_next >= ENA_STORAGE_SYNC_CHECKPOINT_SLOTS)
+    {
+        // new block starts with the checkpoint
+        ena_storage_sync_checkpoint_rotate(&slot);
+    }
+    else
+    {
+        slot.check = ena_storage_sync_checkpoint_check(&slot, checkpoint_sequence, checkpoint_next);
+        size_t address = ena_storage_sync_checkpoint_address() + checkpoint_block * BLOCK_SIZE + checkpoint_next * sizeof(ena_storage_sync_checkpoint_slot_t);
+        ESP_ERROR_CHECK(ena_storage_backend_write(address, &slot, sizeof(ena_storage_sync_checkpoint_slot_t)));
+        checkpoint_next++;
+    }
+    ESP_LOGD(ENA_STORAGE_LOG, "write sync checkpoint (size %u)", size);
+    ena_storage_unlock();
+}
+
+size_t ena_storage_key_digest_address(uint32_t block, uint32_t slot)
+{
+    return ena_storage_key_digests_address() + block * BLOCK_SIZE + sizeof(ena_storage_key_digest_header_t) + slot * sizeof(uint64_t);
+}
+
+void ena_storage_key_digests_erase_block(uint32_t block)
+{
+    ESP_ERROR_CHECK(ena_storage_backend_erase(ena_storage_key_digests_address() + block * BLOCK_SIZE, BLOCK_SIZE));
+    key_digests_day[block] = 0;
+    key_digests_used[block] = 0;
+}
+
+void ena_storage_key_digests_mount(void)
+{
+    if (key_digests_mounted || !ENA_STORAGE_KEY_DIGESTS)
+    {
+        return;
+    }
+
+    ena_storage_key_digest_header_t header;
+    uint32_t digests = 0;
+    for (uint32_t block = 0; block < ENA_STORAGE_KEY_DIGEST_BLOCKS; block++)
+    {
+        ESP_ERROR_CHECK(ena_storage_backend_read(ena_storage_key_digests_address() + block * BLOCK_SIZE, &header, sizeof(ena_storage_key_digest_header_t)));
+        key_digests_day[block] = 0;
+        key_digests_used[block] = 0;
+        if (header.magic == ENA_STORAGE_KEY_DIGEST_MAGIC)
+        {
+            // digests are appended, so the first erased slot is found by bisection
+            uint32_t low = 0;
+            uint32_t high = ENA_STORAGE_KEY_DIGEST_SLOTS;
+            while (low < high)
+            {
+                uint32_t middle = (low + high) / 2;
+                uint64_t digest = 0;
+                ESP_ERROR_CHECK(ena_storage_backend_read(ena_storage_key_digest_address(block, middle), &digest, sizeof(uint64_t)));
+                if (digest == ENA_STORAGE_KEY_DIGEST_EMPTY)
+                {
+                    high = middle;
+                }
+                else
+                {
+                    low = middle + 1;
+                }
+            }
+            key_digests_day[block] = header.day;
+            key_digests_used[block] = low;
+            digests += low;
+        }
+        else if (header.magic != 0xFFFFFFFF || header.day != 0xFFFFFFFF)
+        {
+            // interrupted open or old data
+            ena_storage_key_digests_erase_block(block);
+        }
+    }
+
+    key_digests_mounted = true;
+    ESP_LOGI(ENA_STORAGE_LOG, "mounted key digests: %u digests in %u blocks", digests, ENA_STORAGE_KEY_DIGEST_BLOCKS);
+}
+
+uint32_t ena_storage_key_digests_open_block(uint32_t day)
+{
+    uint32_t block = 0;
+    for (uint32_t i = 0; i < ENA_STORAGE_KEY_DIGEST_BLOCKS; i++)
+    {
+        if (key_digests_day[i] == 0)
+        {
+            block = i;
+            break;
+        }
+        if (key_digests_day[i] < key_digests_day[block])
+        {
+            block = i;
+        }
+    }
+
+    if (key_digests_day[block] != 0)
+    {
+        ESP_LOGW(ENA_STORAGE_LOG, "key digests full, drop %u digests of day %u", key_digests_used[block], key_digests_day[block]);
+        ena_storage_key_digests_erase_block(block);
+    }
+
+    // magic is written last, so an interrupted open is detected on mount
+    size_t address = ena_storage_key_digests_address() + block * BLOCK_SIZE;
+    ESP_ERROR_CHECK(ena_storage_backend_write(address + offsetof(ena_storage_key_digest_header_t, day), &day, sizeof(uint32_t)));
+    uint32_t magic = ENA_STORAGE_KEY_DIGEST_MAGIC;
+    ESP_ERROR_CHECK(ena_storage_backend_write(address, &magic, sizeof(uint32_t)));
+    key_digests_day[block] = day;
+    key_digests_used[block] = 0;
+    return block;
+}
+
+uint32_t ena_storage_key_digests_count(uint32_t day)
+{
+    ena_storage_lock();
+    ena_storage_key_digests_mount();
+    uint32_t count = 0;
+    for (uint32_t block = 0; block < ENA_STORAGE_KEY_DIGEST_BLOCKS; block++)
+    {
+        if (key_digests_day[block] == day)
+        {
+            count += key_digests_used[block];
+        }
+    }
+    ena_storage_unlock();
+    return count;
+}
+
+uint32_t ena_storage_read_key_digests(uint32_t day, uint64_t *digests, uint32_t max)
+{
+    ena_storage_lock();
+    ena_storage_key_digests_mount();
+    uint32_t count = 0;
+    for (uint32_t block = 0; block < ENA_STORAGE_KEY_DIGEST_BLOCKS && count < max; block++)
+    {
+        if (key_digests_day[block] == day && key_digests_used[block] > 0)
+        {
+            uint32_t read = key_digests_used[block];
+            if (read > max - count)
+            {
+                read = max - count;
+            }
+            ESP_ERROR_CHECK(ena_storage_backend_read(ena_storage_key_digest_address(block, 0), &digests[count], read * sizeof(uint64_t)));
+            count += read;
+        }
+    }
+    ena_storage_unlock();
+    return count;
+}
+
+void ena_storage_add_key_digests(uint32_t day, const uint64_t *digests, uint32_t count)
+{
+    ena_storage_lock();
+    if (!ENA_STORAGE_KEY_DIGESTS)
+    {
+        ena_storage_unlock();
+        return;
+    }
+    ena_storage_key_digests_mount();
+    while (count > 0)
+    {
+        uint32_t block = ENA_STORAGE_KEY_DIGEST_BLOCKS;
+        for (uint32_t i = 0; i < ENA_STORAGE_KEY_DIGEST_BLOCKS; i++)
+        {
+            if (key_digests_day[i] == day && key_digests_used[i] < ENA_STORAGE_KEY_DIGEST_SLOTS)
+            {
+                block = i;
+                break;
+            }
+        }
+        if (block == ENA_STORAGE_KEY_DIGEST_BLOCKS)
+        {
+            block = ena_storage_key_digests_open_block(day);
+        }
+
+        uint32_t write = ENA_STORAGE_KEY_DIGEST_SLOTS - key_digests_used[block];
+        if (write > count)
+        {
+            write = count;
+        }
+        ESP_ERROR_CHECK(ena_storage_backend_write(ena_storage_key_digest_address(block, key_digests_used[block]), digests, write * sizeof(uint64_t)));
+        key_digests_used[block] += write;
+        digests += write;
+        count -= write;
+    }
+    ena_storage_unlock();
+}
+
+void ena_storage_expire_key_digests(uint32_t day)
+{
+    ena_storage_lock();
+    ena_storage_key_digests_mount();
+    for (uint32_t block = 0; block < ENA_STORAGE_KEY_DIGEST_BLOCKS; block++)
+    {
+        if (key_digests_day[block] != 0 && key_digests_day[block] < day)
+        {
+            ESP_LOGD(ENA_STORAGE_LOG, "erase %u key digests of day %u", key_digests_used[block], key_digests_day[block]);
+            ena_storage_key_digests_erase_block(block);
+        }
+    }
+    ena_storage_unlock();
+}
+
+uint32_t ena_storage_beacon_index_entry(uint8_t *rpi, uint32_t index)
+{
+    // RPIs are AES output, so plain bytes are uniformly distributed
+    uint32_t tag = (rpi[4] | (rpi[5] << 8)) & ((1 << (32 - ENA_STORAGE_BEACON_INDEX_POSITION_BITS)) - 1);
+    if (tag == 0)
+    {
+        tag = 1;
+    }
+    return (tag << ENA_STORAGE_BEACON_INDEX_POSITION_BITS) | index;
+}
+
+uint32_t ena_storage_beacon_index_slot(uint8_t *rpi)
+{
+    uint32_t hash;
+    memcpy(&hash, rpi, sizeof(uint32_t));
+    return hash & (ENA_STORAGE_BEACON_INDEX_SLOTS - 1);
+}
+
+void ena_storage_beacon_index_invalidate(void)
+{
+    uint32_t magic = 0;
+    ESP_ERROR_CHECK(ena_storage_backend_write(ena_storage_beacon_index_address(), &magic, sizeof(uint32_t)));
+    beacon_index_state = 0;
+    ESP_LOGD(ENA_STORAGE_LOG, "invalidated beacon index");
+}
+
+void ena_storage_beacon_index_set_state(uint32_t base, uint32_t deleted)
+{
+    if (beacon_index_states == ENA_STORAGE_BEACON_INDEX_STATES)
+    {
+        ena_storage_beacon_index_invalidate();
+        return;
+    }
+    // appended to the header, the last written entry is current
+    uint32_t state[2] = {base, deleted};
+    ESP_ERROR_CHECK(ena_storage_backend_write(ena_storage_beacon_index_address() + (2 + beacon_index_states * 2) * sizeof(uint32_t), state, sizeof(state)));
+    beacon_index_states++;
+    beacon_index_base = base;
+    beacon_index_deleted = deleted;
+    if (ena_storage_beacons_count() + deleted > ENA_STORAGE_BEACON_INDEX_USED_MAX)
+    {
+        ESP_LOGD(ENA_STORAGE_LOG, "%u deleted slots in beacon index", deleted);
+        ena_storage_beacon_index_invalidate();
+    }
+}
+
+bool ena_storage_beacon_index_load_state(void)
+{
+    uint32_t states[64][2];
+    beacon_index_states = 0;
+    for (uint32_t start = 0; start < ENA_STORAGE_BEACON_INDEX_STATES; start += 64)
+    {
+        uint32_t count = ENA_STORAGE_BEACON_INDEX_STATES - start < 64 ? ENA_STORAGE_BEACON_INDEX_STATES - start : 64;
+        ESP_ERROR_CHECK(ena_storage_backend_read(ena_storage_beacon_index_address() + (2 + start * 2) * sizeof(uint32_t), states, count * sizeof(states[0])));
+        for (uint32_t i = 0; i < count; i++)
+        {
+            if (states[i][0] == ENA_STORAGE_BEACON_INDEX_EMPTY && states[i][1] == ENA_STORAGE_BEACON_INDEX_EMPTY)
+            {
+                return beacon_index_states > 0;
+            }
+            beacon_index_base = states[i][0];
+            beacon_index_deleted = states[i][1];
+            beacon_index_states++;
+        }
+    }
+    return beacon_index_states > 0;
+}
+
+void ena_storage_beacon_index_insert(uint8_t *rpi, uint32_t index)
+{
+    const size_t slots_address = ena_storage_beacon_index_address() + BLOCK_SIZE;
+    uint32_t entry = ena_storage_beacon_index_entry(rpi, (beacon_index_base + index) & ((1 << ENA_STORAGE_BEACON_INDEX_POSITION_BITS) - 1));
+    uint32_t slot = ena_storage_beacon_index_slot(rpi) & ~(ENA_STORAGE_BEACON_INDEX_PROBE - 1);
+    uint32_t probe = ena_storage_beacon_index_slot(rpi) - slot;
+    uint32_t slots[ENA_STORAGE_BEACON_INDEX_PROBE];
+
+    for (uint32_t probed = 0; probed < ENA_STORAGE_BEACON_INDEX_SLOTS; probed += ENA_STORAGE_BEACON_INDEX_PROBE)
+    {
+        ESP_ERROR_CHECK(ena_storage_backend_read(slots_address + slot * sizeof(uint32_t), slots, sizeof(slots)));
+        for (; probe < ENA_STORAGE_BEACON_INDEX_PROBE; probe++)
+        {
+            // only erased slots can be written without erase
+            if (slots[probe] == ENA_STORAGE_BEACON_INDEX_EMPTY)
+            {
+                ESP_ERROR_CHECK(ena_storage_backend_write(slots_address + (slot + probe) * sizeof(uint32_t), &entry, sizeof(uint32_t)));
+                return;
+            }
+        }
+        probe = 0;
+        slot = (slot + ENA_STORAGE_BEACON_INDEX_PROBE) & (ENA_STORAGE_BEACON_INDEX_SLOTS - 1);
+    }
+
+    ESP_LOGW(ENA_STORAGE_LOG, "beacon index full");
+    ena_storage_beacon_index_invalidate();
+}
+
+void ena_storage_beacon_index_delete(uint8_t *rpi, uint32_t index)
+{
+    const size_t slots_address = ena_storage_beacon_index_address() + BLOCK_SIZE;
+    uint32_t entry = ena_storage_beacon_index_entry(rpi, (beacon_index_base + index) & ((1 << ENA_STORAGE_BEACON_INDEX_POSITION_BITS) - 1));
+    uint32_t slot = ena_storage_beacon_index_slot(rpi) & ~(ENA_STORAGE_BEACON_INDEX_PROBE - 1);
+    uint32_t probe = ena_storage_beacon_index_slot(rpi) - slot;
+    uint32_t slots[ENA_STORAGE_BEACON_INDEX_PROBE];
+
+    for (uint32_t probed = 0; probed < ENA_STORAGE_BEACON_INDEX_SLOTS; probed += ENA_STORAGE_BEACON_INDEX_PROBE)
+    {
+        ESP_ERROR_CHECK(ena_storage_backend_read(slots_address + slot * sizeof(uint32_t), slots, sizeof(slots)));
+        for (; probe < ENA_STORAGE_BEACON_INDEX_PROBE; probe++)
+        {
+            if (slots[probe] == ENA_STORAGE_BEACON_INDEX_EMPTY)
+            {
+                return;
+            }
+            if (slots[probe] == entry)
+            {
+                // clearing all bits needs no erase, the slot stays in the probe chain
+                uint32_t deleted = ENA_STORAGE_BEACON_INDEX_DELETED;
+                ESP_ERROR_CHECK(ena_storage_backend_write(slots_address + (slot + probe) * sizeof(uint32_t), &deleted, sizeof(uint32_t)));
+                return;
+            }
+        }
+        probe = 0;
+        slot = (slot + ENA_STORAGE_BEACON_INDEX_PROBE) & (ENA_STORAGE_BEACON_INDEX_SLOTS - 1);
+    }
+}
+
+uint32_t ena_storage_beacon_index_lookup(uint8_t *rpi, uint32_t *indices, uint32_t max)
+{
+    const size_t slots_address = ena_storage_beacon_index_address() + BLOCK_SIZE;
+    const uint32_t position_mask = (1 << ENA_STORAGE_BEACON_INDEX_POSITION_BITS) - 1;
+    uint32_t entry = ena_storage_beacon_index_entry(rpi, 0);
+    uint32_t slot = ena_storage_beacon_index_slot(rpi) & ~(ENA_STORAGE_BEACON_INDEX_PROBE - 1);
+    uint32_t probe = ena_storage_beacon_index_slot(rpi) - slot;
+    uint32_t slots[ENA_STORAGE_BEACON_INDEX_PROBE];
+    uint32_t found = 0;
+    uint32_t count = ena_storage_beacons_count();
+    ena_beacon_t beacon;
+
+    for (uint32_t probed = 0; probed < ENA_STORAGE_BEACON_INDEX_SLOTS; probed += ENA_STORAGE_BEACON_INDEX_PROBE)
+    {
+        ESP_ERROR_CHECK(ena_storage_backend_read(slots_address + slot * sizeof(uint32_t), slots, sizeof(slots)));
+        for (; probe < ENA_STORAGE_BEACON_INDEX_PROBE; probe++)
+        {
+            if (slots[probe] == ENA_STORAGE_BEACON_INDEX_EMPTY)
+            {
+                return found;
+            }
+            uint32_t index = ((slots[probe] & position_mask) - beacon_index_base) & position_mask;
+            if (slots[probe] != ENA_STORAGE_BEACON_INDEX_DELETED && (slots[probe] & ~position_mask) == entry && index < count)
+            {
+                // tag matched, confirm full RPI
+                ena_storage_cache_read(ena_storage_beacon_address(index), &beacon, sizeof(ena_beacon_t));
+                if (memcmp(beacon.rpi, rpi, ENA_KEY_LENGTH) == 0)
+                {
+                    if (found < max)
+                    {
+                        indices[found] = index;
+                    }
+                    found++;
+                }
+            }
+        }
+        probe = 0;
+        slot = (slot + ENA_STORAGE_BEACON_INDEX_PROBE) & (ENA_STORAGE_BEACON_INDEX_SLOTS - 1);
+    }
+    return found;
+}
+
+void ena_storage_beacon_index_rebuild(void)
+{
+    ena_storage_lock();
+    if (!ENA_STORAGE_BEACON_INDEX)
+    {
+        ena_storage_unlock();
+        return;
+    }
+
+    const size_t index_address = ena_storage_beacon_index_address();
+    uint32_t count = ena_storage_beacons_count();
+    uint32_t index = 0;
+    uint32_t read = 0;
+    ena_storage_beacon_cursor_t cursor;
+    ena_beacon_t beacons[ENA_STORAGE_CURSOR_BATCH];
+
+    ESP_LOGI(ENA_STORAGE_LOG, "rebuild beacon index for %u beacons", count);
+    ESP_ERROR_CHECK(ena_storage_backend_erase(index_address, ENA_STORAGE_BEACON_INDEX_SIZE));
+    beacon_index_base = 0;
+    beacon_index_deleted = 0;
+    beacon_index_states = 0;
+
+    ena_storage_beacon_cursor_open(&cursor, 0, count);
+    while ((read = ena_storage_beacon_cursor_next_batch(&cursor, beacons, ENA_STORAGE_CURSOR_BATCH)) > 0)
+    {
+        for (uint32_t i = 0; i < read; i++, index++)
+        {
+            ena_storage_beacon_index_insert(beacons[i].rpi, index);
+        }
+    }
+
+    // magic is written last, so an interrupted rebuild is detected
+    uint32_t state[2] = {0, 0};
+    ESP_ERROR_CHECK(ena_storage_backend_write(index_address + 2 * sizeof(uint32_t), state, sizeof(state)));
+    beacon_index_states = 1;
+    uint32_t magic = ENA_STORAGE_BEACON_INDEX_MAGIC;
+    ESP_ERROR_CHECK(ena_storage_backend_write(index_address, &magic, sizeof(uint32_t)));
+    beacon_index_state = 1;
+    ena_storage_unlock();
+}
+
+bool ena_storage_beacon_index_valid(void)
+{
+    if (beacon_index_state < 0)
+    {
+        uint32_t magic = 0;
+        ESP_ERROR_CHECK(ena_storage_backend_read(ena_storage_beacon_index_address(), &magic, sizeof(uint32_t)));
+        beacon_index_state = 0;
+        if (magic == ENA_STORAGE_BEACON_INDEX_MAGIC && ena_storage_beacon_index_load_state())
+        {
+            // last beacon might be written without index on power loss
+            uint32_t count = ena_storage_beacons_count();
+            uint32_t index = 0;
+            ena_beacon_t beacon;
+            if (count == 0)
+            {
+                beacon_index_state = 1;
+            }
+            else
+            {
+                ena_storage_get_beacon(count - 1, &beacon);
+                beacon_index_state = 1;
+                if (ena_storage_beacon_index_lookup(beacon.rpi, &index, 1) == 0)
+                {
+                    ESP_LOGW(ENA_STORAGE_LOG, "beacon index does not match stored beacons");
+                    beacon_index_state = 0;
+                }
+            }
+        }
+    }
+    return beacon_index_state == 1;
+}
+
+size_t ena_storage_beacon_log_address(void)
+{
+    return ((ENA_STORAGE_BEACONS_START_ADDRESS + BLOCK_SIZE - 1) / BLOCK_SIZE) * BLOCK_SIZE;
+}
+
+size_t ena_storage_beacon_log_segment_address(uint32_t segment)
+{
+    return ena_storage_beacon_log_address() + segment * BLOCK_SIZE;
+}
+
+size_t ena_storage_beacon_log_record_address(uint32_t segment, uint32_t record)
+{
+    return ena_storage_beacon_log_segment_address(segment) + sizeof(ena_storage_segment_header_t) + record * sizeof(ena_beacon_t);
+}
+
+size_t ena_storage_beacon_column_address(uint32_t segment, size_t column, size_t size, uint32_t record)
+{
+    return ena_storage_beacon_log_segment_address(segment) + ENA_STORAGE_BEACON_COLUMNS_START + column * ENA_STORAGE_BEACON_LOG_RECORDS + record * size;
+}
+
+size_t ena_storage_beacon_columns_address(uint32_t segment)
+{
+    return ena_storage_beacon_log_segment_address(segment) + sizeof(ena_storage_segment_header_t);
+}
+
+size_t ena_storage_beacon_columns_filter_address(uint32_t segment)
+{
+    return ena_storage_beacon_columns_address(segment) + sizeof(ena_storage_segment_columns_t);
+}
+
+uint32_t ena_storage_beacon_columns_filter_bit(const uint8_t *rpi, int hash)
+{
+    // RPIs are random, so their bytes are used as hashes directly
+    return (rpi[2 * hash] | (rpi[2 * hash + 1] << 8)) % (ENA_STORAGE_BEACON_LOG_RECORDS * ENA_STORAGE_BEACON_COLUMNS_FILTER_BITS);
+}
+
+bool ena_storage_beacon_columns_filter_contains(const uint8_t *filter, const uint8_t *rpi)
+{
+    for (int hash = 0; hash < ENA_STORAGE_BEACON_COLUMNS_HASHES; hash++)
+    {
+        uint32_t bit = ena_storage_beacon_columns_filter_bit(rpi, hash);
+        if (filter[bit / 8] & (1 << (bit % 8)))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t ena_storage_beacon_columns_read_max(uint32_t segment, uint32_t written, uint32_t base)
+{
+    uint16_t offsets[ENA_STORAGE_BEACON_LOG_RECORDS];
+    uint32_t max = base;
+    ESP_ERROR_CHECK(ena_storage_backend_read(ena_storage_beacon_column_address(segment, ENA_STORAGE_BEACON_COLUMN_FIRST, sizeof(uint16_t), 0), offsets, written * sizeof(uint16_t)));
+    for (uint32_t i = 0; i < written; i++)
+    {
+        if (base + offsets[i] > max)
+        {
+            max = base + offsets[i];
+        }
+    }
+    return max;
+}
+
+void ena_storage_beacon_columns_close(uint32_t segment)
+{
+    uint32_t base = beacon_log_range[segment * 2];
+    uint32_t max = ena_storage_beacon_columns_read_max(segment, beacon_log_written[segment], base);
+    ESP_ERROR_CHECK(ena_storage_backend_write(ena_storage_beacon_columns_address(segment) + offsetof(ena_storage_segment_columns_t, timestamp_max), &max, sizeof(uint32_t)));
+    beacon_log_range[segment * 2 + 1] = max;
+}
+
+bool ena_storage_beacon_columns_fit(uint32_t segment, ena_beacon_t *beacon)
+{
+    uint32_t base = beacon_log_range[segment * 2];
+    return beacon_log_written[segment] == 0 || (beacon->timestamp_first >= base && beacon->timestamp_first - base <= UINT16_MAX);
+}
+
+void ena_storage_beacon_columns_write(uint32_t segment, uint32_t record, ena_beacon_t *beacon)
+{
+    if (record == 0)
+    {
+        uint32_t base = beacon->timestamp_first > ENA_STORAGE_BEACON_COLUMNS_SLACK ? beacon->timestamp_first - ENA_STORAGE_BEACON_COLUMNS_SLACK : 0;
+        ESP_ERROR_CHECK(ena_storage_backend_write(ena_storage_beacon_columns_address(segment) + offsetof(ena_storage_segment_columns_t, timestamp_base), &base, sizeof(uint32_t)));
+        beacon_log_range[segment * 2] = base;
+        beacon_log_range[segment * 2 + 1] = base + UINT16_MAX;
+    }
+    uint16_t first = beacon->timestamp_first - beacon_log_range[segment * 2];
+    uint16_t last = beacon->timestamp_last - beacon->timestamp_first > UINT16_MAX ? UINT16_MAX : beacon->timestamp_last - beacon->timestamp_first;
+    int8_t rssi = beacon->rssi < INT8_MIN ? INT8_MIN : (beacon->rssi > INT8_MAX ? INT8_MAX : beacon->rssi);
+    ESP_ERROR_CHECK(ena_storage_backend_write(ena_storage_beacon_column_address(segment, ENA_STORAGE_BEACON_COLUMN_RPI, ENA_STORAGE_BEACON_COLUMN_RPI_SIZE, record), beacon->rpi, ENA_STORAGE_BEACON_COLUMN_RPI_SIZE));
+    ESP_ERROR_CHECK(ena_storage_backend_write(ena_storage_beacon_column_address(segment, ENA_STORAGE_BEACON_COLUMN_AEM, ENA_STORAGE_BEACON_COLUMN_AEM_SIZE, record), beacon->aem, ENA_STORAGE_BEACON_COLUMN_AEM_SIZE));
+    ESP_ERROR_CHECK(ena_storage_backend_write(ena_storage_beacon_column_address(segment, ENA_STORAGE_BEACON_COLUMN_FIRST, sizeof(uint16_t), record), &first, sizeof(uint16_t)));
+    ESP_ERROR_CHECK(ena_storage_backend_write(ena_storage_beacon_column_address(segment, ENA_STORAGE_BEACON_COLUMN_LAST, sizeof(uint16_t), record), &last, sizeof(uint16_t)));
+    ESP_ERROR_CHECK(ena_storage_backend_write(ena_storage_beacon_column_address(segment, ENA_STORAGE_BEACON_COLUMN_RSSI, sizeof(int8_t), record), &rssi, sizeof(int8_t)));
+
+    // only clear the bits of this RPI, others stay untouched
+    uint8_t filter[ENA_STORAGE_BEACON_COLUMNS_FILTER_SIZE];
+    memset(filter, 0xFF, sizeof(filter));
+    for (int hash = 0; hash < ENA_STORAGE_BEACON_COLUMNS_HASHES; hash++)
+    {
+        uint32_t bit = ena_storage_beacon_columns_filter_bit(beacon->rpi, hash);
+        filter[bit / 8] &= ~(1 << (bit % 8));
+    }
+    ESP_ERROR_CHECK(ena_storage_backend_write(ena_storage_beacon_columns_filter_address(segment), filter, sizeof(filter)));
+}
+
+void ena_storage_beacon_columns_read(uint32_t segment, uint32_t record, uint32_t count, ena_beacon_t *beacons)
+{
+    uint8_t column[ENA_STORAGE_CURSOR_BATCH * ENA_STORAGE_BEACON_COLUMN_RPI_SIZE];
+    uint32_t base = beacon_log_range[segment * 2];
+    while (count > 0)
+    {
+        uint32_t batch = count < ENA_STORAGE_CURSOR_BATCH ? count : ENA_STORAGE_CURSOR_BATCH;
+        memset(beacons, 0, batch * sizeof(ena_beacon_t));
+        ESP_ERROR_CHECK(ena_storage_backend_read(ena_storage_beacon_column_address(segment, ENA_STORAGE_BEACON_COLUMN_RPI, ENA_STORAGE_BEACON_COLUMN_RPI_SIZE, record), column, batch * ENA_STORAGE_BEACON_COLUMN_RPI_SIZE));
+        for (uint32_t i = 0; i < batch; i++)
+        {
+            memcpy(beacons[i].rpi, &column[i * ENA_STORAGE_BEACON_COLUMN_RPI_SIZE], ENA_STORAGE_BEACON_COLUMN_RPI_SIZE);
+        }
+        ESP_ERROR_CHECK(ena_storage_backend_read(ena_storage_beacon_column_address(segment, ENA_STORAGE_BEACON_COLUMN_AEM, ENA_STORAGE_BEACON_COLUMN_AEM_SIZE, record), column, batch * ENA_STORAGE_BEACON_COLUMN_AEM_SIZE));
+        for (uint32_t i = 0; i < batch; i++)
+        {
+            memcpy(beacons[i].aem, &column[i * ENA_STORAGE_BEACON_COLUMN_AEM_SIZE], ENA_STORAGE_BEACON_COLUMN_AEM_SIZE);
+        }
+        uint16_t first[ENA_STORAGE_CURSOR_BATCH];
+        uint16_t last[ENA_STORAGE_CURSOR_BATCH];
+        int8_t rssi[ENA_STORAGE_CURSOR_BATCH];
+        ESP_ERROR_CHECK(ena_storage_backend_read(ena_storage_beacon_column_address(segment, ENA_STORAGE_BEACON_COLUMN_FIRST, sizeof(uint16_t), record), first, batch * sizeof(uint16_t)));
+        ESP_ERROR_CHECK(ena_storage_backend_read(ena_storage_beacon_column_address(segment, ENA_STORAGE_BEACON_COLUMN_LAST, sizeof(uint16_t), record), last, batch * sizeof(uint16_t)));
+        ESP_ERROR_CHECK(ena_storage_backend_read(ena_storage_beacon_column_address(segment, ENA_STORAGE_BEACON_COLUMN_RSSI, sizeof(int8_t), record), rssi, batch * sizeof(int8_t)));
+        for (uint32_t i = 0; i < batch; i++)
+        {
+            beacons[i].timestamp_first = base + first[i];
+            beacons[i].timestamp_last = beacons[i].timestamp_first + last[i];
+            beacons[i].rssi = rssi[i];
+        }
+        beacons += batch;
+        record += batch;
+        count -= batch;
+    }
+}
+
+void ena_storage_beacon_log_read(uint32_t segment, uint32_t record, uint32_t count, ena_beacon_t *beacons)
+{
+    if (ENA_STORAGE_BEACON_COLUMNS)
+    {
+        ena_storage_beacon_columns_read(segment, record, count, beacons);
+        return;
+    }
+    ESP_ERROR_CHECK(ena_storage_backend_read(ena_storage_beacon_log_record_address(segment, record), beacons, count * sizeof(ena_beacon_t)));
+}
+
+uint32_t ena_storage_beacon_log_cleared_bits(void *data)
+{
+    uint32_t bitmap[ENA_STORAGE_BEACON_LOG_BITMAP_WORDS];
+    memcpy(bitmap, data, sizeof(bitmap));
+    uint32_t cleared = 0;
+    for (int i = 0; i < ENA_STORAGE_BEACON_LOG_BITMAP_WORDS; i++)
+    {
+        cleared += __builtin_popcount(~bitmap[i]);
+    }
+    return cleared;
+}
+
+int ena_storage_beacon_log_sequence_compare(const void *a, const void *b)
+{
+    uint64_t sequence_a = *(const uint64_t *)a;
+    uint64_t sequence_b = *(const uint64_t *)b;
+    return (sequence_a > sequence_b) - (sequence_a < sequence_b);
+}
+
+void ena_storage_beacon_log_mount(void)
+{
+    if (beacon_log_mounted)
+    {
+        return;
+    }
+
+    ena_storage_segment_header_t header;
+    uint32_t segments = (ena_storage_beacons_end_address() - ena_storage_beacon_log_address()) / BLOCK_SIZE;
+    if (beacon_log_segments != segments)
+    {
+        free(beacon_log_written);
+        free(beacon_log_live);
+        free(beacon_log_order);
+        free(beacon_log_range);
+        beacon_log_segments = segments;
+        beacon_log_written = malloc(segments * sizeof(uint16_t));
+        beacon_log_live = malloc(segments * sizeof(uint16_t));
+        beacon_log_order = malloc(segments * sizeof(uint16_t));
+        beacon_log_range = ENA_STORAGE_BEACON_COLUMNS ? malloc(segments * 2 * sizeof(uint32_t)) : NULL;
+    }
+    // sequence in upper, segment in lower bits for sorting
+    uint64_t *sequences = malloc(segments * sizeof(uint64_t));
+    if (beacon_log_written == NULL || beacon_log_live == NULL || beacon_log_order == NULL || sequences == NULL || (ENA_STORAGE_BEACON_COLUMNS && beacon_log_range == NULL))
+    {
+        ESP_LOGE(ENA_STORAGE_LOG, "Warning %s malloc low memory", "beacon log");
+        free(sequences);
+        return;
+    }
+
+    beacon_log_used = 0;
+    beacon_log_count = 0;
+    beacon_log_sequence = 0;
+    for (uint32_t segment = 0; segment < segments; segment++)
+    {
+        ESP_ERROR_CHECK(ena_storage_backend_read(ena_storage_beacon_log_segment_address(segment), &header, sizeof(ena_storage_segment_header_t)));
+        if (header.magic == ENA_STORAGE_BEACON_LOG_SEGMENT_MAGIC)
+        {
+            beacon_log_written[segment] = ena_storage_beacon_log_cleared_bits(header.written);
+            beacon_log_live[segment] = beacon_log_written[segment] - ena_storage_beacon_log_cleared_bits(header.deleted);
+            beacon_log_count += beacon_log_live[segment];
+            if (ENA_STORAGE_BEACON_COLUMNS)
+            {
+                ena_storage_segment_columns_t columns;
+                ESP_ERROR_CHECK(ena_storage_backend_read(ena_storage_beacon_columns_address(segment), &columns, sizeof(ena_storage_segment_columns_t)));
+                // not closed segment may contain any offset to base
+                beacon_log_range[segment * 2] = columns.timestamp_base;
+                beacon_log_range[segment * 2 + 1] = columns.timestamp_max != 0xFFFFFFFF ? columns.timestamp_max : columns.timestamp_base + UINT16_MAX;
+            }
+            sequences[beacon_log_used++] = ((uint64_t)header.sequence << 16) | segment;
+            if (header.sequence >= beacon_log_sequence)
+            {
+                beacon_log_sequence = header.sequence + 1;
+            }
+        }
+        else
+        {
+            // incomplete opened segments or old data have to be erased before use
+            beacon_log_written[segment] = header.magic == 0xFFFFFFFF && header.sequence == 0xFFFFFFFF ? ENA_STORAGE_BEACON_LOG_FREE : ENA_STORAGE_BEACON_LOG_DIRTY;
+            beacon_log_live[segment] = 0;
+        }
+    }
+
+    qsort(sequences, beacon_log_used, sizeof(uint64_t), ena_storage_beacon_log_sequence_compare);
+    for (uint32_t i = 0; i < beacon_log_used; i++)
+    {
+        beacon_log_order[i] = sequences[i] & 0xFFFF;
+    }
+    free(sequences);
+
+    beacon_log_mounted = true;
+    ESP_LOGI(ENA_STORAGE_LOG, "mounted beacon log: %u beacons in %u of %u segments", beacon_log_count, beacon_log_used, segments);
+}
+
+void ena_storage_beacon_log_erase_segment(uint32_t segment)
+{
+    ESP_ERROR_CHECK(ena_storage_backend_erase(ena_storage_beacon_log_segment_address(segment), BLOCK_SIZE));
+    beacon_log_written[segment] = ENA_STORAGE_BEACON_LOG_FREE;
+    beacon_log_live[segment] = 0;
+    beacon_log_erases++;
+    ESP_LOGD(ENA_STORAGE_LOG, "erased beacon segment %u (%u erases)", segment, beacon_log_erases);
+}
+
+void ena_storage_beacon_log_release_segment(uint32_t segment)
+{
+    // head segment is kept until full
+    bool head = segment == beacon_log_order[beacon_log_used - 1];
+    if (beacon_log_live[segment] > 0 || (head && beacon_log_written[segment] < ENA_STORAGE_BEACON_LOG_RECORDS))
+    {
+        return;
+    }
+
+    for (uint32_t i = 0; i < beacon_log_used; i++)
+    {
+        if (beacon_log_order[i] == segment)
+        {
+            memmove(&beacon_log_order[i], &beacon_log_order[i + 1], (beacon_log_used - i - 1) * sizeof(uint16_t));
+            break;
+        }
+    }
+    beacon_log_used--;
+    ena_storage_beacon_log_erase_segment(segment);
+}
+
+bool ena_storage_beacon_log_open_segment(void)
+{
+    uint32_t start = 0;
+    if (beacon_log_used > 0)
+    {
+        start = beacon_log_order[beacon_log_used - 1] + 1;
+    }
+
+    for (uint32_t i = 0; i < beacon_log_segments; i++)
+    {
+        uint32_t segment = (start + i) % beacon_log_segments;
+        if (beacon_log_written[segment] == ENA_STORAGE_BEACON_LOG_FREE || beacon_log_written[segment] == ENA_STORAGE_BEACON_LOG_DIRTY)
+        {
+            size_t address = ena_storage_beacon_log_segment_address(segment);
+            if (beacon_log_written[segment] == ENA_STORAGE_BEACON_LOG_DIRTY)
+            {
+                ena_storage_beacon_log_erase_segment(segment);
+            }
+            // magic is written last, so an interrupted open is detected on mount
+            uint32_t value = beacon_log_sequence++;
+            ESP_ERROR_CHECK(ena_storage_backend_write(address + sizeof(uint32_t), &value, sizeof(uint32_t)));
+            value = ENA_STORAGE_BEACON_LOG_SEGMENT_MAGIC;
+            ESP_ERROR_CHECK(ena_storage_backend_write(address, &value, sizeof(uint32_t)));
+            beacon_log_written[segment] = 0;
+            beacon_log_live[segment] = 0;
+            beacon_log_order[beacon_log_used++] = segment;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ena_storage_beacon_log_locate(uint32_t index, uint32_t *position, uint32_t *record)
+{
+    ena_storage_beacon_log_mount();
+    *position = 0;
+    while (*position < beacon_log_used && index >= beacon_log_live[beacon_log_order[*position]])
+    {
+        index -= beacon_log_live[beacon_log_order[*position]];
+        (*position)++;
+    }
+    if (*position >= beacon_log_used)
+    {
+        return false;
+    }
+
+    uint32_t segment = beacon_log_order[*position];
+    if (beacon_log_written[segment] == beacon_log_live[segment])
+    {
+        // nothing deleted, records are contiguous
+        *record = index;
+        return true;
+    }
+
+    ena_storage_segment_header_t header;
+    ESP_ERROR_CHECK(ena_storage_backend_read(ena_storage_beacon_log_segment_address(segment), &header, sizeof(ena_storage_segment_header_t)));
+    for (uint32_t i = 0; i < beacon_log_written[segment]; i++)
+    {
+        if (header.deleted[i / 32] & (1u << (i % 32)))
+        {
+            if (index == 0)
+            {
+                *record = i;
+                return true;
+            }
+            index--;
+        }
+    }
+    return false;
+}
+
+uint32_t ena_storage_beacon_log_count(void)
+{
+    ena_storage_beacon_log_mount();
+    return beacon_log_count;
+}
+
+void ena_storage_beacon_log_get(uint32_t index, ena_beacon_t *beacon)
+{
+    uint32_t position, record;
+    if (!ena_storage_beacon_log_locate(index, &position, &record))
+    {
+        ESP_LOGW(ENA_STORAGE_LOG, "beacon %u not found in log", index);
+        memset(beacon, 0, sizeof(ena_beacon_t));
+        return;
+    }
+    uint32_t segment = beacon_log_order[position];
+    ena_storage_beacon_log_read(segment, record, 1, beacon);
+}
+
+void ena_storage_beacon_log_add(ena_beacon_t *beacon)
+{
+    ena_storage_beacon_log_mount();
+    bool full = beacon_log_used == 0 || beacon_log_written[beacon_log_order[beacon_log_used - 1]] >= ENA_STORAGE_BEACON_LOG_RECORDS;
+    if (ENA_STORAGE_BEACON_COLUMNS && !full && !ena_storage_beacon_columns_fit(beacon_log_order[beacon_log_used - 1], beacon))
+    {
+        // timestamp cannot be stored relative to the segment, continue with next segment
+        ena_storage_beacon_columns_close(beacon_log_order[beacon_log_used - 1]);
+        full = true;
+    }
+    if (full)
+    {
+        if (!ena_storage_beacon_log_open_segment())
+        {
+            ESP_LOGE(ENA_STORAGE_LOG, "no space left for beacon %u", beacon_log_count);
+            return;
+        }
+    }
+
+    uint32_t segment = beacon_log_order[beacon_log_used - 1];
+    uint32_t record = beacon_log_written[segment];
+    if (ENA_STORAGE_BEACON_COLUMNS)
+    {
+        ena_storage_beacon_columns_write(segment, record, beacon);
+    }
+    else
+    {
+        ESP_ERROR_CHECK(ena_storage_backend_write(ena_storage_beacon_log_record_address(segment, record), beacon, sizeof(ena_beacon_t)));
+    }
+
+    // mark record as complete, all bits of previous records are already cleared
+    uint32_t bitmap = (record % 32) == 31 ? 0 : (0xFFFFFFFF << ((record % 32) + 1));
+    size_t bitmap_address = ena_storage_beacon_log_segment_address(segment) + offsetof(ena_storage_segment_header_t, written) + (record / 32) * sizeof(uint32_t);
+    ESP_ERROR_CHECK(ena_storage_backend_write(bitmap_address, &bitmap, sizeof(uint32_t)));
+
+    beacon_log_written[segment]++;
+    beacon_log_live[segment]++;
+    beacon_log_count++;
+
+    if (ENA_STORAGE_BEACON_COLUMNS && beacon_log_written[segment] >= ENA_STORAGE_BEACON_LOG_RECORDS)
+    {
+        ena_storage_beacon_columns_close(segment);
+    }
+}
+
+void ena_storage_beacon_log_remove(uint32_t index)
+{
+    uint32_t position, record;
+    if (!ena_storage_beacon_log_locate(index, &position, &record))
+    {
+        ESP_LOGW(ENA_STORAGE_LOG, "beacon %u not found in log", index);
+        return;
+    }
+    uint32_t segment = beacon_log_order[position];
+
+    // only clear the bit of the record, others stay untouched
+    uint32_t bitmap = ~(1u << (record % 32));
+    size_t bitmap_address = ena_storage_beacon_log_segment_address(segment) + offsetof(ena_storage_segment_header_t, deleted) + (record / 32) * sizeof(uint32_t);
+    ESP_ERROR_CHECK(ena_storage_backend_write(bitmap_address, &bitmap, sizeof(uint32_t)));
+    beacon_log_live[segment]--;
+    beacon_log_count--;
+
+    ena_storage_beacon_log_release_segment(segment);
+}
+
+void ena_storage_beacon_log_expire(uint32_t timestamp)
+{
+    ena_storage_beacon_log_mount();
+    ena_beacon_t beacon;
+
+    // tail is the oldest segment, so expiry only advances the tail
+    while (beacon_log_used > 0 && beacon_log_written[beacon_log_order[0]] > 0)
+    {
+        uint32_t tail = beacon_log_order[0];
+        uint32_t live = beacon_log_live[tail];
+
+        // newest record decides for the whole segment
+        ena_storage_beacon_log_read(tail, beacon_log_written[tail] - 1, 1, &beacon);
+        if (beacon.timestamp_last <= timestamp && (beacon_log_used > 1 || beacon_log_written[tail] >= ENA_STORAGE_BEACON_LOG_RECORDS))
+        {
+            beacon_log_live[tail] = 0;
+            beacon_log_count -= live;
+            ena_storage_beacon_log_release_segment(tail);
+            continue;
+        }
+
+        // partially expired, mark expired records as deleted
+        ena_storage_segment_header_t header;
+        ESP_ERROR_CHECK(ena_storage_backend_read(ena_storage_beacon_log_segment_address(tail), &header, sizeof(ena_storage_segment_header_t)));
+        for (uint32_t record = 0; record < beacon_log_written[tail]; record++)
+        {
+            if ((header.deleted[record / 32] & (1u << (record % 32))) == 0)
+            {
+                continue;
+            }
+            ena_storage_beacon_log_read(tail, record, 1, &beacon);
+            if (beacon.timestamp_last > timestamp)
+            {
+                break;
+            }
+            uint32_t bitmap = ~(1u << (record % 32));
+            size_t bitmap_address = ena_storage_beacon_log_segment_address(tail) + offsetof(ena_storage_segment_header_t, deleted) + (record / 32) * sizeof(uint32_t);
+            ESP_ERROR_CHECK(ena_storage_backend_write(bitmap_address, &bitmap, sizeof(uint32_t)));
+            beacon_log_live[tail]--;
+            beacon_log_count--;
+        }
+        ena_storage_beacon_log_release_segment(tail);
+        break;
+    }
+}
+
+void ena_storage_beacon_log_erase(void)
+{
+    ena_storage_beacon_log_mount();
+    for (uint32_t i = 0; i < beacon_log_used; i++)
+    {
+        ena_storage_beacon_log_erase_segment(beacon_log_order[i]);
+    }
+    beacon_log_used = 0;
+    beacon_log_count = 0;
+}
+
+uint32_t ena_storage_beacons_count(void)
+{
+    ena_storage_lock();
+    if (ENA_STORAGE_BEACON_LOG)
+    {
+        uint32_t count = ena_storage_beacon_log_count();
+        ena_storage_unlock();
+        return count;
+    }
+    uint32_t count = ena_storage_counter_get(ENA_STORAGE_COUNTER_BEACONS) - ena_storage_beacons_head();
+    ESP_LOGD(ENA_STORAGE_LOG, "read contancts count: %u", count);
+    ena_storage_unlock();
+    return count;
+}
+
+void ena_storage_get_beacon(uint32_t index, ena_beacon_t *beacon)
+{
+    ena_storage_lock();
+    if (ENA_STORAGE_BEACON_LOG)
+    {
+        ena_storage_beacon_log_get(index, beacon);
+    }
+    else
+    {
+        ena_storage_read(ena_storage_beacon_address(index), beacon, sizeof(ena_beacon_t));
+    }
+    ESP_LOGD(ENA_STORAGE_LOG, "read beacon: first %u, last %u and rssi %d", beacon->timestamp_first, beacon->timestamp_last, beacon->rssi);
+    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->rpi, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
+    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->aem, ENA_AEM_METADATA_LENGTH, ESP_LOG_DEBUG);
+    ena_storage_unlock();
+}
+
+void ena_storage_add_beacon(ena_beacon_t *beacon)
+{
+    ena_storage_lock();
+    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->rpi, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
+    if (ENA_STORAGE_BEACON_LOG)
+    {
+        ena_storage_beacon_log_add(beacon);
+        ena_storage_unlock();
+        return;
+    }
+    uint32_t count = ena_storage_beacons_count();
+    if (count >= ena_storage_beacons_capacity())
+    {
+        ESP_LOGE(ENA_STORAGE_LOG, "no space left for beacon %u", count);
+        ena_storage_unlock();
+        return;
+    }
+    // checked before the beacon is written, the check looks up the last stored beacon
+    bool indexed = ENA_STORAGE_BEACON_INDEX && ena_storage_beacon_index_valid();
+    ena_storage_write(ena_storage_beacon_address(count), beacon, sizeof(ena_beacon_t));
+    ena_storage_counter_set(ENA_STORAGE_COUNTER_BEACONS, ena_storage_counter_get(ENA_STORAGE_COUNTER_BEACONS) + 1);
+    if (indexed && beacon_index_state == 1)
+    {
+        ena_storage_beacon_index_insert(beacon->rpi, count);
+    }
+    ESP_LOGD(ENA_STORAGE_LOG, "write beacon: first %u, last %u  and rssi %d", beacon->timestamp_first, beacon->timestamp_last, beacon->rssi);
+    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->rpi, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
+    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->aem, ENA_AEM_METADATA_LENGTH, ESP_LOG_DEBUG);
+    ena_storage_unlock();
+}
+
+void ena_storage_remove_beacon(uint32_t index)
+{
+    ena_storage_lock();
+    if (ENA_STORAGE_BEACON_LOG)
+    {
+        ena_storage_beacon_log_remove(index);
+        ESP_LOGD(ENA_STORAGE_LOG, "remove beacon: %u", index);
+        ena_storage_unlock();
+        return;
+    }
+    uint32_t count = ena_storage_beacons_count();
+    uint32_t head = ena_storage_beacons_head();
+
+    bool indexed = ENA_STORAGE_BEACON_INDEX && ena_storage_beacon_index_valid();
+    uint32_t base = beacon_index_base;
+    uint32_t deleted = beacon_index_deleted;
+    if (indexed)
+    {
+        // removing the first beacon only moves the base, otherwise following beacons get new slots
+        ena_beacon_t beacon;
+        for (uint32_t i = index; i < (index == 0 ? 1 : count); i++)
+        {
+            ena_storage_get_beacon(i, &beacon);
+            ena_storage_beacon_index_delete(beacon.rpi, i);
+            if (i > index)
+            {
+                ena_storage_beacon_index_insert(beacon.rpi, i - 1);
+            }
+            deleted++;
+        }
+        if (index == 0)
+        {
+            base++;
+        }
+    }
+
+    if (index == 0)
+    {
+        // oldest beacon, only the head of the ring moves
+        ena_storage_counter_set(ENA_STORAGE_COUNTER_BEACONS_HEAD, head + 1);
+    }
+    else
+    {
+        uint32_t capacity = ena_storage_beacons_capacity();
+        uint32_t first = head % capacity;
+        if (first + count <= capacity)
+        {
+            ena_storage_shift_delete(ena_storage_beacon_address(index), ENA_STORAGE_BEACONS_START_ADDRESS + (first + count) * sizeof(ena_beacon_t), sizeof(ena_beacon_t));
+        }
+        else
+        {
+            // following beacons wrap around the end of the ring, move them one by one
+            ena_beacon_t beacon;
+            for (uint32_t i = index + 1; i < count; i++)
+            {
+                ena_storage_read(ena_storage_beacon_address(i), &beacon, sizeof(ena_beacon_t));
+                ena_storage_write(ena_storage_beacon_address(i - 1), &beacon, sizeof(ena_beacon_t));
+            }
+        }
+        ena_storage_counter_set(ENA_STORAGE_COUNTER_BEACONS, head + count - 1);
+    }
+    ESP_LOGD(ENA_STORAGE_LOG, "remove beacon: %u", index);
+
+    if (indexed && beacon_index_state == 1)
+    {
+        ena_storage_beacon_index_set_state(base, deleted);
+    }
+    ena_storage_unlock();
+}
+
+void ena_storage_beacon_cursor_open(ena_storage_beacon_cursor_t *cursor, uint32_t start, uint32_t end)
+{
+    ena_storage_lock();
+    uint32_t count = ena_storage_beacons_count();
+    cursor->index = start;
+    cursor->end = end < count ? end : count;
+    cursor->position = 0;
+    cursor->record = 0;
+    if (ENA_STORAGE_BEACON_LOG && cursor->index < cursor->end)
+    {
+        ena_storage_beacon_log_locate(cursor->index, &cursor->position, &cursor->record);
+    }
+    ena_storage_unlock();
 }
 
-void ena_storage_shift_delete(size_t address, size_t end_address, size_t size)
+uint32_t ena_storage_beacon_log_next_batch(ena_storage_beacon_cursor_t *cursor, ena_beacon_t *beacons, uint32_t max)
 {
-    int block_num_start = address / BLOCK_SIZE;
-    // check for overflow
-    if (address + size <= (block_num_start + 1) * BLOCK_SIZE)
+    uint32_t read = 0;
+    while (read < max && cursor->index < cursor->end && cursor->position < beacon_log_used)
     {
-        const esp_partition_t *partition = esp_partition_find_first(
-            ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, ENA_STORAGE_PARTITION_NAME);
-        assert(partition);
+        uint32_t segment = beacon_log_order[cursor->position];
+        if (cursor->record >= beacon_log_written[segment])
+        {
+            cursor->position++;
+            cursor->record = 0;
+            continue;
+        }
 
-        int block_num_end = end_address / BLOCK_SIZE;
-        size_t block_start = address - block_num_start * BLOCK_SIZE;
-        while (block_num_end >= block_num_start)
+        // records of a segment are contiguous, read as many as possible at once
+        uint32_t batch = beacon_log_written[segment] - cursor->record;
+        if (batch > max - read)
+        {
+            batch = max - read;
+        }
+        if (batch > cursor->end - cursor->index)
         {
+            batch = cursor->end - cursor->index;
+        }
+        ena_storage_beacon_log_read(segment, cursor->record, batch, &beacons[read]);
 
-            void *buffer = malloc(BLOCK_SIZE);
-            ESP_ERROR_CHECK(esp_partition_read(partition, block_num_start * BLOCK_SIZE, buffer, BLOCK_SIZE));
-            vTaskDelay(1);
-            // shift inside buffer
-            ESP_LOGD(ENA_STORAGE_LOG, "shift block %d from %u to %u with size %u", block_num_start, (block_start + size), block_start, (BLOCK_SIZE - block_start - size));
-            memcpy((buffer + block_start), (buffer + block_start + size), BLOCK_SIZE - block_start - size);
-            if (block_num_end > block_num_start)
+        uint32_t valid = batch;
+        if (beacon_log_written[segment] != beacon_log_live[segment])
+        {
+            // drop deleted records
+            ena_storage_segment_header_t header;
+            ESP_ERROR_CHECK(ena_storage_backend_read(ena_storage_beacon_log_segment_address(segment), &header, sizeof(ena_storage_segment_header_t)));
+            valid = 0;
+            for (uint32_t i = 0; i < batch; i++)
             {
-                void *buffer_next_block = malloc(BLOCK_SIZE);
-
-                ESP_ERROR_CHECK(esp_partition_read(partition, (block_num_start + 1) * BLOCK_SIZE, buffer_next_block, BLOCK_SIZE));
-                vTaskDelay(1);
-                // shift from next block
-                ESP_LOGD(ENA_STORAGE_LOG, "shift next block size %u", size);
-                memcpy((buffer + BLOCK_SIZE - size), buffer_next_block, size);
-                free(buffer_next_block);
+                uint32_t record = cursor->record + i;
+                if (header.deleted[record / 32] & (1u << (record % 32)))
+                {
+                    beacons[read + valid++] = beacons[read + i];
+                }
             }
-
-            ESP_ERROR_CHECK(esp_partition_erase_range(partition, block_num_start * BLOCK_SIZE, BLOCK_SIZE));
-            ESP_ERROR_CHECK(esp_partition_write(partition, block_num_start * BLOCK_SIZE, buffer, BLOCK_SIZE));
-            free(buffer);
-
-            block_num_start++;
-            block_start = 0;
         }
+        cursor->record += batch;
+        cursor->index += valid;
+        read += valid;
     }
-    else
-    {
-        ESP_LOGD(ENA_STORAGE_LOG, "overflow block at address %u with size %d (block %d)", address, size, block_num_start);
-        const size_t block1_address = address;
-        const size_t block2_address = (block_num_start + 1) * BLOCK_SIZE;
-        const size_t data2_size = address + size - block2_address;
-        const size_t data1_size = size - data2_size;
-        ena_storage_shift_delete(block1_address, block2_address, data1_size);
-        ena_storage_shift_delete(block2_address, end_address - data1_size, data2_size);
-    }
+    return read;
 }
 
-uint32_t ena_storage_read_last_exposure_date(void)
+uint32_t ena_storage_beacon_cursor_next_batch(ena_storage_beacon_cursor_t *cursor, ena_beacon_t *beacons, uint32_t max)
 {
-    uint32_t timestamp = 0;
-    ena_storage_read(ENA_STORAGE_LAST_EXPOSURE_DATE_ADDRESS, &timestamp, sizeof(uint32_t));
-    return timestamp;
+    ena_storage_lock();
+    uint32_t read = 0;
+    if (ENA_STORAGE_BEACON_LOG)
+    {
+        read = ena_storage_beacon_log_next_batch(cursor, beacons, max);
+    }
+    else if (cursor->index < cursor->end)
+    {
+        read = cursor->end - cursor->index;
+        if (read > max)
+        {
+            read = max;
+        }
+        // one flash access up to the end of the ring
+        uint32_t capacity = ena_storage_beacons_capacity();
+        uint32_t record = (ena_storage_beacons_head() + cursor->index) % capacity;
+        if (read > capacity - record)
+        {
+            read = capacity - record;
+        }
+        ena_storage_cache_read(ENA_STORAGE_BEACONS_START_ADDRESS + record * sizeof(ena_beacon_t), beacons, read * sizeof(ena_beacon_t));
+        cursor->index += read;
+    }
+    ena_storage_yield();
+    ena_storage_unlock();
+    return read;
 }
 
-void ena_storage_write_last_exposure_date(uint32_t timestamp)
+esp_err_t ena_storage_beacons_view_open(ena_storage_beacons_view_t *view, uint32_t start, uint32_t end)
 {
-    ena_storage_write(ENA_STORAGE_LAST_EXPOSURE_DATE_ADDRESS, &timestamp, sizeof(uint32_t));
+    ena_storage_lock();
+    memset(view, 0, sizeof(ena_storage_beacons_view_t));
+    if (ENA_STORAGE_BEACON_LOG)
+    {
+        ena_storage_unlock();
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    uint32_t count = ena_storage_beacons_count();
+    if (end > count)
+    {
+        end = count;
+    }
+    if (start >= end)
+    {
+        ena_storage_unlock();
+        return ESP_ERR_INVALID_SIZE;
+    }
+    size_t address = ena_storage_beacon_address(start);
+    if (address + (end - start) * sizeof(ena_beacon_t) > ENA_STORAGE_BEACONS_START_ADDRESS + ena_storage_beacons_capacity() * sizeof(ena_beacon_t))
+    {
+        ESP_LOGD(ENA_STORAGE_LOG, "cannot map beacons [%u,%u]: wrapped around end of ring", start, end);
+        ena_storage_unlock();
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    // mapped flash has to contain cached writes
+    ena_storage_flush();
+    const void *data = NULL;
+    esp_err_t err = ena_storage_backend_mmap(address, (end - start) * sizeof(ena_beacon_t), &data, &view->handle);
+    if (err != ESP_OK)
+    {
+        ESP_LOGD(ENA_STORAGE_LOG, "cannot map beacons [%u,%u]: %s", start, end, esp_err_to_name(err));
+        ena_storage_unlock();
+        return err;
+    }
+    view->beacons = data;
+    view->start = start;
+    view->count = end - start;
+    ena_storage_unlock();
+    return ESP_OK;
 }
 
-uint32_t ena_storage_tek_count(void)
+void ena_storage_beacons_view_close(ena_storage_beacons_view_t *view)
 {
-    uint32_t count = 0;
-    ena_storage_read(ENA_STORAGE_TEK_COUNT_ADDRESS, &count, sizeof(uint32_t));
-    ESP_LOGD(ENA_STORAGE_LOG, "read TEK count: %u", count);
-    return count;
+    if (view->beacons != NULL)
+    {
+        ena_storage_backend_munmap(view->handle);
+    }
+    memset(view, 0, sizeof(ena_storage_beacons_view_t));
 }
 
-uint32_t ena_storage_read_last_tek(ena_tek_t *tek)
+bool ena_storage_beacons_block_free(size_t block_start, uint32_t first, uint32_t live)
 {
-    uint32_t tek_count = ena_storage_tek_count();
-    if (tek_count < 1)
+    uint32_t capacity = ena_storage_beacons_capacity();
+    uint32_t position = block_start > ENA_STORAGE_BEACONS_START_ADDRESS ? (block_start - ENA_STORAGE_BEACONS_START_ADDRESS) / sizeof(ena_beacon_t) : 0;
+    uint32_t last = (block_start + BLOCK_SIZE - 1 - ENA_STORAGE_BEACONS_START_ADDRESS) / sizeof(ena_beacon_t);
+    if (last >= capacity)
     {
-        return 0;
+        last = capacity - 1;
     }
-    uint8_t index = (tek_count % ENA_STORAGE_TEK_MAX) - 1;
-    ena_storage_read(ENA_STORAGE_TEK_START_ADDRESS + index * sizeof(ena_tek_t), tek, sizeof(ena_tek_t));
-
-    ESP_LOGD(ENA_STORAGE_LOG, "read last tek %u:", tek->enin);
-    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, tek->key_data, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
-    return tek_count;
+    for (; position <= last; position++)
+    {
+        if ((position + capacity - first) % capacity < live)
+        {
+            return false;
+        }
+    }
+    return true;
 }
 
-void ena_storage_get_tek(uint32_t index, ena_tek_t *tek)
+void ena_storage_beacons_erase_expired(uint32_t head, uint32_t expired)
 {
-    ena_storage_read(ENA_STORAGE_TEK_START_ADDRESS + index * sizeof(ena_tek_t), tek, sizeof(ena_tek_t));
-    ESP_LOGD(ENA_STORAGE_LOG, "read %d tek %u:", index, tek->enin);
-    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, tek->key_data, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
+    // the moved head has to be in flash before the records behind it are erased
+    ena_storage_flush();
+    uint32_t capacity = ena_storage_beacons_capacity();
+    uint32_t first = (head + expired) % capacity;
+    uint32_t live = ena_storage_counter_get(ENA_STORAGE_COUNTER_BEACONS) - head - expired;
+    size_t ring_end = ENA_STORAGE_BEACONS_START_ADDRESS + capacity * sizeof(ena_beacon_t);
+    size_t checked = SIZE_MAX;
+    for (uint32_t i = 0; i < expired; i++)
+    {
+        size_t block_start = ((ENA_STORAGE_BEACONS_START_ADDRESS + ((head + i) % capacity) * sizeof(ena_beacon_t)) / BLOCK_SIZE) * BLOCK_SIZE;
+        if (block_start == checked)
+        {
+            continue;
+        }
+        checked = block_start;
+        if (!ena_storage_beacons_block_free(block_start, first, live))
+        {
+            continue;
+        }
+        if (block_start < ENA_STORAGE_BEACONS_START_ADDRESS || block_start + BLOCK_SIZE > ring_end)
+        {
+            // edge blocks share flash with the counts and the head word, only their part of the ring is erased
+            size_t start = block_start < ENA_STORAGE_BEACONS_START_ADDRESS ? ENA_STORAGE_BEACONS_START_ADDRESS : block_start;
+            size_t end = block_start + BLOCK_SIZE > ring_end ? ring_end : block_start + BLOCK_SIZE;
+            uint8_t *erased = malloc(end - start);
+            if (erased == NULL)
+            {
+                ESP_LOGE(ENA_STORAGE_LOG, "Warning %s malloc low memory", "erased");
+                continue;
+            }
+            memset(erased, 0xFF, end - start);
+            ena_storage_write(start, erased, end - start);
+            free(erased);
+            continue;
+        }
+        // erased now, so appends after the ring wrapped are written directly instead of rewriting the block
+        int entry = ena_storage_cache_find(block_start);
+        if (entry >= 0)
+        {
+            free(cache_data[entry]);
+            cache_data[entry] = NULL;
+        }
+        ESP_ERROR_CHECK(ena_storage_backend_erase(block_start, BLOCK_SIZE));
+        ESP_LOGD(ENA_STORAGE_LOG, "erased expired beacon block at %u", block_start);
+    }
 }
 
-void ena_storage_write_tek(ena_tek_t *tek)
+void ena_storage_expire_beacons(uint32_t timestamp)
 {
-    uint32_t tek_count = 0;
-    ena_storage_read(ENA_STORAGE_TEK_COUNT_ADDRESS, &tek_count, sizeof(uint32_t));
-    uint8_t index = (tek_count % ENA_STORAGE_TEK_MAX);
-    ena_storage_write(ENA_STORAGE_TEK_START_ADDRESS + index * sizeof(ena_tek_t), tek, sizeof(ena_tek_t));
+    ena_storage_lock();
+    if (beacons_held > 0)
+    {
+        // expiry moves the indices of held cursors and views
+        if (timestamp > beacons_expire_pending)
+        {
+            beacons_expire_pending = timestamp;
+        }
+        ESP_LOGD(ENA_STORAGE_LOG, "beacons held, expire until %u on release", timestamp);
+        ena_storage_unlock();
+        return;
+    }
 
-    tek_count++;
-    ena_storage_write(ENA_STORAGE_TEK_COUNT_ADDRESS, &tek_count, sizeof(uint32_t));
+    if (ENA_STORAGE_BEACON_LOG)
+    {
+        ena_storage_beacon_log_expire(timestamp);
+        ESP_LOGD(ENA_STORAGE_LOG, "expired beacons until %u", timestamp);
+        ena_storage_unlock();
+        return;
+    }
 
-    ESP_LOGD(ENA_STORAGE_LOG, "write tek: ENIN %u", tek->enin);
-    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, tek->key_data, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
-}
+    uint32_t count = ena_storage_beacons_count();
+    uint32_t head = ena_storage_beacons_head();
+    uint32_t expired = 0;
+    ena_storage_beacon_cursor_t cursor;
+    ena_beacon_t beacons[ENA_STORAGE_CURSOR_BATCH];
+    uint32_t read = 0;
+    bool done = false;
+    bool indexed = ENA_STORAGE_BEACON_INDEX && ena_storage_beacon_index_valid();
+    ena_storage_beacon_cursor_open(&cursor, 0, count);
+    while (!done && (read = ena_storage_beacon_cursor_next_batch(&cursor, beacons, ENA_STORAGE_CURSOR_BATCH)) > 0)
+    {
+        for (uint32_t i = 0; i < read && !done; i++)
+        {
+            if (beacons[i].timestamp_last > timestamp)
+            {
+                done = true;
+            }
+            else
+            {
+                if (indexed)
+                {
+                    ena_storage_beacon_index_delete(beacons[i].rpi, expired);
+                }
+                expired++;
+            }
+        }
+    }
 
-uint32_t ena_storage_exposure_information_count(void)
-{
-    uint32_t count = 0;
-    ena_storage_read(ENA_STORAGE_EXPOSURE_INFORMATION_COUNT_ADDRESS, &count, sizeof(uint32_t));
-    ESP_LOGD(ENA_STORAGE_LOG, "read exposure information count: %u", count);
-    return count;
-}
+    if (expired == 0)
+    {
+        ena_storage_unlock();
+        return;
+    }
 
-void ena_storage_get_exposure_information(uint32_t index, ena_exposure_information_t *exposure_info)
-{
-    ena_storage_read(ENA_STORAGE_EXPOSURE_INFORMATION_START_ADDRESS + index * sizeof(ena_exposure_information_t), exposure_info, sizeof(ena_exposure_information_t));
-    ESP_LOGD(ENA_STORAGE_LOG, "read exporuse information: day %u, duration %d", exposure_info->day, exposure_info->duration_minutes);
+    // remaining beacons stay in place, a single counter write moves the head of the ring
+    ena_storage_counter_set(ENA_STORAGE_COUNTER_BEACONS_HEAD, head + expired);
+    ena_storage_beacons_erase_expired(head, expired);
+    ESP_LOGD(ENA_STORAGE_LOG, "expired %u beacons until %u", expired, timestamp);
+
+    // remaining beacons keep their record numbers, the index only moves its base
+    if (indexed && beacon_index_state == 1)
+    {
+        ena_storage_beacon_index_set_state(beacon_index_base + expired, beacon_index_deleted + expired);
+    }
+    ena_storage_unlock();
 }
 
-void ena_storage_add_exposure_information(ena_exposure_information_t *exposure_info)
+void ena_storage_beacons_hold(void)
 {
-    uint32_t count = ena_storage_exposure_information_count();
-    ena_storage_write(ENA_STORAGE_EXPOSURE_INFORMATION_START_ADDRESS + count * sizeof(ena_exposure_information_t), exposure_info, sizeof(ena_exposure_information_t));
-    count++;
-    ena_storage_write(ENA_STORAGE_EXPOSURE_INFORMATION_COUNT_ADDRESS, &count, sizeof(uint32_t));
-    ESP_LOGD(ENA_STORAGE_LOG, "write exposure info:  day %u, duration %d", exposure_info->day, exposure_info->duration_minutes);
+    ena_storage_lock();
+    beacons_held++;
+    ena_storage_unlock();
 }
 
-uint32_t ena_storage_temp_beacons_count(void)
+void ena_storage_beacons_release(void)
 {
-    uint32_t count = 0;
-    ena_storage_read(ENA_STORAGE_TEMP_BEACONS_COUNT_ADDRESS, &count, sizeof(uint32_t));
-    ESP_LOGD(ENA_STORAGE_LOG, "read temp beacons count: %u", count);
-    return count;
+    ena_storage_lock();
+    if (beacons_held > 0 && --beacons_held == 0 && beacons_expire_pending > 0)
+    {
+        uint32_t timestamp = beacons_expire_pending;
+        beacons_expire_pending = 0;
+        ena_storage_expire_beacons(timestamp);
+    }
+    ena_storage_unlock();
 }
 
-void ena_storage_get_temp_beacon(uint32_t index, ena_beacon_t *beacon)
+uint32_t ena_storage_find_beacons(uint8_t *rpi, uint32_t *indices, uint32_t max)
 {
-    ena_storage_read(ENA_STORAGE_TEMP_BEACONS_START_ADDRESS + index * sizeof(ena_beacon_t), beacon, sizeof(ena_beacon_t));
-    ESP_LOGD(ENA_STORAGE_LOG, "read temp beacon: first %u, last %u and rssi %d", beacon->timestamp_first, beacon->timestamp_last, beacon->rssi);
-    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->rpi, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
-    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->aem, ENA_AEM_METADATA_LENGTH, ESP_LOG_DEBUG);
+    ena_storage_lock();
+    if (ENA_STORAGE_BEACON_INDEX)
+    {
+        if (!ena_storage_beacon_index_valid())
+        {
+            ena_storage_beacon_index_rebuild();
+        }
+        uint32_t found = ena_storage_beacon_index_lookup(rpi, indices, max);
+        ena_storage_unlock();
+        return found;
+    }
+
+    // without index, scan all beacons
+    uint32_t found = 0;
+    uint32_t index = 0;
+    uint32_t read = 0;
+    ena_storage_beacon_cursor_t cursor;
+    ena_beacon_t beacons[ENA_STORAGE_CURSOR_BATCH];
+    ena_storage_beacon_cursor_open(&cursor, 0, UINT32_MAX);
+    while ((read = ena_storage_beacon_cursor_next_batch(&cursor, beacons, ENA_STORAGE_CURSOR_BATCH)) > 0)
+    {
+        for (uint32_t i = 0; i < read; i++, index++)
+        {
+            if (memcmp(beacons[i].rpi, rpi, ENA_KEY_LENGTH) == 0)
+            {
+                if (found < max)
+                {
+                    indices[found] = index;
+                }
+                found++;
+            }
+        }
+    }
+    ena_storage_unlock();
+    return found;
 }
 
-uint32_t ena_storage_add_temp_beacon(ena_beacon_t *beacon)
+bool ena_storage_rpi_equal(const uint8_t *a, const uint8_t *b)
 {
-    uint32_t count = ena_storage_temp_beacons_count();
-    // overwrite older temporary beacons?!
-    uint8_t index = count % ENA_STORAGE_TEMP_BEACONS_MAX;
-    ena_storage_set_temp_beacon(index, beacon);
-    ESP_LOGD(ENA_STORAGE_LOG, "add temp beacon at %u: first %u, last %u  and rssi %d", index, beacon->timestamp_first, beacon->timestamp_last, beacon->rssi);
-    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->rpi, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
-    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->aem, ENA_AEM_METADATA_LENGTH, ESP_LOG_DEBUG);
-    count++;
-    ena_storage_write(ENA_STORAGE_TEMP_BEACONS_COUNT_ADDRESS, &count, sizeof(uint32_t));
-    return count - 1;
+    // compare 128 bit with two wide loads instead of byte by byte
+    uint64_t a_words[2], b_words[2];
+    memcpy(a_words, a, ENA_KEY_LENGTH);
+    memcpy(b_words, b, ENA_KEY_LENGTH);
+    return ((a_words[0] ^ b_words[0]) | (a_words[1] ^ b_words[1])) == 0;
 }
 
-void ena_storage_set_temp_beacon(uint32_t index, ena_beacon_t *beacon)
+bool ena_storage_beacon_columns_rpi_equal(const uint8_t *stored, const uint8_t *rpi)
 {
-    ena_storage_write(ENA_STORAGE_TEMP_BEACONS_START_ADDRESS + index * sizeof(ena_beacon_t), beacon, sizeof(ena_beacon_t));
-    ESP_LOGD(ENA_STORAGE_LOG, "set temp beacon at %u: first %u, last %u  and rssi %d", index, beacon->timestamp_first, beacon->timestamp_last, beacon->rssi);
-    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->rpi, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
-    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->aem, ENA_AEM_METADATA_LENGTH, ESP_LOG_DEBUG);
+    if (!ENA_STORAGE_BEACON_FINGERPRINT)
+    {
+        return ena_storage_rpi_equal(stored, rpi);
+    }
+    uint64_t stored_word = 0, rpi_word = 0;
+    memcpy(&stored_word, stored, ENA_STORAGE_BEACON_COLUMN_RPI_SIZE);
+    memcpy(&rpi_word, rpi, ENA_STORAGE_BEACON_COLUMN_RPI_SIZE);
+    return stored_word == rpi_word;
 }
 
-void ena_storage_remove_temp_beacon(uint32_t index)
+uint32_t ena_storage_beacon_columns_match(uint8_t *rpis, uint32_t enin, uint32_t count, uint32_t skew, ena_beacon_t *beacons, uint32_t max)
 {
-    uint32_t count = ena_storage_temp_beacons_count();
-    size_t address_from = ENA_STORAGE_TEMP_BEACONS_START_ADDRESS + index * sizeof(ena_beacon_t);
-    size_t address_to = ENA_STORAGE_TEMP_BEACONS_START_ADDRESS + count * sizeof(ena_beacon_t);
-
-    ena_storage_shift_delete(address_from, address_to, sizeof(ena_beacon_t));
+    ena_storage_beacon_log_mount();
+    uint8_t *column = malloc(ENA_STORAGE_BEACON_LOG_RECORDS * ENA_STORAGE_BEACON_COLUMN_RPI_SIZE);
+    if (column == NULL)
+    {
+        ESP_LOGE(ENA_STORAGE_LOG, "Warning %s malloc low memory", "columns");
+        return 0;
+    }
 
-    count--;
-    ena_storage_write(ENA_STORAGE_TEMP_BEACONS_COUNT_ADDRESS, &count, sizeof(uint32_t));
-    ESP_LOGD(ENA_STORAGE_LOG, "remove temp beacon: %u", index);
-}
+    uint32_t found = 0;
+    uint32_t skipped = 0;
+    uint8_t filter[ENA_STORAGE_BEACON_COLUMNS_FILTER_SIZE];
+    bool candidates[ENA_TEK_ROLLING_PERIOD];
+    ena_beacon_t beacon;
+    for (uint32_t position = 0; position < beacon_log_used; position++)
+    {
+        uint32_t segment = beacon_log_order[position];
+        uint32_t written = beacon_log_written[segment];
+        if (written == 0)
+        {
+            continue;
+        }
 
-uint32_t ena_storage_beacons_count(void)
-{
-    uint32_t count = 0;
-    ena_storage_read(ENA_STORAGE_BEACONS_COUNT_ADDRESS, &count, sizeof(uint32_t));
-    ESP_LOGD(ENA_STORAGE_LOG, "read contancts count: %u", count);
-    return count;
-}
+        // RPIs [start, end) could have been seen in time range of the segment
+        uint32_t enin_min = ena_crypto_enin(beacon_log_range[segment * 2]);
+        uint32_t enin_max = ena_crypto_enin(beacon_log_range[segment * 2 + 1]);
+        uint32_t start = enin_min > enin + skew ? enin_min - enin - skew : 0;
+        uint32_t end = enin_max + skew + 1 > enin ? enin_max + skew + 1 - enin : 0;
+        if (end > count)
+        {
+            end = count;
+        }
+        if (start >= end)
+        {
+            skipped++;
+            continue;
+        }
 
-void ena_storage_get_beacon(uint32_t index, ena_beacon_t *beacon)
-{
-    ena_storage_read(ENA_STORAGE_BEACONS_START_ADDRESS + index * sizeof(ena_beacon_t), beacon, sizeof(ena_beacon_t));
-    ESP_LOGD(ENA_STORAGE_LOG, "read beacon: first %u, last %u and rssi %d", beacon->timestamp_first, beacon->timestamp_last, beacon->rssi);
-    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->rpi, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
-    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->aem, ENA_AEM_METADATA_LENGTH, ESP_LOG_DEBUG);
-}
+        ESP_ERROR_CHECK(ena_storage_backend_read(ena_storage_beacon_columns_filter_address(segment), filter, sizeof(filter)));
+        bool candidate = false;
+        for (uint32_t i = start; i < end; i++)
+        {
+            candidates[i - start] = ena_storage_beacon_columns_filter_contains(filter, &rpis[i * ENA_KEY_LENGTH]);
+            candidate |= candidates[i - start];
+        }
+        if (!candidate)
+        {
+            skipped++;
+            continue;
+        }
 
-void ena_storage_add_beacon(ena_beacon_t *beacon)
-{
-    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->rpi, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
-    uint32_t count = ena_storage_beacons_count();
-    ena_storage_write(ENA_STORAGE_BEACONS_START_ADDRESS + count * sizeof(ena_beacon_t), beacon, sizeof(ena_beacon_t));
-    count++;
-    ena_storage_write(ENA_STORAGE_BEACONS_COUNT_ADDRESS, &count, sizeof(uint32_t));
-    ESP_LOGD(ENA_STORAGE_LOG, "write beacon: first %u, last %u  and rssi %d", beacon->timestamp_first, beacon->timestamp_last, beacon->rssi);
-    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->rpi, ENA_KEY_LENGTH, ESP_LOG_DEBUG);
-    ESP_LOG_BUFFER_HEXDUMP(ENA_STORAGE_LOG, beacon->aem, ENA_AEM_METADATA_LENGTH, ESP_LOG_DEBUG);
+        ena_storage_segment_header_t header;
+        ESP_ERROR_CHECK(ena_storage_backend_read(ena_storage_beacon_log_segment_address(segment), &header, sizeof(ena_storage_segment_header_t)));
+        ESP_ERROR_CHECK(ena_storage_backend_read(ena_storage_beacon_column_address(segment, ENA_STORAGE_BEACON_COLUMN_RPI, ENA_STORAGE_BEACON_COLUMN_RPI_SIZE, 0), column, written * ENA_STORAGE_BEACON_COLUMN_RPI_SIZE));
+        // every record of the segment is compared, matches beyond max are counted only
+        for (uint32_t i = start; i < end; i++)
+        {
+            if (!candidates[i - start])
+            {
+                continue;
+            }
+            for (uint32_t record = 0; record < written; record++)
+            {
+                if (ena_storage_beacon_columns_rpi_equal(&column[record * ENA_STORAGE_BEACON_COLUMN_RPI_SIZE], &rpis[i * ENA_KEY_LENGTH]) && (header.deleted[record / 32] & (1u << (record % 32))))
+                {
+                    ena_storage_beacon_columns_read(segment, record, 1, &beacon);
+                    // complete truncated RPI with the matching one
+                    memcpy(beacon.rpi, &rpis[i * ENA_KEY_LENGTH], ENA_KEY_LENGTH);
+                    uint32_t beacon_enin = ena_crypto_enin(beacon.timestamp_first);
+                    if (beacon_enin + skew >= enin + i && beacon_enin <= enin + i + skew)
+                    {
+                        if (found < max)
+                        {
+                            beacons[found] = beacon;
+                        }
+                        found++;
+                    }
+                }
+            }
+        }
+        ena_storage_yield();
+    }
+    free(column);
+    ESP_LOGD(ENA_STORAGE_LOG, "matched %u beacons, skipped %u of %u segments", found, skipped, beacon_log_used);
+    return found;
 }
 
-void ena_storage_remove_beacon(uint32_t index)
+uint32_t ena_storage_match_beacons(uint8_t *rpis, uint32_t enin, uint32_t count, uint32_t skew, ena_beacon_t *beacons, uint32_t max)
 {
-    uint32_t count = ena_storage_beacons_count();
-    size_t address_from = ENA_STORAGE_BEACONS_START_ADDRESS + index * sizeof(ena_beacon_t);
-    size_t address_to = ENA_STORAGE_BEACONS_START_ADDRESS + count * sizeof(ena_beacon_t);
-
-    ena_storage_shift_delete(address_from, address_to, sizeof(ena_beacon_t));
+    ena_storage_lock();
+    uint32_t found = 0;
+    if (ENA_STORAGE_BEACON_COLUMNS)
+    {
+        // columns are searched per rolling period because of candidate flags
+        for (uint32_t i = 0; i < count; i += ENA_TEK_ROLLING_PERIOD)
+        {
+            uint32_t batch = count - i < ENA_TEK_ROLLING_PERIOD ? count - i : ENA_TEK_ROLLING_PERIOD;
+            found += ena_storage_beacon_columns_match(&rpis[i * ENA_KEY_LENGTH], enin + i, batch, skew, &beacons[found < max ? found : max], found < max ? max - found : 0);
+        }
+        ena_storage_unlock();
+        return found;
+    }
 
-    count--;
-    ena_storage_write(ENA_STORAGE_BEACONS_COUNT_ADDRESS, &count, sizeof(uint32_t));
-    ESP_LOGD(ENA_STORAGE_LOG, "remove beacon: %u", index);
+    uint32_t read = 0;
+    ena_storage_beacon_cursor_t cursor;
+    ena_beacon_t batch[ENA_STORAGE_CURSOR_BATCH];
+    ena_storage_beacon_cursor_open(&cursor, 0, UINT32_MAX);
+    while ((read = ena_storage_beacon_cursor_next_batch(&cursor, batch, ENA_STORAGE_CURSOR_BATCH)) > 0)
+    {
+        for (uint32_t b = 0; b < read; b++)
+        {
+            uint32_t beacon_enin = ena_crypto_enin(batch[b].timestamp_first);
+            uint32_t first = beacon_enin > enin + skew ? beacon_enin - enin - skew : 0;
+            for (uint32_t i = first; i < count && enin + i <= beacon_enin + skew; i++)
+            {
+                if (ena_storage_rpi_equal(batch[b].rpi, &rpis[i * ENA_KEY_LENGTH]))
+                {
+                    if (found < max)
+                    {
+                        beacons[found] = batch[b];
+                    }
+                    found++;
+                    break;
+                }
+            }
+        }
+    }
+    ena_storage_unlock();
+    return found;
 }
 
 void ena_storage_erase_all(void)
 {
-    const esp_partition_t *partition = esp_partition_find_first(
-        ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, ENA_STORAGE_PARTITION_NAME);
-    assert(partition);
-    ESP_ERROR_CHECK(esp_partition_erase_range(partition, 0, partition->size));
-    ESP_LOGI(ENA_STORAGE_LOG, "erased partition %s!", ENA_STORAGE_PARTITION_NAME);
+    ena_storage_lock();
+    ESP_ERROR_CHECK(ena_storage_backend_erase(0, ena_storage_backend_size()));
+    ESP_LOGI(ENA_STORAGE_LOG, "erased storage %s!", ena_storage_backend_get()->name);
+    beacon_index_state = -1;
+    beacon_log_mounted = false;
+    counters_mounted = false;
+    checkpoint_mounted = false;
+    key_digests_mounted = false;
+    for (int entry = 0; entry < ENA_STORAGE_WRITE_CACHE_BLOCKS; entry++)
+    {
+        free(cache_data[entry]);
+        cache_data[entry] = NULL;
+        cache_dirty[entry] = false;
+    }
 
     uint32_t count = 0;
     ena_storage_write(ENA_STORAGE_LAST_EXPOSURE_DATE_ADDRESS, &count, sizeof(uint32_t));
-    ena_storage_write(ENA_STORAGE_TEK_COUNT_ADDRESS, &count, sizeof(uint32_t));
-    ena_storage_write(ENA_STORAGE_EXPOSURE_INFORMATION_COUNT_ADDRESS, &count, sizeof(uint32_t));
-    ena_storage_write(ENA_STORAGE_TEMP_BEACONS_COUNT_ADDRESS, &count, sizeof(uint32_t));
-    ena_storage_write(ENA_STORAGE_BEACONS_COUNT_ADDRESS, &count, sizeof(uint32_t));
+    ena_storage_counter_set(ENA_STORAGE_COUNTER_TEK, count);
+    ena_storage_counter_set(ENA_STORAGE_COUNTER_EXPOSURE_INFORMATION, count);
+    ena_storage_counter_set(ENA_STORAGE_COUNTER_TEMP_BEACONS, count);
+    ena_storage_counter_set(ENA_STORAGE_COUNTER_BEACONS, count);
+    if (!ENA_STORAGE_BEACON_LOG)
+    {
+        ena_storage_counter_set(ENA_STORAGE_COUNTER_BEACONS_HEAD, count);
+    }
+    ena_storage_unlock();
 }
 
 void ena_storage_erase_tek(void)
 {
-    uint32_t count = 0;
-    ena_storage_read(ENA_STORAGE_TEK_COUNT_ADDRESS, &count, sizeof(uint32_t));
+    ena_storage_lock();
+    uint32_t count = ena_storage_counter_get(ENA_STORAGE_COUNTER_TEK);
     uint32_t stored = ENA_STORAGE_TEK_MAX;
 
     if (count < ENA_STORAGE_TEK_MAX)
@@ -366,29 +2812,44 @@ void ena_storage_erase_tek(void)
     }
 
     size_t size = sizeof(uint32_t) + stored * sizeof(ena_tek_t);
+    if (ENA_STORAGE_COUNTER_JOURNAL)
+    {
+        // reset before records, the journal is not part of the erased area
+        ena_storage_counter_set(ENA_STORAGE_COUNTER_TEK, 0);
+    }
     ena_storage_erase(ENA_STORAGE_TEK_COUNT_ADDRESS, size);
     ESP_LOGI(ENA_STORAGE_LOG, "erased %d teks (size %u at %u)", stored, size, ENA_STORAGE_TEK_COUNT_ADDRESS);
+    ena_storage_unlock();
 }
 
 void ena_storage_erase_exposure_information(void)
 {
+    ena_storage_lock();
     uint32_t count = ena_storage_exposure_information_count();
-    uint32_t stored = ENA_STORAGE_EXPOSURE_INFORMATION_MAX;
+    uint32_t stored = ENA_STORAGE_EXPOSURE_INFORMATION_SLOTS;
 
-    if (count < ENA_STORAGE_EXPOSURE_INFORMATION_MAX)
+    if (count < ENA_STORAGE_EXPOSURE_INFORMATION_SLOTS)
     {
         stored = count;
     }
 
     size_t size = sizeof(uint32_t) + stored * sizeof(ena_exposure_information_t);
+    if (ENA_STORAGE_COUNTER_JOURNAL)
+    {
+        // reset before records, the journal is not part of the erased area
+        ena_storage_counter_set(ENA_STORAGE_COUNTER_EXPOSURE_INFORMATION, 0);
+    }
     ena_storage_erase(ENA_STORAGE_EXPOSURE_INFORMATION_COUNT_ADDRESS, size);
+    // invalidate exposure summary
+    ena_storage_erase(ena_storage_exposure_summary_address(), sizeof(uint32_t));
     ESP_LOGI(ENA_STORAGE_LOG, "erased %d exposure information (size %u at %u)", stored, size, ENA_STORAGE_EXPOSURE_INFORMATION_COUNT_ADDRESS);
+    ena_storage_unlock();
 }
 
 void ena_storage_erase_temporary_beacon(void)
 {
-    uint32_t beacon_count = 0;
-    ena_storage_read(ENA_STORAGE_TEMP_BEACONS_COUNT_ADDRESS, &beacon_count, sizeof(uint32_t));
+    ena_storage_lock();
+    uint32_t beacon_count = ena_storage_counter_get(ENA_STORAGE_COUNTER_TEMP_BEACONS);
     uint32_t stored = ENA_STORAGE_TEMP_BEACONS_MAX;
 
     if (beacon_count < ENA_STORAGE_TEMP_BEACONS_MAX)
@@ -397,19 +2858,58 @@ void ena_storage_erase_temporary_beacon(void)
     }
 
     size_t size = sizeof(uint32_t) + stored * sizeof(ena_beacon_t);
+    if (ENA_STORAGE_COUNTER_JOURNAL)
+    {
+        // reset before records, the journal is not part of the erased area
+        ena_storage_counter_set(ENA_STORAGE_COUNTER_TEMP_BEACONS, 0);
+    }
     ena_storage_erase(ENA_STORAGE_TEMP_BEACONS_COUNT_ADDRESS, size);
 
     ESP_LOGI(ENA_STORAGE_LOG, "erased %d temporary beacons (size %u at %u)", stored, size, ENA_STORAGE_TEMP_BEACONS_COUNT_ADDRESS);
+    ena_storage_unlock();
 }
 
 void ena_storage_erase_beacon(void)
 {
-    uint32_t beacon_count = 0;
-    ena_storage_read(ENA_STORAGE_BEACONS_COUNT_ADDRESS, &beacon_count, sizeof(uint32_t));
+    ena_storage_lock();
+    if (ENA_STORAGE_BEACON_LOG)
+    {
+        ena_storage_beacon_log_erase();
+        ESP_LOGI(ENA_STORAGE_LOG, "erased beacon log");
+        ena_storage_unlock();
+        return;
+    }
+    uint32_t beacon_count = ena_storage_beacons_count();
+    uint32_t capacity = ena_storage_beacons_capacity();
+    uint32_t first = ena_storage_beacons_head() % capacity;
 
-    size_t size = sizeof(uint32_t) + beacon_count * sizeof(ena_beacon_t);
-    ena_storage_erase(ENA_STORAGE_BEACONS_COUNT_ADDRESS, size);
-    ESP_LOGI(ENA_STORAGE_LOG, "erased %d beacons (size %u at %u)", beacon_count, size, ENA_STORAGE_BEACONS_COUNT_ADDRESS);
+    if (ENA_STORAGE_COUNTER_JOURNAL)
+    {
+        // reset before records, the journal is not part of the erased area
+        ena_storage_counter_set(ENA_STORAGE_COUNTER_BEACONS, 0);
+        ena_storage_counter_set(ENA_STORAGE_COUNTER_BEACONS_HEAD, 0);
+    }
+    else
+    {
+        ena_storage_erase(ena_storage_counter_address(ENA_STORAGE_COUNTER_BEACONS_HEAD), sizeof(uint32_t));
+    }
+    // stored beacons may wrap around the end of the ring
+    uint32_t size = beacon_count < capacity - first ? beacon_count : capacity - first;
+    ena_storage_erase(ENA_STORAGE_BEACONS_COUNT_ADDRESS, sizeof(uint32_t));
+    if (size > 0)
+    {
+        ena_storage_erase(ENA_STORAGE_BEACONS_START_ADDRESS + first * sizeof(ena_beacon_t), size * sizeof(ena_beacon_t));
+    }
+    if (beacon_count > size)
+    {
+        ena_storage_erase(ENA_STORAGE_BEACONS_START_ADDRESS, (beacon_count - size) * sizeof(ena_beacon_t));
+    }
+    ESP_LOGI(ENA_STORAGE_LOG, "erased %d beacons (ring head %u)", beacon_count, first);
+    if (ENA_STORAGE_BEACON_INDEX)
+    {
+        ena_storage_beacon_index_invalidate();
+    }
+    ena_storage_unlock();
 }
 
 void ena_storage_dump_hash_array(uint8_t *data, size_t size)
@@ -430,8 +2930,7 @@ void ena_storage_dump_hash_array(uint8_t *data, size_t size)
 void ena_storage_dump_teks(void)
 {
     ena_tek_t tek;
-    uint32_t tek_count = 0;
-    ena_storage_read(ENA_STORAGE_TEK_COUNT_ADDRESS, &tek_count, sizeof(uint32_t));
+    uint32_t tek_count = ena_storage_counter_get(ENA_STORAGE_COUNTER_TEK);
     uint32_t stored = ENA_STORAGE_TEK_MAX;
 
     if (tek_count < ENA_STORAGE_TEK_MAX)
@@ -456,9 +2955,9 @@ void ena_storage_dump_exposure_information(void)
 {
     ena_exposure_information_t exposure_info;
     uint32_t exposure_information_count = ena_storage_exposure_information_count();
-    uint32_t stored = ENA_STORAGE_EXPOSURE_INFORMATION_MAX;
+    uint32_t stored = ENA_STORAGE_EXPOSURE_INFORMATION_SLOTS;
 
-    if (exposure_information_count < ENA_STORAGE_EXPOSURE_INFORMATION_MAX)
+    if (exposure_information_count < ENA_STORAGE_EXPOSURE_INFORMATION_SLOTS)
     {
         stored = exposure_information_count;
     }
@@ -477,8 +2976,7 @@ void ena_storage_dump_exposure_information(void)
 void ena_storage_dump_temp_beacons(void)
 {
     ena_beacon_t beacon;
-    uint32_t beacon_count = 0;
-    ena_storage_read(ENA_STORAGE_TEMP_BEACONS_COUNT_ADDRESS, &beacon_count, sizeof(uint32_t));
+    uint32_t beacon_count = ena_storage_counter_get(ENA_STORAGE_COUNTER_TEMP_BEACONS);
     uint32_t stored = ENA_STORAGE_TEMP_BEACONS_MAX;
 
     if (beacon_count < ENA_STORAGE_TEMP_BEACONS_MAX)
@@ -501,18 +2999,24 @@ void ena_storage_dump_temp_beacons(void)
 void ena_storage_dump_beacons(void)
 {
 
-    ena_beacon_t beacon;
-    uint32_t beacon_count = 0;
-    ena_storage_read(ENA_STORAGE_BEACONS_COUNT_ADDRESS, &beacon_count, sizeof(uint32_t));
+    ena_beacon_t beacons[ENA_STORAGE_CURSOR_BATCH];
+    ena_storage_beacon_cursor_t cursor;
+    uint32_t beacon_count = ena_storage_beacons_count();
+    uint32_t read = 0;
+    int index = 0;
     ESP_LOGD(ENA_STORAGE_LOG, "%u beacons\n", beacon_count);
     printf("#,timestamp_first,timestamp_last,rpi,aem,rssi\n");
-    for (int i = 0; i < beacon_count; i++)
+    ena_storage_beacon_cursor_open(&cursor, 0, beacon_count);
+    while ((read = ena_storage_beacon_cursor_next_batch(&cursor, beacons, ENA_STORAGE_CURSOR_BATCH)) > 0)
     {
-        ena_storage_get_beacon(i, &beacon);
-        printf("%d,%u,%u,", i, beacon.timestamp_first, beacon.timestamp_last);
-        ena_storage_dump_hash_array(beacon.rpi, ENA_KEY_LENGTH);
-        printf(",");
-        ena_storage_dump_hash_array(beacon.aem, ENA_AEM_METADATA_LENGTH);
-        printf(",%d\n", beacon.rssi);
+        for (int i = 0; i < read; i++, index++)
+        {
+            // only stored bytes, RPI and AEM are truncated with fingerprints
+            printf("%d,%u,%u,", index, beacons[i].timestamp_first, beacons[i].timestamp_last);
+            ena_storage_dump_hash_array(beacons[i].rpi, ENA_STORAGE_BEACON_FINGERPRINT_SIZE);
+            printf(",");
+            ena_storage_dump_hash_array(beacons[i].aem, ENA_STORAGE_BEACON_FINGERPRINT_AEM_SIZE);
+            printf(",%d\n", beacons[i].rssi);
+        }
     }
 }
\ No newline at end of file
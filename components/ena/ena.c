@@ -59,6 +59,7 @@ void ena_run(void)
         ena_storage_write_tek(&last_tek);
         // clean up old beacons
         ena_beacons_cleanup(unix_timestamp);
+        ena_storage_flush();
     }
 
     // change RPI
@@ -182,6 +183,7 @@ void ena_stop(void)
 {
     ena_bluetooth_advertise_stop();
     ena_bluetooth_scan_stop();
+    ena_bluetooth_scan_snapshot();
     esp_bluedroid_disable();
     esp_bluedroid_deinit();
     esp_bt_controller_disable();
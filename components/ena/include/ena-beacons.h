@@ -23,6 +23,7 @@
 #define ENA_BEACON_LOG "ESP-ENA-beacon"                                  // TAG for Logging
 #define ENA_BEACON_TRESHOLD (CONFIG_ENA_BEACON_TRESHOLD)                 // meet for longer than 5 minutes
 #define ENA_BEACON_CLEANUP_TRESHOLD (CONFIG_ENA_BEACON_CLEANUP_TRESHOLD) // threshold (in days) for stored beacons to be removed
+#define ENA_BEACON_TEMP_TABLE_SIZE (CONFIG_ENA_STORAGE_TEMP_BEACONS_MAX * 2) // slots of hash table for temporary beacons, load factor at most 0.5
 
 /**
  * @brief       check temporary beacon for threshold or expiring
@@ -35,6 +36,22 @@
  */
 void ena_beacons_temp_refresh(uint32_t unix_timestamp);
 
+/**
+ * @brief       write all temporary beacons to storage
+ * 
+ * Temporary beacons are only kept in RAM, this writes them as one snapshot. It is done by
+ * ena_beacons_temp_refresh at most once per scan interval and on shutdown by
+ * ena_bluetooth_scan_snapshot. Only call it from the task handling advertisements.
+ */
+void ena_beacons_temp_snapshot(void);
+
+/**
+ * @brief       restore temporary beacons from last snapshot in storage
+ * 
+ * A beacon stored twice by an interrupted snapshot is restored once, with its latest sighting.
+ */
+void ena_beacons_temp_restore(void);
+
 /**
  * @brief       check stored beacons to expire
  * 
@@ -20,9 +20,12 @@
 #ifndef _ena_BLUETOOTH_SCAN_H_
 #define _ena_BLUETOOTH_SCAN_H_
 
+#include "ena-crypto.h"
+
 #define ENA_SCAN_LOG "ESP-ENA-scan"                          // TAG for Logging
 #define ENA_SCANNING_TIME (CONFIG_ENA_SCANNING_TIME)         // time how long a scan should run
 #define ENA_SCANNING_INTERVAL (CONFIG_ENA_SCANNING_INTERVAL) // interval for next scan to happen
+#define ENA_SCAN_QUEUE_SIZE (CONFIG_ENA_SCAN_QUEUE_SIZE)     // number of advertisements buffered for beacon handling
 
 /**
  * @brief status of BLE scan
@@ -34,6 +37,27 @@ typedef enum
     ENA_SCAN_STATUS_WAITING,      // scan is not running but stopped manually
 } ena_bluetooth_scan_status;
 
+/**
+ * @brief structure for a received advertisement in the scan queue
+ */
+typedef struct __attribute__((__packed__))
+{
+    uint32_t timestamp;                   // time of reception
+    uint8_t rpi[ENA_KEY_LENGTH];          // received RPI
+    uint8_t aem[ENA_AEM_METADATA_LENGTH]; // received AEM
+    int rssi;                             // measured RSSI
+} ena_bluetooth_scan_entry_t;
+
+/**
+ * @brief structure for scan queue statistics
+ */
+typedef struct
+{
+    uint32_t enqueued;  // advertisements put into the queue
+    uint32_t dropped;   // advertisements dropped because the queue was full
+    uint32_t processed; // advertisements handled by the beacon task
+} ena_bluetooth_scan_stats_t;
+
 /**
  * @brief       initialize the BLE scanning
  * 
@@ -66,4 +90,19 @@ void ena_bluetooth_scan_stop(void);
  */
 int ena_bluetooth_scan_get_status(void);
 
+/**
+ * @brief       write a snapshot of temporary beacons and wait for it
+ * 
+ * The snapshot is written by the scan task after all queued advertisements are handled, so it
+ * does not race with updates of temporary beacons.
+ */
+void ena_bluetooth_scan_snapshot(void);
+
+/**
+ * @brief       get statistics of the scan queue
+ * 
+ * @param[out]  stats       pointer to statistics to write to
+ */
+void ena_bluetooth_scan_get_stats(ena_bluetooth_scan_stats_t *stats);
+
 #endif
\ No newline at end of file
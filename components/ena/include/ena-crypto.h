@@ -78,6 +78,19 @@ void ena_crypto_tek(uint8_t *tek);
  */
 void ena_crypto_rpik(uint8_t *rpik, uint8_t *tek);
 
+/**
+ * @brief derive Rolling Proximity Identifier Key (RPIK) and Associated Encrypted Metadata Key (AEMK) with given TEK
+ * 
+ * Fast path of ena_crypto_rpik and ena_crypto_aemk: HMAC states of the empty salt are precomputed and
+ * one HKDF-Extract serves both HKDF-Expand steps. Checked against the specification test vectors on
+ * ena_crypto_init.
+ * 
+ * @param[in] tek TEK for calculating RPIK and AEMK
+ * @param[out] rpik pointer to the new RPIK, NULL to skip
+ * @param[out] aemk pointer to the new AEMK, NULL to skip
+ */
+void ena_crypto_derive_keys(uint8_t *tek, uint8_t *rpik, uint8_t *aemk);
+
 /**
  * @brief calculate a new Rolling Proximity Identifier with given RPIK and ENIN
  * 
@@ -93,6 +106,18 @@ void ena_crypto_rpik(uint8_t *rpik, uint8_t *tek);
  */
 void ena_crypto_rpi(uint8_t *rpi, uint8_t *rpik, uint32_t enin);
 
+/**
+ * @brief calculate consecutive Rolling Proximity Identifiers with given RPIK
+ * 
+ * The AES key schedule is expanded once and all padded EN-RPI blocks are encrypted in one pass.
+ * 
+ * @param[in] rpik RPIK for encrypting RPIs
+ * @param[in] start_enin ENIN of the first RPI
+ * @param[in] count number of RPIs to calculate
+ * @param[out] out contiguous buffer for count * ENA_KEY_LENGTH bytes of RPIs
+ */
+void ena_crypto_rpi_batch(uint8_t *rpik, uint32_t start_enin, size_t count, uint8_t *out);
+
 /**
  * @brief       calculate a new Associated Encrypted Metadata Key (AEMK) with given TEK
  * 
@@ -123,4 +148,17 @@ void ena_crypto_aemk(uint8_t *aemk, uint8_t *tek);
  */
 void ena_crypto_aem(uint8_t *aem, uint8_t *aemk, uint8_t *rpi, uint8_t power_level);
 
+/**
+ * @brief       create Associated Encrypted Metadata (AEM) for multiple RPIs with given AEMK
+ * 
+ * The AES key schedule is expanded once for all RPIs.
+ * 
+ * @param[in]   aemk            AEMK for encrypting AEMs
+ * @param[in]   rpis            contiguous buffer of count RPIs
+ * @param[in]   count           number of AEMs to create
+ * @param[in]   power_level     BLE power level to encrypt in AEMs
+ * @param[out]  out             contiguous buffer for count * ENA_AEM_METADATA_LENGTH bytes of AEMs
+ */
+void ena_crypto_aem_batch(uint8_t *aemk, uint8_t *rpis, size_t count, uint8_t power_level, uint8_t *out);
+
 #endif
\ No newline at end of file
@@ -25,7 +25,13 @@
 #include "ena-storage.h"
 #include "ena-crypto.h"
 
-#define ENA_EXPOSURE_LOG "ESP-ENA-exposure" // TAG for Logging
+#define ENA_EXPOSURE_LOG "ESP-ENA-exposure"                 // TAG for Logging
+#define ENA_EXPOSURE_CHECK_ENIN_SKEW (1)                    // intervals around a RPI to look for beacons (clock skew)
+#define ENA_EXPOSURE_CHECK_ORDER_SLACK (ENA_TIME_WINDOW * 6) // seconds beacons might be stored out of timestamp order
+#define ENA_EXPOSURE_CHECK_AEM_VERSION_MASK (0b11001111)      // bits of AEM version byte to confirm fingerprint matches (major version, reserved)
+#define ENA_EXPOSURE_CHECK_PENDING_MAX (32)                  // key-days merged in RAM during a batch check without heap, more grow in steps of it
+#define ENA_EXPOSURE_SUMMARY_DAYS (16)                       // exposure days aggregated separately, days older than 14 days are merged
+#define ENA_EXPOSURE_SUMMARY_MAGIC (0x454E4153)              // marks persisted exposure summary ("ENAS")
 
 /**
  * @brief report type
@@ -143,6 +149,32 @@ typedef struct __attribute__((__packed__))
     int risk_score_sum;           // sum of all risk_scores
 } ena_exposure_summary_t;
 
+/**
+ * @brief structure for aggregated exposure information of a day
+ * 
+ * Risk scores are kept for every days risk level, so the summary does not change with the age of the day.
+ */
+typedef struct __attribute__((__packed__))
+{
+    uint32_t day;               // day of the exposures, most recent day for merged days
+    uint32_t num_exposures;     // number of exposure information of the day
+    uint8_t max_risk_score[8];  // max. risk score per days risk level
+    uint32_t risk_score_sum[8]; // sum of risk scores per days risk level
+} ena_exposure_day_summary_t;
+
+/**
+ * @brief structure for the persisted aggregates of all exposure information
+ */
+typedef struct __attribute__((__packed__))
+{
+    uint32_t magic;                                             // marks valid aggregates
+    uint32_t count;                                             // number of aggregated exposure information
+    ena_exposure_config_t config;                               // configuration used for risk scores
+    ena_exposure_day_summary_t older;                           // merged days older than 14 days
+    ena_exposure_day_summary_t days[ENA_EXPOSURE_SUMMARY_DAYS]; // days in no order, unused with num_exposures 0
+    uint32_t checksum;                                          // checksum of all previous fields
+} ena_exposure_day_summaries_t;
+
 /**
  * @brief structure for temporary exposure key
  * 
@@ -211,6 +243,9 @@ int ena_exposure_risk_score(ena_exposure_config_t *config, ena_exposure_paramete
 /**
  * @brief returns the current exposure summary
  * 
+ * Uses the persisted aggregates per day, which are updated with new exposure information. All exposure
+ * information is only read again if the configuration changed or the aggregates are invalid.
+ * 
  * @param[in] config the exposure configuration used for calculating scores
  */
 void ena_exposure_summary(ena_exposure_config_t *config);
@@ -260,4 +295,55 @@ int ena_expore_check_find_max(uint32_t timestamp);
  */
 void ena_exposure_check_temporary_exposure_key(ena_temporary_exposure_key_t temporary_exposure_key);
 
+/**
+ * @brief start a batch check of Temporary Exposure Keys
+ * 
+ * Stored beacons are grouped by ENIN of their first recognition once per day, so a following
+ * ena_exposure_check_key derives the RPIK once and compares each RPI only against the beacons seen in
+ * the same interval (+/- ENA_EXPOSURE_CHECK_ENIN_SKEW). Keys of the batch are collected and sorted by
+ * their interval before they are matched, so the beacons of a day are grouped once per batch and not
+ * again for every key of another day. This is the matching engine for every key source.
+ * 
+ * @param[in] keys  most keys of the batch, e.g. a page of the key server, further keys are matched right away
+ */
+void ena_exposure_check_start(uint32_t keys);
+
+/**
+ * @brief check a single Temporary Exposure Key of a running batch check
+ * 
+ * The key is collected and matched later with ena_exposure_check_match, at the latest with
+ * ena_exposure_check_finish.
+ * 
+ * @param[in] temporary_exposure_key    the temporary exposure key to check
+ */
+void ena_exposure_check_key(ena_temporary_exposure_key_t *temporary_exposure_key);
+
+/**
+ * @brief match collected keys of a running batch check
+ * 
+ * Each call matches a bounded number of keys, so a caller can spread a batch over several steps.
+ * 
+ * @param[in] keys  most keys to match in this call
+ * 
+ * @return
+ *              number of collected keys not matched yet
+ */
+uint32_t ena_exposure_check_match(uint32_t keys);
+
+/**
+ * @brief finish a batch check and free grouped beacons
+ * 
+ * Matches of a batch check are merged per Temporary Exposure Key and day and stored as one exposure
+ * information each when the batch is finished, so a key-day matched again later in the batch is still merged.
+ */
+void ena_exposure_check_finish(void);
+
+/**
+ * @brief check a list of Temporary Exposure Keys with all beacons
+ * 
+ * @param[in] temporary_exposure_keys   the temporary exposure keys to check
+ * @param[in] count                     number of temporary exposure keys
+ */
+void ena_exposure_check_temporary_exposure_keys(ena_temporary_exposure_key_t *temporary_exposure_keys, size_t count);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,203 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * @file
+ * 
+ * @brief storage backends (flash partition, file, mmap) with NOR flash semantics
+ * 
+ * Erase sets all bytes of complete blocks to 0xFF, write can only clear bits.
+ * 
+ */
+#ifndef _ena_STORAGE_BACKEND_H_
+#define _ena_STORAGE_BACKEND_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define ENA_STORAGE_BACKEND_BLOCK_SIZE (4096) // erase block size of file backends
+
+/**
+ * @brief structure for a storage backend
+ */
+typedef struct
+{
+    const char *name; // name of the backend for logging
+    void *context;    // backend specific data, e.g. partition or file
+    size_t size;      // size in bytes
+    size_t block_size; // size of an erase block in bytes
+    esp_err_t (*read)(void *context, size_t address, void *data, size_t size);
+    esp_err_t (*write)(void *context, size_t address, const void *data, size_t size);
+    esp_err_t (*erase)(void *context, size_t address, size_t size);
+    esp_err_t (*mmap)(void *context, size_t address, size_t size, const void **data, uint32_t *handle); // optional, NULL if not supported
+    void (*munmap)(void *context, uint32_t handle);                                                     // optional, NULL if not supported
+} ena_storage_backend_t;
+
+/**
+ * @brief structure for storage backend statistics
+ */
+typedef struct
+{
+    uint32_t reads;         // number of read operations
+    uint32_t writes;        // number of write operations
+    uint32_t erases;        // number of erased blocks
+    uint64_t bytes_read;    // total bytes read
+    uint64_t bytes_written; // total bytes written
+} ena_storage_backend_stats_t;
+
+/**
+ * @brief       set the backend used by storage
+ * 
+ * Without a set backend, the flash partition ENA_STORAGE_PARTITION_NAME is used.
+ * 
+ * @param[in]   backend     the backend to use
+ */
+void ena_storage_backend_set(const ena_storage_backend_t *backend);
+
+/**
+ * @brief       get the backend used by storage
+ * 
+ * @return
+ *              current backend
+ */
+const ena_storage_backend_t *ena_storage_backend_get(void);
+
+/**
+ * @brief       read bytes from current backend
+ * 
+ * @param[in]   address     the address to read bytes from
+ * @param[out]  data        pointer to write the read data
+ * @param[in]   size        how many bytes to read
+ * 
+ * @return
+ *              ESP_OK on success
+ */
+esp_err_t ena_storage_backend_read(size_t address, void *data, size_t size);
+
+/**
+ * @brief       write bytes to current backend, only clears bits
+ * 
+ * @param[in]   address     the address to write bytes to
+ * @param[in]   data        the data to write
+ * @param[in]   size        how many bytes to write
+ * 
+ * @return
+ *              ESP_OK on success
+ */
+esp_err_t ena_storage_backend_write(size_t address, const void *data, size_t size);
+
+/**
+ * @brief       erase blocks of current backend
+ * 
+ * @param[in]   address     the address to start erasing, aligned to block size
+ * @param[in]   size        how many bytes to erase, multiple of block size
+ * 
+ * @return
+ *              ESP_OK on success
+ */
+esp_err_t ena_storage_backend_erase(size_t address, size_t size);
+
+/**
+ * @brief       map a region of current backend into memory for reading
+ * 
+ * @param[in]   address     the address of the region
+ * @param[in]   size        size of the region
+ * @param[out]  data        pointer to the mapped region
+ * @param[out]  handle      handle to unmap the region
+ * 
+ * @return
+ *              ESP_OK on success, ESP_ERR_NOT_SUPPORTED if the backend cannot map
+ */
+esp_err_t ena_storage_backend_mmap(size_t address, size_t size, const void **data, uint32_t *handle);
+
+/**
+ * @brief       unmap a region mapped by ena_storage_backend_mmap
+ * 
+ * @param[in]   handle      handle of the mapped region
+ */
+void ena_storage_backend_munmap(uint32_t handle);
+
+/**
+ * @brief       size of current backend
+ * 
+ * @return
+ *              size in bytes
+ */
+size_t ena_storage_backend_size(void);
+
+/**
+ * @brief       erase block size of current backend
+ * 
+ * @return
+ *              block size in bytes
+ */
+size_t ena_storage_backend_block_size(void);
+
+/**
+ * @brief       get statistics of current backend since start or last reset
+ * 
+ * @param[out]  stats       pointer to statistics to write to
+ */
+void ena_storage_backend_get_stats(ena_storage_backend_stats_t *stats);
+
+/**
+ * @brief       reset statistics
+ */
+void ena_storage_backend_reset_stats(void);
+
+/**
+ * @brief       initialize backend for a flash partition
+ * 
+ * @param[out]  backend     backend to initialize
+ * @param[in]   label       label of the data partition
+ * 
+ * @return
+ *              ESP_OK on success, ESP_ERR_NOT_FOUND if there is no such partition
+ */
+esp_err_t ena_storage_backend_partition_init(ena_storage_backend_t *backend, const char *label);
+
+/**
+ * @brief       initialize backend for an image file, created erased if not existing
+ * 
+ * @param[out]  backend     backend to initialize
+ * @param[in]   path        path of the image file
+ * @param[in]   size        size of the image, multiple of ENA_STORAGE_BACKEND_BLOCK_SIZE
+ * 
+ * @return
+ *              ESP_OK on success
+ */
+esp_err_t ena_storage_backend_file_init(ena_storage_backend_t *backend, const char *path, size_t size);
+
+/**
+ * @brief       initialize backend for a memory mapped image file, created erased if not existing
+ * 
+ * Only available on POSIX hosts, reads from ena_storage_backend_mmap are zero-copy.
+ * 
+ * @param[out]  backend     backend to initialize
+ * @param[in]   path        path of the image file
+ * @param[in]   size        size of the image, multiple of ENA_STORAGE_BACKEND_BLOCK_SIZE
+ * 
+ * @return
+ *              ESP_OK on success, ESP_ERR_NOT_SUPPORTED without POSIX mmap
+ */
+esp_err_t ena_storage_backend_mmap_init(ena_storage_backend_t *backend, const char *path, size_t size);
+
+/**
+ * @brief       release resources of a file or mmap backend
+ * 
+ * @param[in]   backend     backend to release
+ */
+void ena_storage_backend_deinit(ena_storage_backend_t *backend);
+
+#endif
\ No newline at end of file
@@ -20,6 +20,8 @@
 #ifndef _ena_STORAGE_H_
 #define _ena_STORAGE_H_
 
+#include "esp_err.h"
+
 #include "ena-crypto.h"
 
 #define ENA_STORAGE_LOG "ESP-ENA-storage"                                                  // TAG for Logging
@@ -28,6 +30,79 @@
 #define ENA_STORAGE_TEK_MAX (CONFIG_ENA_STORAGE_TEK_MAX)                                   // Period of storing TEKs                                                                            // length of a stored beacon -> RPI keysize + AEM size + 4 Bytes for ENIN + 4 Bytes for RSSI
 #define ENA_STORAGE_TEMP_BEACONS_MAX (CONFIG_ENA_STORAGE_TEMP_BEACONS_MAX)                 // Maximum number of temporary stored beacons                                                    // length of a stored beacon -> RPI keysize + AEM size + 4 Bytes for ENIN + 4 Bytes for RSSI
 #define ENA_STORAGE_EXPOSURE_INFORMATION_MAX (CONFIG_ENA_STORAGE_EXPOSURE_INFORMATION_MAX) // Maximum number of stored exposure information
+#define ENA_STORAGE_EXPOSURE_INFORMATION_SLOTS (ENA_STORAGE_EXPOSURE_INFORMATION_MAX - 1)   // ring of exposure information, the last record would overlap the temporary beacons count
+#define ENA_STORAGE_YIELD_BUDGET (CONFIG_ENA_STORAGE_YIELD_BUDGET)                         // time in ms storage reads run before yielding to other tasks
+#define ENA_STORAGE_CURSOR_BATCH (32)                                                      // beacons read at once by internal scans
+
+#ifdef CONFIG_ENA_STORAGE_BEACON_LOG
+#define ENA_STORAGE_BEACON_LOG true
+#else
+#define ENA_STORAGE_BEACON_LOG false
+#endif
+
+#ifdef CONFIG_ENA_STORAGE_BEACON_COLUMNS
+#define ENA_STORAGE_BEACON_COLUMNS true
+#else
+#define ENA_STORAGE_BEACON_COLUMNS false
+#endif
+
+#ifdef CONFIG_ENA_STORAGE_BEACON_FINGERPRINT
+#define ENA_STORAGE_BEACON_FINGERPRINT true
+#define ENA_STORAGE_BEACON_FINGERPRINT_SIZE (CONFIG_ENA_STORAGE_BEACON_FINGERPRINT_SIZE) // stored bytes of a RPI
+#define ENA_STORAGE_BEACON_FINGERPRINT_AEM_SIZE (2)                                      // stored bytes of an AEM
+#else
+#define ENA_STORAGE_BEACON_FINGERPRINT false
+#define ENA_STORAGE_BEACON_FINGERPRINT_SIZE (ENA_KEY_LENGTH)
+#define ENA_STORAGE_BEACON_FINGERPRINT_AEM_SIZE (ENA_AEM_METADATA_LENGTH)
+#endif
+
+// words of record bitmaps in segment header (one bit per record) and remaining bytes of the 64 or 96 bytes header
+#if defined(CONFIG_ENA_STORAGE_BEACON_FINGERPRINT)
+#define ENA_STORAGE_BEACON_LOG_BITMAP_WORDS (10)
+#define ENA_STORAGE_BEACON_LOG_HEADER_RESERVED (8)
+#elif defined(CONFIG_ENA_STORAGE_BEACON_COLUMNS)
+#define ENA_STORAGE_BEACON_LOG_BITMAP_WORDS (5)
+#define ENA_STORAGE_BEACON_LOG_HEADER_RESERVED (16)
+#else
+#define ENA_STORAGE_BEACON_LOG_BITMAP_WORDS (4)
+#define ENA_STORAGE_BEACON_LOG_HEADER_RESERVED (24)
+#endif
+
+#ifdef CONFIG_ENA_STORAGE_BEACON_INDEX
+#define ENA_STORAGE_BEACON_INDEX true
+#define ENA_STORAGE_BEACON_INDEX_SLOTS (1 << CONFIG_ENA_STORAGE_BEACON_INDEX_SLOTS_BITS) // number of slots of the hashed RPI index
+#else
+#define ENA_STORAGE_BEACON_INDEX false
+#define ENA_STORAGE_BEACON_INDEX_SLOTS (1)
+#endif
+
+#ifdef CONFIG_ENA_STORAGE_COUNTER_JOURNAL
+#define ENA_STORAGE_COUNTER_JOURNAL true
+#else
+#define ENA_STORAGE_COUNTER_JOURNAL false
+#endif
+#define ENA_STORAGE_COUNTER_JOURNAL_BLOCKS (2) // blocks of 4kB used alternately by the counter journal
+#define ENA_STORAGE_SYNC_CHECKPOINT_BLOCKS (2)  // blocks of 4kB used alternately by the sync checkpoint
+#define ENA_STORAGE_SYNC_CHECKPOINT_SIZE (32)   // maximum size of a sync checkpoint
+
+#ifdef CONFIG_ENA_STORAGE_WRITE_CACHE
+#define ENA_STORAGE_WRITE_CACHE true
+#define ENA_STORAGE_WRITE_CACHE_BLOCKS (CONFIG_ENA_STORAGE_WRITE_CACHE_BLOCKS)                 // number of cached blocks of 4kB
+#define ENA_STORAGE_WRITE_CACHE_FLUSH_INTERVAL (CONFIG_ENA_STORAGE_WRITE_CACHE_FLUSH_INTERVAL) // time in s after which changed blocks are flushed
+#else
+#define ENA_STORAGE_WRITE_CACHE false
+#define ENA_STORAGE_WRITE_CACHE_BLOCKS (1)
+#define ENA_STORAGE_WRITE_CACHE_FLUSH_INTERVAL (0)
+#endif
+
+#ifdef CONFIG_ENA_STORAGE_KEY_DIGESTS
+#define ENA_STORAGE_KEY_DIGESTS true
+#define ENA_STORAGE_KEY_DIGEST_BLOCKS (CONFIG_ENA_STORAGE_KEY_DIGEST_BLOCKS) // number of blocks of 4kB for key digests
+#else
+#define ENA_STORAGE_KEY_DIGESTS false
+#define ENA_STORAGE_KEY_DIGEST_BLOCKS (1)
+#endif
+#define ENA_STORAGE_KEY_DIGEST_EMPTY (0xFFFFFFFFFFFFFFFF) // erased digest slot, not a valid digest
 
 /**
  * @brief structure for TEK
@@ -51,6 +126,116 @@ typedef struct __attribute__((__packed__))
     int rssi;                             // average measured RSSI
 } ena_beacon_t;
 
+/**
+ * @brief structure for a cursor to read a range of permanently stored beacons in batches
+ */
+typedef struct
+{
+    uint32_t index;    // index of next beacon to read
+    uint32_t end;      // index after last beacon to read
+    uint32_t position; // log-structured storage: position of current segment from tail
+    uint32_t record;   // log-structured storage: next record in current segment
+} ena_storage_beacon_cursor_t;
+
+/**
+ * @brief structure for a read-only memory mapped view of permanently stored beacons
+ */
+typedef struct
+{
+    const ena_beacon_t *beacons; // mapped beacons
+    uint32_t start;              // index of first mapped beacon
+    uint32_t count;              // number of mapped beacons
+    uint32_t handle;             // handle of mapping
+} ena_storage_beacons_view_t;
+
+/**
+ * @brief structure for the header of a segment in log-structured beacon storage
+ *
+ * Bitmaps start erased (all bits set), a cleared bit marks a written or deleted record.
+ */
+typedef struct __attribute__((__packed__))
+{
+    uint32_t magic;                                            // marks a valid segment, written last when opening a segment
+    uint32_t sequence;                                         // sequence number to order segments
+    uint32_t written[ENA_STORAGE_BEACON_LOG_BITMAP_WORDS];     // bitmap of written records, bit is cleared after record is complete
+    uint32_t deleted[ENA_STORAGE_BEACON_LOG_BITMAP_WORDS];     // bitmap of deleted records
+    uint8_t reserved[ENA_STORAGE_BEACON_LOG_HEADER_RESERVED]; // reserved, keeps records aligned
+} ena_storage_segment_header_t;
+
+/**
+ * @brief structure for the column header following the segment header in columnar beacon storage
+ *
+ * A Bloom filter of RPIs follows this header (a cleared bit is set), sized by the records of a segment.
+ * Records of a segment are stored column by column after the filter. First timestamps are stored
+ * as offset to timestamp_base, last timestamps as offset to the first timestamp.
+ */
+typedef struct __attribute__((__packed__))
+{
+    uint32_t timestamp_base; // first timestamps of all records are not before, written with first record
+    uint32_t timestamp_max;  // latest first timestamp of all records, written when segment is closed
+    uint8_t reserved[8];     // reserved
+} ena_storage_segment_columns_t;
+
+/**
+ * @brief structure for the header of a block of key digests
+ *
+ * Digests follow the header in erased slots, a block only holds digests of one day.
+ */
+typedef struct __attribute__((__packed__))
+{
+    uint32_t magic; // marks a used block, written after the day
+    uint32_t day;   // start of the day of the digests
+} ena_storage_key_digest_header_t;
+
+/**
+ * @brief counters of stored entries
+ */
+typedef enum
+{
+    ENA_STORAGE_COUNTER_TEK = 0,              // number of written TEKs
+    ENA_STORAGE_COUNTER_EXPOSURE_INFORMATION, // number of stored exposure information
+    ENA_STORAGE_COUNTER_TEMP_BEACONS,         // number of temporary beacons
+    ENA_STORAGE_COUNTER_BEACONS,              // number of permanent beacons ever added, record number after the newest beacon
+    ENA_STORAGE_COUNTER_SCRATCH,              // counter journal: address of the block copied during a rewrite, bit 0 set if the copy is in the next journal block
+    ENA_STORAGE_COUNTER_BEACONS_HEAD,         // number of permanent beacons ever removed, record number of the oldest beacon
+    ENA_STORAGE_COUNTERS,                     // number of counters
+} ena_storage_counter_t;
+
+/**
+ * @brief structure for the header of a block of the counter journal
+ */
+typedef struct __attribute__((__packed__))
+{
+    uint32_t magic;    // marks a valid block, written after the snapshot of all counters
+    uint32_t sequence; // sequence number to order blocks
+} ena_storage_counter_header_t;
+
+/**
+ * @brief structure for a slot of the counter journal
+ *
+ * A slot sets a counter to its value, every cleared bit of increments adds one to it.
+ */
+typedef struct __attribute__((__packed__))
+{
+    uint32_t value;      // value of counter
+    uint8_t counter;     // counter of slot
+    uint8_t reserved;    // reserved, left erased
+    uint16_t increments; // bitmap of increments since value, cleared from lowest bit
+    uint32_t check;      // CRC-32 of value, counter, sequence of the block and number of the slot
+} ena_storage_counter_slot_t;
+
+/**
+ * @brief structure for a slot of the sync checkpoint
+ *
+ * Blocks of the sync checkpoint start with a header like the counter journal, every slot after it holds a whole
+ * checkpoint and the last valid one is used.
+ */
+typedef struct __attribute__((__packed__))
+{
+    uint8_t data[ENA_STORAGE_SYNC_CHECKPOINT_SIZE]; // checkpoint, left erased after its size
+    uint32_t check;                                 // CRC-32 of data, sequence of the block and number of the slot
+} ena_storage_sync_checkpoint_slot_t;
+
 /**
  * @brief structure for storing a Exposure Information (combined ExposureInformation, ExposureWindow and ScanInstance from Google API >= 1.5)
  */
@@ -98,6 +283,49 @@ void ena_storage_erase(size_t address, size_t size);
  */
 void ena_storage_shift_delete(size_t address, size_t end_address, size_t size);
 
+/**
+ * @brief       write all changed blocks of the write cache to flash
+ * 
+ * Journals the counters waiting for these blocks afterwards. Has to be called before power is cut, e.g. before deep
+ * sleep.
+ */
+void ena_storage_flush(void);
+
+/**
+ * @brief       lock the storage for the calling task
+ * 
+ * The lock is recursive. Storage functions used from several tasks (scan, sync, main loop) lock on their
+ * own, lock around several calls that have to see the same state.
+ */
+void ena_storage_lock(void);
+
+/**
+ * @brief       unlock the storage, once for every ena_storage_lock
+ */
+void ena_storage_unlock(void);
+
+/**
+ * @brief       get value of a counter
+ *
+ * @param[in]   counter     the counter to get
+ *
+ * @return
+ *              value of the counter
+ */
+uint32_t ena_storage_counter_get(ena_storage_counter_t counter);
+
+/**
+ * @brief       set value of a counter
+ *
+ * With the counter journal the value is appended to the journal, an increment by one only clears a bit. While
+ * counted records are in changed blocks of the write cache, the value is kept in RAM and journaled by the next
+ * ena_storage_flush after the records.
+ *
+ * @param[in]   counter     the counter to set
+ * @param[in]   value       the new value
+ */
+void ena_storage_counter_set(ena_storage_counter_t counter, uint32_t value);
+
 /**
  * @brief       get timestamp of most recent exposure data
  * 
@@ -152,6 +380,9 @@ void ena_storage_write_tek(ena_tek_t *tek);
 /**
  * @brief       get number of stored exposure information
  * 
+ * Exposure information is stored in a ring of ENA_STORAGE_EXPOSURE_INFORMATION_SLOTS, so only the last
+ * ENA_STORAGE_EXPOSURE_INFORMATION_SLOTS of them can be read.
+ * 
  * @return
  *              total number of exposure information stored
  */
@@ -160,7 +391,7 @@ uint32_t ena_storage_exposure_information_count(void);
 /**
  * @brief       get exposure information at given index
  * 
- * @param[in]   index       the index of the exposure information to read
+ * @param[in]   index       the index of the exposure information to read (wraps at ENA_STORAGE_EXPOSURE_INFORMATION_SLOTS)
  * @param[out]  exposure_info   pointer to exposure information to write to
  */
 void ena_storage_get_exposure_information(uint32_t index, ena_exposure_information_t *exposure_info);
@@ -168,10 +399,103 @@ void ena_storage_get_exposure_information(uint32_t index, ena_exposure_informati
 /**
  * @brief       store exposure information
  * 
+ * Overwrites the oldest exposure information if all slots are used.
+ * 
  * @param[in]   exposure_info   new exposure information to store 
  */
 void ena_storage_add_exposure_information(ena_exposure_information_t *exposure_info);
 
+/**
+ * @brief       drop exposure information stored after the given count
+ * 
+ * Used to remove exposure information of a partially checked response before it is checked again.
+ * 
+ * @param[in]   count       number of stored exposure information to keep
+ */
+void ena_storage_truncate_exposure_information(uint32_t count);
+
+/**
+ * @brief       read persisted exposure summary
+ * 
+ * The exposure summary is stored in its own block after the beacon area and the sync checkpoint, so permanent beacons
+ * hold three blocks less than the partition offers. Flat beacons stored into these blocks by the former layout are
+ * moved over the oldest beacons on first access.
+ * 
+ * @param[out]  summary     pointer to write the summary to
+ * @param[in]   size        size of the summary, at most 2kB
+ */
+void ena_storage_read_exposure_summary(void *summary, size_t size);
+
+/**
+ * @brief       persist exposure summary
+ * 
+ * @param[in]   summary     pointer to the summary to store
+ * @param[in]   size        size of the summary, at most 2kB
+ */
+void ena_storage_write_exposure_summary(void *summary, size_t size);
+
+/**
+ * @brief       read persisted checkpoint of the key sync
+ * 
+ * The checkpoint is appended to its own blocks before the exposure summary block.
+ * 
+ * @param[out]  checkpoint  pointer to write the checkpoint to, erased bytes without checkpoint
+ * @param[in]   size        size of the checkpoint, at most ENA_STORAGE_SYNC_CHECKPOINT_SIZE
+ */
+void ena_storage_read_sync_checkpoint(void *checkpoint, size_t size);
+
+/**
+ * @brief       persist checkpoint of the key sync
+ * 
+ * Stored data is flushed before, so exposure information covered by the checkpoint is in flash before it. The
+ * checkpoint is appended as a slot, a full block is continued in the other one after erasing it, so an interrupted
+ * write or erase keeps the previous checkpoint.
+ * 
+ * @param[in]   checkpoint  pointer to the checkpoint to store
+ * @param[in]   size        size of the checkpoint, at most ENA_STORAGE_SYNC_CHECKPOINT_SIZE
+ */
+void ena_storage_write_sync_checkpoint(void *checkpoint, size_t size);
+
+/**
+ * @brief       number of stored key digests of a day
+ * 
+ * @param[in]   day         start of the day
+ * 
+ * @return
+ *              number of stored digests of the day
+ */
+uint32_t ena_storage_key_digests_count(uint32_t day);
+
+/**
+ * @brief       read stored key digests of a day
+ * 
+ * @param[in]   day         start of the day
+ * @param[out]  digests     pointer to write the digests to
+ * @param[in]   max         maximum number of digests to read
+ * 
+ * @return
+ *              number of read digests
+ */
+uint32_t ena_storage_read_key_digests(uint32_t day, uint64_t *digests, uint32_t max);
+
+/**
+ * @brief       store key digests of a day
+ * 
+ * Digests are written to erased flash. If all blocks are used, the block of the oldest day is erased.
+ * 
+ * @param[in]   day         start of the day
+ * @param[in]   digests     digests to store, ENA_STORAGE_KEY_DIGEST_EMPTY is not allowed
+ * @param[in]   count       number of digests
+ */
+void ena_storage_add_key_digests(uint32_t day, const uint64_t *digests, uint32_t count);
+
+/**
+ * @brief       erase key digests of days before the given day
+ * 
+ * @param[in]   day         start of the first day to keep
+ */
+void ena_storage_expire_key_digests(uint32_t day);
+
 /**
  * @brief       get number of stored temporary beacons
  * 
@@ -213,6 +537,30 @@ void ena_storage_set_temp_beacon(uint32_t index, ena_beacon_t *beacon);
  */
 void ena_storage_remove_temp_beacon(uint32_t index);
 
+/**
+ * @brief       store all temporary beacons at once
+ * 
+ * The records are written over the previous ones before the count. If interrupted, the previous count
+ * stays, but its records can be mixed with new ones and hold a beacon twice. With the counter journal
+ * the count is cleared first instead, so an interrupted snapshot drops the temporary beacons and their
+ * blocks are rewritten without a copy in the scratch block.
+ * 
+ * @param[in]   beacons     temporary beacons to store
+ * @param[in]   count       number of temporary beacons
+ */
+void ena_storage_write_temp_beacons(ena_beacon_t *beacons, uint32_t count);
+
+/**
+ * @brief       read all stored temporary beacons at once
+ * 
+ * @param[out]  beacons     pointer to temporary beacons to write to
+ * @param[in]   max         maximum number of temporary beacons to read
+ * 
+ * @return
+ *              number of temporary beacons read
+ */
+uint32_t ena_storage_read_temp_beacons(ena_beacon_t *beacons, uint32_t max);
+
 /**
  * @brief       get number of permanently stored beacons
  * 
@@ -221,9 +569,20 @@ void ena_storage_remove_temp_beacon(uint32_t index);
  */
 uint32_t ena_storage_beacons_count(void);
 
+/**
+ * @brief       get number of permanent beacons fitting in the flat beacon area
+ * 
+ * @return
+ *              maximum number of beacons stored without log-structured storage
+ */
+uint32_t ena_storage_beacons_capacity(void);
+
 /**
  * @brief       get permanently stored beacon at given index
  * 
+ * With fingerprints (ENA_STORAGE_BEACON_FINGERPRINT) only the first ENA_STORAGE_BEACON_FINGERPRINT_SIZE bytes
+ * of the RPI and ENA_STORAGE_BEACON_FINGERPRINT_AEM_SIZE bytes of the AEM are stored, the rest is zero.
+ * 
  * @param[in]   index       the index of the beacon to read
  * @param[out] beacon    pointer to to write to
  */
@@ -243,6 +602,125 @@ void ena_storage_add_beacon(ena_beacon_t *beacon);
  */
 void ena_storage_remove_beacon(uint32_t index);
 
+/**
+ * @brief       open a cursor to read a range of permanently stored beacons
+ * 
+ * The range is limited to the stored beacons. The cursor is invalid after beacons are added or removed.
+ * 
+ * @param[out]  cursor      cursor to initialize
+ * @param[in]   start       index of first beacon to read
+ * @param[in]   end         index after last beacon to read
+ */
+void ena_storage_beacon_cursor_open(ena_storage_beacon_cursor_t *cursor, uint32_t start, uint32_t end);
+
+/**
+ * @brief       read next beacons of a cursor
+ * 
+ * Reads as many beacons as possible with one flash access and yields to other tasks only
+ * after ENA_STORAGE_YIELD_BUDGET. RPI and AEM are truncated with fingerprints like for ena_storage_get_beacon.
+ * 
+ * @param[in]   cursor      cursor to read from
+ * @param[out]  beacons     pointer to beacons to write to
+ * @param[in]   max         maximum number of beacons to read
+ * 
+ * @return
+ *              number of beacons read, 0 at end of range
+ */
+uint32_t ena_storage_beacon_cursor_next_batch(ena_storage_beacon_cursor_t *cursor, ena_beacon_t *beacons, uint32_t max);
+
+/**
+ * @brief       map a range of permanently stored beacons read-only into memory
+ * 
+ * The range is limited to the stored beacons. Mapped beacons can be read directly without copying,
+ * on ESP32 through the flash cache. Mapping is only possible for flat beacon storage (not with
+ * ENA_STORAGE_BEACON_LOG) and fails if the range wraps around the end of the beacon ring or no MMU
+ * pages are left, then a cursor has to be used instead.
+ * The view is invalid after beacons are removed.
+ * 
+ * @param[out]  view        view to initialize
+ * @param[in]   start       index of first beacon to map
+ * @param[in]   end         index after last beacon to map
+ * 
+ * @return
+ *              ESP_OK if the range is mapped, otherwise error of mapping
+ */
+esp_err_t ena_storage_beacons_view_open(ena_storage_beacons_view_t *view, uint32_t start, uint32_t end);
+
+/**
+ * @brief       unmap a view of permanently stored beacons
+ * 
+ * @param[in]   view        view to unmap
+ */
+void ena_storage_beacons_view_close(ena_storage_beacons_view_t *view);
+
+/**
+ * @brief       remove all beacons last seen at or before given timestamp
+ * 
+ * Beacons are stored in time order, so only the oldest beacons are removed. Flat storage is a ring,
+ * expiring moves its head with one counter write and then erases the blocks wholly behind it, so
+ * beacons appended after the ring wrapped are written without erasing again. With log-structured storage
+ * (ENA_STORAGE_BEACON_LOG) whole expired segments are erased at the tail of the ring.
+ * 
+ * While beacons are held (ena_storage_beacons_hold), the expiry is postponed to the last release.
+ * 
+ * @param[in]   timestamp   remove beacons with timestamp_last not after this timestamp
+ */
+void ena_storage_expire_beacons(uint32_t timestamp);
+
+/**
+ * @brief       hold the indices of the stored beacons
+ * 
+ * Cursors and views address beacons by index, which moves when beacons expire. A task keeping them
+ * open across several calls holds the beacons, expiries are postponed until the last holder releases.
+ */
+void ena_storage_beacons_hold(void);
+
+/**
+ * @brief       release the indices of the stored beacons, run a postponed expiry after the last holder
+ */
+void ena_storage_beacons_release(void);
+
+/**
+ * @brief       find permanently stored beacons by RPI
+ * 
+ * This probes the hashed RPI index (ENA_STORAGE_BEACON_INDEX). An invalid or corrupted index
+ * is rebuilt from the stored beacons first.
+ * 
+ * @param[in]   rpi         the RPI to find
+ * @param[out]  indices     pointer to write indices of beacons with given RPI to
+ * @param[in]   max         maximum number of indices to write
+ * 
+ * @return
+ *              number of beacons found, can be more than max (only the first max indices are written)
+ */
+uint32_t ena_storage_find_beacons(uint8_t *rpi, uint32_t *indices, uint32_t max);
+
+/**
+ * @brief       find permanently stored beacons for RPIs of consecutive ENINs
+ * 
+ * The RPI at position i belongs to ENIN enin + i. A beacon matches if it has one of the RPIs and was first
+ * seen within skew ENINs of the RPI's ENIN. With columnar storage (ENA_STORAGE_BEACON_COLUMNS) only segments
+ * overlapping the time range and containing a RPI by their Bloom filter are read, otherwise all beacons are scanned.
+ * With fingerprints (ENA_STORAGE_BEACON_FINGERPRINT) only the stored bytes of RPI and AEM are compared, found beacons
+ * get the full matching RPI, but only a truncated AEM. Such matches have to be confirmed by the caller.
+ * 
+ * @param[in]   rpis        RPIs to find, ENA_KEY_LENGTH bytes each
+ * @param[in]   enin        ENIN of the first RPI
+ * @param[in]   count       number of RPIs
+ * @param[in]   skew        allowed difference of ENINs
+ * @param[out]  beacons     pointer to write matching beacons to
+ * @param[in]   max         maximum number of beacons to write
+ * 
+ * @return
+ *              number of beacons found, can be more than max (only the first max beacons are written)
+ */
+uint32_t ena_storage_match_beacons(uint8_t *rpis, uint32_t enin, uint32_t count, uint32_t skew, ena_beacon_t *beacons, uint32_t max);
+
+/**
+ * @brief       rebuild the hashed RPI index from the stored beacons
+ */
+void ena_storage_beacon_index_rebuild(void);
+
 /**
  * @brief       erase the storage
  * 
@@ -312,7 +790,8 @@ void ena_storage_dump_temp_beacons(void);
  * @brief       dump all stored beacons to serial output
  * 
  * This function prints all stored beacons to serial output in
- * the following CSV format: #,timestamp,rpi,aem,rssi
+ * the following CSV format: #,timestamp_first,timestamp_last,rpi,aem,rssi
+ * With fingerprints (ENA_STORAGE_BEACON_FINGERPRINT) only the stored bytes of RPI and AEM are printed.
  */
 void ena_storage_dump_beacons(void);
 
@@ -42,7 +42,7 @@ void ena_run(void);
 void ena_start(void);
 
 /**
- * @brief stop ena
+ * @brief stop ena and write pending storage changes, e.g. before deep sleep
  */
 void ena_stop(void);
 
@@ -0,0 +1,141 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * sequential scan of 50k permanent beacons: single reads with a task delay after each (as before the cursor),
+ * single reads with the yield budget, cursor batches and a mapped view, in records per second
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "ena-host.h"
+#include "ena-storage.h"
+#include "ena-storage-backend.h"
+
+#define BENCH_START (1600000000)
+#define BENCH_BEACONS (50000)
+#define BENCH_DELAYED_BEACONS (2000) // beacons read with a task delay each, slow at any tick rate
+
+static ena_beacon_t batch_buffer[256];
+
+void bench_beacon_cursor_report(const char *name, uint32_t count, uint32_t checksum, double seconds, ena_storage_backend_stats_t *before)
+{
+    ena_storage_backend_stats_t after;
+    ena_storage_backend_get_stats(&after);
+    ENA_HOST_CHECK(checksum == (uint32_t)((uint64_t)count * (count - 1) / 2));
+    printf("%-24s %9.0f records/s, %6u backend reads\n", name, count / seconds, after.reads - before->reads);
+}
+
+uint32_t bench_beacon_cursor_single(uint32_t count, bool delay)
+{
+    uint32_t checksum = 0;
+    ena_beacon_t beacon;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        ena_storage_get_beacon(i, &beacon);
+        checksum += beacon.timestamp_first - BENCH_START;
+        if (delay)
+        {
+            vTaskDelay(1);
+        }
+    }
+    return checksum;
+}
+
+uint32_t bench_beacon_cursor_batches(uint32_t batch)
+{
+    uint32_t checksum = 0;
+    ena_storage_beacon_cursor_t cursor;
+    ena_storage_beacon_cursor_open(&cursor, 0, BENCH_BEACONS);
+    uint32_t read;
+    while ((read = ena_storage_beacon_cursor_next_batch(&cursor, batch_buffer, batch)) > 0)
+    {
+        for (uint32_t i = 0; i < read; i++)
+        {
+            checksum += batch_buffer[i].timestamp_first - BENCH_START;
+        }
+    }
+    return checksum;
+}
+
+uint32_t bench_beacon_cursor_view(void)
+{
+    uint32_t checksum = 0;
+    ena_storage_beacons_view_t view;
+    ESP_ERROR_CHECK(ena_storage_beacons_view_open(&view, 0, BENCH_BEACONS));
+    for (uint32_t i = 0; i < view.count; i++)
+    {
+        checksum += view.beacons[i].timestamp_first - BENCH_START;
+    }
+    ena_storage_beacons_view_close(&view);
+    return checksum;
+}
+
+int main(void)
+{
+    ena_storage_backend_t backend;
+    ESP_ERROR_CHECK(ena_host_flash_init(&backend, ENA_HOST_FLASH_SIZE));
+    ena_storage_backend_set(&backend);
+    ena_storage_erase_all();
+    esp_log_level_set("*", ESP_LOG_WARN);
+
+    ena_beacon_t beacon;
+    memset(&beacon, 0, sizeof(ena_beacon_t));
+    for (uint32_t i = 0; i < BENCH_BEACONS; i++)
+    {
+        esp_fill_random(beacon.rpi, ENA_KEY_LENGTH);
+        beacon.timestamp_first = BENCH_START + i;
+        beacon.timestamp_last = beacon.timestamp_first + 300;
+        ena_storage_add_beacon(&beacon);
+    }
+    ena_storage_flush();
+    ENA_HOST_CHECK(ena_storage_beacons_count() == BENCH_BEACONS);
+
+    printf("sequential scan of %u beacons, tick %u ms, yield budget %u ms\n", BENCH_BEACONS, portTICK_PERIOD_MS, ENA_STORAGE_YIELD_BUDGET);
+    ena_storage_backend_stats_t before;
+    double start;
+    uint32_t checksum;
+
+    ena_storage_backend_get_stats(&before);
+    start = ena_host_seconds();
+    checksum = bench_beacon_cursor_single(BENCH_DELAYED_BEACONS, true);
+    bench_beacon_cursor_report("single, delay each", BENCH_DELAYED_BEACONS, checksum, ena_host_seconds() - start, &before);
+
+    ena_storage_backend_get_stats(&before);
+    start = ena_host_seconds();
+    checksum = bench_beacon_cursor_single(BENCH_BEACONS, false);
+    bench_beacon_cursor_report("single, yield budget", BENCH_BEACONS, checksum, ena_host_seconds() - start, &before);
+
+    uint32_t batches[] = {ENA_STORAGE_CURSOR_BATCH, sizeof(batch_buffer) / sizeof(ena_beacon_t)};
+    for (int i = 0; i < sizeof(batches) / sizeof(batches[0]); i++)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "cursor, batch %u", batches[i]);
+        ena_storage_backend_get_stats(&before);
+        start = ena_host_seconds();
+        checksum = bench_beacon_cursor_batches(batches[i]);
+        bench_beacon_cursor_report(name, BENCH_BEACONS, checksum, ena_host_seconds() - start, &before);
+    }
+
+    ena_storage_backend_get_stats(&before);
+    start = ena_host_seconds();
+    checksum = bench_beacon_cursor_view();
+    bench_beacon_cursor_report("mapped view", BENCH_BEACONS, checksum, ena_host_seconds() - start, &before);
+
+    return ena_host_result();
+}
\ No newline at end of file
@@ -0,0 +1,90 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * daily cleanup of flat beacon storage at full partition size: 14 days of 5000 beacons, then every day the
+ * oldest day is expired and a new day is added, wrapping around the end of the beacon area
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_system.h"
+
+#include "ena-host.h"
+#include "ena-storage.h"
+#include "ena-storage-backend.h"
+
+#define BENCH_START (1600000000)
+#define BENCH_DAY (86400)
+#define BENCH_DAYS (14)
+#define BENCH_CLEANUPS (7)
+#define BENCH_BEACONS_PER_DAY (5000)
+
+void bench_beacon_expire_add_day(uint32_t day)
+{
+    ena_beacon_t beacon;
+    memset(&beacon, 0, sizeof(ena_beacon_t));
+    for (uint32_t i = 0; i < BENCH_BEACONS_PER_DAY; i++)
+    {
+        esp_fill_random(beacon.rpi, ENA_KEY_LENGTH);
+        beacon.timestamp_first = BENCH_START + day * BENCH_DAY + i * (BENCH_DAY / BENCH_BEACONS_PER_DAY);
+        beacon.timestamp_last = beacon.timestamp_first + 300;
+        ena_storage_add_beacon(&beacon);
+    }
+    ena_storage_flush();
+}
+
+int main(void)
+{
+    ena_storage_backend_t backend;
+    ESP_ERROR_CHECK(ena_host_flash_init(&backend, ENA_HOST_FLASH_SIZE));
+    ena_storage_backend_set(&backend);
+    ena_storage_erase_all();
+    esp_log_level_set("*", ESP_LOG_WARN);
+
+    for (uint32_t day = 0; day < BENCH_DAYS; day++)
+    {
+        bench_beacon_expire_add_day(day);
+    }
+    ENA_HOST_CHECK(ena_storage_beacons_count() == BENCH_DAYS * BENCH_BEACONS_PER_DAY);
+
+    double seconds = 0;
+    ena_storage_backend_stats_t before, after, total;
+    memset(&total, 0, sizeof(ena_storage_backend_stats_t));
+    for (uint32_t day = BENCH_DAYS; day < BENCH_DAYS + BENCH_CLEANUPS; day++)
+    {
+        ena_storage_backend_get_stats(&before);
+        double start = ena_host_seconds();
+        ena_storage_expire_beacons(BENCH_START + (day - BENCH_DAYS + 1) * BENCH_DAY - 1);
+        ena_storage_flush();
+        seconds += ena_host_seconds() - start;
+        ena_storage_backend_get_stats(&after);
+        total.reads += after.reads - before.reads;
+        total.writes += after.writes - before.writes;
+        total.erases += after.erases - before.erases;
+        total.bytes_written += after.bytes_written - before.bytes_written;
+        ENA_HOST_CHECK(ena_storage_beacons_count() == (BENCH_DAYS - 1) * BENCH_BEACONS_PER_DAY);
+
+        bench_beacon_expire_add_day(day);
+        ena_beacon_t beacon;
+        ena_storage_get_beacon(0, &beacon);
+        ENA_HOST_CHECK(beacon.timestamp_first == BENCH_START + (day - BENCH_DAYS + 1) * BENCH_DAY);
+    }
+
+    printf("expire %u of %u beacons, average of %u days\n", BENCH_BEACONS_PER_DAY, BENCH_DAYS * BENCH_BEACONS_PER_DAY, BENCH_CLEANUPS);
+    printf("time: %.3f ms\n", seconds * 1e3 / BENCH_CLEANUPS);
+    printf("flash: %u reads, %u writes, %u erased blocks, %llu bytes written\n", total.reads / BENCH_CLEANUPS, total.writes / BENCH_CLEANUPS,
+           total.erases / BENCH_CLEANUPS, (unsigned long long)(total.bytes_written / BENCH_CLEANUPS));
+    return ena_host_result();
+}
\ No newline at end of file
@@ -0,0 +1,120 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * hashed RPI index at full beacon capacity: rebuild time, lookup latency and flash reads, and the index work of
+ * expiring one day of beacons
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_system.h"
+
+#include "ena-host.h"
+#include "ena-storage.h"
+#include "ena-storage-backend.h"
+
+#define BENCH_LOOKUPS (20000)
+#define BENCH_START (1600000000)
+#define BENCH_DAYS (14)
+#define BENCH_INDEX_ADDRESS (((ENA_HOST_FLASH_SIZE - 4096 - ENA_STORAGE_BEACON_INDEX_SLOTS * 4) / 4096) * 4096)
+
+int main(void)
+{
+    ena_storage_backend_t backend;
+    ESP_ERROR_CHECK(ena_host_flash_init(&backend, ENA_HOST_FLASH_SIZE));
+    ena_storage_backend_set(&backend);
+    ena_storage_erase_all();
+
+    // fill until no space is left, beacons spread over 14 days
+    ena_beacon_t beacon;
+    memset(&beacon, 0, sizeof(ena_beacon_t));
+    uint32_t capacity = 0;
+    esp_log_level_set("*", ESP_LOG_NONE);
+    while (true)
+    {
+        esp_fill_random(beacon.rpi, ENA_KEY_LENGTH);
+        beacon.timestamp_first = BENCH_START + capacity * 15;
+        beacon.timestamp_last = beacon.timestamp_first + 300;
+        ena_storage_add_beacon(&beacon);
+        if (ena_storage_beacons_count() == capacity)
+        {
+            break;
+        }
+        capacity++;
+    }
+    esp_log_level_set("*", ESP_LOG_WARN);
+    ena_storage_flush();
+
+    ena_storage_backend_stats_t before, after;
+    ena_storage_backend_get_stats(&before);
+    double start = ena_host_seconds();
+    ena_storage_beacon_index_rebuild();
+    double rebuild = ena_host_seconds() - start;
+    ena_storage_backend_get_stats(&after);
+    uint32_t rebuild_reads = after.reads - before.reads;
+    uint32_t rebuild_writes = after.writes - before.writes;
+
+    // lookups of stored RPIs and of random RPIs
+    static uint8_t rpis[BENCH_LOOKUPS][ENA_KEY_LENGTH];
+    for (uint32_t i = 0; i < BENCH_LOOKUPS; i++)
+    {
+        ena_storage_get_beacon((i * 7919) % capacity, &beacon);
+        memcpy(rpis[i], beacon.rpi, ENA_KEY_LENGTH);
+    }
+    uint32_t index;
+    uint32_t hits = 0;
+    ena_storage_backend_get_stats(&before);
+    start = ena_host_seconds();
+    for (uint32_t i = 0; i < BENCH_LOOKUPS; i++)
+    {
+        hits += ena_storage_find_beacons(rpis[i], &index, 1);
+    }
+    double hit = ena_host_seconds() - start;
+    ena_storage_backend_get_stats(&after);
+    uint32_t hit_reads = after.reads - before.reads;
+    ENA_HOST_CHECK(hits == BENCH_LOOKUPS);
+
+    uint32_t false_hits = 0;
+    ena_storage_backend_get_stats(&before);
+    start = ena_host_seconds();
+    for (uint32_t i = 0; i < BENCH_LOOKUPS; i++)
+    {
+        esp_fill_random(beacon.rpi, ENA_KEY_LENGTH);
+        false_hits += ena_storage_find_beacons(beacon.rpi, &index, 1);
+    }
+    double miss = ena_host_seconds() - start;
+    ena_storage_backend_get_stats(&after);
+    uint32_t miss_reads = after.reads - before.reads;
+    ENA_HOST_CHECK(false_hits == 0);
+
+    // expire the first day, deleted slots instead of a rebuild
+    uint32_t erases = ena_host_flash_block_erases(BENCH_INDEX_ADDRESS);
+    uint32_t day = capacity / BENCH_DAYS;
+    start = ena_host_seconds();
+    ena_storage_expire_beacons(BENCH_START + (day - 1) * 15 + 300);
+    ena_storage_get_beacon(0, &beacon);
+    hits = ena_storage_find_beacons(beacon.rpi, &index, 1);
+    double expire = ena_host_seconds() - start;
+    ENA_HOST_CHECK(ena_storage_beacons_count() == capacity - day);
+    ENA_HOST_CHECK(hits == 1 && index == 0);
+    ENA_HOST_CHECK(ena_host_flash_block_erases(BENCH_INDEX_ADDRESS) == erases);
+
+    printf("capacity with %u index slots: %u beacons\n", ENA_STORAGE_BEACON_INDEX_SLOTS, capacity);
+    printf("rebuild: %.3f s, %u flash reads, %u flash writes\n", rebuild, rebuild_reads, rebuild_writes);
+    printf("lookup of stored RPI: %.2f us, %.2f flash reads\n", hit * 1e6 / BENCH_LOOKUPS, (double)hit_reads / BENCH_LOOKUPS);
+    printf("lookup of unknown RPI: %.2f us, %.2f flash reads\n", miss * 1e6 / BENCH_LOOKUPS, (double)miss_reads / BENCH_LOOKUPS);
+    printf("expire %u beacons and first lookup: %.3f s, %u index erases\n", day, expire, ena_host_flash_block_erases(BENCH_INDEX_ADDRESS) - erases);
+    return ena_host_result();
+}
\ No newline at end of file
@@ -0,0 +1,79 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * flash erases per day of permanent beacon storage with 5,000 beacons a day and a daily cleanup, against a
+ * file-backed partition
+ *
+ * Built for the current Kconfig options, compare the output of the targets with different storage modes.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "esp_system.h"
+
+#include "ena-host.h"
+#include "ena-storage.h"
+#include "ena-storage-backend.h"
+
+#define BENCH_DAYS (21)
+#define BENCH_BEACONS_PER_DAY (4900) // 15 days fit into the beacon log before the daily expiry
+#define BENCH_KEEP_DAYS (14)
+#define BENCH_START (1600041600)
+
+int main(void)
+{
+    char path[] = "/tmp/ena-bench-wear-XXXXXX";
+    int fd = mkstemp(path);
+    close(fd);
+    ena_storage_backend_t backend;
+    ESP_ERROR_CHECK(ena_storage_backend_file_init(&backend, path, ENA_HOST_FLASH_SIZE));
+    ena_storage_backend_set(&backend);
+    ena_storage_erase_all();
+
+    printf("storage: %s\n", ENA_STORAGE_BEACON_LOG ? (ENA_STORAGE_BEACON_COLUMNS ? "columns" : "log") : "flat");
+    printf("day  beacons  erased blocks  written kB\n");
+    ena_beacon_t beacon;
+    memset(&beacon, 0, sizeof(ena_beacon_t));
+    uint32_t steady_erases = 0;
+    for (uint32_t day = 0; day < BENCH_DAYS; day++)
+    {
+        ena_storage_backend_stats_t stats;
+        ena_storage_backend_reset_stats();
+        uint32_t day_start = BENCH_START + day * 86400;
+        for (uint32_t i = 0; i < BENCH_BEACONS_PER_DAY; i++)
+        {
+            esp_fill_random(beacon.rpi, ENA_KEY_LENGTH);
+            beacon.timestamp_first = day_start + i * (86400 / BENCH_BEACONS_PER_DAY);
+            beacon.timestamp_last = beacon.timestamp_first + 300;
+            ena_storage_add_beacon(&beacon);
+        }
+        // daily cleanup like ena_beacons_cleanup
+        ena_storage_expire_beacons(day_start + 86400 - BENCH_KEEP_DAYS * 86400);
+        ena_storage_flush();
+        ena_storage_backend_get_stats(&stats);
+
+        uint32_t expected = (day + 1 < BENCH_KEEP_DAYS ? day + 1 : BENCH_KEEP_DAYS) * BENCH_BEACONS_PER_DAY;
+        ENA_HOST_CHECK(ena_storage_beacons_count() == expected);
+        printf("%3u  %7u  %13u  %10llu\n", day + 1, ena_storage_beacons_count(), stats.erases, (unsigned long long)stats.bytes_written / 1024);
+        if (day >= BENCH_KEEP_DAYS)
+        {
+            steady_erases += stats.erases;
+        }
+    }
+    printf("erased blocks per day after %u days: %u\n", BENCH_KEEP_DAYS, steady_erases / (BENCH_DAYS - BENCH_KEEP_DAYS));
+    unlink(path);
+    return ena_host_result();
+}
\ No newline at end of file
@@ -0,0 +1,92 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * RPIK and AEMK derivation per TEK, generic mbedtls_hkdf against ena_crypto_derive_keys
+ *
+ * Both paths are checked against the test vectors of the Apple/Google cryptography specification and against
+ * each other for random TEKs.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "mbedtls/md.h"
+#include "mbedtls/hkdf.h"
+
+#include "esp_system.h"
+
+#include "ena-host.h"
+#include "ena-crypto.h"
+
+#define BENCH_KEYS (20000)
+
+static const uint8_t test_tek[ENA_KEY_LENGTH] = {0x75, 0xc7, 0x34, 0xc6, 0xdd, 0x1a, 0x78, 0x2d, 0xe7, 0xa9, 0x65, 0xda, 0x5e, 0xb9, 0x31, 0x25};
+static const uint8_t test_rpik[ENA_KEY_LENGTH] = {0x18, 0x5a, 0xd9, 0x1d, 0xb6, 0x9e, 0xc7, 0xdd, 0x04, 0x89, 0x60, 0xf1, 0xf3, 0xba, 0x61, 0x75};
+static const uint8_t test_aemk[ENA_KEY_LENGTH] = {0xd5, 0x7c, 0x46, 0xaf, 0x7a, 0x1d, 0x83, 0x96, 0x5b, 0x9b, 0xed, 0x8b, 0xd1, 0x52, 0x93, 0x6a};
+
+void bench_crypto_derive_hkdf(const uint8_t *tek, uint8_t *rpik, uint8_t *aemk)
+{
+    const uint8_t rpik_info[] = "EN-RPIK";
+    const uint8_t aemk_info[] = "EN-AEMK";
+    const mbedtls_md_info_t *md = mbedtls_md_info_from_type(MBEDTLS_MD_SHA256);
+    mbedtls_hkdf(md, NULL, 0, tek, ENA_KEY_LENGTH, rpik_info, sizeof(rpik_info) - 1, rpik, ENA_KEY_LENGTH);
+    mbedtls_hkdf(md, NULL, 0, tek, ENA_KEY_LENGTH, aemk_info, sizeof(aemk_info) - 1, aemk, ENA_KEY_LENGTH);
+}
+
+int main(void)
+{
+    static uint8_t teks[BENCH_KEYS][ENA_KEY_LENGTH];
+    uint8_t rpik[ENA_KEY_LENGTH], aemk[ENA_KEY_LENGTH];
+    uint8_t hkdf_rpik[ENA_KEY_LENGTH], hkdf_aemk[ENA_KEY_LENGTH];
+
+    ena_crypto_init();
+
+    bench_crypto_derive_hkdf(test_tek, hkdf_rpik, hkdf_aemk);
+    ENA_HOST_CHECK(memcmp(hkdf_rpik, test_rpik, ENA_KEY_LENGTH) == 0 && memcmp(hkdf_aemk, test_aemk, ENA_KEY_LENGTH) == 0);
+    ena_crypto_derive_keys((uint8_t *)test_tek, rpik, aemk);
+    ENA_HOST_CHECK(memcmp(rpik, test_rpik, ENA_KEY_LENGTH) == 0 && memcmp(aemk, test_aemk, ENA_KEY_LENGTH) == 0);
+
+    esp_fill_random(teks, sizeof(teks));
+    for (int k = 0; k < 256; k++)
+    {
+        bench_crypto_derive_hkdf(teks[k], hkdf_rpik, hkdf_aemk);
+        ena_crypto_derive_keys(teks[k], rpik, aemk);
+        ENA_HOST_CHECK(memcmp(rpik, hkdf_rpik, ENA_KEY_LENGTH) == 0 && memcmp(aemk, hkdf_aemk, ENA_KEY_LENGTH) == 0);
+    }
+
+    double start = ena_host_seconds();
+    for (int k = 0; k < BENCH_KEYS; k++)
+    {
+        bench_crypto_derive_hkdf(teks[k], hkdf_rpik, hkdf_aemk);
+    }
+    double hkdf = ena_host_seconds() - start;
+
+    start = ena_host_seconds();
+    for (int k = 0; k < BENCH_KEYS; k++)
+    {
+        ena_crypto_derive_keys(teks[k], rpik, aemk);
+    }
+    double derive = ena_host_seconds() - start;
+
+    start = ena_host_seconds();
+    for (int k = 0; k < BENCH_KEYS; k++)
+    {
+        ena_crypto_derive_keys(teks[k], rpik, NULL);
+    }
+    double derive_rpik = ena_host_seconds() - start;
+
+    printf("mbedtls_hkdf RPIK+AEMK:           %.2f us/TEK\n", hkdf * 1e6 / BENCH_KEYS);
+    printf("ena_crypto_derive_keys RPIK+AEMK: %.2f us/TEK (%.0f%% of mbedtls_hkdf)\n", derive * 1e6 / BENCH_KEYS, 100 * derive / hkdf);
+    printf("ena_crypto_derive_keys RPIK:      %.2f us/TEK (%.0f%% of mbedtls_hkdf)\n", derive_rpik * 1e6 / BENCH_KEYS, 100 * derive_rpik / hkdf);
+    return ena_host_result();
+}
\ No newline at end of file
@@ -0,0 +1,127 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * blocks per second of RPI and AEM derivation, one AES key schedule per call against one per batch
+ *
+ * The per-call path is the one ena-crypto.c used before batching: init, key schedule, one block and free for
+ * every RPI. Both paths must give the same RPIs and AEMs.
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "mbedtls/aes.h"
+
+#include "esp_system.h"
+
+#include "ena-host.h"
+#include "ena-crypto.h"
+
+#define BENCH_KEYS (2000)
+
+void bench_crypto_rpi_single(uint8_t *rpi, uint8_t *rpik, uint32_t enin)
+{
+    uint8_t padded_data[ENA_KEY_LENGTH] = "EN-RPI";
+    padded_data[12] = (enin & 0x000000ff);
+    padded_data[13] = (enin & 0x0000ff00) >> 8;
+    padded_data[14] = (enin & 0x00ff0000) >> 16;
+    padded_data[15] = (enin & 0xff000000) >> 24;
+
+    mbedtls_aes_context aes;
+    mbedtls_aes_init(&aes);
+    mbedtls_aes_setkey_enc(&aes, rpik, ENA_KEY_LENGTH * 8);
+    mbedtls_aes_crypt_ecb(&aes, MBEDTLS_AES_ENCRYPT, padded_data, rpi);
+    mbedtls_aes_free(&aes);
+}
+
+void bench_crypto_aem_single(uint8_t *aem, uint8_t *aemk, uint8_t *rpi, uint8_t power_level)
+{
+    uint8_t metadata[ENA_AEM_METADATA_LENGTH] = {0b01000000, power_level, 0, 0};
+    uint8_t nonce[ENA_KEY_LENGTH];
+    uint8_t stream_block[ENA_KEY_LENGTH] = {0};
+    size_t offset = 0;
+    memcpy(nonce, rpi, ENA_KEY_LENGTH);
+
+    mbedtls_aes_context aes;
+    mbedtls_aes_init(&aes);
+    mbedtls_aes_setkey_enc(&aes, aemk, ENA_KEY_LENGTH * 8);
+    mbedtls_aes_crypt_ctr(&aes, ENA_AEM_METADATA_LENGTH, &offset, nonce, stream_block, metadata, aem);
+    mbedtls_aes_free(&aes);
+}
+
+int main(void)
+{
+    static uint8_t keys[BENCH_KEYS][ENA_KEY_LENGTH];
+    static uint8_t single[ENA_TEK_ROLLING_PERIOD * ENA_KEY_LENGTH];
+    static uint8_t batch[ENA_TEK_ROLLING_PERIOD * ENA_KEY_LENGTH];
+    static uint8_t single_aem[ENA_TEK_ROLLING_PERIOD * ENA_AEM_METADATA_LENGTH];
+    static uint8_t batch_aem[ENA_TEK_ROLLING_PERIOD * ENA_AEM_METADATA_LENGTH];
+    uint32_t enin = 2666640;
+    uint32_t blocks = BENCH_KEYS * ENA_TEK_ROLLING_PERIOD;
+
+    esp_fill_random(keys, sizeof(keys));
+
+    // same results
+    for (int k = 0; k < 16; k++)
+    {
+        ena_crypto_rpi_batch(keys[k], enin, ENA_TEK_ROLLING_PERIOD, batch);
+        ena_crypto_aem_batch(keys[k], batch, ENA_TEK_ROLLING_PERIOD, 0xC8, batch_aem);
+        for (int i = 0; i < ENA_TEK_ROLLING_PERIOD; i++)
+        {
+            bench_crypto_rpi_single(&single[i * ENA_KEY_LENGTH], keys[k], enin + i);
+            bench_crypto_aem_single(&single_aem[i * ENA_AEM_METADATA_LENGTH], keys[k], &single[i * ENA_KEY_LENGTH], 0xC8);
+        }
+        ENA_HOST_CHECK(memcmp(single, batch, sizeof(batch)) == 0);
+        ENA_HOST_CHECK(memcmp(single_aem, batch_aem, sizeof(batch_aem)) == 0);
+    }
+
+    double start = ena_host_seconds();
+    for (int k = 0; k < BENCH_KEYS; k++)
+    {
+        for (int i = 0; i < ENA_TEK_ROLLING_PERIOD; i++)
+        {
+            bench_crypto_rpi_single(&single[i * ENA_KEY_LENGTH], keys[k], enin + i);
+        }
+    }
+    double rpi_single = ena_host_seconds() - start;
+
+    start = ena_host_seconds();
+    for (int k = 0; k < BENCH_KEYS; k++)
+    {
+        ena_crypto_rpi_batch(keys[k], enin, ENA_TEK_ROLLING_PERIOD, batch);
+    }
+    double rpi_batch = ena_host_seconds() - start;
+
+    start = ena_host_seconds();
+    for (int k = 0; k < BENCH_KEYS; k++)
+    {
+        for (int i = 0; i < ENA_TEK_ROLLING_PERIOD; i++)
+        {
+            bench_crypto_aem_single(&single_aem[i * ENA_AEM_METADATA_LENGTH], keys[k], &batch[i * ENA_KEY_LENGTH], 0xC8);
+        }
+    }
+    double aem_single = ena_host_seconds() - start;
+
+    start = ena_host_seconds();
+    for (int k = 0; k < BENCH_KEYS; k++)
+    {
+        ena_crypto_aem_batch(keys[k], batch, ENA_TEK_ROLLING_PERIOD, 0xC8, batch_aem);
+    }
+    double aem_batch = ena_host_seconds() - start;
+
+    printf("RPI per call: %.0f blocks/s\n", blocks / rpi_single);
+    printf("RPI batch:    %.0f blocks/s (%.1fx)\n", blocks / rpi_batch, rpi_single / rpi_batch);
+    printf("AEM per call: %.0f blocks/s\n", blocks / aem_single);
+    printf("AEM batch:    %.0f blocks/s (%.1fx)\n", blocks / aem_batch, aem_single / aem_batch);
+    return ena_host_result();
+}
\ No newline at end of file
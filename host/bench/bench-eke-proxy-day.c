@@ -0,0 +1,161 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * wall-clock time of syncing one day of several pages from the stand-in server, built with and without
+ * CONFIG_ENA_EKE_PROXY_PIPELINE
+ *
+ * The server waits the latency before each response and each segment of a body, however large the reads. The
+ * latency in ms can be given as arguments, each one is a sync of its own.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_system.h"
+
+#include "ena-host.h"
+#include "ena-crypto.h"
+#include "ena-storage.h"
+#include "ena-storage-backend.h"
+#include "ena-eke-proxy.h"
+
+#define BENCH_DAY (86400)
+#define BENCH_NOW (1600041600 + 15 * BENCH_DAY + 600) // ten minutes into the day, nothing hourly to sync
+#define BENCH_PAGES (8)                                // full pages of keys of the day
+#define BENCH_BEACONS (10000)                          // beacons of the 14 days before
+#define BENCH_SEGMENT (1024)                           // bytes of a body per segment
+#define BENCH_LATENCY_MS (20)                          // default latency
+
+static uint32_t bench_latency_us = BENCH_LATENCY_MS * 1000;
+
+int bench_eke_proxy_day_open(const char *url, int *length)
+{
+    usleep(bench_latency_us);
+    if (strstr(url, "/hour/") != NULL || atoi(strstr(url, "page=") + 5) >= BENCH_PAGES)
+    {
+        return 204;
+    }
+    *length = ENA_EKE_PROXY_DEFAULT_LIMIT * ENA_EKE_PROXY_KEY_SIZE;
+    return 200;
+}
+
+int bench_eke_proxy_day_read(const char *url, size_t offset, uint8_t *data, size_t length)
+{
+    size_t end = ENA_EKE_PROXY_DEFAULT_LIMIT * ENA_EKE_PROXY_KEY_SIZE;
+    if (offset + length > end)
+    {
+        length = end - offset;
+    }
+    if (length > 0 && (offset % BENCH_SEGMENT == 0 || offset / BENCH_SEGMENT != (offset + length - 1) / BENCH_SEGMENT))
+    {
+        // next segment arrives, reads of a received one return without waiting
+        usleep(bench_latency_us);
+    }
+    // random keys of the day before, none seen
+    uint32_t rolling_start = ena_crypto_enin(BENCH_NOW - BENCH_NOW % BENCH_DAY - BENCH_DAY);
+    uint32_t rolling_period = ENA_TEK_ROLLING_PERIOD;
+    esp_fill_random(data, length);
+    for (size_t i = 0; i < length; i++)
+    {
+        size_t position = (offset + i) % ENA_EKE_PROXY_KEY_SIZE;
+        if (position >= ENA_KEY_LENGTH && position < ENA_KEY_LENGTH + 4)
+        {
+            data[i] = ((uint8_t *)&rolling_start)[position - ENA_KEY_LENGTH];
+        }
+        else if (position >= ENA_KEY_LENGTH + 4 && position < ENA_KEY_LENGTH + 8)
+        {
+            data[i] = ((uint8_t *)&rolling_period)[position - ENA_KEY_LENGTH - 4];
+        }
+    }
+    return length;
+}
+
+void bench_eke_proxy_day_fill(void)
+{
+    ena_storage_erase_all();
+    ena_beacon_t beacon = {.rssi = -80};
+    uint32_t start = BENCH_NOW - 14 * BENCH_DAY;
+    for (uint32_t i = 0; i < BENCH_BEACONS; i++)
+    {
+        esp_fill_random(beacon.rpi, ENA_KEY_LENGTH);
+        esp_fill_random(beacon.aem, ENA_AEM_METADATA_LENGTH);
+        beacon.timestamp_first = start + (uint64_t)i * 14 * BENCH_DAY / BENCH_BEACONS;
+        beacon.timestamp_last = beacon.timestamp_first + 300;
+        ena_storage_add_beacon(&beacon);
+    }
+    ena_storage_flush();
+}
+
+void bench_eke_proxy_day(void *context)
+{
+    bench_latency_us = *(uint32_t *)context * 1000;
+    ena_host_http_server_t server = {
+        .open = &bench_eke_proxy_day_open,
+        .read = &bench_eke_proxy_day_read,
+        .segment_size = BENCH_SEGMENT,
+    };
+    esp_log_level_set("*", ESP_LOG_ERROR);
+    ena_host_http_set_server(&server);
+    ena_host_clock_set(BENCH_NOW);
+    ena_crypto_init();
+    bench_eke_proxy_day_fill();
+    ena_storage_write_last_exposure_date(BENCH_NOW - BENCH_NOW % BENCH_DAY - BENCH_DAY);
+    ena_storage_flush();
+
+    double start = ena_host_seconds();
+    ena_eke_proxy_start();
+    while (ena_storage_read_last_exposure_date() < BENCH_NOW - BENCH_NOW % BENCH_DAY || ena_eke_proxy_get_state() != ENA_EKE_PROXY_STATE_IDLE)
+    {
+        vTaskDelay(1 / portTICK_PERIOD_MS);
+    }
+    double seconds = ena_host_seconds() - start;
+
+    ena_eke_proxy_stats_t stats;
+    ena_eke_proxy_get_stats(&stats);
+    ENA_HOST_CHECK(stats.keys == BENCH_PAGES * ENA_EKE_PROXY_DEFAULT_LIMIT);
+    printf("%10u  %5u  %6u  %8.2f  %9.1f\n", *(uint32_t *)context, BENCH_PAGES, stats.keys, seconds, seconds * 1000 / BENCH_PAGES);
+}
+
+int main(int argc, char **argv)
+{
+    ena_storage_backend_t backend;
+    ESP_ERROR_CHECK(ena_host_flash_init(&backend, ENA_HOST_FLASH_SIZE));
+    ena_storage_backend_set(&backend);
+
+#ifdef CONFIG_ENA_EKE_PROXY_PIPELINE
+    printf("pipeline, %u byte segments\n", BENCH_SEGMENT);
+#else
+    printf("download then check, %u byte segments\n", BENCH_SEGMENT);
+#endif
+    printf("latency/ms  pages    keys  seconds  ms/page\n");
+    if (argc > 1)
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            uint32_t latency_ms = atoi(argv[i]);
+            ENA_HOST_CHECK(ena_host_boot(&bench_eke_proxy_day, &latency_ms) == 0);
+        }
+    }
+    else
+    {
+        uint32_t latency_ms = BENCH_LATENCY_MS;
+        ENA_HOST_CHECK(ena_host_boot(&bench_eke_proxy_day, &latency_ms) == 0);
+    }
+
+    return ena_host_result();
+}
\ No newline at end of file
@@ -0,0 +1,141 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * TLS handshakes and bytes per key of a 14-day catch-up sync against the stand-in HTTPS server, built with and
+ * without CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+ *
+ * The server closes a kept connection after 10 requests, drops the connection of every 25th request and once
+ * refuses more connections than the sync retries, so the sync sleeps and continues later.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_system.h"
+
+#include "ena-host.h"
+#include "ena-crypto.h"
+#include "ena-storage.h"
+#include "ena-storage-backend.h"
+#include "ena-eke-proxy.h"
+
+#define BENCH_DAY (86400)
+#define BENCH_NOW (1600041600 + 15 * BENCH_DAY + 600) // ten minutes into the day
+#define BENCH_PAGES (3)                                // full pages of keys per day
+#define BENCH_KEEP_ALIVE (10)                          // requests per connection
+#define BENCH_DROP (25)                                // every n-th request loses its connection
+#define BENCH_OUTAGE (30)                              // request starting an outage longer than the retries
+#define BENCH_OUTAGE_REFUSED (8)                       // connections refused in the outage
+
+static uint32_t bench_opened = 0;
+static uint32_t bench_refused = 0;
+
+int bench_eke_proxy_sessions_open(const char *url, int *length)
+{
+    bench_opened++;
+    if (bench_opened == BENCH_OUTAGE && bench_refused < BENCH_OUTAGE_REFUSED)
+    {
+        bench_opened--;
+        bench_refused++;
+        return -1;
+    }
+    if (bench_opened % BENCH_DROP == 0)
+    {
+        return -1;
+    }
+    if (strstr(url, "/hour/") != NULL || atoi(strstr(url, "page=") + 5) >= BENCH_PAGES)
+    {
+        return 204;
+    }
+    *length = ENA_EKE_PROXY_DEFAULT_LIMIT * ENA_EKE_PROXY_KEY_SIZE;
+    return 200;
+}
+
+int bench_eke_proxy_sessions_read(const char *url, size_t offset, uint8_t *data, size_t length)
+{
+    size_t end = ENA_EKE_PROXY_DEFAULT_LIMIT * ENA_EKE_PROXY_KEY_SIZE;
+    if (offset + length > end)
+    {
+        length = end - offset;
+    }
+    // random keys of the first synced day, none seen
+    uint32_t rolling_start = ena_crypto_enin(BENCH_NOW - BENCH_NOW % BENCH_DAY - 14 * BENCH_DAY);
+    uint32_t rolling_period = ENA_TEK_ROLLING_PERIOD;
+    esp_fill_random(data, length);
+    for (size_t i = 0; i < length; i++)
+    {
+        size_t position = (offset + i) % ENA_EKE_PROXY_KEY_SIZE;
+        if (position >= ENA_KEY_LENGTH && position < ENA_KEY_LENGTH + 4)
+        {
+            data[i] = ((uint8_t *)&rolling_start)[position - ENA_KEY_LENGTH];
+        }
+        else if (position >= ENA_KEY_LENGTH + 4 && position < ENA_KEY_LENGTH + 8)
+        {
+            data[i] = ((uint8_t *)&rolling_period)[position - ENA_KEY_LENGTH - 4];
+        }
+    }
+    return length;
+}
+
+int main(void)
+{
+    ena_storage_backend_t backend;
+    ESP_ERROR_CHECK(ena_host_flash_init(&backend, ENA_HOST_FLASH_SIZE));
+    ena_storage_backend_set(&backend);
+    esp_log_level_set("*", ESP_LOG_ERROR);
+
+    ena_host_http_server_t server = {
+        .open = &bench_eke_proxy_sessions_open,
+        .read = &bench_eke_proxy_sessions_read,
+        .keep_alive_requests = BENCH_KEEP_ALIVE,
+    };
+    ena_host_http_set_server(&server);
+    ena_host_clock_set(BENCH_NOW);
+    ena_crypto_init();
+    ena_storage_erase_all();
+    ena_storage_write_last_exposure_date(BENCH_NOW - BENCH_NOW % BENCH_DAY - 14 * BENCH_DAY);
+    ena_storage_flush();
+
+    ena_eke_proxy_start();
+    while (ena_storage_read_last_exposure_date() < BENCH_NOW - BENCH_NOW % BENCH_DAY || ena_eke_proxy_get_state() != ENA_EKE_PROXY_STATE_IDLE)
+    {
+        if (ena_eke_proxy_get_state() == ENA_EKE_PROXY_STATE_IDLE)
+        {
+            // sleep after the outage passes
+            ena_host_clock_advance(10);
+        }
+        vTaskDelay(20 / portTICK_PERIOD_MS);
+    }
+
+    ena_eke_proxy_stats_t stats;
+    ena_eke_proxy_get_stats(&stats);
+    ena_host_http_stats_t http;
+    ena_host_http_get_stats(&http);
+    ENA_HOST_CHECK(stats.keys == 14 * BENCH_PAGES * ENA_EKE_PROXY_DEFAULT_LIMIT);
+    ENA_HOST_CHECK(bench_refused == BENCH_OUTAGE_REFUSED);
+#ifdef CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+    const char *mode = "session tickets";
+    ENA_HOST_CHECK(http.full_handshakes == 1);
+#else
+    const char *mode = "no tickets";
+    ENA_HOST_CHECK(http.full_handshakes == http.connections);
+#endif
+    printf("%-15s: %u keys, %u requests, %u connections, %u full and %u resumed handshakes, %.1f body bytes per key\n",
+           mode, stats.keys, http.requests, http.connections, http.full_handshakes, http.resumed_handshakes, (double)http.bytes / stats.keys);
+
+    return ena_host_result();
+}
\ No newline at end of file
@@ -0,0 +1,136 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * keys per second of the batch exposure check against 10k, 50k and 76k stored beacons
+ *
+ * Beacons are spread over 14 days, 10 pages of 500 keys of all days are checked like pages of the key server, some
+ * keys are planted in the beacons. The planted matches must all be found, nothing else may match. Keys are matched
+ * against beacons of the same ENIN only, so the keys per second must stay flat while the beacons grow.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_system.h"
+
+#include "ena-host.h"
+#include "ena-crypto.h"
+#include "ena-storage.h"
+#include "ena-storage-backend.h"
+#include "ena-exposure.h"
+
+#define BENCH_DAYS (14)
+#define BENCH_KEYS (500)
+#define BENCH_PAGES (10)
+#define BENCH_PLANTED (20) // keys with a beacon in storage
+#define BENCH_START (1600041600)
+
+void bench_exposure_check_key(uint32_t i, ena_temporary_exposure_key_t *key)
+{
+    memset(key, 0, sizeof(ena_temporary_exposure_key_t));
+    memcpy(key->key_data, &i, sizeof(i));
+    key->key_data[15] = 0x5A;
+    key->rolling_start_interval_number = ena_crypto_enin(BENCH_START) + (i % BENCH_DAYS) * ENA_TEK_ROLLING_PERIOD;
+    key->rolling_period = ENA_TEK_ROLLING_PERIOD;
+    key->report_type = 1;
+}
+
+void bench_exposure_check_fill(uint32_t count)
+{
+    ena_storage_erase_all();
+    ena_host_random_seed(count);
+
+    uint32_t span = BENCH_DAYS * 86400;
+    uint32_t planted = 0;
+    uint32_t planted_days[BENCH_DAYS] = {0};
+    ena_beacon_t beacon;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        memset(&beacon, 0, sizeof(ena_beacon_t));
+        beacon.timestamp_first = BENCH_START + (uint64_t)i * span / count;
+        beacon.timestamp_last = beacon.timestamp_first + 300;
+        beacon.rssi = -70;
+        uint32_t day = (beacon.timestamp_first - BENCH_START) / 86400;
+        uint32_t key_index = day + planted_days[day] * BENCH_DAYS;
+        if (key_index < BENCH_PLANTED && i % 97 == 0)
+        {
+            // RPI of a key of the same day at the interval of the beacon
+            ena_temporary_exposure_key_t key;
+            uint8_t rpik[ENA_KEY_LENGTH];
+            bench_exposure_check_key(key_index, &key);
+            ena_crypto_derive_keys(key.key_data, rpik, NULL);
+            ena_crypto_rpi(beacon.rpi, rpik, ena_crypto_enin(beacon.timestamp_first));
+            planted_days[day]++;
+            planted++;
+        }
+        else
+        {
+            esp_fill_random(beacon.rpi, ENA_KEY_LENGTH);
+        }
+        esp_fill_random(beacon.aem, ENA_AEM_METADATA_LENGTH);
+        ena_storage_add_beacon(&beacon);
+    }
+    ena_storage_flush();
+    ENA_HOST_CHECK(planted == BENCH_PLANTED);
+}
+
+double bench_exposure_check(uint32_t count)
+{
+    bench_exposure_check_fill(count);
+    if (!ENA_HOST_CHECK(ena_storage_beacons_count() == count))
+    {
+        return 0;
+    }
+
+    ena_temporary_exposure_key_t *keys = malloc(sizeof(ena_temporary_exposure_key_t) * BENCH_KEYS);
+    double seconds = 0;
+    for (uint32_t page = 0; page < BENCH_PAGES; page++)
+    {
+        for (uint32_t i = 0; i < BENCH_KEYS; i++)
+        {
+            bench_exposure_check_key(page * BENCH_KEYS + i, &keys[i]);
+        }
+        double start = ena_host_seconds();
+        ena_exposure_check_temporary_exposure_keys(keys, BENCH_KEYS);
+        seconds += ena_host_seconds() - start;
+    }
+
+    uint32_t matches = ena_storage_exposure_information_count();
+    ENA_HOST_CHECK(matches == BENCH_PLANTED);
+    printf("%6u beacons: %u keys in %.3f s, %.0f keys/s, %u of %u planted matches\n", count, BENCH_PAGES * BENCH_KEYS, seconds, BENCH_PAGES * BENCH_KEYS / seconds, matches, BENCH_PLANTED);
+    free(keys);
+    return BENCH_PAGES * BENCH_KEYS / seconds;
+}
+
+int main(int argc, char **argv)
+{
+    ena_storage_backend_t backend;
+    ESP_ERROR_CHECK(ena_host_flash_init(&backend, ENA_HOST_FLASH_SIZE));
+    ena_storage_backend_set(&backend);
+    ena_crypto_init();
+
+    double slowest = 0;
+    double fastest = 0;
+    uint32_t counts[] = {10000, 50000, 76000};
+    for (int i = 0; i < (argc > 1 ? argc - 1 : 3); i++)
+    {
+        double keys_per_second = bench_exposure_check(argc > 1 ? atoi(argv[i + 1]) : counts[i]);
+        slowest = (i == 0 || keys_per_second < slowest) ? keys_per_second : slowest;
+        fastest = keys_per_second > fastest ? keys_per_second : fastest;
+    }
+    // grouping the beacons of a day once per batch grows with them, matching a key must not (about 20% when it did)
+    printf("slowest %.0f keys/s, %.0f%% of the fastest\n", slowest, 100 * slowest / fastest);
+    ENA_HOST_CHECK(slowest * 3 >= fastest);
+    return ena_host_result();
+}
\ No newline at end of file
@@ -0,0 +1,182 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * flash writes and erases per synced day of the exposure check, with a record per matching beacon as keys checked
+ * outside a batch and with a record per key and day of the batch check
+ *
+ * 14 days are synced, each with 2000 keys of which 6 were seen for 16 intervals. Both must store the same total
+ * duration.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "esp_log.h"
+#include "esp_system.h"
+
+#include "ena-host.h"
+#include "ena-crypto.h"
+#include "ena-storage.h"
+#include "ena-storage-backend.h"
+#include "ena-exposure.h"
+
+#define BENCH_DAYS (14)
+#define BENCH_KEYS (2000)    // keys per synced day
+#define BENCH_CONTACTS (6)   // keys per day seen
+#define BENCH_SEEN (16)      // intervals each contact was seen at
+#define BENCH_NOISE (2)      // other beacons per interval
+#define BENCH_MINUTES (5)    // duration of a beacon
+#define BENCH_START (1600041600)
+
+typedef struct
+{
+    uint32_t records; // exposure information stored
+    uint32_t writes;  // backend writes of all checks
+    uint32_t erases;  // backend erases of all checks
+    uint32_t minutes; // total duration of the stored exposure information
+} bench_exposure_writes_run_t;
+
+static bench_exposure_writes_run_t *run = NULL; // shared with booted processes
+
+void bench_exposure_writes_key(uint32_t day, uint32_t i, ena_temporary_exposure_key_t *key)
+{
+    memset(key, 0, sizeof(ena_temporary_exposure_key_t));
+    memcpy(key->key_data, &day, sizeof(day));
+    memcpy(&key->key_data[4], &i, sizeof(i));
+    key->key_data[15] = 0x5A;
+    key->rolling_start_interval_number = ena_crypto_enin(BENCH_START) + day * ENA_TEK_ROLLING_PERIOD;
+    key->rolling_period = ENA_TEK_ROLLING_PERIOD;
+    key->report_type = 1;
+}
+
+void bench_exposure_writes_fill(void)
+{
+    ena_storage_erase_all();
+    ena_host_random_seed(BENCH_DAYS);
+
+    ena_temporary_exposure_key_t key;
+    uint8_t rpik[BENCH_CONTACTS][ENA_KEY_LENGTH];
+    ena_beacon_t beacon = {0};
+    for (uint32_t day = 0; day < BENCH_DAYS; day++)
+    {
+        for (uint32_t c = 0; c < BENCH_CONTACTS; c++)
+        {
+            bench_exposure_writes_key(day, c, &key);
+            ena_crypto_derive_keys(key.key_data, rpik[c], NULL);
+        }
+        uint32_t enin = ena_crypto_enin(BENCH_START) + day * ENA_TEK_ROLLING_PERIOD;
+        for (uint32_t j = 0; j < ENA_TEK_ROLLING_PERIOD; j++)
+        {
+            beacon.timestamp_first = (enin + j) * ENA_TIME_WINDOW + 60;
+            beacon.timestamp_last = beacon.timestamp_first + BENCH_MINUTES * 60;
+            for (uint32_t n = 0; n < BENCH_NOISE; n++)
+            {
+                beacon.rssi = -80;
+                esp_fill_random(beacon.rpi, ENA_KEY_LENGTH);
+                esp_fill_random(beacon.aem, ENA_AEM_METADATA_LENGTH);
+                ena_storage_add_beacon(&beacon);
+            }
+            // contacts one after another, each for a block of intervals
+            uint32_t c = j / (ENA_TEK_ROLLING_PERIOD / BENCH_CONTACTS);
+            if (c < BENCH_CONTACTS && j % (ENA_TEK_ROLLING_PERIOD / BENCH_CONTACTS) < BENCH_SEEN)
+            {
+                beacon.rssi = -60;
+                ena_crypto_rpi(beacon.rpi, rpik[c], enin + j);
+                esp_fill_random(beacon.aem, ENA_AEM_METADATA_LENGTH);
+                ena_storage_add_beacon(&beacon);
+            }
+        }
+    }
+    ena_storage_flush();
+}
+
+void bench_exposure_writes_check(void *context)
+{
+    bool batch = *(bool *)context;
+    esp_log_level_set("*", ESP_LOG_ERROR);
+    bench_exposure_writes_fill();
+    ena_host_clock_set(BENCH_START + (BENCH_DAYS + 1) * 86400);
+    memset(run, 0, sizeof(bench_exposure_writes_run_t));
+
+    ena_temporary_exposure_key_t *keys = malloc(sizeof(ena_temporary_exposure_key_t) * BENCH_KEYS);
+    ena_storage_backend_stats_t before, after;
+    ena_exposure_information_t exposure_info;
+    for (uint32_t day = 0; day < BENCH_DAYS; day++)
+    {
+        for (uint32_t i = 0; i < BENCH_KEYS; i++)
+        {
+            bench_exposure_writes_key(day, i, &keys[i]);
+        }
+
+        uint32_t count = ena_storage_exposure_information_count();
+        ena_storage_backend_get_stats(&before);
+        if (batch)
+        {
+            ena_exposure_check_temporary_exposure_keys(keys, BENCH_KEYS);
+        }
+        else
+        {
+            // every match is written right away
+            for (uint32_t i = 0; i < BENCH_KEYS; i++)
+            {
+                ena_exposure_check_key(&keys[i]);
+            }
+            ena_exposure_check_finish();
+        }
+        ena_storage_flush();
+        ena_storage_backend_get_stats(&after);
+        run->writes += after.writes - before.writes;
+        run->erases += after.erases - before.erases;
+
+        // records of the day, still in the ring
+        uint32_t added = ena_storage_exposure_information_count() - count;
+        run->records += added;
+        for (uint32_t i = count; i < count + added; i++)
+        {
+            ena_storage_get_exposure_information(i, &exposure_info);
+            run->minutes += exposure_info.duration_minutes;
+        }
+    }
+    free(keys);
+}
+
+int main(void)
+{
+    ena_storage_backend_t backend;
+    ESP_ERROR_CHECK(ena_host_flash_init(&backend, ENA_HOST_FLASH_SIZE));
+    ena_storage_backend_set(&backend);
+    ena_crypto_init();
+    run = mmap(NULL, sizeof(bench_exposure_writes_run_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    bool modes[] = {false, true};
+    const char *names[] = {"per beacon", "per key-day"};
+    bench_exposure_writes_run_t runs[2];
+    printf("%u days, %u keys per day, %u contacts per day seen at %u intervals\n", BENCH_DAYS, BENCH_KEYS, BENCH_CONTACTS, BENCH_SEEN);
+    printf("mode         records  writes/day  erases/day  minutes\n");
+    for (int i = 0; i < 2; i++)
+    {
+        ENA_HOST_CHECK(ena_host_boot(&bench_exposure_writes_check, &modes[i]) == 0);
+        runs[i] = *run;
+        printf("%-11s  %7u  %10.1f  %10.1f  %7u\n", names[i], runs[i].records, (double)runs[i].writes / BENCH_DAYS,
+               (double)runs[i].erases / BENCH_DAYS, runs[i].minutes);
+    }
+
+    ENA_HOST_CHECK(runs[0].records == BENCH_DAYS * BENCH_CONTACTS * BENCH_SEEN);
+    ENA_HOST_CHECK(runs[1].records == BENCH_DAYS * BENCH_CONTACTS);
+    ENA_HOST_CHECK(runs[0].minutes == BENCH_DAYS * BENCH_CONTACTS * BENCH_SEEN * BENCH_MINUTES);
+    ENA_HOST_CHECK(runs[1].minutes == runs[0].minutes);
+    ENA_HOST_CHECK(runs[1].writes < runs[0].writes);
+    return ena_host_result();
+}
\ No newline at end of file
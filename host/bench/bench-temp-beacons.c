@@ -0,0 +1,299 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * flash erases per hour of temporary beacons, replaying a scan trace through ena_beacon and
+ * ena_beacons_temp_refresh, against a replay of the former flash-resident temporary beacons that wrote every
+ * sighting, against a file-backed partition
+ *
+ *   bench-temp-beacons [trace]
+ *
+ * A trace has one line per received advertisement, "<timestamp> <RPI hex> <AEM hex> <RSSI>", and a line
+ * "end <timestamp>" after every scan. Without a trace, six hours at a busy train station are generated: 30 staff
+ * devices all the time, 20 passengers arriving per minute and staying 3 to 20 minutes, RPIs rotating every 10
+ * to 20 minutes and each present device received once per scan with a probability of 95%.
+ *
+ * Built for the current Kconfig options, compare the erases per scan of the targets with and without write cache.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "esp_system.h"
+
+#include "ena-host.h"
+#include "ena-crypto.h"
+#include "ena-storage.h"
+#include "ena-storage-backend.h"
+#include "ena-beacons.h"
+#include "ena-bluetooth-scan.h"
+
+#define BENCH_START (1600000000)
+#define BENCH_HOURS (6)
+#define BENCH_STAFF (30)
+#define BENCH_ARRIVALS_PER_MINUTE (20)
+#define BENCH_EVENTS_MAX (200000)
+
+typedef struct
+{
+    uint32_t timestamp; // time of reception or end of scan
+    uint8_t rpi[ENA_KEY_LENGTH];
+    uint8_t aem[ENA_AEM_METADATA_LENGTH];
+    int rssi;
+    bool end; // end of scan
+} bench_temp_beacons_event_t;
+
+typedef struct
+{
+    uint32_t arrival;
+    uint32_t departure;
+    uint32_t rotation; // time of first RPI rotation
+    uint32_t interval; // RPI rotation interval
+} bench_temp_beacons_device_t;
+
+static bench_temp_beacons_event_t events[BENCH_EVENTS_MAX];
+static uint32_t events_count = 0;
+
+void bench_temp_beacons_add(uint32_t timestamp, uint32_t device, uint32_t rpi_number, int rssi)
+{
+    bench_temp_beacons_event_t *event = &events[events_count++];
+    memset(event, 0, sizeof(bench_temp_beacons_event_t));
+    event->timestamp = timestamp;
+    uint32_t hash = (device * 0x9E3779B1u) ^ (rpi_number * 0x85EBCA77u);
+    memcpy(event->rpi, &hash, sizeof(hash));
+    memcpy(&event->rpi[4], &device, sizeof(device));
+    memcpy(&event->rpi[8], &rpi_number, sizeof(rpi_number));
+    memcpy(event->aem, &hash, sizeof(hash));
+    event->rssi = rssi;
+}
+
+int bench_temp_beacons_compare(const void *a, const void *b)
+{
+    const bench_temp_beacons_event_t *first = a, *second = b;
+    return (first->timestamp > second->timestamp) - (first->timestamp < second->timestamp);
+}
+
+void bench_temp_beacons_generate(void)
+{
+    uint32_t end = BENCH_START + BENCH_HOURS * 3600;
+    uint32_t devices_count = BENCH_STAFF + BENCH_ARRIVALS_PER_MINUTE * BENCH_HOURS * 60;
+    bench_temp_beacons_device_t *devices = calloc(devices_count, sizeof(bench_temp_beacons_device_t));
+    ena_host_random_seed(7);
+    for (uint32_t i = 0; i < devices_count; i++)
+    {
+        if (i < BENCH_STAFF)
+        {
+            devices[i].arrival = BENCH_START - 3600;
+            devices[i].departure = end;
+        }
+        else
+        {
+            devices[i].arrival = BENCH_START + esp_random() % (BENCH_HOURS * 3600);
+            devices[i].departure = devices[i].arrival + 180 + esp_random() % (17 * 60);
+        }
+        devices[i].interval = 600 + esp_random() % 600;
+        devices[i].rotation = devices[i].arrival + esp_random() % devices[i].interval;
+    }
+
+    for (uint32_t scan = BENCH_START; scan < end; scan += ENA_SCANNING_INTERVAL)
+    {
+        uint32_t first = events_count;
+        for (uint32_t i = 0; i < devices_count && events_count < BENCH_EVENTS_MAX - 1; i++)
+        {
+            uint32_t timestamp = scan + esp_random() % ENA_SCANNING_TIME;
+            if (timestamp < devices[i].arrival || timestamp >= devices[i].departure || esp_random() % 100 >= 95)
+            {
+                continue;
+            }
+            uint32_t rpi_number = timestamp < devices[i].rotation ? 0 : 1 + (timestamp - devices[i].rotation) / devices[i].interval;
+            bench_temp_beacons_add(timestamp, i, rpi_number, -50 - (int)(esp_random() % 40));
+        }
+        qsort(&events[first], events_count - first, sizeof(bench_temp_beacons_event_t), &bench_temp_beacons_compare);
+        events[events_count].end = true;
+        events[events_count++].timestamp = scan + ENA_SCANNING_TIME;
+    }
+    free(devices);
+}
+
+bool bench_temp_beacons_load(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        perror(path);
+        return false;
+    }
+    char line[128];
+    while (fgets(line, sizeof(line), file) != NULL && events_count < BENCH_EVENTS_MAX)
+    {
+        bench_temp_beacons_event_t *event = &events[events_count];
+        memset(event, 0, sizeof(bench_temp_beacons_event_t));
+        char rpi[2 * ENA_KEY_LENGTH + 1], aem[2 * ENA_AEM_METADATA_LENGTH + 1];
+        if (sscanf(line, "end %u", &event->timestamp) == 1)
+        {
+            event->end = true;
+        }
+        else if (sscanf(line, "%u %32s %8s %d", &event->timestamp, rpi, aem, &event->rssi) == 4)
+        {
+            for (int i = 0; i < ENA_KEY_LENGTH; i++)
+            {
+                sscanf(&rpi[2 * i], "%2hhx", &event->rpi[i]);
+            }
+            for (int i = 0; i < ENA_AEM_METADATA_LENGTH; i++)
+            {
+                sscanf(&aem[2 * i], "%2hhx", &event->aem[i]);
+            }
+        }
+        else
+        {
+            continue;
+        }
+        events_count++;
+    }
+    fclose(file);
+    return events_count > 0;
+}
+
+// former temporary beacons: every sighting written to flash, refresh rereads them
+static uint32_t flash_count = 0;
+static ena_beacon_t flash_beacons[ENA_STORAGE_TEMP_BEACONS_MAX];
+
+void bench_temp_beacons_flash_beacon(bench_temp_beacons_event_t *event)
+{
+    for (uint32_t i = 0; i < flash_count; i++)
+    {
+        if (memcmp(flash_beacons[i].rpi, event->rpi, ENA_KEY_LENGTH) == 0 && memcmp(flash_beacons[i].aem, event->aem, ENA_AEM_METADATA_LENGTH) == 0)
+        {
+            flash_beacons[i].rssi = (flash_beacons[i].rssi + event->rssi) / 2;
+            flash_beacons[i].timestamp_last = event->timestamp;
+            ena_storage_set_temp_beacon(i, &flash_beacons[i]);
+            return;
+        }
+    }
+    if (flash_count >= ENA_STORAGE_TEMP_BEACONS_MAX)
+    {
+        return;
+    }
+    ena_beacon_t *beacon = &flash_beacons[flash_count++];
+    memcpy(beacon->rpi, event->rpi, ENA_KEY_LENGTH);
+    memcpy(beacon->aem, event->aem, ENA_AEM_METADATA_LENGTH);
+    beacon->rssi = event->rssi;
+    beacon->timestamp_first = event->timestamp;
+    beacon->timestamp_last = event->timestamp;
+    ena_storage_add_temp_beacon(beacon);
+}
+
+void bench_temp_beacons_flash_refresh(uint32_t unix_timestamp)
+{
+    for (int i = flash_count - 1; i >= 0; i--)
+    {
+        if (flash_beacons[i].timestamp_last - flash_beacons[i].timestamp_first >= ENA_BEACON_TRESHOLD)
+        {
+            ena_storage_add_beacon(&flash_beacons[i]);
+            ena_storage_remove_temp_beacon(i);
+        }
+        else if (unix_timestamp - flash_beacons[i].timestamp_last > (ENA_TIME_WINDOW * 2))
+        {
+            ena_storage_remove_temp_beacon(i);
+        }
+    }
+    flash_count = ena_storage_temp_beacons_count();
+    for (int i = 0; i < flash_count; i++)
+    {
+        ena_storage_get_temp_beacon(i, &flash_beacons[i]);
+    }
+}
+
+// replay the trace, returns erased blocks and the maximum of a single scan
+uint32_t bench_temp_beacons_replay(bool ram, uint32_t *scan_max, uint32_t *stored)
+{
+    ena_storage_erase_all();
+    ena_beacons_temp_restore();
+    flash_count = 0;
+    ena_storage_backend_reset_stats();
+    ena_storage_backend_stats_t stats;
+    uint32_t erases = 0;
+    *scan_max = 0;
+    for (uint32_t i = 0; i < events_count; i++)
+    {
+        ena_host_clock_set(events[i].timestamp);
+        if (!events[i].end)
+        {
+            if (ram)
+            {
+                ena_beacon(events[i].timestamp, events[i].rpi, events[i].aem, events[i].rssi);
+            }
+            else
+            {
+                bench_temp_beacons_flash_beacon(&events[i]);
+            }
+            continue;
+        }
+        if (ram)
+        {
+            ena_beacons_temp_refresh(events[i].timestamp);
+        }
+        else
+        {
+            bench_temp_beacons_flash_refresh(events[i].timestamp);
+        }
+        // the scan task flushes after the refresh of every scan, not after the batches before it
+        ena_storage_flush();
+        ena_storage_backend_get_stats(&stats);
+        if (stats.erases - erases > *scan_max)
+        {
+            *scan_max = stats.erases - erases;
+        }
+        erases = stats.erases;
+    }
+    *stored = ena_storage_beacons_count();
+    return erases;
+}
+
+int main(int argc, char **argv)
+{
+    char path[] = "/tmp/ena-bench-temp-XXXXXX";
+    int fd = mkstemp(path);
+    close(fd);
+    ena_storage_backend_t backend;
+    ESP_ERROR_CHECK(ena_storage_backend_file_init(&backend, path, ENA_HOST_FLASH_SIZE));
+    ena_storage_backend_set(&backend);
+    esp_log_level_set("*", ESP_LOG_ERROR);
+
+    if (argc > 1 ? !bench_temp_beacons_load(argv[1]) : (bench_temp_beacons_generate(), false))
+    {
+        return EXIT_FAILURE;
+    }
+    uint32_t sightings = 0, scans = 0;
+    for (uint32_t i = 0; i < events_count; i++)
+    {
+        events[i].end ? scans++ : sightings++;
+    }
+    double hours = (events[events_count - 1].timestamp - events[0].timestamp) / 3600.0;
+    printf("trace: %s, %u scans, %u advertisements, %.1f hours\n", argc > 1 ? argv[1] : "generated train station", scans, sightings, hours);
+    printf("write cache: %u blocks\n", ENA_STORAGE_WRITE_CACHE ? ENA_STORAGE_WRITE_CACHE_BLOCKS : 0);
+
+    uint32_t flash_max, ram_max, flash_stored, ram_stored;
+    uint32_t flash_erases = bench_temp_beacons_replay(false, &flash_max, &flash_stored);
+    uint32_t ram_erases = bench_temp_beacons_replay(true, &ram_max, &ram_stored);
+    ENA_HOST_CHECK(ram_stored == flash_stored);
+    ENA_HOST_CHECK(ram_erases < flash_erases);
+
+    printf("                    erased blocks per hour  per scan  max per scan  permanent beacons\n");
+    printf("write per sighting  %22.0f  %8.2f  %12u  %17u\n", flash_erases / hours, (double)flash_erases / scans, flash_max, flash_stored);
+    printf("RAM and snapshot    %22.0f  %8.2f  %12u  %17u\n", ram_erases / hours, (double)ram_erases / scans, ram_max, ram_stored);
+    unlink(path);
+    return ena_host_result();
+}
\ No newline at end of file
@@ -0,0 +1,148 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * hash table of temporary beacons at ENA_STORAGE_TEMP_BEACONS_MAX live entries: advertisements per second on
+ * the scan path (ena_beacon) against the former linear search, and removals per second on the refresh path
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "ena-host.h"
+#include "ena-crypto.h"
+#include "ena-storage.h"
+#include "ena-storage-backend.h"
+#include "ena-beacons.h"
+
+#define BENCH_START (1600000000)
+#define BENCH_LOOKUPS (2000000)
+#define BENCH_LINEAR_LOOKUPS (200000)
+#define BENCH_REFRESHES (200)
+
+static uint8_t rpis[ENA_STORAGE_TEMP_BEACONS_MAX][ENA_KEY_LENGTH];
+static uint8_t aems[ENA_STORAGE_TEMP_BEACONS_MAX][ENA_AEM_METADATA_LENGTH];
+static ena_beacon_t linear[ENA_STORAGE_TEMP_BEACONS_MAX];
+
+void bench_temp_table_rpis(uint32_t round)
+{
+    for (uint32_t i = 0; i < ENA_STORAGE_TEMP_BEACONS_MAX; i++)
+    {
+        uint32_t hash = (round * ENA_STORAGE_TEMP_BEACONS_MAX + i) * 2654435761u;
+        memcpy(rpis[i], &hash, sizeof(hash));
+        memcpy(&rpis[i][4], &i, sizeof(i));
+        memcpy(&rpis[i][8], &round, sizeof(round));
+        memcpy(aems[i], &hash, sizeof(hash));
+    }
+}
+
+// former lookup: linear search, here comparing the full RPI and AEM
+int bench_temp_table_linear_find(uint8_t *rpi, uint8_t *aem)
+{
+    for (int i = 0; i < ENA_STORAGE_TEMP_BEACONS_MAX; i++)
+    {
+        if (memcmp(linear[i].rpi, rpi, ENA_KEY_LENGTH) == 0 && memcmp(linear[i].aem, aem, ENA_AEM_METADATA_LENGTH) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+uint32_t bench_temp_table_snapshot_count(void)
+{
+    ena_beacons_temp_snapshot();
+    return ena_storage_temp_beacons_count();
+}
+
+int main(void)
+{
+    ena_storage_backend_t backend;
+    ESP_ERROR_CHECK(ena_host_flash_init(&backend, ENA_HOST_FLASH_SIZE));
+    ena_storage_backend_set(&backend);
+    ena_storage_erase_all();
+    ena_beacons_temp_restore();
+    esp_log_level_set("*", ESP_LOG_WARN);
+
+    // scan path: inserts up to the maximum, then updates of random live entries
+    bench_temp_table_rpis(0);
+    double start = ena_host_seconds();
+    for (uint32_t i = 0; i < ENA_STORAGE_TEMP_BEACONS_MAX; i++)
+    {
+        ena_beacon(BENCH_START, rpis[i], aems[i], -60);
+    }
+    double insert = ena_host_seconds() - start;
+    ENA_HOST_CHECK(bench_temp_table_snapshot_count() == ENA_STORAGE_TEMP_BEACONS_MAX);
+
+    uint32_t x = 1;
+    start = ena_host_seconds();
+    for (uint32_t i = 0; i < BENCH_LOOKUPS; i++)
+    {
+        x = x * 1103515245 + 12345;
+        uint32_t entry = (x >> 8) % ENA_STORAGE_TEMP_BEACONS_MAX;
+        ena_beacon(BENCH_START + 1, rpis[entry], aems[entry], -60);
+    }
+    double update = ena_host_seconds() - start;
+    // updates found their entries instead of adding new ones
+    ENA_HOST_CHECK(bench_temp_table_snapshot_count() == ENA_STORAGE_TEMP_BEACONS_MAX);
+
+    for (uint32_t i = 0; i < ENA_STORAGE_TEMP_BEACONS_MAX; i++)
+    {
+        memcpy(linear[i].rpi, rpis[i], ENA_KEY_LENGTH);
+        memcpy(linear[i].aem, aems[i], ENA_AEM_METADATA_LENGTH);
+    }
+    uint32_t found = 0;
+    start = ena_host_seconds();
+    for (uint32_t i = 0; i < BENCH_LINEAR_LOOKUPS; i++)
+    {
+        x = x * 1103515245 + 12345;
+        uint32_t entry = (x >> 8) % ENA_STORAGE_TEMP_BEACONS_MAX;
+        found += bench_temp_table_linear_find(rpis[entry], aems[entry]) == entry;
+    }
+    double linear_update = ena_host_seconds() - start;
+    ENA_HOST_CHECK(found == BENCH_LINEAR_LOOKUPS);
+
+    // refresh path: every round removes all live entries, expired, and inserts the next ones
+    uint32_t timestamp = BENCH_START + 1;
+    double refresh = 0;
+    for (uint32_t round = 1; round <= BENCH_REFRESHES; round++)
+    {
+        timestamp += 2 * ENA_TIME_WINDOW + 1;
+        start = ena_host_seconds();
+        ena_beacons_temp_refresh(timestamp);
+        refresh += ena_host_seconds() - start;
+        ENA_HOST_CHECK(ena_storage_temp_beacons_count() == 0);
+
+        bench_temp_table_rpis(round);
+        start = ena_host_seconds();
+        for (uint32_t i = 0; i < ENA_STORAGE_TEMP_BEACONS_MAX; i++)
+        {
+            ena_beacon(timestamp, rpis[i], aems[i], -60);
+        }
+        insert += ena_host_seconds() - start;
+    }
+    // after many removals, every live entry is still found
+    for (uint32_t i = 0; i < ENA_STORAGE_TEMP_BEACONS_MAX; i++)
+    {
+        ena_beacon(timestamp + 1, rpis[i], aems[i], -60);
+    }
+    ENA_HOST_CHECK(bench_temp_table_snapshot_count() == ENA_STORAGE_TEMP_BEACONS_MAX);
+
+    printf("%u live temporary beacons, %u table slots\n", ENA_STORAGE_TEMP_BEACONS_MAX, ENA_BEACON_TEMP_TABLE_SIZE);
+    printf("scan path, insert:          %10.0f advertisements/s\n", (BENCH_REFRESHES + 1) * ENA_STORAGE_TEMP_BEACONS_MAX / insert);
+    printf("scan path, update:          %10.0f advertisements/s\n", BENCH_LOOKUPS / update);
+    printf("scan path, linear search:   %10.0f lookups/s\n", BENCH_LINEAR_LOOKUPS / linear_update);
+    printf("refresh path, remove all:   %10.0f removals/s (including snapshot)\n", BENCH_REFRESHES * ENA_STORAGE_TEMP_BEACONS_MAX / refresh);
+    return ena_host_result();
+}
\ No newline at end of file
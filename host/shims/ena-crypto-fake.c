@@ -0,0 +1,139 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * stand-in for ena-crypto.c on hosts without mbedTLS
+ *
+ * Keys, RPIs and AEMs are derived by a keyed mixing function instead of HKDF and AES. It is deterministic and
+ * keeps the structure the component relies on (AEM is metadata XOR a key stream of AEMK and RPI), but it is no
+ * cryptography. Timing of benchmarks with this stand-in does not tell anything about the device.
+ */
+#include <string.h>
+
+#include "esp_system.h"
+
+#include "ena-crypto.h"
+
+#include "ena-host-internal.h"
+
+uint64_t ena_host_crypto_mix(uint64_t x)
+{
+    // splitmix64 finalizer
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+void ena_host_crypto_block(const uint8_t *key, const uint8_t *in, uint8_t *out)
+{
+    uint64_t k[2], v[2];
+    memcpy(k, key, ENA_KEY_LENGTH);
+    memcpy(v, in, ENA_KEY_LENGTH);
+    for (int round = 0; round < 2; round++)
+    {
+        v[0] = ena_host_crypto_mix(v[0] ^ k[0] ^ v[1]);
+        v[1] = ena_host_crypto_mix(v[1] ^ k[1] ^ v[0]);
+    }
+    memcpy(out, v, ENA_KEY_LENGTH);
+}
+
+void ena_host_crypto_derive(const uint8_t *tek, const char *info, uint8_t *key)
+{
+    uint8_t padded_info[ENA_KEY_LENGTH] = {0};
+    memcpy(padded_info, info, strlen(info));
+    ena_host_crypto_block(tek, padded_info, key);
+}
+
+uint32_t ena_host_crypto_derivations(void)
+{
+    return __atomic_load_n(&ena_host_shared()->crypto_derivations, __ATOMIC_RELAXED);
+}
+
+void ena_crypto_init(void)
+{
+}
+
+uint32_t ena_crypto_enin(uint32_t unix_epoch_time)
+{
+    return unix_epoch_time / ENA_TIME_WINDOW;
+}
+
+void ena_crypto_tek(uint8_t *tek)
+{
+    esp_fill_random(tek, ENA_KEY_LENGTH);
+}
+
+void ena_crypto_rpik(uint8_t *rpik, uint8_t *tek)
+{
+    __atomic_add_fetch(&ena_host_shared()->crypto_derivations, 1, __ATOMIC_RELAXED);
+    ena_host_crypto_derive(tek, "EN-RPIK", rpik);
+}
+
+void ena_crypto_derive_keys(uint8_t *tek, uint8_t *rpik, uint8_t *aemk)
+{
+    __atomic_add_fetch(&ena_host_shared()->crypto_derivations, 1, __ATOMIC_RELAXED);
+    if (rpik != NULL)
+    {
+        ena_host_crypto_derive(tek, "EN-RPIK", rpik);
+    }
+    if (aemk != NULL)
+    {
+        ena_host_crypto_derive(tek, "EN-AEMK", aemk);
+    }
+}
+
+void ena_crypto_rpi(uint8_t *rpi, uint8_t *rpik, uint32_t enin)
+{
+    ena_crypto_rpi_batch(rpik, enin, 1, rpi);
+}
+
+void ena_crypto_rpi_batch(uint8_t *rpik, uint32_t start_enin, size_t count, uint8_t *out)
+{
+    uint8_t padded_data[ENA_KEY_LENGTH] = "EN-RPI";
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t enin = start_enin + i;
+        padded_data[12] = (enin & 0x000000ff);
+        padded_data[13] = (enin & 0x0000ff00) >> 8;
+        padded_data[14] = (enin & 0x00ff0000) >> 16;
+        padded_data[15] = (enin & 0xff000000) >> 24;
+        ena_host_crypto_block(rpik, padded_data, &out[i * ENA_KEY_LENGTH]);
+    }
+}
+
+void ena_crypto_aemk(uint8_t *aemk, uint8_t *tek)
+{
+    ena_crypto_derive_keys(tek, NULL, aemk);
+}
+
+void ena_crypto_aem(uint8_t *aem, uint8_t *aemk, uint8_t *rpi, uint8_t power_level)
+{
+    ena_crypto_aem_batch(aemk, rpi, 1, power_level, aem);
+}
+
+void ena_crypto_aem_batch(uint8_t *aemk, uint8_t *rpis, size_t count, uint8_t power_level, uint8_t *out)
+{
+    uint8_t metadata[ENA_AEM_METADATA_LENGTH] = {0};
+    metadata[0] = 0b01000000;
+    metadata[1] = power_level;
+    uint8_t stream_block[ENA_KEY_LENGTH];
+    for (size_t i = 0; i < count; i++)
+    {
+        ena_host_crypto_block(aemk, &rpis[i * ENA_KEY_LENGTH], stream_block);
+        for (int j = 0; j < ENA_AEM_METADATA_LENGTH; j++)
+        {
+            out[i * ENA_AEM_METADATA_LENGTH + j] = metadata[j] ^ stream_block[j];
+        }
+    }
+}
\ No newline at end of file
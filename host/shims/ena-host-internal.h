@@ -0,0 +1,45 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * @file
+ *
+ * @brief state of the host shims shared with forked processes
+ *
+ */
+#ifndef _ena_HOST_INTERNAL_H_
+#define _ena_HOST_INTERNAL_H_
+
+#include <stdint.h>
+
+#include "ena-host.h"
+
+/**
+ * @brief structure for counters shared with forked processes
+ */
+typedef struct
+{
+    uint32_t failures;           // failed checks
+    uint32_t flash_operations;   // writes and erases of the RAM flash
+    uint32_t crypto_derivations; // RPIK derivations of the stand-in crypto
+    ena_host_http_stats_t http;  // statistics of the stand-in key server
+} ena_host_shared_t;
+
+/**
+ * @brief       counters shared with forked processes
+ * @return
+ *              pointer to the shared counters
+ */
+ena_host_shared_t *ena_host_shared(void);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,329 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "wifi-controller.h"
+
+#include "ena-host-internal.h"
+
+typedef struct
+{
+    uint8_t *data;    // flash content, shared with forked processes
+    uint32_t *erases; // erases per block, shared with forked processes
+    size_t size;      // size in bytes
+} ena_host_flash_t;
+
+static ena_host_shared_t *shared = NULL;
+static ena_host_flash_t flash = {0};
+static uint32_t power_cut = 0; // flash operation of this process to cut, 0 for none
+static time_t clock_now = 0;   // time returned by time(), 0 for the real time
+static uint32_t random_state = 0x454E4131;
+static bool wifi_connected = true;
+static wifi_ap_record_t wifi_ap = {.ssid = "host"};
+
+// certificate of the key server embedded by the ena-eke-proxy component
+const uint8_t ena_host_cert_pem_start[] asm("_binary_cert_pem_start") = "";
+const uint8_t ena_host_cert_pem_end[] asm("_binary_cert_pem_end") = "";
+
+__attribute__((constructor)) void ena_host_init(void)
+{
+    // the device runs on UTC, the key sync relies on mktime of gmtime
+    setenv("TZ", "UTC0", 1);
+    tzset();
+    shared = mmap(NULL, sizeof(ena_host_shared_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED)
+    {
+        perror("ena host shared memory");
+        abort();
+    }
+    memset(shared, 0, sizeof(ena_host_shared_t));
+}
+
+ena_host_shared_t *ena_host_shared(void)
+{
+    return shared;
+}
+
+bool ena_host_check(bool ok, const char *condition, const char *file, int line)
+{
+    if (!ok)
+    {
+        fprintf(stderr, "%s:%d: check failed: %s\n", file, line, condition);
+        __atomic_add_fetch(&shared->failures, 1, __ATOMIC_RELAXED);
+    }
+    return ok;
+}
+
+int ena_host_result(void)
+{
+    uint32_t failures = __atomic_load_n(&shared->failures, __ATOMIC_RELAXED);
+    if (failures > 0)
+    {
+        fprintf(stderr, "%u checks failed\n", failures);
+    }
+    return failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+double ena_host_seconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int ena_host_boot(void (*device)(void *context), void *context)
+{
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("ena host boot");
+        abort();
+    }
+    if (pid == 0)
+    {
+        device(context);
+        fflush(NULL);
+        _exit(EXIT_SUCCESS);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status))
+    {
+        fprintf(stderr, "boot terminated by signal %d\n", WTERMSIG(status));
+        __atomic_add_fetch(&shared->failures, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+    return WEXITSTATUS(status);
+}
+
+esp_err_t ena_host_flash_read(void *context, size_t address, void *data, size_t size)
+{
+    if (address + size > flash.size)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(data, &flash.data[address], size);
+    return ESP_OK;
+}
+
+void ena_host_flash_operation(void)
+{
+    __atomic_add_fetch(&shared->flash_operations, 1, __ATOMIC_RELAXED);
+    if (power_cut > 0 && --power_cut == 0)
+    {
+        _exit(ENA_HOST_POWER_CUT_EXIT);
+    }
+}
+
+esp_err_t ena_host_flash_write(void *context, size_t address, const void *data, size_t size)
+{
+    if (address + size > flash.size)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (power_cut == 1)
+    {
+        // only a prefix reaches the flash
+        size = rand() % (size + 1);
+    }
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < size; i++)
+    {
+        flash.data[address + i] &= bytes[i];
+    }
+    ena_host_flash_operation();
+    return ESP_OK;
+}
+
+esp_err_t ena_host_flash_erase(void *context, size_t address, size_t size)
+{
+    if (address + size > flash.size || address % ENA_STORAGE_BACKEND_BLOCK_SIZE != 0 || size % ENA_STORAGE_BACKEND_BLOCK_SIZE != 0)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    for (size_t block = address; block < address + size; block += ENA_STORAGE_BACKEND_BLOCK_SIZE)
+    {
+        flash.erases[block / ENA_STORAGE_BACKEND_BLOCK_SIZE]++;
+    }
+    if (power_cut == 1)
+    {
+        // interrupted erase leaves random bytes erased
+        for (size_t i = 0; i < size; i++)
+        {
+            if (rand() & 1)
+            {
+                flash.data[address + i] = 0xFF;
+            }
+        }
+    }
+    else
+    {
+        memset(&flash.data[address], 0xFF, size);
+    }
+    ena_host_flash_operation();
+    return ESP_OK;
+}
+
+esp_err_t ena_host_flash_mmap(void *context, size_t address, size_t size, const void **data, uint32_t *handle)
+{
+    if (address + size > flash.size)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    *data = &flash.data[address];
+    *handle = 0;
+    return ESP_OK;
+}
+
+void ena_host_flash_munmap(void *context, uint32_t handle)
+{
+}
+
+esp_err_t ena_host_flash_init(ena_storage_backend_t *backend, size_t size)
+{
+    if (size % ENA_STORAGE_BACKEND_BLOCK_SIZE != 0)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (flash.data != NULL)
+    {
+        munmap(flash.data, flash.size);
+        munmap(flash.erases, flash.size / ENA_STORAGE_BACKEND_BLOCK_SIZE * sizeof(uint32_t));
+    }
+    flash.size = size;
+    flash.data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    flash.erases = mmap(NULL, size / ENA_STORAGE_BACKEND_BLOCK_SIZE * sizeof(uint32_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (flash.data == MAP_FAILED || flash.erases == MAP_FAILED)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    memset(flash.data, 0xFF, size);
+
+    memset(backend, 0, sizeof(ena_storage_backend_t));
+    backend->name = "host flash";
+    backend->context = &flash;
+    backend->size = size;
+    backend->block_size = ENA_STORAGE_BACKEND_BLOCK_SIZE;
+    backend->read = &ena_host_flash_read;
+    backend->write = &ena_host_flash_write;
+    backend->erase = &ena_host_flash_erase;
+    backend->mmap = &ena_host_flash_mmap;
+    backend->munmap = &ena_host_flash_munmap;
+    return ESP_OK;
+}
+
+void ena_host_flash_power_cut(uint32_t operations)
+{
+    power_cut = operations;
+}
+
+uint32_t ena_host_flash_operations(void)
+{
+    return __atomic_load_n(&shared->flash_operations, __ATOMIC_RELAXED);
+}
+
+uint32_t ena_host_flash_block_erases(size_t address)
+{
+    return address < flash.size ? flash.erases[address / ENA_STORAGE_BACKEND_BLOCK_SIZE] : 0;
+}
+
+time_t time(time_t *timer)
+{
+    time_t now = __atomic_load_n(&clock_now, __ATOMIC_ACQUIRE);
+    if (now == 0)
+    {
+        struct timespec real;
+        clock_gettime(CLOCK_REALTIME, &real);
+        now = real.tv_sec;
+    }
+    if (timer != NULL)
+    {
+        *timer = now;
+    }
+    return now;
+}
+
+void ena_host_clock_set(time_t now)
+{
+    __atomic_store_n(&clock_now, now, __ATOMIC_RELEASE);
+}
+
+void ena_host_clock_advance(time_t seconds)
+{
+    __atomic_add_fetch(&clock_now, seconds, __ATOMIC_ACQ_REL);
+}
+
+void ena_host_random_seed(uint32_t seed)
+{
+    random_state = seed != 0 ? seed : 1;
+    srand(seed);
+}
+
+uint32_t esp_random(void)
+{
+    // xorshift32, several tasks may race on the state like on a shared hardware RNG
+    uint32_t x = random_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    random_state = x;
+    return x;
+}
+
+void esp_fill_random(void *buffer, size_t length)
+{
+    uint8_t *bytes = buffer;
+    for (size_t i = 0; i < length; i++)
+    {
+        bytes[i] = esp_random() >> 24;
+    }
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+    return 160 * 1024;
+}
+
+size_t xPortGetFreeHeapSize(void)
+{
+    return esp_get_free_heap_size();
+}
+
+void ena_host_wifi_set_connected(bool connected)
+{
+    wifi_connected = connected;
+}
+
+wifi_ap_record_t *wifi_controller_connection(void)
+{
+    return wifi_connected ? &wifi_ap : NULL;
+}
+
+esp_err_t wifi_controller_reconnect(wifi_callback callback)
+{
+    if (callback != NULL)
+    {
+        (*callback)();
+    }
+    return ESP_OK;
+}
\ No newline at end of file
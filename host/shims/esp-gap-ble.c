@@ -0,0 +1,94 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <string.h>
+
+#include "esp_gap_ble_api.h"
+
+#include "ena-host.h"
+
+static esp_gap_ble_cb_t gap_callback = NULL;
+
+esp_err_t esp_ble_gap_register_callback(esp_gap_ble_cb_t callback)
+{
+    gap_callback = callback;
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_set_scan_params(esp_ble_scan_params_t *scan_params)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_start_scanning(uint32_t duration)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_ble_gap_stop_scanning(void)
+{
+    return ESP_OK;
+}
+
+uint8_t *esp_ble_resolve_adv_data(uint8_t *adv_data, uint8_t type, uint8_t *length)
+{
+    // AD structures: length (including type), type, data
+    size_t position = 0;
+    while (position < ESP_BLE_ADV_DATA_LEN_MAX + ESP_BLE_SCAN_RSP_DATA_LEN_MAX && adv_data[position] > 0)
+    {
+        uint8_t structure_length = adv_data[position];
+        if (adv_data[position + 1] == type)
+        {
+            *length = structure_length - 1;
+            return &adv_data[position + 2];
+        }
+        position += structure_length + 1;
+    }
+    *length = 0;
+    return NULL;
+}
+
+void ena_host_ble_scan_result(const uint8_t *rpi, const uint8_t *aem, int rssi)
+{
+    esp_ble_gap_cb_param_t param;
+    memset(&param, 0, sizeof(param));
+    param.scan_rst.search_evt = ESP_GAP_SEARCH_INQ_RES_EVT;
+    param.scan_rst.rssi = rssi;
+    uint8_t *adv = param.scan_rst.ble_adv;
+    // flags
+    adv[0] = 2;
+    adv[1] = 0x01;
+    adv[2] = 0x1A;
+    // complete list of 16-bit service UUIDs: 0xFD6F
+    adv[3] = 3;
+    adv[4] = 0x03;
+    adv[5] = 0x6F;
+    adv[6] = 0xFD;
+    // service data: UUID, RPI, AEM
+    adv[7] = 3 + 16 + 4;
+    adv[8] = 0x16;
+    adv[9] = 0x6F;
+    adv[10] = 0xFD;
+    memcpy(&adv[11], rpi, 16);
+    memcpy(&adv[27], aem, 4);
+    param.scan_rst.adv_data_len = 31;
+    gap_callback(ESP_GAP_BLE_SCAN_RESULT_EVT, &param);
+}
+
+void ena_host_ble_scan_complete(void)
+{
+    esp_ble_gap_cb_param_t param;
+    memset(&param, 0, sizeof(param));
+    param.scan_rst.search_evt = ESP_GAP_SEARCH_INQ_CMPL_EVT;
+    gap_callback(ESP_GAP_BLE_SCAN_RESULT_EVT, &param);
+}
\ No newline at end of file
@@ -0,0 +1,226 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_http_client.h"
+
+#include "ena-host-internal.h"
+
+struct esp_http_client
+{
+    esp_http_client_config_t config;
+    char *url;
+    bool connected;               // connection to the server is open
+    bool session;                 // TLS session ticket of an earlier connection is kept
+    uint32_t connection_requests; // requests sent on the open connection
+    int status;
+    int length;                   // length of response body, -1 if chunked
+    size_t offset;                // bytes of response body read
+    bool complete;                // end of a chunked response body was read
+};
+
+static const ena_host_http_server_t *http_server = NULL;
+
+void ena_host_http_set_server(const ena_host_http_server_t *server)
+{
+    http_server = server;
+}
+
+void ena_host_http_get_stats(ena_host_http_stats_t *stats)
+{
+    memcpy(stats, &ena_host_shared()->http, sizeof(ena_host_http_stats_t));
+}
+
+void ena_host_http_reset_stats(void)
+{
+    memset(&ena_host_shared()->http, 0, sizeof(ena_host_http_stats_t));
+}
+
+void ena_host_http_event(esp_http_client_handle_t client, esp_http_client_event_id_t event_id)
+{
+    if (client->config.event_handler != NULL)
+    {
+        esp_http_client_event_t event = {
+            .event_id = event_id,
+            .client = client,
+            .user_data = client->config.user_data,
+        };
+        client->config.event_handler(&event);
+    }
+}
+
+esp_err_t ena_host_http_connect(esp_http_client_handle_t client)
+{
+    ena_host_http_stats_t *stats = &ena_host_shared()->http;
+    if (client->connected && http_server->keep_alive_requests > 0 && client->connection_requests >= http_server->keep_alive_requests)
+    {
+        // server answered the last request with "Connection: close"
+        esp_http_client_close(client);
+    }
+    if (client->connected)
+    {
+        return ESP_OK;
+    }
+
+    __atomic_add_fetch(&stats->connections, 1, __ATOMIC_RELAXED);
+    if (memcmp(client->url, "https", 5) == 0)
+    {
+        // the component only sets save_client_session with CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+        bool save_session = client->config.save_client_session;
+        if (client->session && save_session)
+        {
+            __atomic_add_fetch(&stats->resumed_handshakes, 1, __ATOMIC_RELAXED);
+        }
+        else
+        {
+            __atomic_add_fetch(&stats->full_handshakes, 1, __ATOMIC_RELAXED);
+        }
+        client->session = save_session;
+    }
+    client->connected = true;
+    client->connection_requests = 0;
+    ena_host_http_event(client, HTTP_EVENT_ON_CONNECTED);
+    return ESP_OK;
+}
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config)
+{
+    esp_http_client_handle_t client = calloc(1, sizeof(struct esp_http_client));
+    memcpy(&client->config, config, sizeof(esp_http_client_config_t));
+    client->url = strdup(config->url);
+    client->config.url = NULL;
+    return client;
+}
+
+esp_err_t esp_http_client_set_url(esp_http_client_handle_t client, const char *url)
+{
+    free(client->url);
+    client->url = strdup(url);
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client, const char *key, const char *value)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_post_field(esp_http_client_handle_t client, const char *data, int length)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_open(esp_http_client_handle_t client, int write_length)
+{
+    if (http_server == NULL)
+    {
+        return ESP_FAIL;
+    }
+    ena_host_http_connect(client);
+    __atomic_add_fetch(&ena_host_shared()->http.requests, 1, __ATOMIC_RELAXED);
+    client->connection_requests++;
+    client->offset = 0;
+    client->complete = false;
+    client->length = 0;
+    client->status = http_server->open(client->url, &client->length);
+    if (client->status < 0)
+    {
+        esp_http_client_close(client);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+int esp_http_client_fetch_headers(esp_http_client_handle_t client)
+{
+    return client->length;
+}
+
+int esp_http_client_read(esp_http_client_handle_t client, char *buffer, int length)
+{
+    if (!client->connected)
+    {
+        return -1;
+    }
+    if (client->length >= 0 && client->offset + length > client->length)
+    {
+        length = client->length - client->offset;
+    }
+    if (http_server->segment_size > 0 && length > http_server->segment_size)
+    {
+        length = http_server->segment_size;
+    }
+    if (length == 0 || client->complete)
+    {
+        return 0;
+    }
+    int read = http_server->read(client->url, client->offset, (uint8_t *)buffer, length);
+    if (read < 0)
+    {
+        esp_http_client_close(client);
+        return -1;
+    }
+    client->complete = read == 0;
+    client->offset += read;
+    __atomic_add_fetch(&ena_host_shared()->http.bytes, read, __ATOMIC_RELAXED);
+    return read;
+}
+
+bool esp_http_client_is_chunked_response(esp_http_client_handle_t client)
+{
+    return client->length < 0;
+}
+
+bool esp_http_client_is_complete_data_received(esp_http_client_handle_t client)
+{
+    return client->length < 0 ? client->complete : client->offset == client->length;
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client)
+{
+    return client->status;
+}
+
+int esp_http_client_get_content_length(esp_http_client_handle_t client)
+{
+    return client->length;
+}
+
+esp_err_t esp_http_client_perform(esp_http_client_handle_t client)
+{
+    esp_err_t err = esp_http_client_open(client, 0);
+    if (err == ESP_OK)
+    {
+        ena_host_http_event(client, HTTP_EVENT_ON_FINISH);
+    }
+    return err;
+}
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t client)
+{
+    if (client->connected)
+    {
+        client->connected = false;
+        ena_host_http_event(client, HTTP_EVENT_DISCONNECTED);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client)
+{
+    esp_http_client_close(client);
+    free(client->url);
+    free(client);
+    return ESP_OK;
+}
\ No newline at end of file
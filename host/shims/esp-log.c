@@ -0,0 +1,102 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdio.h>
+#include <stdarg.h>
+#include <time.h>
+
+#include "esp_log.h"
+
+static esp_log_level_t log_level = ESP_LOG_WARN;
+
+static const char log_letters[] = {'N', 'E', 'W', 'I', 'D', 'V'};
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    log_level = level;
+}
+
+bool esp_log_enabled(esp_log_level_t level)
+{
+    return level <= log_level;
+}
+
+uint32_t esp_log_timestamp(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "%c (%u) %s: ", log_letters[level], esp_log_timestamp(), tag);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+void ESP_LOG_BUFFER_HEX_LEVEL(const char *tag, const void *buffer, size_t length, esp_log_level_t level)
+{
+    if (!esp_log_enabled(level))
+    {
+        return;
+    }
+    const uint8_t *bytes = buffer;
+    for (size_t line = 0; line < length; line += 16)
+    {
+        fprintf(stderr, "%c (%u) %s: ", log_letters[level], esp_log_timestamp(), tag);
+        for (size_t i = line; i < line + 16 && i < length; i++)
+        {
+            fprintf(stderr, "%02x ", bytes[i]);
+        }
+        fprintf(stderr, "\n");
+    }
+}
+
+void ESP_LOG_BUFFER_HEXDUMP(const char *tag, const void *buffer, size_t length, esp_log_level_t level)
+{
+    ESP_LOG_BUFFER_HEX_LEVEL(tag, buffer, length, level);
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code)
+    {
+    case ESP_OK:
+        return "ESP_OK";
+    case ESP_FAIL:
+        return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:
+        return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+        return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:
+        return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:
+        return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:
+        return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED:
+        return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT:
+        return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_INVALID_RESPONSE:
+        return "ESP_ERR_INVALID_RESPONSE";
+    case ESP_ERR_INVALID_CRC:
+        return "ESP_ERR_INVALID_CRC";
+    default:
+        return "UNKNOWN ERROR";
+    }
+}
\ No newline at end of file
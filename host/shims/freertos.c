@@ -0,0 +1,386 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+struct ena_host_task
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t signal;
+    uint32_t notifications;
+    TaskFunction_t function;
+    void *parameter;
+};
+
+struct ena_host_queue
+{
+    pthread_mutex_t lock;
+    pthread_cond_t signal;
+    uint8_t *items;
+    UBaseType_t item_size;
+    UBaseType_t length;
+    UBaseType_t head;
+    UBaseType_t count;
+};
+
+struct ena_host_semaphore
+{
+    pthread_mutex_t lock;
+    pthread_cond_t signal;
+    UBaseType_t count;
+    UBaseType_t max;
+    bool mutex;        // taken and given by the same task
+    bool recursive;    // can be taken again by the holding task
+    pthread_t holder;  // holding task of a mutex
+    UBaseType_t depth; // times a recursive mutex is taken by the holding task
+};
+
+static __thread TaskHandle_t current_task = NULL;
+static pthread_mutex_t critical_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+void ena_host_deadline(TickType_t ticks, struct timespec *deadline)
+{
+    clock_gettime(CLOCK_REALTIME, deadline);
+    deadline->tv_sec += ticks / configTICK_RATE_HZ;
+    deadline->tv_nsec += (long)(ticks % configTICK_RATE_HZ) * (1000000000L / configTICK_RATE_HZ);
+    if (deadline->tv_nsec >= 1000000000L)
+    {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+bool ena_host_wait(pthread_cond_t *signal, pthread_mutex_t *lock, TickType_t ticks, const struct timespec *deadline)
+{
+    if (ticks == 0)
+    {
+        return false;
+    }
+    if (ticks == portMAX_DELAY)
+    {
+        pthread_cond_wait(signal, lock);
+        return true;
+    }
+    return pthread_cond_timedwait(signal, lock, deadline) != ETIMEDOUT;
+}
+
+TaskHandle_t ena_host_task_create(void)
+{
+    TaskHandle_t task = calloc(1, sizeof(struct ena_host_task));
+    pthread_mutex_init(&task->lock, NULL);
+    pthread_cond_init(&task->signal, NULL);
+    return task;
+}
+
+void *ena_host_task_run(void *parameter)
+{
+    current_task = parameter;
+    current_task->function(current_task->parameter);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stack_depth, void *parameter, UBaseType_t priority, TaskHandle_t *handle, BaseType_t core)
+{
+    TaskHandle_t task = ena_host_task_create();
+    task->function = function;
+    task->parameter = parameter;
+    if (handle != NULL)
+    {
+        *handle = task;
+    }
+    if (pthread_create(&task->thread, NULL, &ena_host_task_run, task) != 0)
+    {
+        return pdFAIL;
+    }
+    pthread_detach(task->thread);
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stack_depth, void *parameter, UBaseType_t priority, TaskHandle_t *handle)
+{
+    return xTaskCreatePinnedToCore(function, name, stack_depth, parameter, priority, handle, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t handle)
+{
+    if (handle == NULL || handle == current_task)
+    {
+        pthread_exit(NULL);
+    }
+    abort();
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    struct timespec delay = {
+        .tv_sec = ticks / configTICK_RATE_HZ,
+        .tv_nsec = (long)(ticks % configTICK_RATE_HZ) * (1000000000L / configTICK_RATE_HZ),
+    };
+    nanosleep(&delay, NULL);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    static struct timespec start = {0};
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (start.tv_sec == 0 && start.tv_nsec == 0)
+    {
+        start = now;
+    }
+    return (TickType_t)((now.tv_sec - start.tv_sec) * configTICK_RATE_HZ + (now.tv_nsec - start.tv_nsec) / (1000000000L / configTICK_RATE_HZ));
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    if (current_task == NULL)
+    {
+        // main thread or a thread of a test acting as a task
+        current_task = ena_host_task_create();
+        current_task->thread = pthread_self();
+    }
+    return current_task;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait)
+{
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    struct timespec deadline;
+    ena_host_deadline(ticks_to_wait, &deadline);
+    pthread_mutex_lock(&task->lock);
+    while (task->notifications == 0 && ena_host_wait(&task->signal, &task->lock, ticks_to_wait, &deadline))
+    {
+    }
+    uint32_t notifications = task->notifications;
+    if (notifications > 0)
+    {
+        task->notifications = clear_on_exit ? 0 : notifications - 1;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return notifications;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t handle)
+{
+    if (handle == NULL)
+    {
+        return pdFAIL;
+    }
+    pthread_mutex_lock(&handle->lock);
+    handle->notifications++;
+    pthread_cond_signal(&handle->signal);
+    pthread_mutex_unlock(&handle->lock);
+    return pdPASS;
+}
+
+void taskYIELD(void)
+{
+    sched_yield();
+}
+
+void vPortEnterCritical(portMUX_TYPE *mux)
+{
+    pthread_mutex_lock(&critical_lock);
+}
+
+void vPortExitCritical(portMUX_TYPE *mux)
+{
+    pthread_mutex_unlock(&critical_lock);
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    QueueHandle_t queue = calloc(1, sizeof(struct ena_host_queue));
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->signal, NULL);
+    queue->items = malloc(length * item_size);
+    queue->item_size = item_size;
+    queue->length = length;
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait)
+{
+    struct timespec deadline;
+    ena_host_deadline(ticks_to_wait, &deadline);
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->length)
+    {
+        if (!ena_host_wait(&queue->signal, &queue->lock, ticks_to_wait, &deadline))
+        {
+            pthread_mutex_unlock(&queue->lock);
+            return pdFAIL;
+        }
+    }
+    memcpy(&queue->items[((queue->head + queue->count) % queue->length) * queue->item_size], item, queue->item_size);
+    queue->count++;
+    pthread_cond_broadcast(&queue->signal);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks_to_wait)
+{
+    struct timespec deadline;
+    ena_host_deadline(ticks_to_wait, &deadline);
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0)
+    {
+        if (!ena_host_wait(&queue->signal, &queue->lock, ticks_to_wait, &deadline))
+        {
+            pthread_mutex_unlock(&queue->lock);
+            return pdFAIL;
+        }
+    }
+    memcpy(item, &queue->items[queue->head * queue->item_size], queue->item_size);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    pthread_cond_broadcast(&queue->signal);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->head = 0;
+    queue->count = 0;
+    pthread_cond_broadcast(&queue->signal);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->signal);
+    free(queue->items);
+    free(queue);
+}
+
+SemaphoreHandle_t ena_host_semaphore_create(UBaseType_t count, bool mutex, bool recursive)
+{
+    SemaphoreHandle_t semaphore = calloc(1, sizeof(struct ena_host_semaphore));
+    pthread_mutex_init(&semaphore->lock, NULL);
+    pthread_cond_init(&semaphore->signal, NULL);
+    semaphore->count = count;
+    semaphore->max = 1;
+    semaphore->mutex = mutex;
+    semaphore->recursive = recursive;
+    return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return ena_host_semaphore_create(0, false, false);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return ena_host_semaphore_create(1, true, false);
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void)
+{
+    return ena_host_semaphore_create(1, true, true);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait)
+{
+    struct timespec deadline;
+    ena_host_deadline(ticks_to_wait, &deadline);
+    pthread_mutex_lock(&semaphore->lock);
+    if (semaphore->recursive && semaphore->count == 0 && pthread_equal(semaphore->holder, pthread_self()))
+    {
+        semaphore->depth++;
+        pthread_mutex_unlock(&semaphore->lock);
+        return pdPASS;
+    }
+    while (semaphore->count == 0)
+    {
+        if (!ena_host_wait(&semaphore->signal, &semaphore->lock, ticks_to_wait, &deadline))
+        {
+            pthread_mutex_unlock(&semaphore->lock);
+            return pdFAIL;
+        }
+    }
+    semaphore->count--;
+    if (semaphore->mutex)
+    {
+        semaphore->holder = pthread_self();
+        semaphore->depth = 1;
+    }
+    pthread_mutex_unlock(&semaphore->lock);
+    return pdPASS;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    pthread_mutex_lock(&semaphore->lock);
+    if (semaphore->mutex && (semaphore->count > 0 || !pthread_equal(semaphore->holder, pthread_self())))
+    {
+        // only the holding task gives a mutex back
+        pthread_mutex_unlock(&semaphore->lock);
+        return pdFAIL;
+    }
+    if (semaphore->recursive && --semaphore->depth > 0)
+    {
+        pthread_mutex_unlock(&semaphore->lock);
+        return pdPASS;
+    }
+    if (semaphore->count == semaphore->max)
+    {
+        pthread_mutex_unlock(&semaphore->lock);
+        return pdFAIL;
+    }
+    semaphore->count++;
+    pthread_cond_signal(&semaphore->signal);
+    pthread_mutex_unlock(&semaphore->lock);
+    return pdPASS;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t mutex, TickType_t ticks_to_wait)
+{
+    return xSemaphoreTake(mutex, ticks_to_wait);
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t mutex)
+{
+    return xSemaphoreGive(mutex);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore)
+{
+    pthread_mutex_destroy(&semaphore->lock);
+    pthread_cond_destroy(&semaphore->signal);
+    free(semaphore);
+}
\ No newline at end of file
@@ -0,0 +1,211 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * @file
+ *
+ * @brief controls of the host shims for tests and benchmarks
+ *
+ * Flash, clock, stand-in key server, BLE scan results and the stand-in crypto are driven from here. Counters
+ * are kept in memory shared with forked processes, so a test can simulate a reboot or power loss by running
+ * the device part in a child process.
+ *
+ */
+#ifndef _ena_HOST_H_
+#define _ena_HOST_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "esp_err.h"
+#include "ena-storage-backend.h"
+
+#define ENA_HOST_FLASH_SIZE (0x261000) // size of the "ena" partition in partitions.csv
+#define ENA_HOST_POWER_CUT_EXIT (99)   // exit status of a process that lost power during a flash operation
+
+/**
+ * @brief check a condition of a test, failures are reported and counted
+ */
+#define ENA_HOST_CHECK(condition) ena_host_check((condition), #condition, __FILE__, __LINE__)
+
+/**
+ * @brief structure for a stand-in key server
+ */
+typedef struct
+{
+    /**
+     * @brief answer a request
+     * @param[in]   url         requested url
+     * @param[out]  length      length of the response body, -1 for a chunked response
+     * @return
+     *              HTTP status, or -1 to fail the request (connection refused)
+     */
+    int (*open)(const char *url, int *length);
+    /**
+     * @brief read from the response body
+     * @param[in]   url         requested url
+     * @param[in]   offset      offset in the response body
+     * @param[out]  data        buffer to write to
+     * @param[in]   length      maximum bytes to write
+     * @return
+     *              bytes written, 0 at the end of a chunked response, -1 to drop the connection
+     */
+    int (*read)(const char *url, size_t offset, uint8_t *data, size_t length);
+    uint32_t keep_alive_requests; // requests per connection before the server closes it, 0 for unlimited
+    size_t segment_size;          // maximum bytes returned by one read, 0 for unlimited
+} ena_host_http_server_t;
+
+/**
+ * @brief structure for statistics of the stand-in key server
+ */
+typedef struct
+{
+    uint32_t requests;           // opened requests
+    uint32_t connections;        // established connections
+    uint32_t full_handshakes;    // TLS handshakes with certificate exchange
+    uint32_t resumed_handshakes; // TLS handshakes resumed with a session ticket
+    uint64_t bytes;              // bytes of response bodies read
+} ena_host_http_stats_t;
+
+/**
+ * @brief       report a failed check
+ * @param[in]   ok          result of the check
+ * @param[in]   condition   checked condition as text
+ * @param[in]   file        source file
+ * @param[in]   line        source line
+ * @return
+ *              ok
+ */
+bool ena_host_check(bool ok, const char *condition, const char *file, int line);
+
+/**
+ * @brief       result of a test
+ * @return
+ *              exit status for main, 0 if no check failed (in this or forked processes)
+ */
+int ena_host_result(void);
+
+/**
+ * @brief       monotonic clock for benchmarks
+ * @return
+ *              seconds since an arbitrary start
+ */
+double ena_host_seconds(void);
+
+/**
+ * @brief       run a part of a test in a forked process, like a boot of the device
+ * Statics of the components start fresh for every boot, flash content and counters are shared.
+ * @param[in]   device      function to run
+ * @param[in]   context     argument of the function
+ * @return
+ *              exit status of the process, ENA_HOST_POWER_CUT_EXIT if it lost power
+ */
+int ena_host_boot(void (*device)(void *context), void *context);
+
+/**
+ * @brief       initialize a backend on a shared RAM image with NOR flash semantics, erased
+ * The image is shared with forked processes, so they see the same flash content.
+ * @param[out]  backend     backend to initialize
+ * @param[in]   size        size of the image, multiple of ENA_STORAGE_BACKEND_BLOCK_SIZE
+ * @return
+ *              ESP_OK on success
+ */
+esp_err_t ena_host_flash_init(ena_storage_backend_t *backend, size_t size);
+
+/**
+ * @brief       cut the power during a following flash operation
+ * The n-th following write or erase is done partially (random prefix of a write, random bytes of an erase)
+ * and the process exits with ENA_HOST_POWER_CUT_EXIT.
+ * @param[in]   operations  number of the write or erase to cut, 0 to disable
+ */
+void ena_host_flash_power_cut(uint32_t operations);
+
+/**
+ * @brief       number of writes and erases done since start
+ * @return
+ *              number of writes and erases of all processes
+ */
+uint32_t ena_host_flash_operations(void);
+
+/**
+ * @brief       erases of a single block since start
+ * @param[in]   address     address in the block
+ * @return
+ *              number of erases of the block
+ */
+uint32_t ena_host_flash_block_erases(size_t address);
+
+/**
+ * @brief       set the clock returned by time(), it stands still until set or advanced again
+ * @param[in]   now     the UNIX timestamp to return
+ */
+void ena_host_clock_set(time_t now);
+
+/**
+ * @brief       advance the clock set with ena_host_clock_set
+ * @param[in]   seconds     seconds to add
+ */
+void ena_host_clock_advance(time_t seconds);
+
+/**
+ * @brief       seed the generator behind esp_random
+ * @param[in]   seed    the seed
+ */
+void ena_host_random_seed(uint32_t seed);
+
+/**
+ * @brief       set the stand-in key server answering esp_http_client requests
+ * @param[in]   server  the server
+ */
+void ena_host_http_set_server(const ena_host_http_server_t *server);
+
+/**
+ * @brief       get statistics of the stand-in key server
+ * @param[out]  stats   pointer to write statistics to
+ */
+void ena_host_http_get_stats(ena_host_http_stats_t *stats);
+
+/**
+ * @brief       reset statistics of the stand-in key server
+ */
+void ena_host_http_reset_stats(void);
+
+/**
+ * @brief       deliver an ENA advertisement to the registered GAP callback, like the Bluetooth task
+ * @param[in]   rpi     RPI of the advertisement
+ * @param[in]   aem     AEM of the advertisement
+ * @param[in]   rssi    RSSI of the advertisement
+ */
+void ena_host_ble_scan_result(const uint8_t *rpi, const uint8_t *aem, int rssi);
+
+/**
+ * @brief       deliver the end of a scan to the registered GAP callback
+ */
+void ena_host_ble_scan_complete(void);
+
+/**
+ * @brief       set the WiFi connection state returned by wifi_controller_connection
+ * @param[in]   connected   true if connected
+ */
+void ena_host_wifi_set_connected(bool connected);
+
+/**
+ * @brief       RPIK derivations of the stand-in crypto since start
+ * @return
+ *              number of derivations of all processes
+ */
+uint32_t ena_host_crypto_derivations(void);
+
+#endif
\ No newline at end of file
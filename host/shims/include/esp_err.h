@@ -0,0 +1,70 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * @file
+ *
+ * @brief host shim of esp_err.h, ESP_ERROR_CHECK aborts like on the device
+ *
+ */
+#ifndef _ena_HOST_ESP_ERR_H_
+#define _ena_HOST_ESP_ERR_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sdkconfig.h"
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_STATE 0x103
+#define ESP_ERR_INVALID_SIZE 0x104
+#define ESP_ERR_NOT_FOUND 0x105
+#define ESP_ERR_NOT_SUPPORTED 0x106
+#define ESP_ERR_TIMEOUT 0x107
+#define ESP_ERR_INVALID_RESPONSE 0x108
+#define ESP_ERR_INVALID_CRC 0x109
+#define ESP_ERR_INVALID_VERSION 0x10A
+#define ESP_ERR_INVALID_MAC 0x10B
+
+/**
+ * @brief       name of an error code
+ * @param[in]   code    the error code
+ * @return
+ *              name of the error code, "UNKNOWN ERROR" for unknown codes
+ */
+const char *esp_err_to_name(esp_err_t code);
+
+#define ESP_ERROR_CHECK(x)                                                               \
+    do                                                                                   \
+    {                                                                                    \
+        esp_err_t err_rc_ = (x);                                                         \
+        if (err_rc_ != ESP_OK)                                                           \
+        {                                                                                \
+            fprintf(stderr, "ESP_ERROR_CHECK failed: esp_err_t 0x%x (%s) at %s:%d\n%s\n", \
+                    err_rc_, esp_err_to_name(err_rc_), __FILE__, __LINE__, #x);          \
+            abort();                                                                     \
+        }                                                                                \
+    } while (0)
+
+#define ESP_ERROR_CHECK_WITHOUT_ABORT(x) (x)
+
+#endif
\ No newline at end of file
@@ -0,0 +1,108 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * @file
+ *
+ * @brief host shim of esp_gap_ble_api.h for BLE scanning
+ *
+ * There is no controller, scan results are delivered to the registered callback by ena_host_ble_scan_result.
+ *
+ */
+#ifndef _ena_HOST_ESP_GAP_BLE_API_H_
+#define _ena_HOST_ESP_GAP_BLE_API_H_
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#define ESP_BLE_ADV_DATA_LEN_MAX (31)
+#define ESP_BLE_SCAN_RSP_DATA_LEN_MAX (31)
+
+typedef enum
+{
+    ESP_GAP_BLE_SCAN_PARAM_SET_COMPLETE_EVT,
+    ESP_GAP_BLE_SCAN_RESULT_EVT,
+    ESP_GAP_BLE_SCAN_START_COMPLETE_EVT,
+    ESP_GAP_BLE_SCAN_STOP_COMPLETE_EVT,
+} esp_gap_ble_cb_event_t;
+
+typedef enum
+{
+    ESP_GAP_SEARCH_INQ_RES_EVT,
+    ESP_GAP_SEARCH_INQ_CMPL_EVT,
+} esp_gap_search_evt_t;
+
+typedef enum
+{
+    BLE_SCAN_TYPE_PASSIVE,
+    BLE_SCAN_TYPE_ACTIVE,
+} esp_ble_scan_type_t;
+
+typedef enum
+{
+    BLE_ADDR_TYPE_PUBLIC,
+    BLE_ADDR_TYPE_RANDOM,
+} esp_ble_addr_type_t;
+
+typedef enum
+{
+    BLE_SCAN_FILTER_ALLOW_ALL,
+} esp_ble_scan_filter_t;
+
+typedef enum
+{
+    BLE_SCAN_DUPLICATE_DISABLE,
+    BLE_SCAN_DUPLICATE_ENABLE,
+} esp_ble_scan_duplicate_t;
+
+typedef struct
+{
+    esp_ble_scan_type_t scan_type;
+    esp_ble_addr_type_t own_addr_type;
+    esp_ble_scan_filter_t scan_filter_policy;
+    uint16_t scan_interval;
+    uint16_t scan_window;
+    esp_ble_scan_duplicate_t scan_duplicate;
+} esp_ble_scan_params_t;
+
+typedef union
+{
+    struct ble_scan_result_evt_param
+    {
+        esp_gap_search_evt_t search_evt;
+        int rssi;
+        uint8_t ble_adv[ESP_BLE_ADV_DATA_LEN_MAX + ESP_BLE_SCAN_RSP_DATA_LEN_MAX];
+        uint8_t adv_data_len;
+        uint8_t scan_rsp_len;
+    } scan_rst;
+} esp_ble_gap_cb_param_t;
+
+typedef void (*esp_gap_ble_cb_t)(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param);
+
+esp_err_t esp_ble_gap_register_callback(esp_gap_ble_cb_t callback);
+esp_err_t esp_ble_gap_set_scan_params(esp_ble_scan_params_t *scan_params);
+esp_err_t esp_ble_gap_start_scanning(uint32_t duration);
+esp_err_t esp_ble_gap_stop_scanning(void);
+
+/**
+ * @brief       find an AD structure in advertising data
+ * @param[in]   adv_data    advertising data
+ * @param[in]   type        AD type to find
+ * @param[out]  length      length of the found data, 0 if not found
+ * @return
+ *              pointer to the data of the AD structure, NULL if not found
+ */
+uint8_t *esp_ble_resolve_adv_data(uint8_t *adv_data, uint8_t type, uint8_t *length);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,92 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * @file
+ *
+ * @brief host shim of esp_http_client.h
+ *
+ * Requests are answered by the stand-in server set with ena_host_http_set_server, which also counts
+ * connections and TLS handshakes.
+ *
+ */
+#ifndef _ena_HOST_ESP_HTTP_CLIENT_H_
+#define _ena_HOST_ESP_HTTP_CLIENT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+typedef struct esp_http_client *esp_http_client_handle_t;
+
+typedef enum
+{
+    HTTP_EVENT_ERROR,
+    HTTP_EVENT_ON_CONNECTED,
+    HTTP_EVENT_HEADERS_SENT,
+    HTTP_EVENT_ON_HEADER,
+    HTTP_EVENT_ON_DATA,
+    HTTP_EVENT_ON_FINISH,
+    HTTP_EVENT_DISCONNECTED,
+} esp_http_client_event_id_t;
+
+typedef struct esp_http_client_event
+{
+    esp_http_client_event_id_t event_id;
+    esp_http_client_handle_t client;
+    void *data;
+    int data_len;
+    void *user_data;
+    char *header_key;
+    char *header_value;
+} esp_http_client_event_t;
+
+typedef esp_err_t (*http_event_handle_cb)(esp_http_client_event_t *evt);
+
+typedef enum
+{
+    HTTP_METHOD_GET,
+    HTTP_METHOD_POST,
+} esp_http_client_method_t;
+
+typedef struct
+{
+    const char *url;
+    const char *cert_pem;
+    int timeout_ms;
+    esp_http_client_method_t method;
+    http_event_handle_cb event_handler;
+    int buffer_size;
+    void *user_data;
+    bool is_async;
+    bool keep_alive_enable;
+    bool save_client_session; // CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS, always declared so the shims agree on the layout
+} esp_http_client_config_t;
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config);
+esp_err_t esp_http_client_set_url(esp_http_client_handle_t client, const char *url);
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client, const char *key, const char *value);
+esp_err_t esp_http_client_set_post_field(esp_http_client_handle_t client, const char *data, int length);
+esp_err_t esp_http_client_open(esp_http_client_handle_t client, int write_length);
+int esp_http_client_fetch_headers(esp_http_client_handle_t client);
+int esp_http_client_read(esp_http_client_handle_t client, char *buffer, int length);
+bool esp_http_client_is_chunked_response(esp_http_client_handle_t client);
+bool esp_http_client_is_complete_data_received(esp_http_client_handle_t client);
+int esp_http_client_get_status_code(esp_http_client_handle_t client);
+int esp_http_client_get_content_length(esp_http_client_handle_t client);
+esp_err_t esp_http_client_perform(esp_http_client_handle_t client);
+esp_err_t esp_http_client_close(esp_http_client_handle_t client);
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client);
+
+#endif
\ No newline at end of file
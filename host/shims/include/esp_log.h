@@ -0,0 +1,88 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * @file
+ *
+ * @brief host shim of esp_log.h, writes to stderr
+ *
+ * Only warnings and errors are written by default, esp_log_level_set("*", level) changes the level of all tags.
+ *
+ */
+#ifndef _ena_HOST_ESP_LOG_H_
+#define _ena_HOST_ESP_LOG_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+
+typedef enum
+{
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE,
+} esp_log_level_t;
+
+/**
+ * @brief       set log level
+ * @param[in]   tag     ignored, the level applies to all tags
+ * @param[in]   level   maximum level to write
+ */
+void esp_log_level_set(const char *tag, esp_log_level_t level);
+
+/**
+ * @brief       check if a level is written
+ * @param[in]   level   the level to check
+ * @return
+ *              true if messages of this level are written
+ */
+bool esp_log_enabled(esp_log_level_t level);
+
+/**
+ * @brief       write a log message
+ * @param[in]   level   level of the message
+ * @param[in]   tag     tag of the message
+ * @param[in]   format  printf format of the message
+ */
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...) __attribute__((format(printf, 3, 4)));
+
+/**
+ * @brief       milliseconds since start
+ * @return
+ *              milliseconds since start
+ */
+uint32_t esp_log_timestamp(void);
+
+void ESP_LOG_BUFFER_HEX_LEVEL(const char *tag, const void *buffer, size_t length, esp_log_level_t level);
+void ESP_LOG_BUFFER_HEXDUMP(const char *tag, const void *buffer, size_t length, esp_log_level_t level);
+
+#define ESP_LOG_LEVEL(level, tag, format, ...)                   \
+    do                                                           \
+    {                                                            \
+        if (esp_log_enabled(level))                              \
+        {                                                        \
+            esp_log_write(level, tag, format "\n", ##__VA_ARGS__); \
+        }                                                        \
+    } while (0)
+
+#define ESP_LOGE(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) ESP_LOG_LEVEL(ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
+
+#endif
\ No newline at end of file
@@ -0,0 +1,49 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * @file
+ *
+ * @brief host shim of esp_system.h
+ *
+ */
+#ifndef _ena_HOST_ESP_SYSTEM_H_
+#define _ena_HOST_ESP_SYSTEM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+
+/**
+ * @brief       random number, from a seeded generator so runs can be repeated
+ * @return
+ *              32 random bits
+ */
+uint32_t esp_random(void);
+
+/**
+ * @brief       fill a buffer with random bytes
+ * @param[out]  buffer  the buffer to fill
+ * @param[in]   length  number of bytes
+ */
+void esp_fill_random(void *buffer, size_t length);
+
+/**
+ * @brief       free heap
+ * @return
+ *              a constant on the host
+ */
+uint32_t esp_get_free_heap_size(void);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,44 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * @file
+ *
+ * @brief host shim of esp_wifi_types.h with the types used by wifi-controller.h
+ *
+ */
+#ifndef _ena_HOST_ESP_WIFI_TYPES_H_
+#define _ena_HOST_ESP_WIFI_TYPES_H_
+
+#include <stdint.h>
+
+typedef struct
+{
+    uint8_t bssid[6];
+    uint8_t ssid[33];
+    uint8_t primary;
+    int8_t rssi;
+} wifi_ap_record_t;
+
+typedef struct
+{
+    uint8_t ssid[32];
+    uint8_t password[64];
+} wifi_sta_config_t;
+
+typedef union
+{
+    wifi_sta_config_t sta;
+} wifi_config_t;
+
+#endif
\ No newline at end of file
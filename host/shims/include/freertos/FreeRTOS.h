@@ -0,0 +1,75 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * @file
+ *
+ * @brief host shim of FreeRTOS on POSIX threads
+ *
+ * A tick is a millisecond of the monotonic clock. Tasks are threads and run truly parallel, there are
+ * no priorities and no preemption points.
+ *
+ */
+#ifndef _ena_HOST_FREERTOS_H_
+#define _ena_HOST_FREERTOS_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define configTICK_RATE_HZ (1000)
+#define portTICK_PERIOD_MS (1000 / configTICK_RATE_HZ)
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define portNUM_PROCESSORS (2)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000))
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+#define pdFAIL (pdFALSE)
+#define pdPASS (pdTRUE)
+#define tskNO_AFFINITY (0x7FFFFFFF)
+
+typedef struct
+{
+    int unused;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {0}
+
+/**
+ * @brief       enter a critical section, one global lock for all sections
+ * @param[in]   mux     ignored
+ */
+void vPortEnterCritical(portMUX_TYPE *mux);
+
+/**
+ * @brief       leave a critical section
+ * @param[in]   mux     ignored
+ */
+void vPortExitCritical(portMUX_TYPE *mux);
+
+#define portENTER_CRITICAL(mux) vPortEnterCritical(mux)
+#define portEXIT_CRITICAL(mux) vPortExitCritical(mux)
+
+/**
+ * @brief       free heap
+ * @return
+ *              a constant on the host
+ */
+size_t xPortGetFreeHeapSize(void);
+
+#endif
\ No newline at end of file
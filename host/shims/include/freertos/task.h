@@ -0,0 +1,43 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * @file
+ *
+ * @brief host shim of FreeRTOS tasks and task notifications
+ *
+ */
+#ifndef _ena_HOST_TASK_H_
+#define _ena_HOST_TASK_H_
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct ena_host_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *parameter);
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stack_depth, void *parameter, UBaseType_t priority, TaskHandle_t *handle);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stack_depth, void *parameter, UBaseType_t priority, TaskHandle_t *handle, BaseType_t core);
+
+/**
+ * @brief       delete a task, only the calling task (NULL) can be deleted on the host
+ * @param[in]   handle  NULL for the calling task
+ */
+void vTaskDelete(TaskHandle_t handle);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait);
+BaseType_t xTaskNotifyGive(TaskHandle_t handle);
+void taskYIELD(void);
+
+#endif
\ No newline at end of file
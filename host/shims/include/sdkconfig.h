@@ -0,0 +1,111 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * @file
+ *
+ * @brief Kconfig defaults of ena and ena-eke-proxy for host builds
+ *
+ * Every value can be overwritten by a compile definition of the test or benchmark. Bool options are off
+ * unless defined, like in a generated sdkconfig.h.
+ *
+ */
+#ifndef _ena_HOST_SDKCONFIG_H_
+#define _ena_HOST_SDKCONFIG_H_
+
+// Exposure Notification API
+#ifndef CONFIG_ENA_STORAGE_TEK_MAX
+#define CONFIG_ENA_STORAGE_TEK_MAX 14
+#endif
+#ifndef CONFIG_ENA_STORAGE_EXPOSURE_INFORMATION_MAX
+#define CONFIG_ENA_STORAGE_EXPOSURE_INFORMATION_MAX 500
+#endif
+#ifndef CONFIG_ENA_STORAGE_TEMP_BEACONS_MAX
+#define CONFIG_ENA_STORAGE_TEMP_BEACONS_MAX 1000
+#endif
+#ifndef CONFIG_ENA_STORAGE_START_ADDRESS
+#define CONFIG_ENA_STORAGE_START_ADDRESS 0
+#endif
+#ifndef CONFIG_ENA_STORAGE_PARTITION_NAME
+#define CONFIG_ENA_STORAGE_PARTITION_NAME "ena"
+#endif
+#ifndef CONFIG_ENA_STORAGE_YIELD_BUDGET
+#define CONFIG_ENA_STORAGE_YIELD_BUDGET 20
+#endif
+#if defined(CONFIG_ENA_STORAGE_BEACON_FINGERPRINT) && !defined(CONFIG_ENA_STORAGE_BEACON_FINGERPRINT_SIZE)
+#define CONFIG_ENA_STORAGE_BEACON_FINGERPRINT_SIZE 8
+#endif
+#if defined(CONFIG_ENA_STORAGE_BEACON_INDEX) && !defined(CONFIG_ENA_STORAGE_BEACON_INDEX_SLOTS_BITS)
+#define CONFIG_ENA_STORAGE_BEACON_INDEX_SLOTS_BITS 17
+#endif
+#if defined(CONFIG_ENA_STORAGE_WRITE_CACHE) && !defined(CONFIG_ENA_STORAGE_WRITE_CACHE_BLOCKS)
+#define CONFIG_ENA_STORAGE_WRITE_CACHE_BLOCKS 2
+#endif
+#if defined(CONFIG_ENA_STORAGE_WRITE_CACHE) && !defined(CONFIG_ENA_STORAGE_WRITE_CACHE_FLUSH_INTERVAL)
+#define CONFIG_ENA_STORAGE_WRITE_CACHE_FLUSH_INTERVAL 60
+#endif
+#if defined(CONFIG_ENA_STORAGE_KEY_DIGESTS) && !defined(CONFIG_ENA_STORAGE_KEY_DIGEST_BLOCKS)
+#define CONFIG_ENA_STORAGE_KEY_DIGEST_BLOCKS 16
+#endif
+#ifndef CONFIG_ENA_BEACON_TRESHOLD
+#define CONFIG_ENA_BEACON_TRESHOLD 300
+#endif
+#ifndef CONFIG_ENA_BEACON_CLEANUP_TRESHOLD
+#define CONFIG_ENA_BEACON_CLEANUP_TRESHOLD 14
+#endif
+#ifndef CONFIG_ENA_SCANNING_TIME
+#define CONFIG_ENA_SCANNING_TIME 30
+#endif
+#ifndef CONFIG_ENA_SCANNING_INTERVAL
+#define CONFIG_ENA_SCANNING_INTERVAL 300
+#endif
+#ifndef CONFIG_ENA_SCAN_QUEUE_SIZE
+#define CONFIG_ENA_SCAN_QUEUE_SIZE 256
+#endif
+#ifndef CONFIG_ENA_BT_ROTATION_TIMEOUT_INTERVAL
+#define CONFIG_ENA_BT_ROTATION_TIMEOUT_INTERVAL 900
+#endif
+#ifndef CONFIG_ENA_BT_RANDOMIZE_ROTATION_TIMEOUT_INTERVAL
+#define CONFIG_ENA_BT_RANDOMIZE_ROTATION_TIMEOUT_INTERVAL 150
+#endif
+#ifndef CONFIG_ENA_TEK_ROLLING_PERIOD
+#define CONFIG_ENA_TEK_ROLLING_PERIOD 144
+#endif
+
+// ENA Exposue Key Export Proxy, requests go to the stand-in server of esp_http_client
+#ifndef CONFIG_ENA_EKE_PROXY_KEYFILES_DAILY_URL
+#define CONFIG_ENA_EKE_PROXY_KEYFILES_DAILY_URL "https://cwa-proxy.champonthis.de/version/v1/diagnosis-keys/country/DE/date/%s?page=%u&size=%u"
+#endif
+#ifndef CONFIG_ENA_EKE_PROXY_KEYFILES_HOURLY
+#define CONFIG_ENA_EKE_PROXY_KEYFILES_HOURLY 1
+#endif
+#ifndef CONFIG_ENA_EKE_PROXY_KEYFILES_HOURLY_URL
+#define CONFIG_ENA_EKE_PROXY_KEYFILES_HOURLY_URL "https://cwa-proxy.champonthis.de/version/v1/diagnosis-keys/country/DE/date/%s/hour/%u?page=%u&size=%u"
+#endif
+#ifndef CONFIG_ENA_EKE_PROXY_KEYFILES_DAILY_FORMAT
+#define CONFIG_ENA_EKE_PROXY_KEYFILES_DAILY_FORMAT "%Y-%m-%d"
+#endif
+#ifndef CONFIG_ENA_EKE_PROXY_KEYFILES_UPLOAD_URL
+#define CONFIG_ENA_EKE_PROXY_KEYFILES_UPLOAD_URL "https://cwa-proxy.champonthis.de/version/v1/diagnosis-keys"
+#endif
+#ifndef CONFIG_ENA_EKE_PROXY_KEY_LIMIT
+#define CONFIG_ENA_EKE_PROXY_KEY_LIMIT 500
+#endif
+#ifndef CONFIG_ENA_EKE_PROXY_MAX_PAST_DAYS
+#define CONFIG_ENA_EKE_PROXY_MAX_PAST_DAYS 14
+#endif
+#if defined(CONFIG_ENA_EKE_PROXY_PIPELINE) && !defined(CONFIG_ENA_EKE_PROXY_PIPELINE_CORE)
+#define CONFIG_ENA_EKE_PROXY_PIPELINE_CORE -1
+#endif
+
+#endif
\ No newline at end of file
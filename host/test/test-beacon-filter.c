@@ -0,0 +1,86 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * Bloom filters of full columnar segments: stored RPIs are always candidates, the rate of segments read for
+ * RPIs not stored stays low
+ */
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_system.h"
+
+#include "ena-host.h"
+#include "ena-crypto.h"
+#include "ena-storage.h"
+#include "ena-storage-backend.h"
+
+#define TEST_START (1600041600)
+#define TEST_BEACONS (10000)     // beacons of one interval, about 40 full segments
+#define TEST_QUERIES (2000)      // RPIs not stored
+#define TEST_MAX_FP_RATE (0.02)  // segments read per segment probed for RPIs not stored
+
+int main(void)
+{
+    ena_storage_backend_t backend;
+    ESP_ERROR_CHECK(ena_host_flash_init(&backend, ENA_HOST_FLASH_SIZE));
+    ena_storage_backend_set(&backend);
+    ena_crypto_init();
+    ena_storage_erase_all();
+    esp_log_level_set("*", ESP_LOG_WARN);
+
+    // every segment covers the interval, so every segment is probed
+    uint32_t enin = ena_crypto_enin(TEST_START);
+    ena_beacon_t beacon = {.timestamp_first = TEST_START, .timestamp_last = TEST_START + 60, .rssi = -70};
+    ena_beacon_t stored;
+    for (uint32_t i = 0; i < TEST_BEACONS; i++)
+    {
+        esp_fill_random(beacon.rpi, ENA_KEY_LENGTH);
+        ena_storage_add_beacon(&beacon);
+        if (i == TEST_BEACONS / 2)
+        {
+            stored = beacon;
+        }
+    }
+    ena_storage_flush();
+
+    ena_beacon_t found;
+    ENA_HOST_CHECK(ena_storage_match_beacons(stored.rpi, enin, 1, 0, &found, 1) == 1);
+
+    // without a candidate only the filter of a segment is read, with one also its header and RPI column,
+    // so the query with fewest reads had no false positive and read the filter of every segment
+    uint32_t reads = 0;
+    uint32_t segments = UINT32_MAX;
+    uint8_t rpi[ENA_KEY_LENGTH];
+    ena_storage_backend_stats_t before, after;
+    for (uint32_t i = 0; i < TEST_QUERIES; i++)
+    {
+        esp_fill_random(rpi, ENA_KEY_LENGTH);
+        ena_storage_backend_get_stats(&before);
+        ENA_HOST_CHECK(ena_storage_match_beacons(rpi, enin, 1, 0, &found, 1) == 0);
+        ena_storage_backend_get_stats(&after);
+        reads += after.reads - before.reads;
+        if (after.reads - before.reads < segments)
+        {
+            segments = after.reads - before.reads;
+        }
+    }
+    uint32_t probes = TEST_QUERIES * segments;
+    double rate = (double)(reads - probes) / 2 / probes;
+    printf("%u beacons in %u segments, %u bytes of key data per beacon\n", TEST_BEACONS, segments, ENA_STORAGE_BEACON_FINGERPRINT_SIZE);
+    printf("false positive rate: %.4f (%u of %u segments read)\n", rate, (reads - probes) / 2, probes);
+    ENA_HOST_CHECK(rate <= TEST_MAX_FP_RATE);
+
+    return ena_host_result();
+}
\ No newline at end of file
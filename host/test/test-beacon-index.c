@@ -0,0 +1,131 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * hashed RPI index: removed and expired beacons are deleted from the index without a rebuild, the index is only
+ * rebuilt after too many deleted slots
+ */
+#include <string.h>
+
+#include "ena-host.h"
+#include "ena-storage.h"
+#include "ena-storage-backend.h"
+
+#define TEST_BEACONS (2000)
+#define TEST_START (1600000000)
+#define TEST_INDEX_ADDRESS (((ENA_HOST_FLASH_SIZE - 4096 - ENA_STORAGE_BEACON_INDEX_SLOTS * 4) / 4096) * 4096)
+
+void test_beacon_index_beacon(uint32_t i, ena_beacon_t *beacon)
+{
+    memset(beacon, 0, sizeof(ena_beacon_t));
+    // spread over the slots like AES output
+    uint32_t hash = i * 2654435761u;
+    memcpy(beacon->rpi, &hash, sizeof(hash));
+    memcpy(&beacon->rpi[4], &i, sizeof(i));
+    beacon->rpi[15] = 0x42;
+    beacon->timestamp_first = TEST_START + i * 10;
+    beacon->timestamp_last = beacon->timestamp_first + 5;
+}
+
+// beacons first..last (exclusive) are found at their number - offset, or not found with offset UINT32_MAX
+void test_beacon_index_check(uint32_t first, uint32_t last, uint32_t offset)
+{
+    ena_beacon_t beacon;
+    uint32_t indices[2];
+    uint32_t misses = 0;
+    for (uint32_t i = first; i < last; i++)
+    {
+        test_beacon_index_beacon(i, &beacon);
+        uint32_t found = ena_storage_find_beacons(beacon.rpi, indices, 2);
+        if (offset == UINT32_MAX ? found != 0 : (found != 1 || indices[0] != i - offset))
+        {
+            misses++;
+        }
+    }
+    ENA_HOST_CHECK(misses == 0);
+}
+
+void test_beacon_index_fill(void *context)
+{
+    ena_storage_erase_all();
+    ena_beacon_t beacon;
+    for (uint32_t i = 0; i < TEST_BEACONS; i++)
+    {
+        test_beacon_index_beacon(i, &beacon);
+        ena_storage_add_beacon(&beacon);
+    }
+    ena_storage_beacon_index_rebuild();
+    ena_storage_flush();
+    test_beacon_index_check(0, TEST_BEACONS, 0);
+}
+
+void test_beacon_index_expire(void *context)
+{
+    uint32_t erases = ena_host_flash_block_erases(TEST_INDEX_ADDRESS);
+    // expire first 500 beacons
+    ena_storage_expire_beacons(TEST_START + 499 * 10 + 5);
+    ena_storage_flush();
+    ENA_HOST_CHECK(ena_storage_beacons_count() == TEST_BEACONS - 500);
+    test_beacon_index_check(0, 500, UINT32_MAX);
+    test_beacon_index_check(500, TEST_BEACONS, 500);
+    ENA_HOST_CHECK(ena_host_flash_block_erases(TEST_INDEX_ADDRESS) == erases);
+}
+
+void test_beacon_index_reboot(void *context)
+{
+    uint32_t erases = ena_host_flash_block_erases(TEST_INDEX_ADDRESS);
+    test_beacon_index_check(500, TEST_BEACONS, 500);
+
+    // first and a middle beacon
+    ena_storage_remove_beacon(0);
+    ena_storage_remove_beacon(1000);
+    ena_storage_flush();
+    ENA_HOST_CHECK(ena_storage_beacons_count() == TEST_BEACONS - 502);
+    test_beacon_index_check(500, 501, UINT32_MAX);
+    test_beacon_index_check(501, 1501, 501);
+    test_beacon_index_check(1501, 1502, UINT32_MAX);
+    test_beacon_index_check(1502, TEST_BEACONS, 502);
+    ENA_HOST_CHECK(ena_host_flash_block_erases(TEST_INDEX_ADDRESS) == erases);
+}
+
+void test_beacon_index_threshold(void *context)
+{
+    // 1498 live and 1000 deleted slots fit in 3/4 of the 4096 slots, 1000 more beacons and 999 more deleted do not
+    uint32_t erases = ena_host_flash_block_erases(TEST_INDEX_ADDRESS);
+    ena_beacon_t beacon;
+    for (uint32_t i = TEST_BEACONS; i < TEST_BEACONS + 1000; i++)
+    {
+        test_beacon_index_beacon(i, &beacon);
+        ena_storage_add_beacon(&beacon);
+    }
+    ENA_HOST_CHECK(ena_host_flash_block_erases(TEST_INDEX_ADDRESS) == erases);
+    ena_storage_expire_beacons(TEST_START + 1499 * 10 + 5);
+    ena_storage_flush();
+    test_beacon_index_check(1000, 1500, UINT32_MAX);
+    test_beacon_index_check(1500, 1501, 1500);
+    test_beacon_index_check(1502, TEST_BEACONS + 1000, 1501);
+    ENA_HOST_CHECK(ena_host_flash_block_erases(TEST_INDEX_ADDRESS) == erases + 1);
+}
+
+int main(void)
+{
+    ena_storage_backend_t backend;
+    ESP_ERROR_CHECK(ena_host_flash_init(&backend, ENA_HOST_FLASH_SIZE));
+    ena_storage_backend_set(&backend);
+
+    ENA_HOST_CHECK(ena_host_boot(&test_beacon_index_fill, NULL) == 0);
+    ENA_HOST_CHECK(ena_host_boot(&test_beacon_index_expire, NULL) == 0);
+    ENA_HOST_CHECK(ena_host_boot(&test_beacon_index_reboot, NULL) == 0);
+    ENA_HOST_CHECK(ena_host_boot(&test_beacon_index_threshold, NULL) == 0);
+    return ena_host_result();
+}
\ No newline at end of file
@@ -0,0 +1,121 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * RPI seen more often than the buffers of the exposure check hold: all beacons are found and matched, with
+ * index, columnar segments and fingerprints. A beacon whose RPI only shares the fingerprint of a RPI of the key is
+ * found with fingerprints, but its AEM does not decrypt to version 1, so it adds no exposure.
+ */
+#include <string.h>
+
+#include "esp_system.h"
+
+#include "ena-host.h"
+#include "ena-crypto.h"
+#include "ena-storage.h"
+#include "ena-storage-backend.h"
+#include "ena-exposure.h"
+
+#define TEST_START (1600041600)
+#define TEST_NOISE (3000)   // other beacons, before and after the matching ones
+#define TEST_MATCHES (100)  // beacons with the same RPI, more than the batch of the exposure check
+#define TEST_INTERVAL (10)  // interval of the key the beacons were seen at
+#define TEST_COLLISIONS (ENA_STORAGE_BEACON_FINGERPRINT ? 1 : 0) // found beacons only sharing the fingerprint
+
+void test_beacon_match_noise(uint32_t count, uint32_t *timestamp)
+{
+    ena_beacon_t beacon = {.rssi = -80};
+    for (uint32_t i = 0; i < count; i++)
+    {
+        esp_fill_random(beacon.rpi, ENA_KEY_LENGTH);
+        esp_fill_random(beacon.aem, ENA_AEM_METADATA_LENGTH);
+        beacon.timestamp_first = *timestamp;
+        beacon.timestamp_last = *timestamp + 60;
+        ena_storage_add_beacon(&beacon);
+        *timestamp += 1;
+    }
+}
+
+int main(void)
+{
+    ena_storage_backend_t backend;
+    ESP_ERROR_CHECK(ena_host_flash_init(&backend, ENA_HOST_FLASH_SIZE));
+    ena_storage_backend_set(&backend);
+    ena_crypto_init();
+    ena_storage_erase_all();
+
+    uint32_t enin = ena_crypto_enin(TEST_START);
+    ena_temporary_exposure_key_t key = {.rolling_start_interval_number = enin, .rolling_period = ENA_TEK_ROLLING_PERIOD};
+    memset(key.key_data, 7, ENA_KEY_LENGTH);
+    uint8_t rpik[ENA_KEY_LENGTH], aemk[ENA_KEY_LENGTH];
+    ena_crypto_derive_keys(key.key_data, rpik, aemk);
+
+    uint32_t timestamp = TEST_START;
+    test_beacon_match_noise(TEST_NOISE / 2, &timestamp);
+    // seen every 5 seconds for 10 minutes each within the window of the interval
+    ena_beacon_t beacon = {.rssi = -60};
+    ena_crypto_rpi(beacon.rpi, rpik, enin + TEST_INTERVAL);
+    ena_crypto_aem(beacon.aem, aemk, beacon.rpi, 0);
+    uint32_t seen = (enin + TEST_INTERVAL) * ENA_TIME_WINDOW;
+    timestamp = timestamp > seen ? timestamp : seen;
+    for (uint32_t i = 0; i < TEST_MATCHES; i++)
+    {
+        beacon.timestamp_first = timestamp;
+        beacon.timestamp_last = timestamp + 600;
+        ena_storage_add_beacon(&beacon);
+        timestamp += 5;
+    }
+    // other device at the next interval, stored bytes of the RPI collide, decrypted AEM has another version
+    ena_beacon_t collision = {.rssi = -60};
+    ena_crypto_rpi(collision.rpi, rpik, enin + TEST_INTERVAL + 1);
+    ena_crypto_aem(collision.aem, aemk, collision.rpi, 0);
+    collision.rpi[ENA_KEY_LENGTH - 1] ^= 0xFF;
+    collision.aem[0] ^= 0x40;
+    collision.timestamp_first = (enin + TEST_INTERVAL + 1) * ENA_TIME_WINDOW;
+    collision.timestamp_last = collision.timestamp_first + 600;
+    ena_storage_add_beacon(&collision);
+    timestamp = collision.timestamp_first + 1;
+    test_beacon_match_noise(TEST_NOISE / 2, &timestamp);
+    ena_storage_flush();
+    ENA_HOST_CHECK(ena_storage_beacons_count() == TEST_NOISE + TEST_MATCHES + 1);
+
+    // matches beyond max are counted, only the first max are written
+    uint8_t rpis[ENA_TEK_ROLLING_PERIOD * ENA_KEY_LENGTH];
+    ena_crypto_rpi_batch(rpik, enin, ENA_TEK_ROLLING_PERIOD, rpis);
+    static ena_beacon_t found[TEST_MATCHES + TEST_COLLISIONS];
+    ENA_HOST_CHECK(ena_storage_match_beacons(rpis, enin, ENA_TEK_ROLLING_PERIOD, ENA_EXPOSURE_CHECK_ENIN_SKEW, found, 8) == TEST_MATCHES + TEST_COLLISIONS);
+    ENA_HOST_CHECK(ena_storage_match_beacons(rpis, enin, ENA_TEK_ROLLING_PERIOD, ENA_EXPOSURE_CHECK_ENIN_SKEW, found, TEST_MATCHES + TEST_COLLISIONS) == TEST_MATCHES + TEST_COLLISIONS);
+    uint32_t complete = 0;
+    for (uint32_t i = 0; i < TEST_MATCHES; i++)
+    {
+        complete += memcmp(found[i].rpi, beacon.rpi, ENA_KEY_LENGTH) == 0 ? 1 : 0;
+    }
+    ENA_HOST_CHECK(complete == TEST_MATCHES);
+
+    if (!ENA_STORAGE_BEACON_LOG)
+    {
+        uint32_t indices[8];
+        ENA_HOST_CHECK(ena_storage_find_beacons(beacon.rpi, indices, 8) == TEST_MATCHES);
+        ENA_HOST_CHECK(indices[0] == TEST_NOISE / 2);
+    }
+
+    // every beacon adds its 10 minutes to the exposure of the key, the collision is rejected
+    ena_storage_erase_exposure_information();
+    ena_exposure_check_temporary_exposure_keys(&key, 1);
+    ENA_HOST_CHECK(ena_storage_exposure_information_count() == 1);
+    ena_exposure_information_t exposure_info;
+    ena_storage_get_exposure_information(0, &exposure_info);
+    ENA_HOST_CHECK(exposure_info.duration_minutes == TEST_MATCHES * 10);
+
+    return ena_host_result();
+}
\ No newline at end of file
@@ -0,0 +1,139 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * flat beacons of the layout without exposure summary block, stored up to the end of the partition: on first
+ * access the beacons in the summary block replace the oldest ones, also when a migration was interrupted after
+ * moving a part of them, and the summary block is usable afterwards
+ */
+#include <string.h>
+#include <sys/mman.h>
+
+#include "ena-host.h"
+#include "ena-storage.h"
+#include "ena-storage-backend.h"
+
+#define TEST_START (1600000000)
+#define TEST_BEHIND (100) // beacons stored behind the beacon area of the current layout, in the summary block
+
+extern const int ENA_STORAGE_BEACONS_START_ADDRESS;
+
+static uint32_t *capacity = NULL; // beacons fitting in the beacon area, shared with booted processes
+
+void test_beacon_migrate_beacon(uint32_t i, ena_beacon_t *beacon)
+{
+    memset(beacon, 0, sizeof(ena_beacon_t));
+    memcpy(beacon->rpi, &i, sizeof(i));
+    memset(&beacon->rpi[4], 0xA5, ENA_KEY_LENGTH - 4);
+    beacon->timestamp_first = TEST_START + i * 10;
+    beacon->timestamp_last = beacon->timestamp_first + 5;
+    beacon->rssi = -70;
+}
+
+void test_beacon_migrate_old(void *context)
+{
+    // without head word and summary block, written like the former add of a beacon
+    ena_storage_erase_all();
+    *capacity = ena_storage_beacons_capacity();
+    size_t end = ENA_STORAGE_BEACONS_START_ADDRESS + (*capacity + TEST_BEHIND) * sizeof(ena_beacon_t);
+    size_t first_block = (ENA_STORAGE_BEACONS_START_ADDRESS / ENA_STORAGE_BACKEND_BLOCK_SIZE + 1) * ENA_STORAGE_BACKEND_BLOCK_SIZE;
+    size_t last_block = ((end + ENA_STORAGE_BACKEND_BLOCK_SIZE - 1) / ENA_STORAGE_BACKEND_BLOCK_SIZE) * ENA_STORAGE_BACKEND_BLOCK_SIZE;
+    ESP_ERROR_CHECK(ena_storage_backend_erase(first_block, last_block - first_block));
+    ena_beacon_t beacon;
+    for (uint32_t i = 0; i < *capacity + TEST_BEHIND; i++)
+    {
+        test_beacon_migrate_beacon(i, &beacon);
+        ESP_ERROR_CHECK(ena_storage_backend_write(ENA_STORAGE_BEACONS_START_ADDRESS + i * sizeof(ena_beacon_t), &beacon, sizeof(ena_beacon_t)));
+    }
+    ena_storage_counter_set(ENA_STORAGE_COUNTER_BEACONS, *capacity + TEST_BEHIND);
+}
+
+void test_beacon_migrate_interrupted(void *context)
+{
+    // first beacons moved, head not written yet
+    test_beacon_migrate_old(context);
+    ena_beacon_t beacon;
+    for (uint32_t i = 0; i < TEST_BEHIND / 2; i++)
+    {
+        test_beacon_migrate_beacon(*capacity + i, &beacon);
+        ena_storage_write(ENA_STORAGE_BEACONS_START_ADDRESS + i * sizeof(ena_beacon_t), &beacon, sizeof(ena_beacon_t));
+    }
+    ena_storage_flush();
+}
+
+void test_beacon_migrate_check(void *context)
+{
+    // oldest beacons dropped, all others in order
+    ENA_HOST_CHECK(ena_storage_beacons_count() == *capacity);
+    ena_beacon_t beacon, expected;
+    uint32_t errors = 0;
+    for (uint32_t i = 0; i < *capacity; i++)
+    {
+        ena_storage_get_beacon(i, &beacon);
+        test_beacon_migrate_beacon(TEST_BEHIND + i, &expected);
+        errors += memcmp(&beacon, &expected, sizeof(ena_beacon_t)) == 0 ? 0 : 1;
+    }
+    ENA_HOST_CHECK(errors == 0);
+
+    // summary block holds no beacon data
+    uint8_t summary[64];
+    ena_storage_read_exposure_summary(summary, sizeof(summary));
+    uint8_t zeros[64] = {0};
+    ENA_HOST_CHECK(memcmp(summary, zeros, sizeof(summary)) == 0);
+}
+
+void test_beacon_migrate_use(void *context)
+{
+    // ring continues, summary written next to the beacons
+    ena_beacon_t beacon;
+    test_beacon_migrate_beacon(*capacity + TEST_BEHIND, &beacon);
+    ena_storage_remove_beacon(0);
+    ena_storage_add_beacon(&beacon);
+    uint8_t summary[64];
+    memset(summary, 0x5A, sizeof(summary));
+    ena_storage_write_exposure_summary(summary, sizeof(summary));
+    ena_storage_flush();
+}
+
+void test_beacon_migrate_used(void *context)
+{
+    ENA_HOST_CHECK(ena_storage_beacons_count() == *capacity);
+    ena_beacon_t beacon, expected;
+    ena_storage_get_beacon(0, &beacon);
+    test_beacon_migrate_beacon(TEST_BEHIND + 1, &expected);
+    ENA_HOST_CHECK(memcmp(&beacon, &expected, sizeof(ena_beacon_t)) == 0);
+    ena_storage_get_beacon(*capacity - 1, &beacon);
+    test_beacon_migrate_beacon(*capacity + TEST_BEHIND, &expected);
+    ENA_HOST_CHECK(memcmp(&beacon, &expected, sizeof(ena_beacon_t)) == 0);
+    uint8_t summary[64], written[64];
+    memset(written, 0x5A, sizeof(written));
+    ena_storage_read_exposure_summary(summary, sizeof(summary));
+    ENA_HOST_CHECK(memcmp(summary, written, sizeof(summary)) == 0);
+}
+
+int main(void)
+{
+    ena_storage_backend_t backend;
+    ESP_ERROR_CHECK(ena_host_flash_init(&backend, ENA_HOST_FLASH_SIZE));
+    ena_storage_backend_set(&backend);
+    capacity = mmap(NULL, sizeof(uint32_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    ENA_HOST_CHECK(ena_host_boot(&test_beacon_migrate_interrupted, NULL) == 0);
+    ENA_HOST_CHECK(ena_host_boot(&test_beacon_migrate_check, NULL) == 0);
+    ENA_HOST_CHECK(ena_host_boot(&test_beacon_migrate_old, NULL) == 0);
+    ENA_HOST_CHECK(ena_host_boot(&test_beacon_migrate_check, NULL) == 0);
+    ENA_HOST_CHECK(ena_host_boot(&test_beacon_migrate_use, NULL) == 0);
+    ENA_HOST_CHECK(ena_host_boot(&test_beacon_migrate_used, NULL) == 0);
+
+    return ena_host_result();
+}
\ No newline at end of file
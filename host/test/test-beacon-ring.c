@@ -0,0 +1,200 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * flat beacon storage as ring: expire moves the head and erases the blocks behind it, beacons wrap around the end
+ * of the beacon area without erasing again, and with the counter journal an expire cut off at any flash operation
+ * keeps the old or the new beacons
+ */
+#include <string.h>
+#include <sys/mman.h>
+
+#include "ena-host.h"
+#include "ena-storage.h"
+#include "ena-storage-backend.h"
+
+#define TEST_START (1600000000)
+#define TEST_EXPIRED (1000) // beacons expired before the ring wraps
+#define TEST_WRAPPED (500)  // beacons added behind the end of the beacon area
+
+extern const int ENA_STORAGE_BEACONS_START_ADDRESS;
+
+static uint32_t *capacity = NULL; // beacons fitting in the ring, shared with booted processes
+
+void test_beacon_ring_beacon(uint32_t i, ena_beacon_t *beacon)
+{
+    memset(beacon, 0, sizeof(ena_beacon_t));
+    memcpy(beacon->rpi, &i, sizeof(i));
+    beacon->rpi[15] = 0x5A;
+    beacon->timestamp_first = TEST_START + i * 10;
+    beacon->timestamp_last = beacon->timestamp_first + 5;
+}
+
+uint32_t test_beacon_ring_number(const ena_beacon_t *beacon)
+{
+    uint32_t i;
+    memcpy(&i, beacon->rpi, sizeof(i));
+    return i;
+}
+
+// count beacons, numbers increasing from first to last, read the same with get and cursor
+void test_beacon_ring_check(uint32_t count, uint32_t first, uint32_t last)
+{
+    ENA_HOST_CHECK(ena_storage_beacons_count() == count);
+    ena_storage_beacon_cursor_t cursor;
+    ena_beacon_t beacons[64];
+    ena_beacon_t beacon, expected;
+    uint32_t index = 0;
+    uint32_t previous = 0;
+    uint32_t errors = 0;
+    uint32_t read;
+    ena_storage_beacon_cursor_open(&cursor, 0, count);
+    while ((read = ena_storage_beacon_cursor_next_batch(&cursor, beacons, 64)) > 0)
+    {
+        for (uint32_t i = 0; i < read; i++, index++)
+        {
+            uint32_t number = test_beacon_ring_number(&beacons[i]);
+            test_beacon_ring_beacon(number, &expected);
+            ena_storage_get_beacon(index, &beacon);
+            if (memcmp(&beacons[i], &expected, sizeof(ena_beacon_t)) != 0 || memcmp(&beacon, &expected, sizeof(ena_beacon_t)) != 0 ||
+                (index == 0 ? number != first : number <= previous) || (index == count - 1 && number != last))
+            {
+                errors++;
+            }
+            previous = number;
+        }
+    }
+    ENA_HOST_CHECK(index == count);
+    ENA_HOST_CHECK(errors == 0);
+}
+
+void test_beacon_ring_fill(void *context)
+{
+    ena_storage_erase_all();
+    ena_beacon_t beacon;
+    uint32_t i = 0;
+    do
+    {
+        test_beacon_ring_beacon(i++, &beacon);
+        ena_storage_add_beacon(&beacon);
+    } while (ena_storage_beacons_count() == i);
+    ena_storage_flush();
+    *capacity = ena_storage_beacons_count();
+    printf("ring capacity: %u beacons\n", *capacity);
+    test_beacon_ring_check(*capacity, 0, *capacity - 1);
+}
+
+void test_beacon_ring_wrap(void *context)
+{
+    uint32_t operations = ena_host_flash_operations();
+    ena_storage_expire_beacons(TEST_START + (TEST_EXPIRED - 1) * 10 + 5);
+    ena_storage_flush();
+    printf("expire: %u flash operations\n", ena_host_flash_operations() - operations);
+    test_beacon_ring_check(*capacity - TEST_EXPIRED, TEST_EXPIRED, *capacity - 1);
+
+    // a block of the ring wholly behind the head, erased once by the expire
+    size_t block = ENA_STORAGE_BEACONS_START_ADDRESS + TEST_WRAPPED / 2 * sizeof(ena_beacon_t);
+    uint32_t erases = ena_host_flash_block_erases(block);
+    ena_beacon_t beacon;
+    for (uint32_t i = *capacity; i < *capacity + TEST_WRAPPED; i++)
+    {
+        test_beacon_ring_beacon(i, &beacon);
+        ena_storage_add_beacon(&beacon);
+    }
+    ena_storage_flush();
+    ENA_HOST_CHECK(erases > 0 && ena_host_flash_block_erases(block) == erases);
+    test_beacon_ring_check(*capacity - TEST_EXPIRED + TEST_WRAPPED, TEST_EXPIRED, *capacity + TEST_WRAPPED - 1);
+}
+
+void test_beacon_ring_view(void *context)
+{
+    uint32_t count = *capacity - TEST_EXPIRED + TEST_WRAPPED;
+    test_beacon_ring_check(count, TEST_EXPIRED, *capacity + TEST_WRAPPED - 1);
+
+    ena_storage_beacons_view_t view;
+    // before the end of the ring, after it and across it
+    uint32_t end = *capacity - TEST_EXPIRED;
+    ENA_HOST_CHECK(ena_storage_beacons_view_open(&view, end - 100, end) == ESP_OK);
+    ENA_HOST_CHECK(view.count == 100 && test_beacon_ring_number(&view.beacons[0]) == *capacity - 100);
+    ena_storage_beacons_view_close(&view);
+    ENA_HOST_CHECK(ena_storage_beacons_view_open(&view, end, count) == ESP_OK);
+    ENA_HOST_CHECK(view.count == TEST_WRAPPED && test_beacon_ring_number(&view.beacons[0]) == *capacity);
+    ena_storage_beacons_view_close(&view);
+    ENA_HOST_CHECK(ena_storage_beacons_view_open(&view, end - 1, end + 1) == ESP_ERR_NOT_SUPPORTED);
+}
+
+void test_beacon_ring_remove(void *context)
+{
+    uint32_t count = *capacity - TEST_EXPIRED + TEST_WRAPPED;
+    // oldest beacon, then one with following beacons across the end of the ring
+    ena_storage_remove_beacon(0);
+    ena_storage_remove_beacon(count - TEST_WRAPPED - 11);
+    ena_storage_flush();
+    count -= 2;
+    test_beacon_ring_check(count, TEST_EXPIRED + 1, *capacity + TEST_WRAPPED - 1);
+    ena_beacon_t beacon;
+    ena_storage_get_beacon(count - TEST_WRAPPED - 9, &beacon);
+    ENA_HOST_CHECK(test_beacon_ring_number(&beacon) == *capacity - 9);
+    ena_storage_get_beacon(count - TEST_WRAPPED - 10, &beacon);
+    ENA_HOST_CHECK(test_beacon_ring_number(&beacon) == *capacity - 11);
+}
+
+void test_beacon_ring_cut(void *context)
+{
+    ena_host_flash_power_cut(*(uint32_t *)context);
+    ena_storage_expire_beacons(TEST_START + (TEST_EXPIRED + 2000 - 1) * 10 + 5);
+    ena_storage_flush();
+}
+
+void test_beacon_ring_recover(void *context)
+{
+    // old or new beacons, never a mix
+    uint32_t count = ena_storage_beacons_count();
+    uint32_t after = *capacity - TEST_EXPIRED + TEST_WRAPPED - 2;
+    if (count == after)
+    {
+        test_beacon_ring_check(count, TEST_EXPIRED + 1, *capacity + TEST_WRAPPED - 1);
+    }
+    else
+    {
+        test_beacon_ring_check(after - 1999, TEST_EXPIRED + 2000, *capacity + TEST_WRAPPED - 1);
+    }
+}
+
+int main(void)
+{
+    ena_storage_backend_t backend;
+    ESP_ERROR_CHECK(ena_host_flash_init(&backend, ENA_HOST_FLASH_SIZE));
+    ena_storage_backend_set(&backend);
+    capacity = mmap(NULL, sizeof(uint32_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    ENA_HOST_CHECK(ena_host_boot(&test_beacon_ring_fill, NULL) == 0);
+    ENA_HOST_CHECK(ena_host_boot(&test_beacon_ring_wrap, NULL) == 0);
+    ENA_HOST_CHECK(ena_host_boot(&test_beacon_ring_view, NULL) == 0);
+    ENA_HOST_CHECK(ena_host_boot(&test_beacon_ring_remove, NULL) == 0);
+
+    if (ENA_STORAGE_COUNTER_JOURNAL)
+    {
+        // cut every flash operation of the expire until it completes
+        uint32_t cuts = 0;
+        for (uint32_t operation = 1; ena_host_boot(&test_beacon_ring_cut, &operation) == ENA_HOST_POWER_CUT_EXIT; operation++)
+        {
+            ENA_HOST_CHECK(ena_host_boot(&test_beacon_ring_recover, NULL) == 0);
+            cuts++;
+        }
+        printf("expire cut at %u flash operations\n", cuts);
+        ENA_HOST_CHECK(cuts > 0);
+    }
+    ENA_HOST_CHECK(ena_host_boot(&test_beacon_ring_recover, NULL) == 0);
+    return ena_host_result();
+}
\ No newline at end of file
@@ -0,0 +1,232 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * counter journal: power cut at every flash operation of counter writes across a rotation and of block rewrites,
+ * and cleared bits in the newest slot. After every reboot a counter or a rewritten block holds its old or its new
+ * value, never another one.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "esp_log.h"
+
+#include "ena-host.h"
+#include "ena-storage.h"
+#include "ena-storage-backend.h"
+
+#define TEST_WRITES (600)    // counter writes, appending more than the slots of a journal block
+#define TEST_FAULTS (2000)   // slots with cleared bits
+#define TEST_TEK_COUNT (42)  // counter not written, has to stay
+#define TEST_REWRITES (6)    // rewrites of the first block, copies alternate between scratch and journal block
+
+typedef struct
+{
+    uint32_t attempt;  // counter write in progress
+    uint32_t previous; // value before the fault
+    uint32_t value;    // value written
+    uint32_t wrong;    // reboots with a value neither old nor new
+} test_counter_journal_state_t;
+
+static test_counter_journal_state_t *state = NULL; // shared with booted processes
+
+uint32_t test_counter_journal_value(uint32_t attempt)
+{
+    // every third write increments the previous value, the others append a slot
+    if (attempt > 0 && attempt % 3 == 0)
+    {
+        return test_counter_journal_value(attempt - 1) + 1;
+    }
+    return attempt * 2654435761u;
+}
+
+size_t test_counter_journal_address(void)
+{
+    // journal blocks followed by scratch block at the end of the storage, without beacon index
+    return (ena_storage_backend_size() / ENA_STORAGE_BACKEND_BLOCK_SIZE - ENA_STORAGE_COUNTER_JOURNAL_BLOCKS - 1) * ENA_STORAGE_BACKEND_BLOCK_SIZE;
+}
+
+void test_counter_journal_check(uint32_t previous, uint32_t value)
+{
+    uint32_t count = ena_storage_counter_get(ENA_STORAGE_COUNTER_EXPOSURE_INFORMATION);
+    if ((count != previous && count != value) || ena_storage_counter_get(ENA_STORAGE_COUNTER_TEK) != TEST_TEK_COUNT)
+    {
+        state->wrong++;
+    }
+}
+
+void test_counter_journal_tek(ena_tek_t *tek)
+{
+    memset(tek, 0x5A, sizeof(ena_tek_t));
+}
+
+void test_counter_journal_erase(void *context)
+{
+    ena_storage_erase_all();
+    // a record in the block of the last exposure date, kept by its rewrites
+    ena_tek_t tek;
+    test_counter_journal_tek(&tek);
+    ena_storage_write(ENA_STORAGE_START_ADDRESS + 2 * sizeof(uint32_t), &tek, sizeof(ena_tek_t));
+    ena_storage_counter_set(ENA_STORAGE_COUNTER_TEK, TEST_TEK_COUNT);
+}
+
+void test_counter_journal_cut(void *context)
+{
+    esp_log_level_set("*", ESP_LOG_ERROR);
+    ena_host_flash_power_cut(*(uint32_t *)context);
+    for (state->attempt = 1; state->attempt < TEST_WRITES; state->attempt++)
+    {
+        ena_storage_counter_set(ENA_STORAGE_COUNTER_EXPOSURE_INFORMATION, test_counter_journal_value(state->attempt));
+    }
+}
+
+void test_counter_journal_recover(void *context)
+{
+    esp_log_level_set("*", ESP_LOG_ERROR);
+    test_counter_journal_check(test_counter_journal_value(state->attempt - 1), test_counter_journal_value(state->attempt));
+}
+
+void test_counter_journal_rewrite(void *context)
+{
+    esp_log_level_set("*", ESP_LOG_ERROR);
+    ena_host_flash_power_cut(*(uint32_t *)context);
+    for (state->attempt = 1; state->attempt <= TEST_REWRITES; state->attempt++)
+    {
+        // written over the previous date, so the block is rewritten
+        ena_storage_write_last_exposure_date(test_counter_journal_value(state->attempt));
+    }
+}
+
+void test_counter_journal_rewritten(void *context)
+{
+    esp_log_level_set("*", ESP_LOG_ERROR);
+    // the journal is mounted with the first counter, it finishes an interrupted rewrite
+    uint32_t tek_count = ena_storage_counter_get(ENA_STORAGE_COUNTER_TEK);
+    uint32_t date = ena_storage_read_last_exposure_date();
+    ena_tek_t tek, expected;
+    test_counter_journal_tek(&expected);
+    ena_storage_read(ENA_STORAGE_START_ADDRESS + 2 * sizeof(uint32_t), &tek, sizeof(ena_tek_t));
+    if ((date != test_counter_journal_value(state->attempt - 1) && date != test_counter_journal_value(state->attempt)) ||
+        memcmp(&tek, &expected, sizeof(ena_tek_t)) != 0 || tek_count != TEST_TEK_COUNT)
+    {
+        state->wrong++;
+    }
+}
+
+void test_counter_journal_fault(void *context)
+{
+    esp_log_level_set("*", ESP_LOG_ERROR);
+    uint32_t trial = *(uint32_t *)context;
+    srand(trial);
+    state->previous = ena_storage_counter_get(ENA_STORAGE_COUNTER_EXPOSURE_INFORMATION);
+    state->value = test_counter_journal_value(TEST_WRITES + 1 + trial * 3);
+    ena_storage_counter_set(ENA_STORAGE_COUNTER_EXPOSURE_INFORMATION, state->value);
+
+    // clear bits of value, counter or check of the slot, a flash cell losing charge
+    ena_storage_counter_slot_t slot;
+    for (size_t i = 0; i < ENA_STORAGE_COUNTER_JOURNAL_BLOCKS * (ENA_STORAGE_BACKEND_BLOCK_SIZE / sizeof(ena_storage_counter_slot_t)); i++)
+    {
+        size_t address = test_counter_journal_address() + (i / (ENA_STORAGE_BACKEND_BLOCK_SIZE / sizeof(ena_storage_counter_slot_t))) * ENA_STORAGE_BACKEND_BLOCK_SIZE +
+                         (i % (ENA_STORAGE_BACKEND_BLOCK_SIZE / sizeof(ena_storage_counter_slot_t))) * sizeof(ena_storage_counter_slot_t);
+        ESP_ERROR_CHECK(ena_storage_backend_read(address, &slot, sizeof(ena_storage_counter_slot_t)));
+        if (slot.counter == ENA_STORAGE_COUNTER_EXPOSURE_INFORMATION && slot.value == state->value)
+        {
+            uint8_t mask[sizeof(ena_storage_counter_slot_t)];
+            memset(mask, 0xFF, sizeof(mask));
+            uint32_t bits = 1 + rand() % 4;
+            for (uint32_t i = 0; i < bits; i++)
+            {
+                uint32_t bit = rand() % (sizeof(uint32_t) + sizeof(uint8_t) + sizeof(uint32_t)) * 8;
+                // skip reserved byte and increments, neither is part of the check
+                size_t byte = bit / 8 < 5 ? bit / 8 : bit / 8 + 3;
+                mask[byte] &= ~(1 << (bit % 8));
+            }
+            ESP_ERROR_CHECK(ena_storage_backend_write(address, mask, sizeof(mask)));
+            return;
+        }
+    }
+    ENA_HOST_CHECK(false);
+}
+
+void test_counter_journal_faulted(void *context)
+{
+    esp_log_level_set("*", ESP_LOG_ERROR);
+    test_counter_journal_check(state->previous, state->value);
+}
+
+int main(void)
+{
+    ena_storage_backend_t backend;
+    ESP_ERROR_CHECK(ena_host_flash_init(&backend, ENA_HOST_FLASH_SIZE));
+    ena_storage_backend_set(&backend);
+    state = mmap(NULL, sizeof(test_counter_journal_state_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    // cut every flash operation of the writes until they complete
+    uint32_t cuts = 0;
+    for (uint32_t operation = 1;; operation++, cuts++)
+    {
+        ENA_HOST_CHECK(ena_host_boot(&test_counter_journal_erase, NULL) == 0);
+        if (ena_host_boot(&test_counter_journal_cut, &operation) != ENA_HOST_POWER_CUT_EXIT)
+        {
+            break;
+        }
+        ENA_HOST_CHECK(ena_host_boot(&test_counter_journal_recover, NULL) == 0);
+    }
+    printf("counter writes cut at %u flash operations\n", cuts);
+    ENA_HOST_CHECK(cuts >= TEST_WRITES - 1);
+    ENA_HOST_CHECK(state->wrong == 0);
+
+    // cut every flash operation of the block rewrites until they complete
+    cuts = 0;
+    for (uint32_t operation = 1;; operation++, cuts++)
+    {
+        ENA_HOST_CHECK(ena_host_boot(&test_counter_journal_erase, NULL) == 0);
+        if (ena_host_boot(&test_counter_journal_rewrite, &operation) != ENA_HOST_POWER_CUT_EXIT)
+        {
+            break;
+        }
+        ENA_HOST_CHECK(ena_host_boot(&test_counter_journal_rewritten, NULL) == 0);
+    }
+    printf("block rewrites cut at %u flash operations\n", cuts);
+    ENA_HOST_CHECK(state->wrong == 0);
+
+    // copies of the complete rewrites are spread over the scratch block and the journal block rotated to next
+    size_t scratch = test_counter_journal_address() + ENA_STORAGE_COUNTER_JOURNAL_BLOCKS * ENA_STORAGE_BACKEND_BLOCK_SIZE;
+    uint32_t scratch_erases = ena_host_flash_block_erases(scratch);
+    uint32_t journal_erases = 0;
+    for (uint32_t block = 0; block < ENA_STORAGE_COUNTER_JOURNAL_BLOCKS; block++)
+    {
+        journal_erases += ena_host_flash_block_erases(test_counter_journal_address() + block * ENA_STORAGE_BACKEND_BLOCK_SIZE);
+    }
+    uint32_t none = 0;
+    ENA_HOST_CHECK(ena_host_boot(&test_counter_journal_rewrite, &none) == 0);
+    for (uint32_t block = 0; block < ENA_STORAGE_COUNTER_JOURNAL_BLOCKS; block++)
+    {
+        journal_erases -= ena_host_flash_block_erases(test_counter_journal_address() + block * ENA_STORAGE_BACKEND_BLOCK_SIZE);
+    }
+    ENA_HOST_CHECK(ena_host_flash_block_erases(scratch) - scratch_erases == TEST_REWRITES / 2);
+    ENA_HOST_CHECK(-journal_erases == TEST_REWRITES / 2);
+
+    // clear bits of the newest slot
+    for (uint32_t i = 0; i < TEST_FAULTS; i++)
+    {
+        ENA_HOST_CHECK(ena_host_boot(&test_counter_journal_fault, &i) == 0);
+        ENA_HOST_CHECK(ena_host_boot(&test_counter_journal_faulted, NULL) == 0);
+    }
+    printf("%u of %u slots with cleared bits read as a wrong value\n", state->wrong, TEST_FAULTS);
+    ENA_HOST_CHECK(state->wrong == 0);
+
+    return ena_host_result();
+}
\ No newline at end of file
@@ -0,0 +1,259 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * sync checkpoint: a day of several pages, each with one key seen before, is synced from the stand-in server with
+ * a power cut at every flash operation of the sync and with a dropped connection, then resumed after the reboot.
+ * The checkpoint block is almost full, so the cuts also hit its rotation. Every run stores the exposure
+ * information of the uninterrupted sync once and fetches at most the pages in flight again.
+ *
+ * Built with the counter journal, without it a cut during a block rewrite can lose the counters of that block.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_system.h"
+
+#include "ena-host.h"
+#include "ena-crypto.h"
+#include "ena-storage.h"
+#include "ena-storage-backend.h"
+#include "ena-eke-proxy.h"
+
+#define TEST_DAY (86400)
+#define TEST_START (1600041600)                  // start of the synced day
+#define TEST_NOW (TEST_START + TEST_DAY + 600)   // ten minutes into the next day, nothing hourly to sync
+#define TEST_PAGES (4)                           // full pages of keys of the day
+#define TEST_MATCH (123)                         // key of every page with a stored beacon
+#define TEST_BEACONS (500)                       // other beacons of the day
+#define TEST_SEGMENT (1024)                      // bytes of a read
+#define TEST_DROP_OFFSET (5000)                  // offset of the dropped connection in page 2
+#ifdef CONFIG_ENA_EKE_PROXY_PIPELINE
+#define TEST_IN_FLIGHT (ENA_EKE_PROXY_PIPELINE_PAGES) // pages requested before their checkpoint
+#else
+#define TEST_IN_FLIGHT (1)
+#endif
+
+typedef struct
+{
+    uint32_t cut;         // flash operation of the sync to cut, 0 for none
+    bool drop;            // drop the connection once in page 2
+    bool cut_done;        // the sync lost power
+    uint32_t operations;  // flash operations of the sync without cut
+    uint32_t pages;       // pages answered with keys, over all boots
+    uint32_t records;     // stored exposure information after the sync
+    uint32_t minutes;     // total duration of the stored exposure information
+    uint32_t date;        // last exposure date after the sync
+} test_eke_proxy_checkpoint_state_t;
+
+static test_eke_proxy_checkpoint_state_t *state = NULL; // shared with booted processes
+static bool test_dropped = false;
+
+void test_eke_proxy_checkpoint_key(uint32_t page, uint32_t i, uint8_t *record)
+{
+    uint32_t rolling_start = ena_crypto_enin(TEST_START);
+    uint32_t rolling_period = ENA_TEK_ROLLING_PERIOD;
+    memset(record, 0, ENA_EKE_PROXY_KEY_SIZE);
+    uint32_t hash = (page * ENA_EKE_PROXY_DEFAULT_LIMIT + i) * 2654435761u;
+    memcpy(record, &hash, sizeof(hash));
+    memcpy(&record[4], &page, sizeof(page));
+    memcpy(&record[8], &i, sizeof(i));
+    memcpy(&record[ENA_KEY_LENGTH], &rolling_start, 4);
+    memcpy(&record[ENA_KEY_LENGTH + 4], &rolling_period, 4);
+}
+
+int test_eke_proxy_checkpoint_open(const char *url, int *length)
+{
+    if (strstr(url, "/hour/") != NULL || atoi(strstr(url, "page=") + 5) >= TEST_PAGES)
+    {
+        return 204;
+    }
+    state->pages++;
+    *length = ENA_EKE_PROXY_DEFAULT_LIMIT * ENA_EKE_PROXY_KEY_SIZE;
+    return 200;
+}
+
+int test_eke_proxy_checkpoint_read(const char *url, size_t offset, uint8_t *data, size_t length)
+{
+    uint32_t page = atoi(strstr(url, "page=") + 5);
+    if (state->drop && !test_dropped && page == 2 && offset >= TEST_DROP_OFFSET)
+    {
+        test_dropped = true;
+        return -1;
+    }
+    size_t end = ENA_EKE_PROXY_DEFAULT_LIMIT * ENA_EKE_PROXY_KEY_SIZE;
+    if (offset + length > end)
+    {
+        length = end - offset;
+    }
+    uint8_t record[ENA_EKE_PROXY_KEY_SIZE];
+    for (size_t i = 0; i < length; i++)
+    {
+        if (i == 0 || (offset + i) % ENA_EKE_PROXY_KEY_SIZE == 0)
+        {
+            test_eke_proxy_checkpoint_key(page, (offset + i) / ENA_EKE_PROXY_KEY_SIZE, record);
+        }
+        data[i] = record[(offset + i) % ENA_EKE_PROXY_KEY_SIZE];
+    }
+    return length;
+}
+
+void test_eke_proxy_checkpoint_fill(void)
+{
+    ena_storage_erase_all();
+    ena_host_random_seed(1);
+    uint32_t enin = ena_crypto_enin(TEST_START);
+    ena_beacon_t beacon = {.rssi = -80};
+    for (uint32_t i = 0; i < TEST_BEACONS; i++)
+    {
+        esp_fill_random(beacon.rpi, ENA_KEY_LENGTH);
+        esp_fill_random(beacon.aem, ENA_AEM_METADATA_LENGTH);
+        beacon.timestamp_first = TEST_START + i * (TEST_DAY / TEST_BEACONS);
+        beacon.timestamp_last = beacon.timestamp_first + 300;
+        ena_storage_add_beacon(&beacon);
+    }
+    // planted key of every page seen for 10 minutes at its own interval
+    uint8_t record[ENA_EKE_PROXY_KEY_SIZE];
+    uint8_t rpik[ENA_KEY_LENGTH];
+    for (uint32_t page = 0; page < TEST_PAGES; page++)
+    {
+        uint32_t interval = enin + 10 + page * 10;
+        test_eke_proxy_checkpoint_key(page, TEST_MATCH, record);
+        ena_crypto_derive_keys(record, rpik, NULL);
+        ena_crypto_rpi(beacon.rpi, rpik, interval);
+        beacon.rssi = -60;
+        beacon.timestamp_first = interval * ENA_TIME_WINDOW + 30;
+        beacon.timestamp_last = beacon.timestamp_first + 600;
+        ena_storage_add_beacon(&beacon);
+    }
+    ena_storage_write_last_exposure_date(TEST_START);
+
+    // checkpoint block almost full, the sync rotates it
+    ena_eke_proxy_checkpoint_t checkpoint = {0};
+    for (uint32_t i = 0; i < ENA_STORAGE_BACKEND_BLOCK_SIZE / sizeof(ena_storage_sync_checkpoint_slot_t) - 4; i++)
+    {
+        ena_storage_write_sync_checkpoint(&checkpoint, sizeof(ena_eke_proxy_checkpoint_t));
+    }
+    ena_storage_flush();
+}
+
+void test_eke_proxy_checkpoint_sync(void)
+{
+    ena_host_http_server_t server = {
+        .open = &test_eke_proxy_checkpoint_open,
+        .read = &test_eke_proxy_checkpoint_read,
+        .segment_size = TEST_SEGMENT,
+    };
+    ena_host_http_set_server(&server);
+    ena_eke_proxy_start();
+    while (ena_storage_read_last_exposure_date() < TEST_NOW - TEST_NOW % TEST_DAY || ena_eke_proxy_get_state() != ENA_EKE_PROXY_STATE_IDLE)
+    {
+        if (ena_eke_proxy_get_state() == ENA_EKE_PROXY_STATE_IDLE)
+        {
+            // sleep after the dropped connection passes
+            ena_host_clock_advance(10);
+        }
+        vTaskDelay(5 / portTICK_PERIOD_MS);
+    }
+}
+
+void test_eke_proxy_checkpoint_first(void *context)
+{
+    esp_log_level_set("*", ESP_LOG_ERROR);
+    ena_host_clock_set(TEST_NOW);
+    ena_crypto_init();
+    test_eke_proxy_checkpoint_fill();
+
+    uint32_t operations = ena_host_flash_operations();
+    state->cut_done = state->cut > 0;
+    ena_host_flash_power_cut(state->cut);
+    test_eke_proxy_checkpoint_sync();
+    ena_host_flash_power_cut(0);
+    state->cut_done = false;
+    state->operations = ena_host_flash_operations() - operations;
+}
+
+void test_eke_proxy_checkpoint_resume(void *context)
+{
+    esp_log_level_set("*", ESP_LOG_ERROR);
+    ena_host_clock_set(TEST_NOW);
+    ena_crypto_init();
+    test_eke_proxy_checkpoint_sync();
+
+    state->records = ena_storage_exposure_information_count();
+    state->minutes = 0;
+    ena_exposure_information_t exposure_info;
+    for (uint32_t i = 0; i < state->records; i++)
+    {
+        ena_storage_get_exposure_information(i, &exposure_info);
+        state->minutes += exposure_info.duration_minutes;
+    }
+    state->date = ena_storage_read_last_exposure_date();
+}
+
+void test_eke_proxy_checkpoint_run(uint32_t cut, bool drop)
+{
+    state->cut = cut;
+    state->drop = drop;
+    state->pages = 0;
+    int status = ena_host_boot(&test_eke_proxy_checkpoint_first, NULL);
+    ENA_HOST_CHECK(status == 0 || (status == ENA_HOST_POWER_CUT_EXIT && state->cut_done));
+    ENA_HOST_CHECK(ena_host_boot(&test_eke_proxy_checkpoint_resume, NULL) == 0);
+}
+
+int main(void)
+{
+    ena_storage_backend_t backend;
+    ESP_ERROR_CHECK(ena_host_flash_init(&backend, ENA_HOST_FLASH_SIZE));
+    ena_storage_backend_set(&backend);
+    state = mmap(NULL, sizeof(test_eke_proxy_checkpoint_state_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    // uninterrupted sync
+    test_eke_proxy_checkpoint_run(0, false);
+    test_eke_proxy_checkpoint_state_t expected = *state;
+    ENA_HOST_CHECK(expected.records == TEST_PAGES);
+    ENA_HOST_CHECK(expected.pages == TEST_PAGES);
+    ENA_HOST_CHECK(expected.date == TEST_NOW - TEST_NOW % TEST_DAY);
+    ENA_HOST_CHECK(expected.operations > 0);
+
+    // dropped connection, retried from the checkpoint of page 1
+    test_eke_proxy_checkpoint_run(0, true);
+    ENA_HOST_CHECK(state->records == expected.records && state->minutes == expected.minutes);
+    ENA_HOST_CHECK(state->pages == TEST_PAGES + 1);
+
+    uint32_t wrong = 0;
+    uint32_t pages_max = 0;
+    for (uint32_t cut = 1; cut <= expected.operations; cut++)
+    {
+        test_eke_proxy_checkpoint_run(cut, false);
+        if (state->records != expected.records || state->minutes != expected.minutes || state->date != expected.date || state->pages > TEST_PAGES + TEST_IN_FLIGHT)
+        {
+            printf("power cut at flash operation %u: %u exposure information (%u minutes), %u pages fetched\n", cut, state->records, state->minutes, state->pages);
+            wrong++;
+        }
+        if (state->pages > pages_max)
+        {
+            pages_max = state->pages;
+        }
+    }
+    ENA_HOST_CHECK(wrong == 0);
+    printf("%u power cuts during a sync of %u pages: %u exposure information each, at most %u pages fetched\n",
+           expected.operations, TEST_PAGES, expected.records, pages_max);
+
+    return ena_host_result();
+}
\ No newline at end of file
@@ -0,0 +1,245 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * key digests: the first hours of a day are synced hourly from the stand-in server, then the daily request of the
+ * day returns the keys of these hours again together with keys published later. Built with and without
+ * CONFIG_ENA_STORAGE_KEY_DIGESTS, with the stand-in crypto counting the derivations.
+ *
+ * With digests the keys of the hours are skipped in the daily request, so it derives the RPIK and RPIs only of the
+ * later keys and stores the exposure information of a key of the hours once. Without them every key of the daily
+ * request is derived again and the key of the hours matches a second time. A sync interrupted after the digests of
+ * a page counts the keys of the page, not its digests, on resume. The hourly sync runs its steps in the test, no
+ * step derives more than the keys read or matched in one.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_system.h"
+
+#include "ena-host.h"
+#include "ena-crypto.h"
+#include "ena-storage.h"
+#include "ena-storage-backend.h"
+#include "ena-eke-proxy.h"
+
+#define TEST_DAY (86400)
+#define TEST_HOUR (3600)
+#define TEST_START (1600041600)   // start of the synced day
+#define TEST_HOURS (3)            // hours synced hourly, a full page each
+#define TEST_PAGES (4)            // full pages of the daily request, the keys of the hours first
+#define TEST_MATCH_HOURLY (123)   // key of hour 0 with a stored beacon
+#define TEST_MATCH_DAILY (TEST_HOURS * ENA_EKE_PROXY_DEFAULT_LIMIT + 123) // key published after the hours with a stored beacon
+#define TEST_BEACONS (200)        // other beacons of the day
+#define TEST_RESUMED_KEYS (7)     // keys of a page finished before an interruption, one of them with a digest
+
+static uint32_t test_hourly_pages = 0;
+static uint32_t test_daily_pages = 0;
+
+void test_eke_proxy_digests_key(uint32_t index, uint8_t *record)
+{
+    uint32_t rolling_start = ena_crypto_enin(TEST_START);
+    uint32_t rolling_period = ENA_TEK_ROLLING_PERIOD;
+    memset(record, 0, ENA_EKE_PROXY_KEY_SIZE);
+    uint32_t hash = index * 2654435761u;
+    memcpy(record, &hash, sizeof(hash));
+    memcpy(&record[4], &index, sizeof(index));
+    memcpy(&record[ENA_KEY_LENGTH], &rolling_start, 4);
+    memcpy(&record[ENA_KEY_LENGTH + 4], &rolling_period, 4);
+}
+
+int test_eke_proxy_digests_open(const char *url, int *length)
+{
+    uint32_t page = atoi(strstr(url, "page=") + 5);
+    const char *hour = strstr(url, "/hour/");
+    if (hour != NULL)
+    {
+        if (page > 0 || atoi(hour + 6) >= TEST_HOURS)
+        {
+            return 204;
+        }
+        test_hourly_pages++;
+    }
+    else
+    {
+        if (page >= TEST_PAGES)
+        {
+            return 204;
+        }
+        test_daily_pages++;
+    }
+    *length = ENA_EKE_PROXY_DEFAULT_LIMIT * ENA_EKE_PROXY_KEY_SIZE;
+    return 200;
+}
+
+int test_eke_proxy_digests_read(const char *url, size_t offset, uint8_t *data, size_t length)
+{
+    // keys of an hour are the page of the same number of the daily request
+    const char *hour = strstr(url, "/hour/");
+    uint32_t page = hour != NULL ? atoi(hour + 6) : atoi(strstr(url, "page=") + 5);
+    size_t end = ENA_EKE_PROXY_DEFAULT_LIMIT * ENA_EKE_PROXY_KEY_SIZE;
+    if (offset + length > end)
+    {
+        length = end - offset;
+    }
+    uint8_t record[ENA_EKE_PROXY_KEY_SIZE];
+    for (size_t i = 0; i < length; i++)
+    {
+        if (i == 0 || (offset + i) % ENA_EKE_PROXY_KEY_SIZE == 0)
+        {
+            test_eke_proxy_digests_key(page * ENA_EKE_PROXY_DEFAULT_LIMIT + (offset + i) / ENA_EKE_PROXY_KEY_SIZE, record);
+        }
+        data[i] = record[(offset + i) % ENA_EKE_PROXY_KEY_SIZE];
+    }
+    return length;
+}
+
+void test_eke_proxy_digests_plant(uint32_t index, uint32_t interval)
+{
+    uint8_t record[ENA_EKE_PROXY_KEY_SIZE];
+    uint8_t rpik[ENA_KEY_LENGTH];
+    ena_beacon_t beacon = {.rssi = -60};
+    test_eke_proxy_digests_key(index, record);
+    ena_crypto_derive_keys(record, rpik, NULL);
+    ena_crypto_rpi(beacon.rpi, rpik, interval);
+    beacon.timestamp_first = interval * ENA_TIME_WINDOW + 30;
+    beacon.timestamp_last = beacon.timestamp_first + 600;
+    ena_storage_add_beacon(&beacon);
+}
+
+void test_eke_proxy_digests_fill(void)
+{
+    ena_storage_erase_all();
+    ena_host_random_seed(1);
+    uint32_t enin = ena_crypto_enin(TEST_START);
+    ena_beacon_t beacon = {.rssi = -80};
+    for (uint32_t i = 0; i < TEST_BEACONS; i++)
+    {
+        esp_fill_random(beacon.rpi, ENA_KEY_LENGTH);
+        esp_fill_random(beacon.aem, ENA_AEM_METADATA_LENGTH);
+        beacon.timestamp_first = TEST_START + i * (TEST_DAY / TEST_BEACONS);
+        beacon.timestamp_last = beacon.timestamp_first + 300;
+        ena_storage_add_beacon(&beacon);
+    }
+    test_eke_proxy_digests_plant(TEST_MATCH_HOURLY, enin + 10);
+    test_eke_proxy_digests_plant(TEST_MATCH_DAILY, enin + 100);
+    ena_storage_write_last_exposure_date(TEST_START);
+    ena_storage_flush();
+}
+
+void test_eke_proxy_digests_sync(uint32_t now, uint32_t date, ena_eke_proxy_stats_t *stats, uint32_t *derivations, uint32_t *step_max)
+{
+    ena_eke_proxy_stats_t before;
+    ena_eke_proxy_get_stats(&before);
+    uint32_t derived = ena_host_crypto_derivations();
+    ena_host_clock_set(now);
+    while (ena_storage_read_last_exposure_date() < date || ena_eke_proxy_get_state() != ENA_EKE_PROXY_STATE_IDLE)
+    {
+        if (step_max == NULL)
+        {
+            vTaskDelay(5 / portTICK_PERIOD_MS);
+            continue;
+        }
+        // sync task not started yet, each step runs here to count its derivations
+        uint32_t step = ena_host_crypto_derivations();
+        ena_eke_proxy_run();
+        step = ena_host_crypto_derivations() - step;
+        if (step > *step_max)
+        {
+            *step_max = step;
+        }
+    }
+    ena_eke_proxy_get_stats(stats);
+    stats->keys -= before.keys;
+    stats->duplicates -= before.duplicates;
+    stats->dropped -= before.dropped;
+    *derivations = ena_host_crypto_derivations() - derived;
+}
+
+int main(void)
+{
+    ena_storage_backend_t backend;
+    ESP_ERROR_CHECK(ena_host_flash_init(&backend, ENA_HOST_FLASH_SIZE));
+    ena_storage_backend_set(&backend);
+    esp_log_level_set("*", ESP_LOG_ERROR);
+
+    ena_host_http_server_t server = {
+        .open = &test_eke_proxy_digests_open,
+        .read = &test_eke_proxy_digests_read,
+    };
+    ena_host_http_set_server(&server);
+    ena_host_clock_set(TEST_START);
+    ena_crypto_init();
+    test_eke_proxy_digests_fill();
+
+    // ten minutes after the hours, each synced with its own request
+    ena_eke_proxy_stats_t hourly, daily;
+    uint32_t hourly_derivations, daily_derivations;
+    uint32_t step_max = 0;
+    test_eke_proxy_digests_sync(TEST_START + TEST_HOURS * TEST_HOUR + 600, TEST_START + TEST_HOURS * TEST_HOUR, &hourly, &hourly_derivations, &step_max);
+    uint32_t hourly_records = ena_storage_exposure_information_count();
+    ENA_HOST_CHECK(step_max > 0 && step_max <= ENA_EKE_PROXY_READ_KEYS);
+    ENA_HOST_CHECK(test_hourly_pages == TEST_HOURS);
+    ENA_HOST_CHECK(hourly.keys == TEST_HOURS * ENA_EKE_PROXY_DEFAULT_LIMIT);
+    ENA_HOST_CHECK(hourly.duplicates == 0 && hourly.dropped == 0);
+    ENA_HOST_CHECK(hourly_derivations == hourly.keys);
+    ENA_HOST_CHECK(hourly_records == 1);
+    ena_eke_proxy_start();
+
+    // ten minutes into the next day, the whole day is requested
+    test_eke_proxy_digests_sync(TEST_START + TEST_DAY + 600, TEST_START + TEST_DAY, &daily, &daily_derivations, NULL);
+    uint32_t records = ena_storage_exposure_information_count();
+    ENA_HOST_CHECK(test_daily_pages == TEST_PAGES);
+    ENA_HOST_CHECK(daily.keys == TEST_PAGES * ENA_EKE_PROXY_DEFAULT_LIMIT);
+    ENA_HOST_CHECK(daily.dropped == 0);
+    ENA_HOST_CHECK(daily_derivations == daily.keys - daily.duplicates);
+#ifdef CONFIG_ENA_STORAGE_KEY_DIGESTS
+    const char *mode = "key digests";
+    ENA_HOST_CHECK(daily.duplicates == hourly.keys);
+    ENA_HOST_CHECK(records == 2);
+#else
+    const char *mode = "no digests";
+    ENA_HOST_CHECK(daily.duplicates == 0);
+    ENA_HOST_CHECK(records == 3);
+#endif
+    printf("%-11s: %u hourly keys, %u RPIK derivations, at most %u a step; %u daily keys, %u skipped, %u RPIK derivations (%u RPIs); %u exposure information\n",
+           mode, hourly.keys, hourly_derivations, step_max, daily.keys, daily.duplicates, daily_derivations, daily_derivations * ENA_TEK_ROLLING_PERIOD, records);
+
+#ifdef CONFIG_ENA_STORAGE_KEY_DIGESTS
+    // interrupted after the digests of the first page of the next day's first hour, fewer digests than keys stored
+    uint32_t next_day = TEST_START + TEST_DAY;
+    ena_eke_proxy_checkpoint_t checkpoint = {
+        .magic = ENA_EKE_PROXY_CHECKPOINT_MAGIC,
+        .date = next_day,
+        .hour = 0,
+        .exposure_information = records,
+        .key_digests = ena_storage_key_digests_count(next_day),
+        .page_keys = TEST_RESUMED_KEYS,
+    };
+    ena_storage_write_sync_checkpoint(&checkpoint, sizeof(ena_eke_proxy_checkpoint_t));
+    uint64_t digest = 1;
+    ena_storage_add_key_digests(next_day, &digest, 1);
+    ena_eke_proxy_stats_t resumed;
+    uint32_t resumed_derivations;
+    test_eke_proxy_digests_sync(next_day + TEST_HOUR + 600, next_day + TEST_HOUR, &resumed, &resumed_derivations, NULL);
+    ena_storage_read_sync_checkpoint(&checkpoint, sizeof(ena_eke_proxy_checkpoint_t));
+    ENA_HOST_CHECK(checkpoint.date == next_day && checkpoint.page == 1);
+    ENA_HOST_CHECK(checkpoint.keys == TEST_RESUMED_KEYS && checkpoint.page_keys == 0);
+#endif
+
+    return ena_host_result();
+}
\ No newline at end of file
@@ -0,0 +1,183 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * streaming key parser: the stand-in server answers with a page of 10k keys, chunked and with content length,
+ * in segments splitting key records. Every key is checked, the planted one matches, and the heap used while
+ * receiving does not grow with the page.
+ */
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "ena-host.h"
+#include "ena-crypto.h"
+#include "ena-storage.h"
+#include "ena-storage-backend.h"
+#include "ena-eke-proxy.h"
+
+#define TEST_START (1600041600)  // start of the synced day, hour 0 is requested
+#define TEST_KEYS (10000)        // keys of the large page
+#define TEST_SMALL_KEYS (1000)   // keys of the page to compare the heap with
+#define TEST_MATCH (5001)        // key with a stored beacon, its record is split by the segments
+#define TEST_SEGMENT (61)        // bytes of a read, not a multiple of the key size
+
+typedef struct
+{
+    uint32_t keys;  // keys of the page
+    bool chunked;   // chunked response, content length otherwise
+    size_t segment; // maximum bytes of a read, 0 for unlimited
+} test_eke_proxy_stream_case_t;
+
+static uint32_t test_keys = 0;
+static bool test_chunked = false;
+static size_t heap_base = 0;
+static size_t *heap_peak = NULL; // shared with the booted device
+
+void test_eke_proxy_stream_key(uint32_t i, uint8_t *record)
+{
+    uint32_t rolling_start = ena_crypto_enin(TEST_START);
+    uint32_t rolling_period = ENA_TEK_ROLLING_PERIOD;
+    memset(record, 0, ENA_EKE_PROXY_KEY_SIZE);
+    uint32_t hash = i * 2654435761u;
+    memcpy(record, &hash, sizeof(hash));
+    memcpy(&record[4], &i, sizeof(i));
+    memcpy(&record[ENA_KEY_LENGTH], &rolling_start, 4);
+    memcpy(&record[ENA_KEY_LENGTH + 4], &rolling_period, 4);
+}
+
+size_t test_eke_proxy_stream_heap(void)
+{
+    return mallinfo2().uordblks;
+}
+
+int test_eke_proxy_stream_open(const char *url, int *length)
+{
+    if (atoi(strstr(url, "page=") + 5) > 0)
+    {
+        return 204;
+    }
+    *length = test_chunked ? -1 : test_keys * ENA_EKE_PROXY_KEY_SIZE;
+    return 200;
+}
+
+int test_eke_proxy_stream_read(const char *url, size_t offset, uint8_t *data, size_t length)
+{
+    size_t used = test_eke_proxy_stream_heap() - heap_base;
+    if (used > *heap_peak)
+    {
+        *heap_peak = used;
+    }
+
+    size_t end = test_keys * ENA_EKE_PROXY_KEY_SIZE;
+    if (offset + length > end)
+    {
+        length = end - offset;
+    }
+    uint8_t record[ENA_EKE_PROXY_KEY_SIZE];
+    for (size_t i = 0; i < length; i++)
+    {
+        if (i == 0 || (offset + i) % ENA_EKE_PROXY_KEY_SIZE == 0)
+        {
+            test_eke_proxy_stream_key((offset + i) / ENA_EKE_PROXY_KEY_SIZE, record);
+        }
+        data[i] = record[(offset + i) % ENA_EKE_PROXY_KEY_SIZE];
+    }
+    return length;
+}
+
+void test_eke_proxy_stream_device(void *context)
+{
+    test_eke_proxy_stream_case_t *test_case = context;
+    ena_host_http_server_t server = {
+        .open = &test_eke_proxy_stream_open,
+        .read = &test_eke_proxy_stream_read,
+        .segment_size = test_case->segment,
+    };
+    test_keys = test_case->keys;
+    test_chunked = test_case->chunked;
+    // a single arena, so mallinfo2 counts the allocations of all tasks
+    mallopt(M_ARENA_MAX, 1);
+    ena_host_http_set_server(&server);
+    ena_host_clock_set(TEST_START + 2 * 60 * 60);
+    ena_crypto_init();
+    ena_storage_erase_exposure_information();
+    ena_storage_write_last_exposure_date(TEST_START);
+    // every case syncs hour 0 from its first page
+    ena_eke_proxy_checkpoint_t checkpoint = {0};
+    ena_storage_write_sync_checkpoint(&checkpoint, sizeof(ena_eke_proxy_checkpoint_t));
+
+    heap_base = test_eke_proxy_stream_heap();
+    *heap_peak = 0;
+    ena_eke_proxy_start();
+    // hour 0 is finished after all keys are matched, nothing left to sync afterwards
+    while (ena_storage_read_last_exposure_date() == TEST_START || ena_eke_proxy_get_state() != ENA_EKE_PROXY_STATE_IDLE)
+    {
+        vTaskDelay(10 / portTICK_PERIOD_MS);
+    }
+
+    ena_eke_proxy_stats_t stats;
+    ena_eke_proxy_get_stats(&stats);
+    ENA_HOST_CHECK(stats.keys == test_case->keys);
+    ENA_HOST_CHECK(stats.bytes == test_case->keys * ENA_EKE_PROXY_KEY_SIZE);
+    ENA_HOST_CHECK(ena_storage_read_last_exposure_date() == TEST_START + 60 * 60);
+    ENA_HOST_CHECK(ena_storage_exposure_information_count() == (test_case->keys > TEST_MATCH ? 1 : 0));
+    printf("%5u keys, %-14s, segment %4zu: %u requests, %u bytes, peak heap while receiving %zu bytes\n",
+           stats.keys, test_case->chunked ? "chunked" : "content length", test_case->segment, stats.requests, stats.bytes, *heap_peak);
+}
+
+int main(void)
+{
+    ena_storage_backend_t backend;
+    ESP_ERROR_CHECK(ena_host_flash_init(&backend, ENA_HOST_FLASH_SIZE));
+    ena_storage_backend_set(&backend);
+    ena_crypto_init();
+    ena_storage_erase_all();
+    heap_peak = mmap(NULL, sizeof(size_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    // beacon of the planted key seen at interval 10 of the day
+    uint8_t record[ENA_EKE_PROXY_KEY_SIZE];
+    uint8_t rpik[ENA_KEY_LENGTH];
+    uint32_t enin = ena_crypto_enin(TEST_START);
+    ena_beacon_t beacon = {.timestamp_first = (enin + 10) * ENA_TIME_WINDOW + 30, .timestamp_last = (enin + 10) * ENA_TIME_WINDOW + 630, .rssi = -60};
+    test_eke_proxy_stream_key(TEST_MATCH, record);
+    ena_crypto_derive_keys(record, rpik, NULL);
+    ena_crypto_rpi(beacon.rpi, rpik, enin + 10);
+    ena_storage_add_beacon(&beacon);
+    ena_storage_flush();
+
+    test_eke_proxy_stream_case_t cases[] = {
+        {TEST_KEYS, false, 0},
+        {TEST_KEYS, false, TEST_SEGMENT},
+        {TEST_KEYS, true, 0},
+        {TEST_KEYS, true, TEST_SEGMENT},
+        {TEST_SMALL_KEYS, true, TEST_SEGMENT},
+    };
+    size_t peaks[sizeof(cases) / sizeof(cases[0])];
+    for (int i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        ENA_HOST_CHECK(ena_host_boot(&test_eke_proxy_stream_device, &cases[i]) == 0);
+        peaks[i] = *heap_peak;
+    }
+
+    // heap while receiving depends on the read size, not on the keys of the page
+    ENA_HOST_CHECK(peaks[3] <= peaks[4] + 1024);
+    ENA_HOST_CHECK(peaks[2] < TEST_KEYS * ENA_EKE_PROXY_KEY_SIZE / 4);
+
+    return ena_host_result();
+}
\ No newline at end of file
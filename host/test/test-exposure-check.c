@@ -0,0 +1,120 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * batch exposure check: matches within the clock skew, keys with invalid intervals from the key server, more
+ * matching key-days in one batch than pending without heap, each sent twice
+ */
+#include <string.h>
+
+#include "esp_system.h"
+
+#include "ena-host.h"
+#include "ena-crypto.h"
+#include "ena-storage.h"
+#include "ena-storage-backend.h"
+#include "ena-exposure.h"
+
+#define TEST_START (1600041600)
+#define TEST_KEY_DAYS (ENA_EXPOSURE_CHECK_PENDING_MAX + 8) // matching keys of one batch
+
+void test_exposure_check_key(uint8_t seed, uint32_t rolling_start, uint32_t rolling_period, ena_temporary_exposure_key_t *key)
+{
+    memset(key, 0, sizeof(ena_temporary_exposure_key_t));
+    memset(key->key_data, seed, ENA_KEY_LENGTH);
+    key->rolling_start_interval_number = rolling_start;
+    key->rolling_period = rolling_period;
+}
+
+void test_exposure_check_beacon(ena_temporary_exposure_key_t *key, uint32_t enin, uint32_t timestamp)
+{
+    uint8_t rpik[ENA_KEY_LENGTH];
+    ena_beacon_t beacon = {.timestamp_first = timestamp, .timestamp_last = timestamp + 600, .rssi = -60};
+    ena_crypto_derive_keys(key->key_data, rpik, NULL);
+    ena_crypto_rpi(beacon.rpi, rpik, enin);
+    ena_storage_add_beacon(&beacon);
+}
+
+uint32_t test_exposure_check(ena_temporary_exposure_key_t *key)
+{
+    ena_storage_erase_exposure_information();
+    ena_exposure_check_temporary_exposure_keys(key, 1);
+    return ena_storage_exposure_information_count();
+}
+
+int main(void)
+{
+    ena_storage_backend_t backend;
+    ESP_ERROR_CHECK(ena_host_flash_init(&backend, ENA_HOST_FLASH_SIZE));
+    ena_storage_backend_set(&backend);
+    ena_crypto_init();
+    ena_storage_erase_all();
+
+    uint32_t enin = ena_crypto_enin(TEST_START);
+    ena_temporary_exposure_key_t key, other;
+    test_exposure_check_key(1, enin, ENA_TEK_ROLLING_PERIOD, &key);
+    test_exposure_check_key(2, enin, ENA_TEK_ROLLING_PERIOD, &other);
+
+    ena_beacon_t noise = {.timestamp_first = TEST_START, .timestamp_last = TEST_START + 60};
+    for (int i = 0; i < 100; i++)
+    {
+        esp_fill_random(noise.rpi, ENA_KEY_LENGTH);
+        ena_storage_add_beacon(&noise);
+        noise.timestamp_first += 5;
+        noise.timestamp_last += 5;
+    }
+    // RPI of interval 10 seen one interval late (clock skew), RPI of interval 20 of the other key seen 3 intervals late
+    test_exposure_check_beacon(&key, enin + 10, (enin + 11) * ENA_TIME_WINDOW + 30);
+    test_exposure_check_beacon(&other, enin + 20, (enin + 23) * ENA_TIME_WINDOW + 30);
+    ena_storage_flush();
+
+    ENA_HOST_CHECK(test_exposure_check(&key) == 1);
+    ENA_HOST_CHECK(test_exposure_check(&other) == 0);
+
+    // rolling period above TEKRollingPeriod is clamped, RPIs of the period still match
+    key.rolling_period = 0xFFFFFFFF;
+    ENA_HOST_CHECK(test_exposure_check(&key) == 1);
+    key.rolling_period = 11;
+    ENA_HOST_CHECK(test_exposure_check(&key) == 1);
+    key.rolling_period = 10;
+    ENA_HOST_CHECK(test_exposure_check(&key) == 0);
+
+    // invalid intervals are skipped
+    key.rolling_period = 0;
+    ENA_HOST_CHECK(test_exposure_check(&key) == 0);
+    test_exposure_check_key(1, 0, ENA_TEK_ROLLING_PERIOD, &key);
+    ENA_HOST_CHECK(test_exposure_check(&key) == 0);
+    test_exposure_check_key(1, 0xFFFFFFF0, ENA_TEK_ROLLING_PERIOD, &key);
+    ENA_HOST_CHECK(test_exposure_check(&key) == 0);
+
+    // a key sent again later in the batch merges into the record of its key-day, also after more key-days matched
+    ena_temporary_exposure_key_t keys[2 * TEST_KEY_DAYS];
+    for (int i = 0; i < TEST_KEY_DAYS; i++)
+    {
+        test_exposure_check_key(10 + i, enin, ENA_TEK_ROLLING_PERIOD, &keys[i]);
+        test_exposure_check_beacon(&keys[i], enin + 30 + i, (enin + 30 + i) * ENA_TIME_WINDOW + 30);
+        keys[TEST_KEY_DAYS + i] = keys[i];
+    }
+    ena_storage_flush();
+    ena_storage_erase_exposure_information();
+    ena_exposure_check_temporary_exposure_keys(keys, 2 * TEST_KEY_DAYS);
+    ENA_HOST_CHECK(ena_storage_exposure_information_count() == TEST_KEY_DAYS);
+    ena_exposure_information_t exposure_info;
+    for (int i = 0; i < TEST_KEY_DAYS; i++)
+    {
+        ena_storage_get_exposure_information(i, &exposure_info);
+        ENA_HOST_CHECK(exposure_info.duration_minutes == 2 * 10);
+    }
+
+    return ena_host_result();
+}
\ No newline at end of file
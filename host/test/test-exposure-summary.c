@@ -0,0 +1,142 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * latency of the exposure summary with 500 and 50,000 exposure information: a rebuild reads every record, after
+ * a boot with the persisted summary and after an appended record only a few reads are needed, and all give the
+ * summary of the rebuild
+ */
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "esp_log.h"
+
+#include "ena-host.h"
+#include "ena-storage.h"
+#include "ena-storage-backend.h"
+#include "ena-exposure.h"
+
+#define TEST_NOW (1600041600 + 20 * 86400)
+#define TEST_MAX_READS (8) // reads of a summary without rebuild
+
+typedef struct
+{
+    ena_exposure_summary_t summary; // summary of the last run
+    uint32_t reads;                 // backend reads of the last run
+    double seconds;                 // duration of the last run
+} test_exposure_summary_run_t;
+
+static test_exposure_summary_run_t *run = NULL; // shared with booted processes
+
+void test_exposure_summary_info(uint32_t i, ena_exposure_information_t *exposure_info)
+{
+    memset(exposure_info, 0, sizeof(ena_exposure_information_t));
+    exposure_info->day = TEST_NOW - TEST_NOW % 86400 - (i % 20) * 86400;
+    exposure_info->typical_attenuation = 20 + i % 60;
+    exposure_info->min_attenuation = exposure_info->typical_attenuation - 5;
+    exposure_info->duration_minutes = 5 + i % 40;
+    exposure_info->report_type = 1 + i % 5;
+}
+
+void test_exposure_summary_fill(void *context)
+{
+    ena_storage_erase_all();
+    ena_exposure_information_t exposure_info;
+    for (uint32_t i = 0; i < *(uint32_t *)context; i++)
+    {
+        test_exposure_summary_info(i, &exposure_info);
+        ena_storage_add_exposure_information(&exposure_info);
+    }
+    ena_storage_flush();
+}
+
+void test_exposure_summary_measure(void)
+{
+    ena_storage_backend_stats_t before, after;
+    ena_storage_backend_get_stats(&before);
+    double start = ena_host_seconds();
+    ena_exposure_summary(ena_exposure_default_config());
+    run->seconds = ena_host_seconds() - start;
+    ena_storage_backend_get_stats(&after);
+    run->reads = after.reads - before.reads;
+    memcpy(&run->summary, ena_exposure_current_summary(), sizeof(ena_exposure_summary_t));
+}
+
+void test_exposure_summary_rebuild(void *context)
+{
+    // invalid persisted summary, every record is read
+    uint32_t invalid = 0;
+    ena_storage_write_exposure_summary(&invalid, sizeof(uint32_t));
+    test_exposure_summary_measure();
+}
+
+void test_exposure_summary_boot(void *context)
+{
+    test_exposure_summary_measure();
+}
+
+void test_exposure_summary_append(void *context)
+{
+    // summary loaded before, one record stored by the check
+    ena_exposure_summary(ena_exposure_default_config());
+    ena_exposure_information_t exposure_info;
+    test_exposure_summary_info(*(uint32_t *)context, &exposure_info);
+    ena_storage_add_exposure_information(&exposure_info);
+    test_exposure_summary_measure();
+}
+
+bool test_exposure_summary_equal(ena_exposure_summary_t *a, ena_exposure_summary_t *b)
+{
+    return a->days_since_last_exposure == b->days_since_last_exposure && a->num_exposures == b->num_exposures &&
+           a->max_risk_score == b->max_risk_score && a->risk_score_sum == b->risk_score_sum;
+}
+
+int main(void)
+{
+    ena_storage_backend_t backend;
+    ESP_ERROR_CHECK(ena_host_flash_init(&backend, ENA_HOST_FLASH_SIZE));
+    ena_storage_backend_set(&backend);
+    ena_host_clock_set(TEST_NOW);
+    esp_log_level_set("*", ESP_LOG_WARN);
+    run = mmap(NULL, sizeof(test_exposure_summary_run_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    // all records and the appended one fit in the ring
+    uint32_t counts[] = {500, 50000};
+    printf("records  rebuild reads      ms  boot reads      ms  append reads      ms\n");
+    for (int i = 0; i < sizeof(counts) / sizeof(counts[0]); i++)
+    {
+        ENA_HOST_CHECK(ena_host_boot(&test_exposure_summary_fill, &counts[i]) == 0);
+        ENA_HOST_CHECK(ena_host_boot(&test_exposure_summary_rebuild, NULL) == 0);
+        test_exposure_summary_run_t rebuild = *run;
+        ENA_HOST_CHECK(rebuild.summary.num_exposures == counts[i]);
+        ENA_HOST_CHECK(rebuild.reads >= counts[i]);
+
+        ENA_HOST_CHECK(ena_host_boot(&test_exposure_summary_boot, NULL) == 0);
+        test_exposure_summary_run_t boot = *run;
+        ENA_HOST_CHECK(test_exposure_summary_equal(&boot.summary, &rebuild.summary));
+        ENA_HOST_CHECK(boot.reads <= TEST_MAX_READS);
+
+        ENA_HOST_CHECK(ena_host_boot(&test_exposure_summary_append, &counts[i]) == 0);
+        test_exposure_summary_run_t append = *run;
+        ENA_HOST_CHECK(append.reads <= TEST_MAX_READS);
+        ENA_HOST_CHECK(ena_host_boot(&test_exposure_summary_rebuild, NULL) == 0);
+        ENA_HOST_CHECK(test_exposure_summary_equal(&append.summary, &run->summary));
+        ENA_HOST_CHECK(append.summary.num_exposures == counts[i] + 1);
+
+        printf("%7u  %13u  %6.2f  %10u  %6.2f  %12u  %6.2f\n", counts[i], rebuild.reads, rebuild.seconds * 1000,
+               boot.reads, boot.seconds * 1000, append.reads, append.seconds * 1000);
+    }
+
+    return ena_host_result();
+}
\ No newline at end of file
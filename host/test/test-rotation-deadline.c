@@ -0,0 +1,186 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * rotation deadlines while a 14-day backlog syncs: the main loop rotates the RPI at its deadlines, adds scanned
+ * beacons and expires old ones with the TEK rollover, while the sync task downloads and matches pages from a
+ * stand-in server with latency. No deadline is missed by more than a second, and beacons expired while the
+ * check held them are gone after the sync.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_system.h"
+
+#include "ena-host.h"
+#include "ena-crypto.h"
+#include "ena-storage.h"
+#include "ena-storage-backend.h"
+#include "ena-eke-proxy.h"
+
+#define TEST_DAY (86400)
+#define TEST_NOW (1600041600 + 15 * TEST_DAY + 1800) // half an hour into the day, nothing hourly to sync
+#define TEST_BEACONS (20000)                          // beacons of the 14 days before
+#define TEST_PAGES (2)                                // full pages of keys per day
+#define TEST_LATENCY_US (5000)                        // latency of a request and of a read of the stand-in server
+#define TEST_ROTATION_MS (100)                        // deadlines of the main loop, scaled from minutes
+#define TEST_ROLLOVER (10)                            // rotations per TEK rollover, which expires beacons
+#define TEST_LOOP_MS (10)                             // delay of the main loop
+#define TEST_MAX_LATE_MS (1000)
+
+int test_rotation_deadline_open(const char *url, int *length)
+{
+    usleep(TEST_LATENCY_US);
+    if (strstr(url, "/hour/") != NULL || atoi(strstr(url, "page=") + 5) >= TEST_PAGES)
+    {
+        return 204;
+    }
+    *length = ENA_EKE_PROXY_DEFAULT_LIMIT * ENA_EKE_PROXY_KEY_SIZE;
+    return 200;
+}
+
+int test_rotation_deadline_read(const char *url, size_t offset, uint8_t *data, size_t length)
+{
+    usleep(TEST_LATENCY_US);
+    size_t end = ENA_EKE_PROXY_DEFAULT_LIMIT * ENA_EKE_PROXY_KEY_SIZE;
+    if (offset + length > end)
+    {
+        length = end - offset;
+    }
+    // keys of one of the past days, none seen
+    uint32_t rolling_start = ena_crypto_enin(TEST_NOW - TEST_NOW % TEST_DAY - 14 * TEST_DAY) + (offset % 14) * ENA_TEK_ROLLING_PERIOD;
+    uint32_t rolling_period = ENA_TEK_ROLLING_PERIOD;
+    for (size_t i = 0; i < length; i++)
+    {
+        size_t position = (offset + i) % ENA_EKE_PROXY_KEY_SIZE;
+        if (position < ENA_KEY_LENGTH)
+        {
+            data[i] = (uint8_t)esp_random();
+        }
+        else if (position < ENA_KEY_LENGTH + 4)
+        {
+            data[i] = ((uint8_t *)&rolling_start)[position - ENA_KEY_LENGTH];
+        }
+        else if (position < ENA_KEY_LENGTH + 8)
+        {
+            data[i] = ((uint8_t *)&rolling_period)[position - ENA_KEY_LENGTH - 4];
+        }
+        else
+        {
+            data[i] = 0;
+        }
+    }
+    return length;
+}
+
+void test_rotation_deadline_fill(void)
+{
+    ena_storage_erase_all();
+    ena_beacon_t beacon = {.rssi = -80};
+    uint32_t start = TEST_NOW - 14 * TEST_DAY;
+    for (uint32_t i = 0; i < TEST_BEACONS; i++)
+    {
+        esp_fill_random(beacon.rpi, ENA_KEY_LENGTH);
+        esp_fill_random(beacon.aem, ENA_AEM_METADATA_LENGTH);
+        beacon.timestamp_first = start + (uint64_t)i * 14 * TEST_DAY / TEST_BEACONS;
+        beacon.timestamp_last = beacon.timestamp_first + 300;
+        ena_storage_add_beacon(&beacon);
+    }
+    ena_storage_write_last_exposure_date(TEST_NOW - 14 * TEST_DAY);
+    ena_storage_flush();
+}
+
+void test_rotation_deadline_device(void *context)
+{
+    ena_host_http_server_t server = {
+        .open = &test_rotation_deadline_open,
+        .read = &test_rotation_deadline_read,
+        .segment_size = 1024,
+    };
+    esp_log_level_set("*", ESP_LOG_WARN);
+    ena_host_http_set_server(&server);
+    ena_host_clock_set(TEST_NOW);
+    ena_crypto_init();
+    test_rotation_deadline_fill();
+
+    ena_eke_proxy_start();
+    double start = ena_host_seconds();
+    double deadline = start + TEST_ROTATION_MS / 1000.0;
+    double late_max = 0;
+    uint32_t rotations = 0;
+    uint32_t expired_until = 0;
+    uint32_t scanned = 0;
+    ena_tek_t tek = {.enin = ena_crypto_enin(TEST_NOW), .rolling_period = ENA_TEK_ROLLING_PERIOD};
+    ena_beacon_t beacon = {.rssi = -70};
+    // keep the loop running until the backlog is synced
+    while (ena_storage_read_last_exposure_date() < TEST_NOW - TEST_NOW % TEST_DAY || ena_eke_proxy_get_state() != ENA_EKE_PROXY_STATE_IDLE)
+    {
+        double now = ena_host_seconds();
+        if (now >= deadline)
+        {
+            // RPI rotation, late by the time the loop was blocked
+            if (now - deadline > late_max)
+            {
+                late_max = now - deadline;
+            }
+            deadline += TEST_ROTATION_MS / 1000.0;
+            rotations++;
+            if (rotations % TEST_ROLLOVER == 0)
+            {
+                // TEK rollover, beacons of the oldest hour expire
+                esp_fill_random(tek.key_data, ENA_KEY_LENGTH);
+                ena_storage_write_tek(&tek);
+                expired_until = TEST_NOW - 14 * TEST_DAY + (rotations / TEST_ROLLOVER) * 3600;
+                ena_storage_expire_beacons(expired_until);
+                ena_storage_flush();
+            }
+        }
+
+        // beacon of the scan task
+        esp_fill_random(beacon.rpi, ENA_KEY_LENGTH);
+        beacon.timestamp_first = TEST_NOW + scanned++;
+        beacon.timestamp_last = beacon.timestamp_first + 60;
+        ena_storage_add_beacon(&beacon);
+        vTaskDelay(TEST_LOOP_MS / portTICK_PERIOD_MS);
+    }
+    double seconds = ena_host_seconds() - start;
+
+    ena_eke_proxy_stats_t stats;
+    ena_eke_proxy_get_stats(&stats);
+    ENA_HOST_CHECK(stats.keys == 14 * TEST_PAGES * ENA_EKE_PROXY_DEFAULT_LIMIT);
+    ENA_HOST_CHECK(rotations > TEST_ROLLOVER);
+    ENA_HOST_CHECK(late_max * 1000 <= TEST_MAX_LATE_MS);
+
+    // expiries postponed while the check held the beacons ran on release
+    ena_beacon_t oldest;
+    ena_storage_get_beacon(0, &oldest);
+    ENA_HOST_CHECK(oldest.timestamp_last > expired_until);
+    printf("%u keys of 14 days synced in %.2f s: %u rotations, latest %.1f ms after its deadline, %u beacons scanned\n",
+           stats.keys, seconds, rotations, late_max * 1000, scanned);
+}
+
+int main(void)
+{
+    ena_storage_backend_t backend;
+    ESP_ERROR_CHECK(ena_host_flash_init(&backend, ENA_HOST_FLASH_SIZE));
+    ena_storage_backend_set(&backend);
+
+    ENA_HOST_CHECK(ena_host_boot(&test_rotation_deadline_device, NULL) == 0);
+
+    return ena_host_result();
+}
\ No newline at end of file
@@ -0,0 +1,102 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * scan queue replay: 10,000 advertisements per second from the Bluetooth task, with a refresh of temporary beacons
+ * every second, are handed to the scan task without blocking the callback
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_log.h"
+
+#include "ena-host.h"
+#include "ena-storage.h"
+#include "ena-beacons.h"
+#include "ena-bluetooth-scan.h"
+
+#define TEST_START (1600000000)
+#define TEST_RATE (10000)  // advertisements per second
+#define TEST_SECONDS (3)
+#define TEST_DEVICES (500) // distinct RPIs, every device advertises TEST_RATE / TEST_DEVICES times per second
+#define TEST_BURST (100)   // advertisements delivered at once, every TEST_BURST / TEST_RATE seconds
+
+void test_scan_queue_replay(void *context)
+{
+    ena_storage_erase_all();
+    ena_bluetooth_scan_init();
+    esp_log_level_set("*", ESP_LOG_WARN);
+
+    uint8_t rpi[ENA_KEY_LENGTH], aem[ENA_AEM_METADATA_LENGTH];
+    memset(rpi, 0, sizeof(rpi));
+    memset(aem, 0, sizeof(aem));
+    double callback_max = 0;
+    double callback_total = 0;
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (uint32_t i = 0; i < TEST_RATE * TEST_SECONDS; i++)
+    {
+        if (i % TEST_BURST == 0)
+        {
+            // pace bursts at the replayed rate
+            next.tv_nsec += 1000000000L / TEST_RATE * TEST_BURST;
+            if (next.tv_nsec >= 1000000000L)
+            {
+                next.tv_sec++;
+                next.tv_nsec -= 1000000000L;
+            }
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        }
+        if (i % TEST_RATE == 0)
+        {
+            // end of a scan, the refresh writes a snapshot of temporary beacons on the scan task
+            ena_host_clock_set(TEST_START + i / TEST_RATE * ENA_SCANNING_INTERVAL);
+            ena_host_ble_scan_complete();
+        }
+        uint32_t device = i % TEST_DEVICES;
+        memcpy(rpi, &device, sizeof(device));
+        aem[0] = device & 0xFF;
+        double start = ena_host_seconds();
+        ena_host_ble_scan_result(rpi, aem, -60);
+        double callback = ena_host_seconds() - start;
+        callback_total += callback;
+        if (callback > callback_max)
+        {
+            callback_max = callback;
+        }
+    }
+    ena_bluetooth_scan_snapshot();
+
+    ena_bluetooth_scan_stats_t stats;
+    ena_bluetooth_scan_get_stats(&stats);
+    printf("%u advertisements at %u/s: %u enqueued, %u dropped, %u processed\n", TEST_RATE * TEST_SECONDS, TEST_RATE, stats.enqueued,
+           stats.dropped, stats.processed);
+    printf("callback: %.2f us average, %.1f us max\n", callback_total * 1e6 / (TEST_RATE * TEST_SECONDS), callback_max * 1e6);
+    ENA_HOST_CHECK(stats.enqueued + stats.dropped == TEST_RATE * TEST_SECONDS);
+    ENA_HOST_CHECK(stats.processed == stats.enqueued);
+    // the queue holds ENA_SCAN_QUEUE_SIZE entries, a loaded host may delay the scan task for a moment
+    ENA_HOST_CHECK(stats.dropped * 100 <= TEST_RATE * TEST_SECONDS);
+    ENA_HOST_CHECK(ena_storage_temp_beacons_count() == TEST_DEVICES);
+}
+
+int main(void)
+{
+    ena_storage_backend_t backend;
+    ESP_ERROR_CHECK(ena_host_flash_init(&backend, ENA_HOST_FLASH_SIZE));
+    ena_storage_backend_set(&backend);
+    ena_host_clock_set(TEST_START);
+
+    ENA_HOST_CHECK(ena_host_boot(&test_scan_queue_replay, NULL) == 0);
+    return ena_host_result();
+}
\ No newline at end of file
@@ -0,0 +1,238 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * snapshot of temporary beacons on shutdown: written by the scan task while advertisements keep arriving,
+ * it contains every advertisement received before the request and is restored on the next boot. With the counter
+ * journal a snapshot cut off at any flash operation is restored with every beacon at most once. Refreshes at the end
+ * of scans write a snapshot every scan, also when a scan ends a little early.
+ */
+#include <stdio.h>
+#include <pthread.h>
+#include <string.h>
+
+#include "ena-host.h"
+#include "ena-storage.h"
+#include "ena-beacons.h"
+#include "ena-bluetooth-scan.h"
+
+#define TEST_START (1600000000)
+#define TEST_BEFORE (200) // advertisements before the snapshot, fit into the scan queue
+#define TEST_DURING (600) // advertisements while the snapshot is written
+#define TEST_TORN (300)   // temporary beacons of the snapshot before the cut one
+
+void test_scan_snapshot_beacon(uint32_t i, uint8_t *rpi, uint8_t *aem)
+{
+    memset(rpi, 0, ENA_KEY_LENGTH);
+    uint32_t hash = i * 2654435761u;
+    memcpy(rpi, &hash, sizeof(hash));
+    memcpy(&rpi[4], &i, sizeof(i));
+    memset(aem, i & 0xFF, ENA_AEM_METADATA_LENGTH);
+}
+
+void *test_scan_snapshot_bluetooth(void *context)
+{
+    uint8_t rpi[ENA_KEY_LENGTH], aem[ENA_AEM_METADATA_LENGTH];
+    for (uint32_t i = TEST_BEFORE; i < TEST_BEFORE + TEST_DURING; i++)
+    {
+        test_scan_snapshot_beacon(i, rpi, aem);
+        ena_host_ble_scan_result(rpi, aem, -70);
+    }
+    return NULL;
+}
+
+// stored temporary beacons are complete advertisements, the first ones all present
+void test_scan_snapshot_check(uint32_t min, uint32_t max)
+{
+    static ena_beacon_t beacons[ENA_STORAGE_TEMP_BEACONS_MAX];
+    uint32_t count = ena_storage_read_temp_beacons(beacons, ENA_STORAGE_TEMP_BEACONS_MAX);
+    ENA_HOST_CHECK(count >= min && count <= max);
+    uint8_t rpi[ENA_KEY_LENGTH], aem[ENA_AEM_METADATA_LENGTH];
+    uint32_t invalid = 0;
+    uint32_t before = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t number;
+        memcpy(&number, &beacons[i].rpi[4], sizeof(number));
+        test_scan_snapshot_beacon(number, rpi, aem);
+        if (number >= TEST_BEFORE + TEST_DURING || memcmp(beacons[i].rpi, rpi, ENA_KEY_LENGTH) != 0 ||
+            memcmp(beacons[i].aem, aem, ENA_AEM_METADATA_LENGTH) != 0 || beacons[i].timestamp_first != TEST_START)
+        {
+            invalid++;
+        }
+        else if (number < TEST_BEFORE)
+        {
+            before++;
+        }
+    }
+    ENA_HOST_CHECK(invalid == 0);
+    ENA_HOST_CHECK(before == TEST_BEFORE);
+}
+
+void test_scan_snapshot_stop(void *context)
+{
+    ena_storage_erase_all();
+    ena_bluetooth_scan_init();
+
+    uint8_t rpi[ENA_KEY_LENGTH], aem[ENA_AEM_METADATA_LENGTH];
+    for (uint32_t i = 0; i < TEST_BEFORE; i++)
+    {
+        test_scan_snapshot_beacon(i, rpi, aem);
+        ena_host_ble_scan_result(rpi, aem, -60);
+    }
+
+    pthread_t bluetooth;
+    pthread_create(&bluetooth, NULL, &test_scan_snapshot_bluetooth, NULL);
+    ena_bluetooth_scan_snapshot();
+    test_scan_snapshot_check(TEST_BEFORE, TEST_BEFORE + TEST_DURING);
+    pthread_join(bluetooth, NULL);
+
+    ena_bluetooth_scan_stats_t stats;
+    ena_bluetooth_scan_get_stats(&stats);
+    ENA_HOST_CHECK(stats.enqueued + stats.dropped == TEST_BEFORE + TEST_DURING);
+}
+
+void test_scan_snapshot_restore(void *context)
+{
+    uint32_t count = ena_storage_temp_beacons_count();
+    test_scan_snapshot_check(TEST_BEFORE, TEST_BEFORE + TEST_DURING);
+    ena_bluetooth_scan_init();
+    // restored beacons are known, a repeated advertisement only updates its temporary beacon
+    uint8_t rpi[ENA_KEY_LENGTH], aem[ENA_AEM_METADATA_LENGTH];
+    test_scan_snapshot_beacon(0, rpi, aem);
+    ena_host_ble_scan_result(rpi, aem, -60);
+    ena_bluetooth_scan_snapshot();
+    ENA_HOST_CHECK(ena_storage_temp_beacons_count() == count);
+}
+
+void test_scan_snapshot_torn_beacon(uint32_t i, uint32_t seen, ena_beacon_t *beacon)
+{
+    test_scan_snapshot_beacon(i, beacon->rpi, beacon->aem);
+    beacon->timestamp_first = TEST_START;
+    beacon->timestamp_last = seen;
+    beacon->rssi = -70;
+}
+
+void test_scan_snapshot_torn_fill(void *context)
+{
+    static ena_beacon_t beacons[TEST_TORN];
+    ena_storage_erase_all();
+    for (uint32_t i = 0; i < TEST_TORN; i++)
+    {
+        test_scan_snapshot_torn_beacon(i, TEST_START, &beacons[i]);
+    }
+    ena_storage_write_temp_beacons(beacons, TEST_TORN);
+    ena_storage_flush();
+}
+
+void test_scan_snapshot_torn_cut(void *context)
+{
+    // the later half seen again and moved to the front, as after the first half was removed
+    static ena_beacon_t beacons[TEST_TORN / 2];
+    for (uint32_t i = 0; i < TEST_TORN / 2; i++)
+    {
+        test_scan_snapshot_torn_beacon(TEST_TORN / 2 + i, TEST_START + 60, &beacons[i]);
+    }
+    ena_host_flash_power_cut(*(uint32_t *)context);
+    ena_storage_write_temp_beacons(beacons, TEST_TORN / 2);
+    ena_storage_flush();
+}
+
+void test_scan_snapshot_torn_restore(void *context)
+{
+    static ena_beacon_t beacons[ENA_STORAGE_TEMP_BEACONS_MAX];
+    bool restored[TEST_TORN] = {false};
+    ena_beacons_temp_restore();
+    ena_beacons_temp_snapshot();
+    uint32_t count = ena_storage_read_temp_beacons(beacons, ENA_STORAGE_TEMP_BEACONS_MAX);
+    // beacons of the first half may be replaced, beacons of the later half are kept once, unless the journal
+    // dropped the cut snapshot
+    ENA_HOST_CHECK(count <= TEST_TORN && (count >= TEST_TORN / 2 || (ENA_STORAGE_COUNTER_JOURNAL && count == 0)));
+    uint32_t invalid = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t number;
+        memcpy(&number, &beacons[i].rpi[4], sizeof(number));
+        if (number >= TEST_TORN || restored[number] || (number >= TEST_TORN / 2 && count == TEST_TORN / 2 && beacons[i].timestamp_last != TEST_START + 60))
+        {
+            invalid++;
+            continue;
+        }
+        restored[number] = true;
+    }
+    for (uint32_t number = TEST_TORN / 2; number < TEST_TORN; number++)
+    {
+        invalid += count > 0 && !restored[number];
+    }
+    ENA_HOST_CHECK(invalid == 0);
+
+    // every restored beacon is found again and expires
+    ena_beacons_temp_refresh(TEST_START + 3 * ENA_TIME_WINDOW);
+    ENA_HOST_CHECK(ena_storage_temp_beacons_count() == 0);
+}
+
+void test_scan_snapshot_interval(void *context)
+{
+    static ena_beacon_t beacons[ENA_STORAGE_TEMP_BEACONS_MAX];
+    uint8_t rpi[ENA_KEY_LENGTH];
+    uint8_t aem[ENA_AEM_METADATA_LENGTH];
+    ena_storage_erase_all();
+    ena_beacons_temp_restore();
+    uint32_t skipped = 0;
+    for (uint32_t scan = 0; scan < 8; scan++)
+    {
+        // every other scan ends a second early
+        uint32_t timestamp = TEST_START + scan * ENA_SCANNING_INTERVAL - scan % 2;
+        test_scan_snapshot_beacon(scan, rpi, aem);
+        ena_beacon(timestamp, rpi, aem, -60);
+        ena_beacons_temp_refresh(timestamp);
+        bool stored = false;
+        uint32_t count = ena_storage_read_temp_beacons(beacons, ENA_STORAGE_TEMP_BEACONS_MAX);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            stored = stored || memcmp(beacons[i].rpi, rpi, ENA_KEY_LENGTH) == 0;
+        }
+        skipped += !stored;
+    }
+    ENA_HOST_CHECK(skipped == 0);
+}
+
+int main(void)
+{
+    ena_storage_backend_t backend;
+    ESP_ERROR_CHECK(ena_host_flash_init(&backend, ENA_HOST_FLASH_SIZE));
+    ena_storage_backend_set(&backend);
+    ena_host_clock_set(TEST_START);
+
+    ENA_HOST_CHECK(ena_host_boot(&test_scan_snapshot_stop, NULL) == 0);
+    ENA_HOST_CHECK(ena_host_boot(&test_scan_snapshot_restore, NULL) == 0);
+    ENA_HOST_CHECK(ena_host_boot(&test_scan_snapshot_interval, NULL) == 0);
+
+    // without the journal a cut rewrite loses its block, so only the complete snapshot is checked
+    uint32_t cuts = 0;
+    for (uint32_t operation = ENA_STORAGE_COUNTER_JOURNAL ? 1 : 0;; operation++)
+    {
+        ENA_HOST_CHECK(ena_host_boot(&test_scan_snapshot_torn_fill, NULL) == 0);
+        int status = ena_host_boot(&test_scan_snapshot_torn_cut, &operation);
+        ENA_HOST_CHECK(ena_host_boot(&test_scan_snapshot_torn_restore, NULL) == 0);
+        if (status != ENA_HOST_POWER_CUT_EXIT)
+        {
+            ENA_HOST_CHECK(status == 0);
+            break;
+        }
+        cuts++;
+    }
+    printf("snapshot cut at %u flash operations\n", cuts);
+    ENA_HOST_CHECK(cuts > 0 || !ENA_STORAGE_COUNTER_JOURNAL);
+    return ena_host_result();
+}
\ No newline at end of file
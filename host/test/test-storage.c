@@ -0,0 +1,118 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * storage round trip of TEKs, beacons and exposure information across a reboot
+ */
+#include <string.h>
+
+#include "ena-host.h"
+#include "ena-storage.h"
+#include "ena-storage-backend.h"
+
+#define TEST_BEACONS (1000)
+
+void test_storage_beacon(uint32_t i, ena_beacon_t *beacon)
+{
+    memset(beacon, 0, sizeof(ena_beacon_t));
+    memcpy(beacon->rpi, &i, sizeof(i));
+    beacon->rpi[15] = 0xA5;
+    beacon->timestamp_first = 1600000000 + i * 60;
+    beacon->timestamp_last = beacon->timestamp_first + 300;
+    beacon->rssi = -60 - (int)(i % 30);
+}
+
+void test_storage_write(void *context)
+{
+    ena_storage_erase_all();
+
+    ena_tek_t tek = {.enin = 2666640, .rolling_period = 144};
+    memset(tek.key_data, 0x42, sizeof(tek.key_data));
+    ena_storage_write_tek(&tek);
+
+    ena_beacon_t beacon;
+    for (uint32_t i = 0; i < TEST_BEACONS; i++)
+    {
+        test_storage_beacon(i, &beacon);
+        ena_storage_add_beacon(&beacon);
+    }
+
+    ena_exposure_information_t info = {.day = 1600041600, .duration_minutes = 15, .min_attenuation = 40};
+    ena_storage_add_exposure_information(&info);
+    ena_storage_flush();
+}
+
+void test_storage_read(void *context)
+{
+    ENA_HOST_CHECK(ena_storage_tek_count() == 1);
+    ena_tek_t tek;
+    ena_storage_read_last_tek(&tek);
+    ENA_HOST_CHECK(tek.enin == 2666640 && tek.rolling_period == 144 && tek.key_data[0] == 0x42);
+
+    ENA_HOST_CHECK(ena_storage_beacons_count() == TEST_BEACONS);
+    ena_beacon_t expected, beacon;
+    for (uint32_t i = 0; i < TEST_BEACONS; i += 97)
+    {
+        test_storage_beacon(i, &expected);
+        ena_storage_get_beacon(i, &beacon);
+        ENA_HOST_CHECK(memcmp(&expected, &beacon, sizeof(ena_beacon_t)) == 0);
+    }
+
+    ENA_HOST_CHECK(ena_storage_exposure_information_count() == 1);
+    ena_exposure_information_t info;
+    ena_storage_get_exposure_information(0, &info);
+    ENA_HOST_CHECK(info.day == 1600041600 && info.duration_minutes == 15);
+}
+
+void test_storage_shift_delete(void *context)
+{
+    // every removed temporary beacon, some of them across a block boundary, shifts all following ones
+    uint32_t count = 300;
+    ena_beacon_t beacon, expected;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        test_storage_beacon(i, &beacon);
+        ena_storage_add_temp_beacon(&beacon);
+    }
+    uint32_t removed = 0;
+    for (int index = 250; index >= 10; index -= 20)
+    {
+        ena_storage_remove_temp_beacon(index);
+        removed++;
+    }
+    ENA_HOST_CHECK(ena_storage_temp_beacons_count() == count - removed);
+    uint32_t errors = 0;
+    for (uint32_t index = 0, i = 0; index < count - removed; index++, i++)
+    {
+        if (i >= 10 && i <= 250 && (i - 10) % 20 == 0)
+        {
+            i++;
+        }
+        test_storage_beacon(i, &expected);
+        ena_storage_get_temp_beacon(index, &beacon);
+        errors += memcmp(&expected, &beacon, sizeof(ena_beacon_t)) != 0;
+    }
+    ENA_HOST_CHECK(errors == 0);
+}
+
+int main(void)
+{
+    ena_storage_backend_t backend;
+    ESP_ERROR_CHECK(ena_host_flash_init(&backend, ENA_HOST_FLASH_SIZE));
+    ena_storage_backend_set(&backend);
+
+    ENA_HOST_CHECK(ena_host_boot(&test_storage_write, NULL) == 0);
+    ENA_HOST_CHECK(ena_host_boot(&test_storage_read, NULL) == 0);
+    ENA_HOST_CHECK(ena_host_boot(&test_storage_shift_delete, NULL) == 0);
+    return ena_host_result();
+}
\ No newline at end of file
@@ -0,0 +1,174 @@
+// Copyright 2020 Lukas Haubaum
+//
+// Licensed under the GNU Affero General Public License, Version 3;
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     https://www.gnu.org/licenses/agpl-3.0.html
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+/**
+ * write-back block cache: writes to a block cost one erase on flush and are read back before, writes not
+ * flushed are lost on reboot, the least recently used block is written when a further block is changed, a shift
+ * delete across cached blocks matches the same delete on a copy, and the count of cached records is written with
+ * them on flush, also with the counter journal
+ */
+#include <string.h>
+#include <sys/mman.h>
+
+#include "ena-host.h"
+#include "ena-storage.h"
+#include "ena-storage-backend.h"
+
+#define TEST_BLOCK (ENA_STORAGE_BACKEND_BLOCK_SIZE)
+#define TEST_ADDRESS (100 * TEST_BLOCK) // first of the written blocks, inside the beacon area
+#define TEST_BLOCKS (ENA_STORAGE_WRITE_CACHE_BLOCKS + 1)
+#define TEST_WRITES (64)                // small writes to one block
+#define TEST_ERASES (ENA_STORAGE_COUNTER_JOURNAL ? 2 : 1) // erases of a written block, the journal keeps a copy
+
+static uint8_t *expected = NULL; // content of the written blocks, shared with booted processes
+
+void test_write_cache_fill(uint8_t *data, size_t size, uint8_t seed)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        data[i] = (uint8_t)(i * 31 + seed);
+    }
+}
+
+void test_write_cache_check(void)
+{
+    static uint8_t data[TEST_BLOCKS * TEST_BLOCK];
+    ena_storage_read(TEST_ADDRESS, data, sizeof(data));
+    ENA_HOST_CHECK(memcmp(data, expected, TEST_BLOCKS * TEST_BLOCK) == 0);
+}
+
+uint32_t test_write_cache_erases(void)
+{
+    ena_storage_backend_stats_t stats;
+    ena_storage_backend_get_stats(&stats);
+    return stats.erases;
+}
+
+void test_write_cache_erase(void *context)
+{
+    // written blocks are not erased, so changes go through the cache
+    ena_storage_erase_all();
+    test_write_cache_fill(expected, TEST_BLOCKS * TEST_BLOCK, 1);
+    ena_storage_write(TEST_ADDRESS, expected, TEST_BLOCKS * TEST_BLOCK);
+    // counted temporary beacon, also starts the counter journal
+    ena_beacon_t beacon = {.rssi = -60};
+    ena_storage_add_temp_beacon(&beacon);
+    ena_storage_flush();
+    test_write_cache_check();
+}
+
+void test_write_cache_batch(void *context)
+{
+    uint32_t erases = test_write_cache_erases();
+    uint8_t data[16];
+    for (uint32_t i = 0; i < TEST_WRITES; i++)
+    {
+        test_write_cache_fill(data, sizeof(data), 2 + i);
+        ena_storage_write(TEST_ADDRESS + i * 48, data, sizeof(data));
+        memcpy(&expected[i * 48], data, sizeof(data));
+    }
+    test_write_cache_check();
+    ENA_HOST_CHECK(test_write_cache_erases() == erases);
+    ena_storage_flush();
+    ENA_HOST_CHECK(test_write_cache_erases() == erases + TEST_ERASES);
+
+    // lost with the reboot
+    memset(data, 0, sizeof(data));
+    ena_storage_write(TEST_ADDRESS, data, sizeof(data));
+}
+
+void test_write_cache_evict(void *context)
+{
+    // flushed batch, not the write after it
+    test_write_cache_check();
+
+    uint32_t erases = test_write_cache_erases();
+    uint8_t data[16];
+    for (uint32_t block = 0; block < TEST_BLOCKS; block++)
+    {
+        test_write_cache_fill(data, sizeof(data), 100 + block);
+        ena_storage_write(TEST_ADDRESS + block * TEST_BLOCK + 8, data, sizeof(data));
+        if (block == 0)
+        {
+            memcpy(&expected[8], data, sizeof(data));
+        }
+    }
+    // first block written to make room for the last
+    ENA_HOST_CHECK(test_write_cache_erases() == erases + TEST_ERASES);
+}
+
+void test_write_cache_shift(void *context)
+{
+    // evicted block kept, the others lost with the reboot
+    test_write_cache_check();
+
+    // delete 100 bytes in the first block, everything up to the end of the second block moves
+    size_t address = TEST_ADDRESS + TEST_BLOCK - 2000;
+    size_t end = TEST_ADDRESS + 2 * TEST_BLOCK;
+    ena_storage_shift_delete(address, end, 100);
+    memmove(&expected[address - TEST_ADDRESS], &expected[address - TEST_ADDRESS + 100], end - address - 100);
+    test_write_cache_check();
+    ena_storage_flush();
+}
+
+void test_write_cache_counter(void *context)
+{
+    // rewritten record in the cache, the added one counted without erasing
+    uint32_t erases = test_write_cache_erases();
+    ena_beacon_t beacon = {.rssi = -70};
+    ena_storage_set_temp_beacon(0, &beacon);
+    ena_storage_add_temp_beacon(&beacon);
+    ENA_HOST_CHECK(ena_storage_temp_beacons_count() == 2);
+    ENA_HOST_CHECK(test_write_cache_erases() == erases);
+}
+
+void test_write_cache_counted(void *context)
+{
+    // neither the records nor their count written
+    ena_beacon_t beacon;
+    ena_storage_get_temp_beacon(0, &beacon);
+    ENA_HOST_CHECK(ena_storage_temp_beacons_count() == 1);
+    ENA_HOST_CHECK(beacon.rssi == -60);
+
+    beacon.rssi = -70;
+    ena_storage_set_temp_beacon(0, &beacon);
+    ena_storage_add_temp_beacon(&beacon);
+    ena_storage_flush();
+}
+
+void test_write_cache_flushed(void *context)
+{
+    test_write_cache_check();
+    ena_beacon_t beacon;
+    ena_storage_get_temp_beacon(1, &beacon);
+    ENA_HOST_CHECK(ena_storage_temp_beacons_count() == 2);
+    ENA_HOST_CHECK(beacon.rssi == -70);
+}
+
+int main(void)
+{
+    ena_storage_backend_t backend;
+    ESP_ERROR_CHECK(ena_host_flash_init(&backend, ENA_HOST_FLASH_SIZE));
+    ena_storage_backend_set(&backend);
+    expected = mmap(NULL, TEST_BLOCKS * TEST_BLOCK, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    ENA_HOST_CHECK(ena_host_boot(&test_write_cache_erase, NULL) == 0);
+    ENA_HOST_CHECK(ena_host_boot(&test_write_cache_batch, NULL) == 0);
+    ENA_HOST_CHECK(ena_host_boot(&test_write_cache_evict, NULL) == 0);
+    ENA_HOST_CHECK(ena_host_boot(&test_write_cache_shift, NULL) == 0);
+    ENA_HOST_CHECK(ena_host_boot(&test_write_cache_counter, NULL) == 0);
+    ENA_HOST_CHECK(ena_host_boot(&test_write_cache_counted, NULL) == 0);
+    ENA_HOST_CHECK(ena_host_boot(&test_write_cache_flushed, NULL) == 0);
+
+    return ena_host_result();
+}
\ No newline at end of file
@@ -107,10 +107,12 @@ void app_main(void)
 
     wifi_controller_reconnect(NULL);
 
+    // key sync blocks on network and matching, so it runs in its own task
+    ena_eke_proxy_start();
+
     while (1)
     {
         ena_run();
-        ena_eke_proxy_run();
         vTaskDelay(1000 / portTICK_PERIOD_MS);
     }
 }